@@ -0,0 +1,181 @@
+/*
+ * OurLoRa host emulator - minimal Arduino core shim
+ *
+ * Just enough of the ESP32 Arduino API for firmware/ourlora*.h (and
+ * the main tank's upload helpers) to build and run on Linux. Time is
+ * virtual (see emu_core.h): delay() advances the clock and lets due
+ * radio events / ISRs run.
+ */
+#ifndef OURLORA_EMU_ARDUINO_H
+#define OURLORA_EMU_ARDUINO_H
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "emu_core.h"
+
+#define IRAM_ATTR
+
+#define HIGH 1
+#define LOW 0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define RISING 1
+#define FALLING 2
+#define CHANGE 3
+
+#define DEC 10
+#define HEX 16
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#ifndef constrain
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#endif
+
+// ============================================================
+//  TIME
+// ============================================================
+
+inline unsigned long micros() {
+  emu::dispatch_due();
+  return (unsigned long)emu::now_us();
+}
+
+inline unsigned long millis() {
+  emu::dispatch_due();
+  return (unsigned long)(emu::now_us() / 1000);
+}
+
+inline void delayMicroseconds(unsigned int us) { emu::advance_us(us); }
+
+inline void delay(unsigned long ms) { emu::block_us((uint64_t)ms * 1000); }
+
+inline void yield() { emu::block_us(0); }
+
+// ============================================================
+//  GPIO + INTERRUPTS
+// ============================================================
+
+// Pins are int here (Arduino: uint8_t) so large emulated networks have enough
+inline void pinMode(int, uint8_t) {}
+
+inline void digitalWrite(int pin, uint8_t val) {
+  emu::Gpio &g = emu::gpio();
+  g.writes++;
+  g.level[pin] = val ? 1 : 0;
+  if (g.hooks.count(pin)) {
+    std::vector<emu::PinHook> &hooks = g.hooks[pin];
+    for (size_t i = 0; i < hooks.size(); i++) hooks[i].onWrite(val ? 1 : 0);
+  }
+}
+
+inline int digitalRead(int pin) {
+  emu::Gpio &g = emu::gpio();
+  return g.level.count(pin) ? g.level[pin] : 0;
+}
+
+inline int digitalPinToInterrupt(int pin) { return pin; }
+
+inline void attachInterrupt(int pin, void (*isr)(), int mode) {
+  emu::gpio().isr[pin] = isr;
+  emu::gpio().isrMode[pin] = mode;
+}
+
+inline void attachInterruptArg(int pin, void (*isr)(void *), void *arg, int mode) {
+  emu::gpio().isrArg[pin] = std::make_pair(isr, arg);
+  emu::gpio().isrMode[pin] = mode;
+}
+
+inline void detachInterrupt(int pin) {
+  emu::gpio().isr.erase(pin);
+  emu::gpio().isrArg.erase(pin);
+  emu::gpio().isrMode.erase(pin);
+}
+
+inline void noInterrupts() { emu::sched().interruptLock++; }
+
+inline void interrupts() {
+  if (emu::sched().interruptLock > 0) emu::sched().interruptLock--;
+  emu::run_pending_isrs();
+}
+
+// ============================================================
+//  RANDOM
+// ============================================================
+
+inline void randomSeed(unsigned long seed) { emu::seed(seed); }
+
+inline long random(long howbig) {
+  return howbig <= 0 ? 0 : (long)(emu::rand32() % (uint32_t)howbig);
+}
+
+inline long random(long howsmall, long howbig) {
+  return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall);
+}
+
+// ============================================================
+//  PRINT (byte sink base class of Serial, network clients, ...)
+// ============================================================
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size) {
+    size_t n = 0;
+    while (n < size && write(buffer[n])) n++;
+    return n;
+  }
+};
+
+// ============================================================
+//  SERIAL (prints to stdout unless muted)
+// ============================================================
+
+class HardwareSerial {
+ public:
+  bool muted = true;
+
+  void begin(unsigned long) {}
+
+  int printf(const char *fmt, ...) {
+    if (muted) return 0;
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vprintf(fmt, ap);
+    va_end(ap);
+    return n;
+  }
+
+  void print(const char *s) { printf("%s", s); }
+  void print(char c) { printf("%c", c); }
+  void print(long v, int base = DEC) { printf(base == HEX ? "%lX" : "%ld", v); }
+  void print(int v, int base = DEC) { print((long)v, base); }
+  void print(unsigned long v, int base = DEC) { printf(base == HEX ? "%lX" : "%lu", v); }
+  void print(unsigned int v, int base = DEC) { print((unsigned long)v, base); }
+  void print(uint8_t v, int base = DEC) { print((unsigned long)v, base); }
+  void print(double v, int digits = 2) { printf("%.*f", digits, v); }
+
+  void println() { printf("\n"); }
+  template <typename T>
+  void println(T v) { print(v); println(); }
+  template <typename T>
+  void println(T v, int fmt) { print(v, fmt); println(); }
+};
+
+inline HardwareSerial &emu_serial() {
+  static HardwareSerial s;
+  return s;
+}
+#define Serial emu_serial()
+
+#endif  // OURLORA_EMU_ARDUINO_H
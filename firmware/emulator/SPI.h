@@ -0,0 +1,108 @@
+/*
+ * OurLoRa host emulator - SPI shim
+ *
+ * Bytes go to whichever emulated chip currently has its CS low.
+ * Every byte charges bus time to the virtual clock at the active
+ * clock rate, and the bus keeps counters for benchmarks. afterCall
+ * runs between driver calls (CS may still be low), where a real
+ * interrupt could preempt a transaction.
+ */
+#ifndef OURLORA_EMU_SPI_H
+#define OURLORA_EMU_SPI_H
+
+#include <functional>
+
+#include "Arduino.h"
+
+#define MSBFIRST 1
+#define LSBFIRST 0
+#define SPI_MODE0 0x00
+
+class SPISettings {
+ public:
+  SPISettings() : clock(1000000), bitOrder(MSBFIRST), dataMode(SPI_MODE0) {}
+  SPISettings(uint32_t c, uint8_t o, uint8_t m) : clock(c), bitOrder(o), dataMode(m) {}
+  uint32_t clock;
+  uint8_t bitOrder;
+  uint8_t dataMode;
+};
+
+struct SpiBusStats {
+  uint64_t transactions;  // beginTransaction() calls
+  uint64_t nested;        // ... while another transaction was open
+  uint64_t calls;         // transfer()/transferBytes()/writeBytes() calls
+  uint64_t bytes;         // bytes clocked
+  uint64_t busyNs;        // time spent clocking + per-call overhead
+};
+
+class SPIClass {
+ public:
+  // Cost of one driver call on the ESP32 (setup of the SPI peripheral)
+  uint32_t callOverheadNs = 1000;
+  // Many-node benches turn this off: each real node has its own CPU and
+  // bus, on the one shared virtual clock their SPI time would add up
+  bool chargeClock = true;
+  SpiBusStats stats;
+  // Test hook, called after every transfer()/transferBytes()/writeBytes()
+  std::function<void(const uint8_t *out, uint32_t size)> afterCall;
+
+  SPIClass() { memset(&stats, 0, sizeof(stats)); }
+
+  void begin(int8_t = -1, int8_t = -1, int8_t = -1, int8_t = -1) {}
+  void end() {}
+  void setFrequency(uint32_t hz) { _clock = hz; }
+
+  void beginTransaction(SPISettings s) {
+    _clock = s.clock;
+    stats.transactions++;
+    if (_open) stats.nested++;  // ESP32: the bus mutex is already held
+    _open = true;
+  }
+  void endTransaction() { _open = false; }
+
+  uint8_t transfer(uint8_t out) {
+    _charge(1);
+    emu::SpiDevice *d = emu::selected_device();
+    uint8_t in = d ? d->spiByte(out) : 0xFF;
+    if (afterCall) afterCall(&out, 1);
+    return in;
+  }
+
+  void transferBytes(const uint8_t *out, uint8_t *in, uint32_t size) {
+    _charge(size);
+    emu::SpiDevice *d = emu::selected_device();
+    for (uint32_t i = 0; i < size; i++) {
+      uint8_t r = d ? d->spiByte(out ? out[i] : 0xFF) : 0xFF;
+      if (in) in[i] = r;
+    }
+    if (afterCall) afterCall(out, size);
+  }
+
+  void writeBytes(const uint8_t *data, uint32_t size) { transferBytes(data, NULL, size); }
+
+  void resetStats() { memset(&stats, 0, sizeof(stats)); }
+
+ private:
+  uint32_t _clock = 1000000;  // Arduino default when no transaction is used
+  bool _open = false;         // Inside beginTransaction() .. endTransaction()
+  uint64_t _fracNs = 0;
+
+  void _charge(uint32_t nbytes) {
+    uint64_t ns = callOverheadNs + (uint64_t)nbytes * 8 * 1000000000ull / _clock;
+    stats.calls++;
+    stats.bytes += nbytes;
+    stats.busyNs += ns;
+    if (!chargeClock) return;
+    _fracNs += ns;
+    emu::charge_us(_fracNs / 1000);
+    _fracNs %= 1000;
+  }
+};
+
+inline SPIClass &emu_spi() {
+  static SPIClass s;
+  return s;
+}
+#define SPI emu_spi()
+
+#endif  // OURLORA_EMU_SPI_H
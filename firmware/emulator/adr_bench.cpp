@@ -0,0 +1,182 @@
+/*
+ * OurLoRa ADR benchmark
+ *
+ * A gateway (ADR controller) and one sub tank node, both starting at
+ * DR0 (SF12/125 kHz). The node reports every REPORT_MS, the gateway
+ * answers each report. Scenarios:
+ *   step up       - strong link: the controller moves both to a fast rate
+ *   step down     - the link gets 35 dB weaker once they run fast:
+ *                   frames still arrive, the controller lowers the rate
+ *   link lost     - the link gets 40 dB weaker: nothing arrives at the
+ *                   fast rate, both fall back until they hear each
+ *                   other again
+ *   failed switch - the node's radio is busy when it should switch
+ *                   (set_profile() fails once); it must still follow
+ *                   the controller instead of ending on another rate
+ * Prints the final data rate of each side, switches, fallbacks, when
+ * the last switch happened, how long the two sides spent on different
+ * rates and report delivery over the final two minutes. Exits with 1
+ * if they end apart, or if a failed switch keeps them apart for more
+ * than one report period.
+ *
+ * Build and run (from the repository root):
+ *   g++ -std=gnu++11 -O2 -I firmware/emulator \
+ *       firmware/emulator/adr_bench.cpp -o adr_bench
+ *   ./adr_bench
+ */
+#include <Arduino.h>
+#include <SPI.h>
+
+#include "air_medium.h"
+#include "sx1278_model.h"
+
+#include "../ourlora_adr.h"
+
+using emu::AirMedium;
+using emu::Sx1278Model;
+
+static const uint8_t GATEWAY_ID = 1;
+static const uint8_t NODE_ID = 2;
+static const uint32_t REPORT_MS = 5000;
+static const uint32_t RUN_MS = 1800000;    // 30 minutes
+static const uint32_t DROP_AT_MS = 300000; // Step down / link lost: link gets weak here
+static const uint32_t TAIL_MS = 120000;    // Delivery measured over the end
+static const double STRONG_DBM = -80;
+static const double WEAK_DBM = -115;      // Heard at SF7/500 kHz, without the margin
+static const double LOST_DBM = -120;      // Only heard below SF7/500 kHz
+
+enum Scenario { STEP_UP, STEP_DOWN, LINK_LOST, FAILED_SWITCH };
+
+// A radio whose next profile switches can be made to fail, as when the
+// application has a transmission in flight at that moment
+class BusyRadio : public RuntimeLoRaRadio {
+ public:
+  int busySwitches;
+
+  BusyRadio(uint8_t cs, uint8_t rst, uint8_t dio0)
+    : RuntimeLoRaRadio(cs, rst, dio0), busySwitches(0) {}
+
+  bool set_profile(const OurLoRaModemProfile &profile) {
+    if (busySwitches > 0) {
+      busySwitches--;
+      return false;
+    }
+    return RuntimeLoRaRadio::set_profile(profile);
+  }
+};
+
+struct Result {
+  OurLoRaAdrStats gw, node;
+  double lastSwitchS;                      // Last data rate change on either side
+  double apartS;                           // Time the two sides used different rates
+  int sent, delivered;                     // Reports over the final TAIL_MS
+};
+
+static void drain(BusyRadio &radio, OurLoRaAdr<BusyRadio> &adr, int *reports) {
+  OurLoRaRxFrame f;
+  while (radio.rx_pop(&f)) {
+    if (f.length < 1 || adr.handle_frame(f.data, f.length, f.rssi, f.snr)) continue;
+    adr.observe(f.data[0], f.rssi, f.snr);
+    if (reports && f.data[0] == NODE_ID) {
+      (*reports)++;
+      uint8_t answer[4] = { GATEWAY_ID, f.data[1], 0, 0 };
+      radio.send_a_msg(answer, sizeof(answer));
+    }
+  }
+}
+
+static Result run(Scenario scenario) {
+  emu::reset_world();
+  randomSeed(42);
+
+  AirMedium air;
+  Sx1278Model gwChip(1, 2, 3), nodeChip(4, 5, 6);
+  air.attach(&gwChip);
+  air.attach(&nodeChip);
+  air.setLinkBoth(&gwChip, &nodeChip, STRONG_DBM);
+  BusyRadio gateway(1, 2, 3), node(4, 5, 6);
+  gateway.setup(433);
+  node.setup(433);
+  const OurLoRaModemProfile &p = gateway.profile();
+  OurLoRaModemProfile slow(p.frequencyHz, 12, LORA_BW_125, p.codingRate, p.crc, LORA_LDRO_AUTO,
+                           p.preambleLength, p.syncWord, p.implicitLength);
+  gateway.set_profile(slow);
+  node.set_profile(slow);
+  gateway.enforce_duty_cycle(false);       // Measure ADR, not the regulation
+  node.enforce_duty_cycle(false);
+  gateway.enable_interrupts();
+  emu::radio_task(gateway);
+  node.enable_interrupts();
+  emu::radio_task(node);
+  gateway.start_listening();
+  node.start_listening();
+
+  OurLoRaAdr<BusyRadio> gwAdr(gateway, GATEWAY_ID, GATEWAY_ID);
+  OurLoRaAdr<BusyRadio> nodeAdr(node, NODE_ID, GATEWAY_ID);
+  if (scenario == FAILED_SWITCH) node.busySwitches = 1;
+
+  Result r;
+  memset(&r, 0, sizeof(r));
+  uint8_t lastGwDr = gwAdr.data_rate(), lastNodeDr = nodeAdr.data_rate();
+  uint32_t start = millis(), due = start, lastSwitch = start, lastLoop = start;
+  uint8_t seq = 0;
+  int received = 0;
+  bool dropped = false;
+  while (millis() - start < RUN_MS) {
+    uint32_t now = millis() - start;
+    if ((scenario == STEP_DOWN || scenario == LINK_LOST) && !dropped && now >= DROP_AT_MS) {
+      air.setLinkBoth(&gwChip, &nodeChip, scenario == LINK_LOST ? LOST_DBM : WEAK_DBM);
+      dropped = true;
+    }
+    if ((int32_t)(millis() - due) >= 0) {
+      uint8_t report[12] = { NODE_ID, seq++ };
+      node.send_a_msg(report, sizeof(report));
+      if (now >= RUN_MS - TAIL_MS) r.sent++;
+      due += REPORT_MS;
+    }
+    int before = received;
+    drain(gateway, gwAdr, &received);
+    drain(node, nodeAdr, NULL);
+    if (now >= RUN_MS - TAIL_MS) r.delivered += received - before;
+    gwAdr.poll();
+    nodeAdr.poll();
+
+    if (lastGwDr != lastNodeDr) r.apartS += (millis() - lastLoop) / 1000.0;
+    lastLoop = millis();
+    if (gwAdr.data_rate() != lastGwDr || nodeAdr.data_rate() != lastNodeDr) {
+      lastGwDr = gwAdr.data_rate();
+      lastNodeDr = nodeAdr.data_rate();
+      lastSwitch = millis();
+    }
+    delay(10);
+  }
+  r.gw = gwAdr.stats();
+  r.node = nodeAdr.stats();
+  r.lastSwitchS = (lastSwitch - start) / 1000.0;
+  emu::reset_world();  // Drop pending events before the radios go away
+  return r;
+}
+
+int main() {
+  printf("OurLoRa ADR bench: report every %u s, %u s per run, start at DR0 (SF12/125 kHz)\n",
+         (unsigned)(REPORT_MS / 1000), (unsigned)(RUN_MS / 1000));
+  printf("link %.0f dBm; from %u s: step down %.0f dBm, link lost %.0f dBm\n\n", STRONG_DBM,
+         (unsigned)(DROP_AT_MS / 1000), WEAK_DBM, LOST_DBM);
+  printf("%-14s %6s %6s %8s %8s %9s %8s %10s\n", "scenario", "gw DR", "nd DR", "switches",
+         "fallback", "last sw s", "apart s", "tail deliv");
+
+  const char *names[] = { "step up", "step down", "link lost", "failed switch" };
+  bool agree = true;
+  for (int s = STEP_UP; s <= FAILED_SWITCH; s++) {
+    Result r = run((Scenario)s);
+    printf("%-14s %6u %6u %4u/%-3u %4u/%-3u %9.1f %8.1f %5d/%-4d\n", names[s], r.gw.dataRate,
+           r.node.dataRate, (unsigned)r.gw.dataRateChanges, (unsigned)r.node.dataRateChanges,
+           (unsigned)r.gw.fallbacks, (unsigned)r.node.fallbacks, r.lastSwitchS, r.apartS,
+           r.delivered, r.sent);
+    if (r.gw.dataRate != r.node.dataRate || r.delivered == 0) agree = false;
+    if (s == FAILED_SWITCH && r.apartS > REPORT_MS / 1000.0) agree = false;
+  }
+  printf("\n%s\n", agree ? "PASS: both sides end on the same data rate and hear each other"
+                         : "FAIL: gateway and node ended, or stayed, apart");
+  return agree ? 0 : 1;
+}
@@ -0,0 +1,248 @@
+/*
+ * OurLoRa host emulator - virtual air medium
+ *
+ * Connects any number of Sx1278Model radios. A frame reaches a radio
+ * that is listening on the same channel (frequency, SF, bandwidth,
+ * sync word; FSK: frequency, bit rate, sync bytes) and had a chance
+ * to see the preamble. Overlapping
+ * frames on a channel collide unless one is >= captureDb stronger;
+ * frames below the demodulation SNR floor are not heard at all.
+ *
+ * Link budget: rssi(from, to) defaults to defaultRssiDbm and can be
+ * set per link; lossRate drops frames at random (CRC error).
+ * Interference on a frequency (setInterference) shows up in the
+ * wideband RSSI and ruins the frames it overlaps, unless they are
+ * >= captureDb stronger.
+ */
+#ifndef OURLORA_EMU_AIR_MEDIUM_H
+#define OURLORA_EMU_AIR_MEDIUM_H
+
+#include <map>
+#include <vector>
+
+#include "sx1278_model.h"
+
+namespace emu {
+
+class AirMedium : public Ether {
+ public:
+  double defaultRssiDbm = -80;
+  double lossRate = 0.0;     // random per-reception corruption probability
+  double captureDb = 6.0;    // stronger frame survives a collision
+
+  struct Stats {
+    uint64_t framesSent;
+    uint64_t deliveries;     // clean receptions
+    uint64_t collisions;     // receptions ruined by overlap
+    uint64_t corrupted;      // receptions ruined by lossRate
+    uint64_t jammed;         // receptions ruined by interference
+    uint64_t airtimeUs;
+  };
+  Stats stats;
+
+  AirMedium() { memset(&stats, 0, sizeof(stats)); }
+
+  void attach(Sx1278Model *r) {
+    r->ether = this;
+    _radios.push_back(r);
+  }
+
+  void setLink(Sx1278Model *from, Sx1278Model *to, double rssiDbm) {
+    _links[std::make_pair(from, to)] = rssiDbm;
+  }
+
+  void setLinkBoth(Sx1278Model *a, Sx1278Model *b, double rssiDbm) {
+    setLink(a, b, rssiDbm);
+    setLink(b, a, rssiDbm);
+  }
+
+  // Mark two radios as out of range of each other
+  void cutLink(Sx1278Model *a, Sx1278Model *b) { setLinkBoth(a, b, -200); }
+
+  // In-band interference on a frequency (dBm), for noise surveys: on
+  // for onUs of every periodUs, at a random offset within each period
+  // (periodUs = 0: always on)
+  void setInterference(uint32_t frf, double dbm, uint32_t periodUs = 0, uint32_t onUs = 0) {
+    Interferer i = { dbm, periodUs, onUs < periodUs ? onUs : periodUs };
+    _interference[frf] = i;
+  }
+
+  double rssi(Sx1278Model *from, Sx1278Model *to) const {
+    std::map<std::pair<Sx1278Model *, Sx1278Model *>, double>::const_iterator it =
+        _links.find(std::make_pair(from, to));
+    return it == _links.end() ? defaultRssiDbm : it->second;
+  }
+
+  // ----------------------------------------------------------
+  //  Ether
+  // ----------------------------------------------------------
+  void startTx(const AirFrame &frame) {
+    prune();
+    stats.framesSent++;
+    stats.airtimeUs += frame.endUs - frame.startUs;
+    _onAir.push_back(Reception());
+    Reception &rx = _onAir.back();
+    rx.frame = frame;
+    uint64_t id = ++_nextId;
+    rx.id = id;
+    for (size_t i = 0; i < _radios.size(); i++) {
+      Sx1278Model *r = _radios[i];
+      if (r != frame.from && r->receiving() && !r->locked()) tryLock(rx, r);
+    }
+    // A radio that starts listening later may still catch the preamble
+    schedule_at(frame.endUs, [this, id]() { finish(id); });
+  }
+
+  void radioListening(Sx1278Model *radio) {
+    prune();
+    for (size_t i = 0; i < _onAir.size(); i++) {
+      if (radio->locked()) break;
+      Reception &rx = _onAir[i];
+      if (rx.frame.from != radio && now_us() <= rx.frame.preambleEndUs &&
+          now_us() < rx.frame.endUs) {
+        tryLock(rx, radio);
+      }
+    }
+  }
+
+  bool channelActive(Sx1278Model *radio, uint64_t minOnAirUs) {
+    prune();
+    for (size_t i = 0; i < _onAir.size(); i++) {
+      const AirFrame &f = _onAir[i].frame;
+      if (f.from != radio && sameChannel(f, radio) && now_us() < f.endUs &&
+          f.startUs + minOnAirUs <= now_us() && audible(f, radio)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  double rssiNow(Sx1278Model *radio) {
+    prune();
+    double mw = dbmToMw(radio->noiseFloorDbm());
+    std::map<uint32_t, Interferer>::const_iterator it = _interference.find(radio->frf());
+    if (it != _interference.end() && interfering(it->first, it->second, now_us(), now_us() + 1)) {
+      mw += dbmToMw(it->second.dbm);
+    }
+    for (size_t i = 0; i < _onAir.size(); i++) {
+      const AirFrame &f = _onAir[i].frame;
+      if (f.from != radio && f.frf == radio->frf() && now_us() < f.endUs) {
+        mw += dbmToMw(rssi(f.from, radio));
+      }
+    }
+    return 10 * log10(mw);
+  }
+
+ private:
+  struct Interferer {
+    double dbm;
+    uint32_t periodUs, onUs;
+  };
+
+  struct Reception {
+    uint64_t id;
+    AirFrame frame;
+    std::vector<Sx1278Model *> locked;
+  };
+
+  std::vector<Sx1278Model *> _radios;
+  std::vector<Reception> _onAir;
+  std::map<std::pair<Sx1278Model *, Sx1278Model *>, double> _links;
+  std::map<uint32_t, Interferer> _interference;
+  uint64_t _nextId = 0;
+
+  static double dbmToMw(double dbm) { return pow(10.0, dbm / 10.0); }
+
+  // Is the interferer on at any time in [t0, t1)?
+  static bool interfering(uint32_t frf, const Interferer &i, uint64_t t0, uint64_t t1) {
+    if (i.periodUs == 0) return true;
+    for (uint64_t k = t0 / i.periodUs; k * i.periodUs < t1; k++) {
+      uint64_t x = (k + 1) * 0x9E3779B97F4A7C15ULL ^ frf;  // splitmix64: burst offset
+      x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+      x ^= x >> 31;
+      uint64_t on = k * i.periodUs + x % (i.periodUs - i.onUs + 1);
+      if (on < t1 && t0 < on + i.onUs) return true;
+    }
+    return false;
+  }
+
+  static bool sameChannel(const AirFrame &f, const Sx1278Model *r) {
+    if (f.fsk) {
+      return !r->isLoRa() && f.frf == r->frf() && f.bitrateReg == r->fskBitrateReg() &&
+             f.fskSync == r->fskSync();
+    }
+    return r->isLoRa() && f.frf == r->frf() && f.sf == r->sf() && f.bw == r->bwCode() &&
+           f.syncWord == r->syncWord();
+  }
+
+  double snrAt(const AirFrame &f, Sx1278Model *r) const {
+    return rssi(f.from, r) - r->noiseFloorDbm();
+  }
+
+  bool audible(const AirFrame &f, Sx1278Model *r) const {
+    return snrAt(f, r) >= r->requiredSnr();
+  }
+
+  void tryLock(Reception &rx, Sx1278Model *r) {
+    if (sameChannel(rx.frame, r) && audible(rx.frame, r)) {
+      r->lockReceive(rx.id, rx.frame);
+      if (!r->locked()) return;
+      rx.locked.push_back(r);
+    }
+  }
+
+  // Drop frames that ended long ago (kept briefly for overlap checks)
+  void prune() {
+    uint64_t t = now_us();
+    size_t w = 0;
+    for (size_t i = 0; i < _onAir.size(); i++) {
+      if (_onAir[i].frame.endUs + 1000000 > t) {
+        if (w != i) _onAir[w] = _onAir[i];
+        w++;
+      }
+    }
+    _onAir.resize(w);
+  }
+
+  void finish(uint64_t id) {
+    Reception *rx = 0;
+    for (size_t i = 0; i < _onAir.size(); i++) {
+      if (_onAir[i].id == id) rx = &_onAir[i];
+    }
+    if (!rx) return;
+    Reception done = *rx;
+    const AirFrame &f = done.frame;
+    for (size_t i = 0; i < done.locked.size(); i++) {
+      Sx1278Model *r = done.locked[i];
+      if (!r->lockedOn(id) || !sameChannel(f, r)) continue;
+      double sig = rssi(f.from, r);
+      bool ok = true;
+      for (size_t j = 0; j < _onAir.size(); j++) {
+        const AirFrame &o = _onAir[j].frame;
+        if (_onAir[j].id == id || o.from == r || o.frf != f.frf) continue;
+        bool overlap = o.startUs < f.endUs && f.startUs < o.endUs;
+        if (overlap && sig - rssi(o.from, r) < captureDb) ok = false;
+      }
+      std::map<uint32_t, Interferer>::const_iterator it = _interference.find(f.frf);
+      bool jammed = it != _interference.end() && sig - it->second.dbm < captureDb &&
+                    interfering(it->first, it->second, f.startUs, f.endUs);
+      if (!ok) {
+        stats.collisions++;
+      } else if (jammed) {
+        ok = false;
+        stats.jammed++;
+      } else if (lossRate > 0 && rand_unit() < lossRate) {
+        ok = false;
+        stats.corrupted++;
+      } else {
+        stats.deliveries++;
+      }
+      r->deliver(f, sig, snrAt(f, r), ok);
+    }
+  }
+};
+
+}  // namespace emu
+
+#endif  // OURLORA_EMU_AIR_MEDIUM_H
@@ -0,0 +1,298 @@
+/*
+ * Batched upload benchmark
+ *
+ * One hour of the main tank: the slave sends a reading every second
+ * over ESP-NOW (with jitter), loop() takes a master reading every
+ * ~3.2 s. Compares the old upload - a status snapshot PUT every 5 s,
+ * carrying only the latest reading of each tank - with batches of
+ * every sample sent as one streamed multi-path PATCH (status +
+ * history entries, like main_tank.ino) at several flush intervals,
+ * against the HTTPS model (https_model.h) over a keep-alive
+ * UploadSession. Prints requests, samples delivered per tank,
+ * sample age at upload, bytes sent and how long WiFi was busy; every
+ * history key in the bodies is checked for uniqueness. Time is
+ * virtual, so results are repeatable.
+ *
+ * Build and run (from the repository root):
+ *   g++ -std=gnu++11 -O2 -I firmware/emulator \
+ *       firmware/emulator/batch_bench.cpp -o batch_bench
+ *   ./batch_bench
+ */
+#include <Arduino.h>
+
+#include <set>
+#include <string>
+
+#include "https_model.h"
+
+#include "../main_tank_node/json_writer.h"
+#include "../main_tank_node/sample_batch.h"
+#include "../main_tank_node/upload_session.h"
+
+using emu::HttpsModel;
+
+static const uint32_t RUN_MS = 3600000;
+static const uint32_t SLAVE_MS = 1000;       // ESP-NOW packet period
+static const uint32_t PASS_MS = 3150;        // loop(): TDS average + delay(3000)
+static const uint32_t SNAPSHOT_MS = 5000;    // Old FIREBASE_INTERVAL
+static const uint32_t EPOCH0 = 1760600000;   // UTC at millis() == 0
+static const char *HOST = "hydronet-monitor-default-rtdb.firebaseio.com";
+static const char *PATH = "/waterSystem.json?auth=0123456789abcdef0123456789abcdef01234567";
+
+// ============================================================
+//  MAIN TANK DATA (as in main_tank.ino)
+// ============================================================
+
+typedef struct {
+  float tdsPpm;
+  uint8_t waterQualityCode;
+  float tankLevelPercent;
+  float tankLevelCm;
+  float flow1_Lmin;
+  float flow2_Lmin;
+} struct_message;
+
+typedef struct {
+  float tdsPpm;
+  const char *waterQuality;
+  float tankLevelPercent;
+  float tankLevelCm;
+} MasterReading;
+
+typedef struct {
+  uint32_t epoch;
+  uint16_t epochMs;
+  uint8_t node;                              // 0 master, 1 slave
+  uint32_t uptimeMs;
+  union {
+    MasterReading master;
+    struct_message slave;
+  };
+} Sample;
+
+static const char *quality(uint8_t code) {
+  static const char *text[] = { "Sensor Error / No Reading", "Excellent Drinking Water",
+                                "Good Quality Water", "Average - Not Recommended",
+                                "BAD Water (High TDS)" };
+  return code < 5 ? text[code] : "Unknown Code";
+}
+
+static const JsonField MASTER_FIELDS[] = {
+  JSON_FIELD_FLOAT(MasterReading, tdsPpm, 1),
+  JSON_FIELD_TEXT(MasterReading, waterQuality),
+  JSON_FIELD_FLOAT(MasterReading, tankLevelPercent, 1),
+  JSON_FIELD_FLOAT(MasterReading, tankLevelCm, 1),
+};
+
+static const JsonField SLAVE_FIELDS[] = {
+  JSON_FIELD_FLOAT(struct_message, flow1_Lmin, 2),
+  JSON_FIELD_FLOAT(struct_message, flow2_Lmin, 2),
+  JSON_FIELD_FLOAT(struct_message, tdsPpm, 1),
+  JSON_FIELD_UINT8(struct_message, waterQualityCode),
+  JSON_FIELD_LOOKUP(struct_message, waterQualityCode, "waterQuality", quality),
+  JSON_FIELD_FLOAT(struct_message, tankLevelPercent, 1),
+  JSON_FIELD_FLOAT(struct_message, tankLevelCm, 1),
+};
+
+static char stage[512];
+static MasterReading latestMaster;
+static struct_message latestSlave;
+static uint32_t slaveSerial;                 // Packets generated
+
+static void stamp(Sample *s, uint8_t node) {
+  uint64_t ms = (uint64_t)EPOCH0 * 1000 + millis();
+  s->epoch = ms / 1000;
+  s->epochMs = ms % 1000;
+  s->node = node;
+  s->uptimeMs = millis();
+}
+
+static void writeStatus(JsonWriter &json) {
+  json.begin_object();
+  json.key("master").begin_object();
+  json.fields(&latestMaster, MASTER_FIELDS, JSON_COUNT(MASTER_FIELDS));
+  json.end_object();
+  json.key("slave").begin_object();
+  json.fields(&latestSlave, SLAVE_FIELDS, JSON_COUNT(SLAVE_FIELDS));
+  json.end_object();
+  json.end_object();
+}
+
+static void writeEntry(JsonWriter &json, const Sample &s) {
+  char key[40];
+  snprintf(key, sizeof(key), "history/%s/t%lu%03u", s.node ? "slave" : "master",
+           (unsigned long)s.epoch, (unsigned)s.epochMs);
+  json.key(key).begin_object();
+  if (s.node) {
+    json.fields(&s.slave, SLAVE_FIELDS, JSON_COUNT(SLAVE_FIELDS));
+  } else {
+    json.fields(&s.master, MASTER_FIELDS, JSON_COUNT(MASTER_FIELDS));
+  }
+  json.field("timestamp", "2026-10-16T07:33:20Z");
+  json.end_object();
+}
+
+template <class Batch>
+struct BatchBody {
+  Batch *masters, *slaves;
+  uint16_t nm, ns;
+
+  size_t operator()(Print *out) {
+    JsonWriter json(out ? stage : NULL, out ? sizeof(stage) : 0, out);
+    json.begin_object();
+    json.key("status");
+    writeStatus(json);
+    for (uint16_t i = 0; i < nm; i++) writeEntry(json, masters->at(i));
+    for (uint16_t i = 0; i < ns; i++) writeEntry(json, slaves->at(i));
+    json.end_object();
+    json.finish();
+    return json.length();
+  }
+};
+
+// ============================================================
+//  RUNS
+// ============================================================
+
+struct Result {
+  uint32_t requests, handshakes, failures;
+  uint32_t masterGen, masterSent, slaveGen, slaveSent;
+  double ageMeanS, ageMaxS;                  // Sample age when its upload returned 200
+  double kbPerHour;
+  double busyS;                              // Handshake + request time, whole hour
+  uint32_t keyDups, badRequests;
+  uint16_t maxWaiting;
+};
+
+static Result run(uint32_t flushMs) {        // 0 = old snapshot PUT
+  emu::reset_world();
+  randomSeed(25);
+  HttpsModel tls;
+  UploadSession<HttpsModel> session(tls, HOST);
+  SampleBatch<Sample, 128> masters(96, flushMs ? flushMs : 1);
+  SampleBatch<Sample, 128> slaves(96, flushMs ? flushMs : 1);
+
+  Result r;
+  memset(&r, 0, sizeof(r));
+  slaveSerial = 0;
+  double ageSum = 0;
+  uint32_t lastSentSerial = 0;
+  std::set<std::string> keys;
+
+  // Slave packets arrive in the background, every ~1 s
+  std::function<void()> packet = [&]() {
+    slaveSerial++;
+    latestSlave.tdsPpm = 250 + slaveSerial % 40;
+    latestSlave.waterQualityCode = 2;
+    latestSlave.tankLevelPercent = 45 + slaveSerial % 7;
+    latestSlave.tankLevelCm = latestSlave.tankLevelPercent;
+    latestSlave.flow1_Lmin = 3.42f;
+    latestSlave.flow2_Lmin = 1.87f;
+    if (flushMs) {
+      Sample s;
+      stamp(&s, 1);
+      s.slave = latestSlave;
+      slaves.push(s);
+    }
+    emu::schedule_in((SLAVE_MS - 50 + random(100)) * 1000ULL, packet);
+  };
+  emu::schedule_in(random(SLAVE_MS) * 1000ULL, packet);
+
+  uint32_t lastSnapshot = 0;
+  while (millis() < RUN_MS) {
+    // loop(): master reading
+    delay(150);
+    r.masterGen++;
+    latestMaster.tdsPpm = 140 + r.masterGen % 30;
+    latestMaster.waterQuality = "Excellent Drinking Water";
+    latestMaster.tankLevelPercent = 74;
+    latestMaster.tankLevelCm = 74;
+
+    if (!flushMs) {
+      if (millis() - lastSnapshot >= SNAPSHOT_MS) {
+        lastSnapshot = millis();
+        JsonWriter json(stage, sizeof(stage));
+        writeStatus(json);
+        json.finish();
+        if (session.put(PATH, stage, json.length()) == 200) {
+          r.masterSent++;                    // One reading of each tank per PUT
+          if (slaveSerial != lastSentSerial) r.slaveSent++;
+          lastSentSerial = slaveSerial;
+        }
+      }
+    } else {
+      Sample s;
+      stamp(&s, 0);
+      s.master = latestMaster;
+      masters.push(s);
+      if (masters.size() + slaves.size() > r.maxWaiting) r.maxWaiting = masters.size() + slaves.size();
+      if (masters.due() || slaves.due()) {
+        BatchBody<SampleBatch<Sample, 128> > body = { &masters, &slaves, masters.size(), slaves.size() };
+        if (session.request_stream("PATCH", PATH, body) == 200) {
+          for (uint16_t i = 0; i < body.nm + body.ns; i++) {
+            const Sample &x = i < body.nm ? masters.at(i) : slaves.at(i - body.nm);
+            double age = (millis() - x.uptimeMs) / 1000.0;
+            ageSum += age;
+            if (age > r.ageMaxS) r.ageMaxS = age;
+          }
+          r.masterSent += body.nm;
+          r.slaveSent += body.ns;
+          const std::string &b = tls.lastBody;
+          for (size_t at = b.find("\"history/"); at != std::string::npos;
+               at = b.find("\"history/", at + 1)) {
+            if (!keys.insert(b.substr(at, b.find('"', at + 1) - at)).second) r.keyDups++;
+          }
+        }
+        masters.drop(body.nm);
+        slaves.drop(body.ns);
+      }
+    }
+    tls.idle();
+    delay(PASS_MS - 150);
+  }
+
+  r.slaveGen = slaveSerial;
+  UploadSessionStats st = session.stats();
+  r.requests = st.requests;
+  r.handshakes = st.handshakes;
+  r.failures = st.failures;
+  r.busyS = (st.handshakeMs + st.requestMs) / 1000.0;
+  r.kbPerHour = tls.stats.bodyBytes / 1024.0;
+  r.badRequests = tls.stats.badRequests;
+  r.ageMeanS = flushMs && r.masterSent + r.slaveSent ? ageSum / (r.masterSent + r.slaveSent) : 0;
+  emu::reset_world();
+  return r;
+}
+
+int main() {
+  printf("Batch bench: 1 h, slave packet every %u s, master reading every %.2f s, "
+         "keep-alive HTTPS\n\n", (unsigned)(SLAVE_MS / 1000), PASS_MS / 1000.0);
+  printf("%-20s %6s %7s %5s %13s %13s %8s %8s %8s %7s %5s %5s\n", "upload", "reqs", "reqs/x",
+         "tls", "master", "slave", "age_s", "age_max", "KB", "busy_s", "wait", "dups");
+
+  const uint32_t flushes[] = { 0, 15000, 30000, 45000, 60000, 120000 };
+  uint32_t baseline = 0;
+  for (unsigned i = 0; i < sizeof(flushes) / sizeof(flushes[0]); i++) {
+    Result r = run(flushes[i]);
+    if (!flushes[i]) baseline = r.requests;
+    char name[32], master[24], slave[24];
+    if (flushes[i]) {
+      snprintf(name, sizeof(name), "batch, flush %u s", (unsigned)(flushes[i] / 1000));
+    } else {
+      snprintf(name, sizeof(name), "snapshot PUT / %u s", (unsigned)(SNAPSHOT_MS / 1000));
+    }
+    snprintf(master, sizeof(master), "%u/%u", (unsigned)r.masterSent, (unsigned)r.masterGen);
+    snprintf(slave, sizeof(slave), "%u/%u", (unsigned)r.slaveSent, (unsigned)r.slaveGen);
+    printf("%-20s %6u %7.1f %5u %13s %13s %8.1f %8.1f %8.0f %7.1f %5u %5u%s\n", name,
+           (unsigned)r.requests, (double)baseline / r.requests, (unsigned)r.handshakes, master,
+           slave, r.ageMeanS,
+           r.ageMaxS, r.kbPerHour, r.busyS, (unsigned)r.maxWaiting, (unsigned)r.keyDups,
+           r.failures || r.badRequests ? "  FAILURES" : "");
+  }
+  printf("\nreqs/x = request reduction vs snapshot PUTs; tls = handshakes (idle > %u s reconnects)\n",
+         (unsigned)(UPLOAD_IDLE_MS / 1000));
+  printf("master/slave = samples uploaded / taken (the rest still wait for the next flush)\n");
+  printf("age = sample age when its batch was stored; KB = request bodies; busy = WiFi busy\n");
+  printf("wait = most samples held in RAM; dups = history keys written twice\n");
+  return 0;
+}
@@ -0,0 +1,297 @@
+/*
+ * OurLoRa DIO0 race test
+ *
+ * Fires the DIO0 interrupt while the driver is in the middle of an
+ * SPI transaction and checks that the interrupt does no SPI of its
+ * own: no nested transaction (which takes the bus mutex on ESP32), no
+ * register access inside a FIFO burst, payloads intact.
+ *   1. DIO0 rises right after the FIFO address byte of the TX burst
+ *      in _begin_transmit(), before the payload bytes.
+ *   2. Frames arrive while the application keeps the bus busy, with
+ *      due events (RxDone, TxDone) dispatched after every SPI call so
+ *      DIO0 lands inside register reads, bursts and mode changes.
+ *   3. The DIO0 edge of a TxDone never reaches the MCU: the start_transmit()
+ *      must time out, report false to on_tx_done() and free the radio.
+ *   4. Two frames arrive before the receiver services DIO0 (no radio
+ *      task, loop() busy): the first is overwritten in the FIFO and
+ *      must show up in link_stats().rxMissed.
+ * Prints PASS/FAIL per check and exits with 1 on any failure.
+ *
+ * Build and run (from the repository root):
+ *   g++ -std=gnu++11 -O2 -I firmware/emulator \
+ *       firmware/emulator/dio0_race_bench.cpp -o dio0_race_bench
+ *   ./dio0_race_bench
+ */
+#include <Arduino.h>
+#include <SPI.h>
+
+#include "air_medium.h"
+#include "sx1278_model.h"
+
+#include "../ourlora.h"
+
+using emu::AirMedium;
+using emu::Sx1278Model;
+
+static const int PAYLOAD = 24;
+static const int FRAMES = 50;
+static const uint32_t LIMIT_MS = 30000;
+
+static int failures = 0;
+
+static void check(const char *what, bool ok) {
+  printf("  %-44s %s\n", what, ok ? "PASS" : "FAIL");
+  if (!ok) failures++;
+}
+
+// Byte 0 is the sequence number, the rest follows from it
+static void fill(uint8_t *payload, int seq) {
+  payload[0] = (uint8_t)seq;
+  for (int i = 1; i < PAYLOAD; i++) payload[i] = (uint8_t)(seq * 7 + i);
+}
+
+static bool intact(const OurLoRaRxFrame &f) {
+  uint8_t expect[PAYLOAD];
+  fill(expect, f.data[0]);
+  return f.length == PAYLOAD && memcmp(f.data, expect, PAYLOAD) == 0;
+}
+
+// ============================================================
+//  1. DIO0 IN THE MIDDLE OF THE TX FIFO BURST
+// ============================================================
+
+static void testTxBurst() {
+  printf("DIO0 during the TX FIFO burst\n");
+  emu::reset_world();
+  AirMedium air;
+  Sx1278Model gwChip(1, 2, 3), nodeChip(4, 5, 6);
+  air.attach(&gwChip);
+  air.attach(&nodeChip);
+  RuntimeLoRaRadio gateway(1, 2, 3), node(4, 5, 6);
+  gateway.setup(433);
+  node.setup(433);
+  node.enforce_duty_cycle(false);
+  gateway.enable_interrupts();
+  node.enable_interrupts();
+  gateway.start_listening();
+
+  bool armed = true, fired = false;
+  uint64_t isrCalls = 0;
+  uint64_t nestedBefore = SPI.stats.nested;
+  SPI.afterCall = [&](const uint8_t *out, uint32_t size) {
+    // The FIFO write address, sent just before the payload bytes
+    if (!armed || emu::selected_device() != &nodeChip || size != 1 || !out ||
+        out[0] != (REG_FIFO | 0x80)) {
+      return;
+    }
+    armed = false;
+    fired = true;
+    uint64_t calls = SPI.stats.calls;
+    emu::drive_pin(6, HIGH);
+    emu::drive_pin(6, LOW);
+    isrCalls = SPI.stats.calls - calls;
+  };
+
+  uint8_t payload[PAYLOAD];
+  fill(payload, 1);
+  bool sent = node.send_a_msg(payload, PAYLOAD);
+  SPI.afterCall = NULL;
+
+  OurLoRaRxFrame f;
+  bool got = false;
+  uint32_t start = millis();
+  while (!got && millis() - start < 1000) {
+    got = gateway.rx_pop(&f);
+    delay(1);
+  }
+
+  check("interrupt fired inside the burst", fired);
+  check("no SPI calls from the interrupt", isrCalls == 0);
+  check("no nested SPI transaction", SPI.stats.nested == nestedBefore);
+  check("send_a_msg() saw TxDone", sent && !node.is_transmitting());
+  check("gateway got the payload intact", got && intact(f) && f.data[0] == 1);
+}
+
+// ============================================================
+//  2. FRAMES ARRIVING WHILE THE BUS IS BUSY
+// ============================================================
+
+static void testBusyBus() {
+  printf("DIO0 during application SPI traffic, %d frames\n", FRAMES);
+  emu::reset_world();
+  randomSeed(31);
+  AirMedium air;
+  Sx1278Model gwChip(1, 2, 3), nodeChip(4, 5, 6);
+  air.attach(&gwChip);
+  air.attach(&nodeChip);
+  RuntimeLoRaRadio gateway(1, 2, 3), node(4, 5, 6);
+  gateway.setup(433);
+  node.setup(433);
+  node.enforce_duty_cycle(false);
+  gateway.enable_interrupts();
+  node.enable_interrupts();
+  gateway.start_listening();
+
+  uint64_t nestedBefore = SPI.stats.nested;
+  uint64_t isrSpiCalls = 0;
+  bool inDispatch = false;
+  SPI.afterCall = [&](const uint8_t *, uint32_t) {
+    if (inDispatch) {
+      isrSpiCalls++;  // SPI from inside an event: the ISR talked to the chip
+      return;
+    }
+    inDispatch = true;
+    emu::dispatch_due();
+    inDispatch = false;
+  };
+
+  uint8_t payload[PAYLOAD];
+  int queued = 0, received = 0, damaged = 0;
+  uint32_t start = millis();
+  while (received + damaged < FRAMES && millis() - start < LIMIT_MS) {
+    if (queued < FRAMES) {
+      fill(payload, queued);
+      if (node.enqueue(payload, PAYLOAD) >= 0) queued++;
+    }
+    gateway.rssi_now();  // Keep the bus busy like a survey or a sensor would
+    OurLoRaRxFrame f;
+    while (gateway.rx_pop(&f)) {
+      if (intact(f)) received++;
+      else damaged++;
+    }
+    gateway.poll();
+    node.poll();
+    delayMicroseconds(random(20, 200));  // Drift against the frame timing
+  }
+  SPI.afterCall = NULL;
+
+  printf("  received %d/%d, damaged %d, overruns %u\n", received, FRAMES, damaged,
+         (unsigned)gateway.rx_overruns());
+  check("no SPI calls from the interrupt", isrSpiCalls == 0);
+  check("no nested SPI transaction", SPI.stats.nested == nestedBefore);
+  check("every frame received intact", received == FRAMES && damaged == 0);
+}
+
+// ============================================================
+//  3. TXDONE EDGE LOST
+// ============================================================
+
+static int txDoneCalls = 0;
+static bool txDoneOk = true;
+
+static void onTxDone(bool success) {
+  txDoneCalls++;
+  txDoneOk = success;
+}
+
+static void testLostTxDone() {
+  printf("DIO0 edge of TxDone lost\n");
+  emu::reset_world();
+  AirMedium air;
+  Sx1278Model gwChip(1, 2, 3), nodeChip(4, 5, 6);
+  air.attach(&gwChip);
+  air.attach(&nodeChip);
+  RuntimeLoRaRadio gateway(1, 2, 3), node(4, 5, 6);
+  gateway.setup(433);
+  node.setup(433);
+  node.enforce_duty_cycle(false);
+  gateway.enable_interrupts();
+  emu::radio_task(gateway);
+  node.enable_interrupts();
+  emu::radio_task(node);
+  gateway.start_listening();
+  node.start_listening();
+  node.on_tx_done(onTxDone);
+
+  uint8_t payload[PAYLOAD];
+  fill(payload, 1);
+  nodeChip.dropDio0Edges = 1;
+  bool started = node.start_transmit(payload, PAYLOAD);
+  uint32_t start = millis();
+  while (node.is_transmitting() && millis() - start < LIMIT_MS) {
+    node.poll();
+    delay(1);
+  }
+  bool freed = !node.is_transmitting();
+  uint32_t waitedMs = millis() - start;
+  bool reportedFalse = txDoneCalls == 1 && !txDoneOk;
+
+  // The radio must work again: a second frame and a queued one go out
+  txDoneCalls = 0;
+  fill(payload, 2);
+  bool again = node.start_transmit(payload, PAYLOAD);
+  while (node.is_transmitting() && millis() - start < LIMIT_MS) delay(1);
+  bool secondOk = txDoneCalls == 1 && txDoneOk;
+  fill(payload, 3);
+  bool queued = node.enqueue(payload, PAYLOAD) >= 0;
+
+  int got = 0;
+  uint32_t rxStart = millis();
+  while (got < 3 && millis() - rxStart < 1000) {
+    node.poll();
+    OurLoRaRxFrame f;
+    while (gateway.rx_pop(&f)) {
+      if (intact(f)) got++;
+    }
+    delay(1);
+  }
+
+  printf("  freed after %u ms, %u TX timeouts\n", (unsigned)waitedMs,
+         (unsigned)node.link_stats().txTimeouts);
+  check("start_transmit() started", started);
+  check("TX timed out and freed the radio", freed && node.link_stats().txTimeouts == 1);
+  check("on_tx_done() got false", reportedFalse);
+  check("next start_transmit() completed", again && secondOk);
+  check("next enqueue() accepted", queued);
+  check("gateway got all three frames", got == 3);
+}
+
+// ============================================================
+//  4. SECOND FRAME BEFORE RXDONE WAS SERVICED
+// ============================================================
+
+static void testLateService() {
+  printf("Two frames before DIO0 is serviced\n");
+  emu::reset_world();
+  AirMedium air;
+  Sx1278Model gwChip(1, 2, 3), nodeChip(4, 5, 6);
+  air.attach(&gwChip);
+  air.attach(&nodeChip);
+  RuntimeLoRaRadio gateway(1, 2, 3), node(4, 5, 6);
+  gateway.setup(433);
+  node.setup(433);
+  node.enforce_duty_cycle(false);
+  gateway.enable_interrupts();             // No radio task: only driver calls service DIO0
+  gateway.start_listening();
+
+  uint8_t payload[PAYLOAD];
+  fill(payload, 1);
+  bool sent = node.send_a_msg(payload, PAYLOAD);
+  OurLoRaRxFrame f;
+  bool first = gateway.rx_pop(&f) && intact(f) && f.data[0] == 1;
+  fill(payload, 2);
+  sent = node.send_a_msg(payload, PAYLOAD) && sent;
+  fill(payload, 3);
+  sent = node.send_a_msg(payload, PAYLOAD) && sent;  // Overwrites frame 2
+
+  int got = 0, last = -1;
+  while (gateway.rx_pop(&f)) {
+    if (intact(f)) got++;
+    last = f.data[0];
+  }
+  OurLoRaLinkStats s = gateway.link_stats();
+  printf("  received %d of the late frames, %u missed\n", got, (unsigned)s.rxMissed);
+  check("frames sent, first one read in time", sent && first);
+  check("only the newest late frame is left", got == 1 && last == 3);
+  check("the overwritten frame counted as missed", s.rxMissed == 1);
+}
+
+int main() {
+  testTxBurst();
+  testBusyBus();
+  testLostTxDone();
+  testLateService();
+  emu::reset_world();
+  printf("\n%s\n", failures ? "FAIL" : "PASS");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,231 @@
+/*
+ * OurLoRa host emulator - virtual clock, pins and interrupts
+ *
+ * Everything the Arduino shim needs that is not radio specific:
+ *   - a microsecond virtual clock (time only moves when code calls
+ *     delay(), or when the SPI bus / emulator charges time for work)
+ *   - an event queue used by the radio models (TxDone timers, ...)
+ *   - GPIO levels and attachInterrupt() handlers
+ *
+ * Header only; every function is inline so the emulator needs no
+ * separate objects next to the sketch-style driver headers.
+ */
+#ifndef OURLORA_EMU_CORE_H
+#define OURLORA_EMU_CORE_H
+
+#include <stdint.h>
+#include <functional>
+#include <map>
+#include <queue>
+#include <vector>
+
+namespace emu {
+
+// ============================================================
+//  VIRTUAL CLOCK + EVENT QUEUE
+// ============================================================
+
+struct Event {
+  uint64_t atUs;
+  uint64_t order;                  // FIFO among events at the same time
+  std::function<void()> fire;
+  bool operator>(const Event &o) const {
+    return atUs != o.atUs ? atUs > o.atUs : order > o.order;
+  }
+};
+
+struct Scheduler {
+  uint64_t nowUs = 0;
+  uint64_t nextOrder = 0;
+  int interruptLock = 0;           // noInterrupts() nesting
+  bool dispatching = false;
+  int blocked = 0;                 // In delay()/yield(): other tasks may run
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event> > events;
+};
+
+inline Scheduler &sched() {
+  static Scheduler s;
+  return s;
+}
+
+inline uint64_t now_us() { return sched().nowUs; }
+
+inline void schedule_at(uint64_t atUs, std::function<void()> fire) {
+  Scheduler &s = sched();
+  Event e;
+  e.atUs = atUs < s.nowUs ? s.nowUs : atUs;
+  e.order = s.nextOrder++;
+  e.fire = fire;
+  s.events.push(e);
+}
+
+inline void schedule_in(uint64_t delayUs, std::function<void()> fire) {
+  schedule_at(now_us() + delayUs, fire);
+}
+
+// Fire every event that is due. Events (and the ISRs they trigger)
+// never run while interrupts are masked or while another event runs.
+inline void dispatch_due() {
+  Scheduler &s = sched();
+  if (s.dispatching || s.interruptLock > 0) return;
+  s.dispatching = true;
+  while (!s.events.empty() && s.events.top().atUs <= s.nowUs) {
+    Event e = s.events.top();
+    s.events.pop();
+    e.fire();
+  }
+  s.dispatching = false;
+}
+
+// Move the clock forward, firing events at their own timestamps
+inline void advance_to(uint64_t targetUs) {
+  Scheduler &s = sched();
+  while (!s.events.empty() && s.events.top().atUs <= targetUs &&
+         !s.dispatching && s.interruptLock == 0) {
+    if (s.events.top().atUs > s.nowUs) s.nowUs = s.events.top().atUs;
+    dispatch_due();
+  }
+  if (targetUs > s.nowUs) s.nowUs = targetUs;
+  dispatch_due();
+}
+
+inline void advance_us(uint64_t us) { advance_to(now_us() + us); }
+
+// The running code blocks (delay(), yield()), so a task that was woken
+// gets the CPU; busy waits and clock reads use advance_us()/dispatch_due()
+inline void block_us(uint64_t us) {
+  sched().blocked++;
+  advance_us(us);
+  sched().blocked--;
+}
+
+// Can a woken task run now, rather than preempting a driver call?
+inline bool task_may_run() { return sched().blocked > 0; }
+
+// Charge CPU/bus time without giving interrupts a chance to run
+inline void charge_us(uint64_t us) { sched().nowUs += us; }
+
+// Time of the next pending event (UINT64_MAX if none)
+inline uint64_t next_event_us() {
+  Scheduler &s = sched();
+  return s.events.empty() ? UINT64_MAX : s.events.top().atUs;
+}
+
+// ============================================================
+//  GPIO + INTERRUPTS
+// ============================================================
+
+typedef void (*IsrFn)();
+typedef void (*IsrArgFn)(void *);
+
+struct PinHook {
+  // Called for every digitalWrite() to that pin (radio CS / RST lines)
+  std::function<void(int level)> onWrite;
+};
+
+struct Gpio {
+  std::map<int, int> level;
+  std::map<int, int> isrMode;
+  std::map<int, IsrFn> isr;
+  std::map<int, std::pair<IsrArgFn, void *> > isrArg;
+  std::map<int, std::vector<PinHook> > hooks;
+  std::vector<int> pendingIsr;     // Edges seen while interrupts were masked
+  uint64_t writes = 0;
+};
+
+inline Gpio &gpio() {
+  static Gpio g;
+  return g;
+}
+
+inline void hook_pin(int pin, std::function<void(int)> onWrite) {
+  PinHook h;
+  h.onWrite = onWrite;
+  gpio().hooks[pin].push_back(h);
+}
+
+inline void run_isr(int pin) {
+  Gpio &g = gpio();
+  if (g.isr.count(pin)) g.isr[pin]();
+  else if (g.isrArg.count(pin)) g.isrArg[pin].first(g.isrArg[pin].second);
+}
+
+// Drive an input pin from the "hardware" side; fires attached ISRs,
+// or (like the GPIO status latch) holds them until interrupts()
+inline void drive_pin(int pin, int level) {
+  Gpio &g = gpio();
+  int old = g.level.count(pin) ? g.level[pin] : 0;
+  g.level[pin] = level;
+  if (old == level || !g.isrMode.count(pin)) return;
+  int mode = g.isrMode[pin];
+  bool rising = level && !old;
+  // Arduino: RISING = 1, FALLING = 2, CHANGE = 3 (see Arduino.h shim)
+  bool fire = (mode == 3) || (mode == 1 && rising) || (mode == 2 && !rising);
+  if (!fire) return;
+  if (sched().interruptLock > 0) {
+    for (size_t i = 0; i < g.pendingIsr.size(); i++) {
+      if (g.pendingIsr[i] == pin) return;  // One latch per pin
+    }
+    g.pendingIsr.push_back(pin);
+    return;
+  }
+  run_isr(pin);
+}
+
+// Interrupts unmasked: run the ISRs that were held back
+inline void run_pending_isrs() {
+  Gpio &g = gpio();
+  while (!g.pendingIsr.empty() && sched().interruptLock == 0) {
+    int pin = g.pendingIsr.front();
+    g.pendingIsr.erase(g.pendingIsr.begin());
+    run_isr(pin);
+  }
+}
+
+// ============================================================
+//  SPI DEVICES
+// ============================================================
+
+// A chip on the shared SPI bus; it selects itself from its CS hook
+struct SpiDevice {
+  virtual ~SpiDevice() {}
+  virtual uint8_t spiByte(uint8_t out) = 0;
+};
+
+inline SpiDevice *&selected_device() {
+  static SpiDevice *d = 0;
+  return d;
+}
+
+// ============================================================
+//  DETERMINISTIC RANDOM NUMBERS
+// ============================================================
+
+inline uint64_t &rng_state() {
+  static uint64_t s = 0x9E3779B97F4A7C15ull;
+  return s;
+}
+
+inline void seed(uint64_t s) { rng_state() = s ? s : 1; }
+
+inline uint32_t rand32() {
+  uint64_t &x = rng_state();
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return (uint32_t)(x >> 16);
+}
+
+// Uniform in [0, 1)
+inline double rand_unit() { return rand32() / 4294967296.0; }
+
+// Reset clock, pins and pending events between benchmark runs
+inline void reset_world() {
+  sched() = Scheduler();
+  gpio() = Gpio();
+  selected_device() = 0;
+}
+
+}  // namespace emu
+
+#endif  // OURLORA_EMU_CORE_H
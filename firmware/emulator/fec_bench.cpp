@@ -0,0 +1,98 @@
+/*
+ * OurLoRa forward error correction benchmark
+ *
+ * 1. Codec speed on this host: encode and decode (with as many lost
+ *    data blocks as there are parity blocks, the slowest case) of
+ *    K blocks of BLOCK bytes, in MB of data per second.
+ * 2. Recovery versus loss rate: share of K-fragment messages that are
+ *    complete after one round, when every frame is lost independently
+ *    with the given probability (Monte Carlo, no radio).
+ *
+ * The over-the-air comparison with retransmission is in frag_bench.
+ *
+ * Build and run (from the repository root):
+ *   g++ -std=gnu++11 -O2 -I firmware/emulator \
+ *       firmware/emulator/fec_bench.cpp -o fec_bench
+ *   ./fec_bench
+ */
+#include <Arduino.h>
+#include <SPI.h>
+
+#include <chrono>
+
+#include "../ourlora_frag.h"
+
+static const int K = 8;                    // Fragments of a 1.6 KB message
+static const int BLOCK = 200;              // OURLORA_FRAG_SIZE
+static const int TRIALS = 100000;
+
+static double seconds_since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static void speed(int m) {
+  static uint8_t store[K + OURLORA_FEC_MAX_PARITY][BLOCK];
+  uint8_t *blocks[K + OURLORA_FEC_MAX_PARITY];
+  for (int i = 0; i < K + m; i++) blocks[i] = store[i];
+  for (int i = 0; i < K; i++) {
+    for (int j = 0; j < BLOCK; j++) store[i][j] = random(256);
+  }
+
+  const int rounds = 20000;
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) {
+    store[0][0] = r;
+    OurLoRaFec::encode(blocks, K, blocks + K, m, BLOCK);
+  }
+  double enc = (double)rounds * K * BLOCK / seconds_since(t0) / 1e6;
+
+  bool present[K + OURLORA_FEC_MAX_PARITY];
+  for (int i = 0; i < K + m; i++) present[i] = i >= m;  // First m data blocks lost
+  static uint8_t saved[OURLORA_FEC_MAX_PARITY][BLOCK];
+  double busy = 0;
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < m; i++) memcpy(saved[i], store[K + i], BLOCK);  // Decode eats parity
+    t0 = std::chrono::steady_clock::now();
+    OurLoRaFec::decode(blocks, present, K, m, BLOCK);
+    busy += seconds_since(t0);
+    for (int i = 0; i < m; i++) memcpy(store[K + i], saved[i], BLOCK);
+  }
+  double dec = (double)rounds * K * BLOCK / busy / 1e6;
+  printf("%6d %12.1f %12.1f\n", m, enc, dec);
+}
+
+static double recovery(int m, double loss) {
+  int complete = 0;
+  for (int t = 0; t < TRIALS; t++) {
+    int lostData = 0, gotParity = 0;
+    for (int i = 0; i < K + m; i++) {
+      bool lost = random(1000000) < loss * 1000000;
+      if (i < K && lost) lostData++;
+      if (i >= K && !lost) gotParity++;
+    }
+    if (lostData <= gotParity) complete++;
+  }
+  return (double)complete / TRIALS;
+}
+
+int main() {
+  randomSeed(5);
+  printf("OurLoRa FEC bench: %d data blocks of %d bytes\n\n", K, BLOCK);
+  printf("%6s %12s %12s\n", "parity", "encode_MB/s", "decode_MB/s");
+  const int parities[] = { 1, 2, 4, 8 };
+  for (int i = 0; i < 4; i++) speed(parities[i]);
+
+  printf("\nmessages complete after one round (%d trials each)\n", TRIALS);
+  printf("%6s %9s", "parity", "overhead");
+  const double losses[] = { 0.05, 0.1, 0.2, 0.3 };
+  for (int l = 0; l < 4; l++) printf("  loss%3.0f%%", 100 * losses[l]);
+  printf("\n");
+  const int ms[] = { 0, 1, 2, 4 };
+  for (int i = 0; i < 4; i++) {
+    printf("%6d %8.0f%%", ms[i], 100.0 * ms[i] / K);
+    for (int l = 0; l < 4; l++) printf(" %8.1f%%", 100 * recovery(ms[i], losses[l]));
+    printf("\n");
+  }
+  printf("\nparity 1 is a plain XOR; decode time includes rebuilding `parity` lost blocks\n");
+  return 0;
+}
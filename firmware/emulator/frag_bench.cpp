@@ -0,0 +1,149 @@
+/*
+ * OurLoRa fragmentation benchmark
+ *
+ * A sub tank node sends MESSAGES blobs of MESSAGE_LEN bytes to the
+ * main tank while the air medium corrupts a share of all receptions.
+ * Compares sending each fragment once, resending the whole message
+ * until every fragment made it (told for free by the bench, so this
+ * is the best case for whole-message retry), and OurLoRaFragmenter,
+ * which resends only the fragments missing from the receiver's status
+ * (statuses go over the same lossy air), without and with FEC_PARITY
+ * parity fragments per message. Prints delivery ratio,
+ * frames on air per message and time per message. Time is virtual,
+ * so results are repeatable.
+ *
+ * Build and run (from the repository root):
+ *   g++ -std=gnu++11 -O2 -I firmware/emulator \
+ *       firmware/emulator/frag_bench.cpp -o frag_bench
+ *   ./frag_bench
+ */
+#include <Arduino.h>
+#include <SPI.h>
+
+#include "air_medium.h"
+#include "sx1278_model.h"
+
+#include "../ourlora_frag.h"
+
+using emu::AirMedium;
+using emu::Sx1278Model;
+
+static const uint8_t NODE_ID = 2;
+static const uint8_t GATEWAY_ID = 1;
+static const int MESSAGES = 20;
+static const uint16_t MESSAGE_LEN = 1500;  // A day of hourly history
+static const int FRAGMENTS = (MESSAGE_LEN + OURLORA_FRAG_SIZE - 1) / OURLORA_FRAG_SIZE;
+static const int MAX_ROUNDS = 20;          // Whole-message retry gives up after this
+static const int FEC_PARITY = 2;
+
+enum Mode { ONCE, WHOLE, SELECTIVE, SELECTIVE_FEC };
+
+struct Result {
+  int delivered;
+  double framesPerMessage;                 // Everything on air, statuses included
+  double secondsPerMessage;
+  uint32_t resent;                         // Fragments sent more than once
+};
+
+static Result run(Mode mode, double loss) {
+  emu::reset_world();
+  randomSeed(99);
+
+  AirMedium air;
+  air.lossRate = loss;
+  Sx1278Model gwChip(1, 2, 3), nodeChip(4, 5, 6);
+  air.attach(&gwChip);
+  air.attach(&nodeChip);
+  RuntimeLoRaRadio gateway(1, 2, 3), node(4, 5, 6);
+  gateway.setup(433);
+  node.setup(433);
+  gateway.enforce_duty_cycle(false);       // Measure the protocol, not the regulation
+  node.enforce_duty_cycle(false);
+  gateway.enable_interrupts();
+  emu::radio_task(gateway);
+  node.enable_interrupts();
+  emu::radio_task(node);
+  gateway.start_listening();
+  node.start_listening();
+
+  OurLoRaFragmenter<RuntimeLoRaRadio> gwFrag(gateway, GATEWAY_ID);
+  OurLoRaFragmenter<RuntimeLoRaRadio> nodeFrag(node, NODE_ID);
+  nodeFrag.set_fec(mode == SELECTIVE_FEC ? FEC_PARITY : 0);
+
+  static uint8_t message[MESSAGE_LEN];
+  Result r;
+  memset(&r, 0, sizeof(r));
+  uint32_t start = millis();
+  for (int m = 0; m < MESSAGES; m++) {
+    for (int i = 0; i < MESSAGE_LEN; i++) message[i] = m + i;
+
+    if (mode == ONCE || mode == WHOLE) {
+      // Fragments as raw frames: [index, data...]
+      bool have[FRAGMENTS] = { false };
+      int missing = FRAGMENTS;
+      for (int round = 0; round < (mode == ONCE ? 1 : MAX_ROUNDS) && missing > 0; round++) {
+        for (int i = 0; i < FRAGMENTS; i++) {
+          uint8_t frame[1 + OURLORA_FRAG_SIZE];
+          int n = MESSAGE_LEN - i * OURLORA_FRAG_SIZE;
+          if (n > OURLORA_FRAG_SIZE) n = OURLORA_FRAG_SIZE;
+          frame[0] = i;
+          memcpy(frame + 1, message + i * OURLORA_FRAG_SIZE, n);
+          node.send_a_msg(frame, 1 + n);
+          if (round > 0) r.resent++;
+          delay(1);
+          OurLoRaRxFrame f;
+          while (gateway.rx_pop(&f)) {
+            if (f.length > 0 && !have[f.data[0]]) {
+              have[f.data[0]] = true;
+              missing--;
+            }
+          }
+        }
+      }
+      if (missing == 0) r.delivered++;
+      continue;
+    }
+
+    nodeFrag.send(GATEWAY_ID, message, MESSAGE_LEN);
+    while (nodeFrag.busy()) {
+      OurLoRaRxFrame f;
+      const uint8_t *data;
+      uint8_t from;
+      while (gateway.rx_pop(&f)) {
+        int n = gwFrag.handle_frame(f.data, f.length, &data, &from);
+        if (n == MESSAGE_LEN && memcmp(data, message, n) == 0) r.delivered++;
+      }
+      while (node.rx_pop(&f)) {
+        nodeFrag.handle_frame(f.data, f.length, &data, &from);
+      }
+      nodeFrag.poll();
+      gwFrag.poll();
+      delay(1);
+    }
+  }
+
+  r.framesPerMessage = (double)air.stats.framesSent / MESSAGES;
+  r.secondsPerMessage = (millis() - start) / 1000.0 / MESSAGES;
+  if (mode >= SELECTIVE) r.resent = nodeFrag.stats().fragmentsResent;
+  emu::reset_world();  // Drop pending events before the radios go away
+  return r;
+}
+
+int main() {
+  printf("OurLoRa fragmentation bench: %d messages of %u bytes (%d fragments of %d), SF7 BW125\n\n",
+         MESSAGES, (unsigned)MESSAGE_LEN, FRAGMENTS, OURLORA_FRAG_SIZE);
+  printf("%5s %-10s %8s %9s %7s %7s\n", "loss", "mode", "deliv", "frames/m", "s/msg", "resent");
+
+  const double losses[] = { 0.0, 0.1, 0.3 };
+  const char *names[] = { "once", "whole", "selective", "sel+fec" };
+  for (unsigned i = 0; i < sizeof(losses) / sizeof(losses[0]); i++) {
+    for (int m = ONCE; m <= SELECTIVE_FEC; m++) {
+      Result r = run((Mode)m, losses[i]);
+      printf("%4.0f%% %-10s %7.1f%% %9.2f %7.2f %7u\n", 100 * losses[i], names[m],
+             100.0 * r.delivered / MESSAGES, r.framesPerMessage, r.secondsPerMessage, r.resent);
+    }
+  }
+  printf("\nloss = share of receptions corrupted; whole = resend every fragment until all arrived\n");
+  printf("sel+fec = selective with %d parity fragments per message\n", FEC_PARITY);
+  return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * OurLoRa FSK bulk transfer benchmark
+ *
+ * A sub tank node sends TRANSFER bytes of history to the main tank
+ * in 255-byte frames, once over LoRa SF7 BW125 and once in FSK packet
+ * mode at 50 and 250 kbit/s, both ends polling every POLL_US. Prints
+ * the transfer time, effective throughput, FIFO top-ups per packet
+ * (send and receive side) and how long switching between LoRa and FSK
+ * took. The second table slows down the polling at 250 kbit/s to show
+ * where the 64-byte FIFO runs dry (TX) or overflows (RX). Time is
+ * virtual, so results are repeatable.
+ *
+ * Build and run (from the repository root):
+ *   g++ -std=gnu++11 -O2 -I firmware/emulator \
+ *       firmware/emulator/fsk_bench.cpp -o fsk_bench
+ *   ./fsk_bench
+ */
+#include <Arduino.h>
+#include <SPI.h>
+
+#include "air_medium.h"
+#include "sx1278_model.h"
+
+#include "../ourlora.h"
+
+using emu::AirMedium;
+using emu::Sx1278Model;
+
+static const uint32_t TRANSFER = 16384;   // Two weeks of hourly history
+static const uint8_t FRAME = 255;
+static const uint32_t POLL_US = 100;
+
+struct Result {
+  uint32_t delivered;                      // Bytes with a good CRC
+  uint32_t frames;
+  double seconds;
+  double topUpsPerFrame;                   // Sender + receiver
+  uint32_t switchUs;                       // LoRa to FSK, profile written
+  uint32_t backUs;                         // FSK to LoRa
+  uint32_t reswitchUs;                     // LoRa to FSK, profile still loaded
+  uint32_t lost;                           // Frames sent but not received
+  uint32_t underruns;                      // Chip model: TX FIFO ran dry
+  uint32_t overruns;                       // Chip model: RX FIFO overflowed
+};
+
+static Result run(const OurLoRaFskProfile *fsk, uint32_t poll_us) {
+  emu::reset_world();
+  randomSeed(3);
+  SPI.chargeClock = false;                 // Two nodes, no shared bus
+
+  AirMedium air;
+  Sx1278Model tankChip(1, 2, 3), nodeChip(4, 5, 6);
+  air.attach(&tankChip);
+  air.attach(&nodeChip);
+  RuntimeLoRaRadio tank(1, 2, 3), node(4, 5, 6);
+  tank.setup(433);
+  node.setup(433);
+  node.enforce_duty_cycle(false);          // Measure the link, not the regulation
+  tank.enable_interrupts();
+  emu::radio_task(tank);
+  tank.start_listening();
+
+  Result r;
+  memset(&r, 0, sizeof(r));
+  if (fsk) {
+    SPI.chargeClock = true;                // Switch times include the SPI traffic
+    node.start_fsk(*fsk);
+    r.switchUs = node.fsk_stats().lastSwitchUs;
+    uint32_t t0 = micros();
+    node.stop_fsk();
+    r.backUs = micros() - t0;
+    node.start_fsk(*fsk);
+    r.reswitchUs = node.fsk_stats().lastSwitchUs;
+    SPI.chargeClock = false;
+    tank.start_fsk(*fsk);
+  }
+
+  static uint8_t history[TRANSFER];
+  for (uint32_t i = 0; i < TRANSFER; i++) history[i] = i * 7;
+  uint32_t start = micros();
+  uint32_t offset = 0;
+  while (offset < TRANSFER || node.fsk_transmitting() || tank.is_transmitting()) {
+    if (offset < TRANSFER) {
+      uint8_t n = TRANSFER - offset < FRAME ? TRANSFER - offset : FRAME;
+      bool started = fsk ? node.fsk_start_transmit(history + offset, n)
+                         : node.send_a_msg(history + offset, n);
+      if (started) {
+        offset += n;
+        r.frames++;
+      }
+    }
+    node.poll();
+    tank.poll();
+    OurLoRaRxFrame f;
+    while (tank.rx_pop(&f)) {
+      if (f.length > 0) r.delivered += f.length;
+    }
+    delayMicroseconds(poll_us);
+  }
+  // Let the receiver drain the last frame
+  for (int i = 0; i < 100; i++) {
+    tank.poll();
+    OurLoRaRxFrame f;
+    while (tank.rx_pop(&f)) {
+      if (f.length > 0) r.delivered += f.length;
+    }
+    delayMicroseconds(poll_us);
+  }
+  r.seconds = (micros() - start) / 1e6;
+
+  if (fsk) {
+    OurLoRaFskStats tx = node.fsk_stats(), rx = tank.fsk_stats();
+    r.topUpsPerFrame = (double)(tx.fifoTopUps + rx.fifoTopUps) / r.frames;
+    r.lost = r.frames - rx.received;
+    tank.stop_fsk();
+    node.stop_fsk();
+  }
+  r.underruns = nodeChip.counters.fskUnderruns;
+  r.overruns = tankChip.counters.fskOverruns;
+  emu::reset_world();  // Drop pending events before the radios go away
+  return r;
+}
+
+int main() {
+  printf("OurLoRa FSK bench: %u bytes in %u-byte frames, polling every %u us\n\n",
+         (unsigned)TRANSFER, FRAME, (unsigned)POLL_US);
+  printf("%-10s %8s %8s %9s %7s %9s %10s %8s %8s\n", "link", "deliv", "seconds", "kbit/s",
+         "frames", "topups/f", "to_fsk_us", "back_us", "again_us");
+
+  const OurLoRaFskProfile *links[] = { NULL, &FSK_PROFILE_433_50K, &FSK_PROFILE_433_250K };
+  const char *names[] = { "LoRa SF7", "FSK 50k", "FSK 250k" };
+  for (int i = 0; i < 3; i++) {
+    Result r = run(links[i], POLL_US);
+    printf("%-10s %7.1f%% %8.2f %9.1f %7u %9.2f %10u %8u %8u\n", names[i],
+           100.0 * r.delivered / TRANSFER, r.seconds, r.delivered * 8 / r.seconds / 1000,
+           (unsigned)r.frames, r.topUpsPerFrame, (unsigned)r.switchUs, (unsigned)r.backUs,
+           (unsigned)r.reswitchUs);
+  }
+
+  printf("\nFSK 250k with slower polling (FIFO holds %d bytes = %u us at 250 kbit/s)\n",
+         OURLORA_FSK_FIFO_SIZE, (unsigned)(OURLORA_FSK_FIFO_SIZE * 32));
+  printf("%8s %8s %9s %6s %10s %9s\n", "poll_us", "deliv", "kbit/s", "lost", "underruns",
+         "overruns");
+  const uint32_t polls[] = { 100, 500, 1000, 1500, 3000 };
+  for (unsigned i = 0; i < sizeof(polls) / sizeof(polls[0]); i++) {
+    Result r = run(&FSK_PROFILE_433_250K, polls[i]);
+    printf("%8u %7.1f%% %9.1f %6u %10u %9u\n", (unsigned)polls[i], 100.0 * r.delivered / TRANSFER,
+           r.delivered * 8 / r.seconds / 1000, (unsigned)r.lost, (unsigned)r.underruns,
+           (unsigned)r.overruns);
+  }
+  printf("\nto_fsk = first start_fsk(), back = stop_fsk(), again = start_fsk() with the FSK\n");
+  printf("registers still loaded; all with SPI at %u Hz\n", (unsigned)OURLORA_SPI_CLOCK_HZ);
+  printf("underrun = TX FIFO empty mid-packet (frame goes out corrupted, CRC error at the receiver)\n");
+  return 0;
+}
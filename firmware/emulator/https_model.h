@@ -0,0 +1,161 @@
+/*
+ * OurLoRa host emulator - HTTPS server behind a TLS client
+ *
+ * Stands in for WiFiClientSecure talking to the Firebase REST API, in
+ * virtual time: connect() costs a TCP round trip plus a full TLS 1.2
+ * handshake (2 round trips + handshakeCpuMs of ESP32 crypto), every
+ * request one round trip plus serverMs once its last byte is in. The
+ * server answers a JSON body with 200 and echoes it (Content-Length,
+ * or chunked), anything else with 400, and keeps the connection open.
+ *
+ * Connection loss: the server closes connections idle for
+ * idleCloseMs (seen by connected()); with dropRate, idle() kills the
+ * connection silently - the next request goes out, nothing comes
+ * back, and the reset shows one round trip later.
+ */
+#ifndef OURLORA_EMU_HTTPS_MODEL_H
+#define OURLORA_EMU_HTTPS_MODEL_H
+
+#include <string>
+
+#include "Arduino.h"
+
+namespace emu {
+
+class HttpsModel : public Print {
+ public:
+  uint32_t rttMs = 40;             // WiFi + internet to the server
+  uint32_t handshakeCpuMs = 350;   // ECDHE + RSA-2048 verify on the ESP32
+  uint32_t serverMs = 25;
+  uint32_t idleCloseMs = 60000;    // 0 = never
+  double dropRate = 0.0;           // Per idle(): connection dies silently
+  bool chunked = false;            // Chunked responses
+
+  struct Stats {
+    uint32_t connects;
+    uint32_t requests;             // Complete requests the server saw
+    uint32_t badRequests;          // ... answered 400
+    uint64_t bodyBytes;            // Request bodies
+  };
+  Stats stats = {};
+  std::string lastBody;            // Body of the last complete request
+
+  int connect(const char *, uint16_t) {
+    stop();
+    delay(rttMs);                          // TCP SYN / SYN-ACK
+    delay(2 * rttMs + handshakeCpuMs);     // TLS 1.2 full handshake
+    up_ = true;
+    dead_ = false;
+    lastUs_ = now_us();
+    stats.connects++;
+    return 1;
+  }
+
+  uint8_t connected() {
+    if (up_ && !dead_ && idleCloseMs && now_us() > lastUs_ + (uint64_t)idleCloseMs * 1000) {
+      up_ = false;                         // FIN from the server
+    }
+    if (up_ && dead_ && deadSeenUs_ && now_us() >= deadSeenUs_) {
+      up_ = false;                         // RST came back
+    }
+    return up_ || in_.size() > inPos_;
+  }
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+
+  size_t write(const uint8_t *data, size_t length) override {
+    if (!connected()) return 0;
+    if (dead_) {
+      deadSeenUs_ = now_us() + rttMs * 1000;
+      return length;                       // Goes out, nobody answers
+    }
+    delayMicroseconds(length / 2);         // ~2 MB/s through TLS + WiFi
+    request_.append((const char *)data, length);
+    serve();
+    return length;
+  }
+
+  int available() {
+    if (now_us() < readyUs_) return 0;
+    return in_.size() - inPos_;
+  }
+
+  int read() {
+    if (!available()) return -1;
+    return (uint8_t)in_[inPos_++];
+  }
+
+  int read(uint8_t *buffer, size_t size) {
+    size_t n = available();
+    if (n > size) n = size;
+    memcpy(buffer, in_.data() + inPos_, n);
+    inPos_ += n;
+    return n;
+  }
+
+  void stop() {
+    up_ = false;
+    in_.clear();
+    inPos_ = 0;
+    request_.clear();
+  }
+
+  // Between requests: the connection may die without anyone noticing
+  void idle() {
+    if (up_ && rand_unit() < dropRate) {
+      dead_ = true;
+      deadSeenUs_ = 0;
+    }
+  }
+
+ private:
+  bool up_ = false;
+  bool dead_ = false;
+  uint64_t deadSeenUs_ = 0;
+  uint64_t lastUs_ = 0;
+  uint64_t readyUs_ = 0;
+  std::string request_;
+  std::string in_;
+  size_t inPos_ = 0;
+
+  // Answer once the whole request is in: echo the body, like Firebase
+  void serve() {
+    size_t end = request_.find("\r\n\r\n");
+    if (end == std::string::npos) return;
+    size_t at = request_.find("Content-Length: ");
+    size_t length = at == std::string::npos || at > end ? 0 : atoi(request_.c_str() + at + 16);
+    if (request_.size() < end + 4 + length) return;
+    std::string body = request_.substr(end + 4, length);
+    bool ok = (request_.compare(0, 4, "PUT ") == 0 || request_.compare(0, 6, "PATCH ") == 0) &&
+              body.size() > 0 && body[0] == '{' && body[body.size() - 1] == '}';
+    stats.requests++;
+    stats.bodyBytes += body.size();
+    if (!ok) stats.badRequests++;
+    lastBody = body;
+    request_.erase(0, end + 4 + length);
+
+    std::string response = ok ? "HTTP/1.1 200 OK\r\n" : "HTTP/1.1 400 Bad Request\r\n";
+    response += "Content-Type: application/json; charset=utf-8\r\n"
+                "Access-Control-Allow-Origin: *\r\n"
+                "Cache-Control: no-cache\r\n"
+                "Strict-Transport-Security: max-age=31556926; includeSubDomains; preload\r\n";
+    if (chunked) {
+      char size[16];
+      snprintf(size, sizeof(size), "%x\r\n", (unsigned)body.size());
+      response += "Transfer-Encoding: chunked\r\n\r\n";
+      response += size + body + "\r\n0\r\n\r\n";
+    } else {
+      response += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+      response += "Connection: keep-alive\r\n\r\n" + body;
+    }
+    in_.erase(0, inPos_);
+    inPos_ = 0;
+    in_ += response;
+    readyUs_ = now_us() + (uint64_t)(rttMs + serverMs) * 1000;
+    lastUs_ = readyUs_;
+  }
+};
+
+}  // namespace emu
+
+#endif  // OURLORA_EMU_HTTPS_MODEL_H
@@ -0,0 +1,302 @@
+/*
+ * Upload payload serializer benchmark
+ *
+ * Builds the main tank's Firebase status payload (master and slave
+ * objects, ~280 bytes) CYCLES times, with new sensor values every
+ * time, three ways: String-style concatenation as sendToFirebase()
+ * used to do (std::string temporaries here), snprintf into a static
+ * buffer, and JsonWriter with the field tables from main_tank.ino.
+ * Prints host time per payload, heap allocations per payload and how
+ * much the heap grew over the run (malloc is wrapped to count), then
+ * checks JsonWriter's numbers against printf and that streaming
+ * through a small staging buffer gives the same bytes.
+ *
+ * Build and run (from the repository root):
+ *   g++ -std=gnu++11 -O2 -I firmware/emulator \
+ *       firmware/emulator/json_bench.cpp -o json_bench
+ *   ./json_bench
+ */
+#include <Arduino.h>
+#include <malloc.h>
+
+#include <chrono>
+#include <string>
+
+#include "../main_tank_node/json_writer.h"
+
+// ============================================================
+//  HEAP ACCOUNTING (glibc: the executable's malloc wins)
+// ============================================================
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static uint64_t allocations = 0;
+static int64_t liveBytes = 0;
+
+extern "C" void *malloc(size_t size) {
+  void *p = __libc_malloc(size);
+  allocations++;
+  if (p) liveBytes += malloc_usable_size(p);
+  return p;
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+  void *p = __libc_calloc(count, size);
+  allocations++;
+  if (p) liveBytes += malloc_usable_size(p);
+  return p;
+}
+
+extern "C" void *realloc(void *ptr, size_t size) {
+  if (ptr) liveBytes -= malloc_usable_size(ptr);
+  void *p = __libc_realloc(ptr, size);
+  allocations++;
+  if (p) liveBytes += malloc_usable_size(p);
+  return p;
+}
+
+extern "C" void free(void *ptr) {
+  if (ptr) liveBytes -= malloc_usable_size(ptr);
+  __libc_free(ptr);
+}
+
+// ============================================================
+//  PAYLOAD (records and schemas as in main_tank.ino)
+// ============================================================
+
+typedef struct struct_message {
+  float   tdsPpm;
+  uint8_t waterQualityCode;
+  float   tankLevelPercent;
+  float   tankLevelCm;
+  float   flow1_Lmin;
+  float   flow2_Lmin;
+} struct_message;
+
+typedef struct {
+  float       tdsPpm;
+  const char *waterQuality;
+  float       tankLevelPercent;
+  float       tankLevelCm;
+} MasterReading;
+
+static const char *slaveQualityText(uint8_t code) {
+  switch (code) {
+    case 0:  return "Sensor Error / No Reading";
+    case 1:  return "Excellent Drinking Water";
+    case 2:  return "Good Quality Water";
+    case 3:  return "Average - Not Recommended";
+    case 4:  return "BAD Water (High TDS)";
+    default: return "Unknown Code";
+  }
+}
+
+static const JsonField MASTER_FIELDS[] = {
+  JSON_FIELD_FLOAT(MasterReading, tdsPpm, 1),
+  JSON_FIELD_TEXT(MasterReading, waterQuality),
+  JSON_FIELD_FLOAT(MasterReading, tankLevelPercent, 1),
+  JSON_FIELD_FLOAT(MasterReading, tankLevelCm, 1),
+};
+
+static const JsonField SLAVE_FIELDS[] = {
+  JSON_FIELD_FLOAT(struct_message, flow1_Lmin, 2),
+  JSON_FIELD_FLOAT(struct_message, flow2_Lmin, 2),
+  JSON_FIELD_FLOAT(struct_message, tdsPpm, 1),
+  JSON_FIELD_UINT8(struct_message, waterQualityCode),
+  JSON_FIELD_LOOKUP(struct_message, waterQualityCode, "waterQuality", slaveQualityText),
+  JSON_FIELD_FLOAT(struct_message, tankLevelPercent, 1),
+  JSON_FIELD_FLOAT(struct_message, tankLevelCm, 1),
+};
+
+static const int CYCLES = 100000;
+static const int INPUTS = 64;              // Distinct readings, cycled through
+
+static MasterReading masters[INPUTS];
+static struct_message slaves[INPUTS];
+
+static float uniform(float low, float high) {
+  return low + (high - low) * (random(1000000) / 1e6f);
+}
+
+static void makeInputs() {
+  for (int i = 0; i < INPUTS; i++) {
+    masters[i].tdsPpm = uniform(0, 900);
+    masters[i].waterQuality = i % 3 ? "Good Quality Water" : "Excellent Drinking Water";
+    masters[i].tankLevelPercent = uniform(0, 100);
+    masters[i].tankLevelCm = masters[i].tankLevelPercent;
+    slaves[i].tdsPpm = uniform(0, 900);
+    slaves[i].waterQualityCode = random(5);
+    slaves[i].tankLevelPercent = uniform(0, 100);
+    slaves[i].tankLevelCm = uniform(0, 150);
+    slaves[i].flow1_Lmin = uniform(0, 30);
+    slaves[i].flow2_Lmin = uniform(0, 30);
+  }
+}
+
+// ============================================================
+//  THE THREE BUILDERS
+// ============================================================
+
+// String(x, decimals) stand-in
+static std::string str(float x, int decimals) {
+  char tmp[24];
+  snprintf(tmp, sizeof(tmp), "%.*f", decimals, x);
+  return std::string(tmp);
+}
+
+static size_t buildConcat(const MasterReading &m, const struct_message &s, char *out) {
+  std::string json = "{";
+  json += "\"master\":{";
+  json += "\"tdsPpm\":"             + str(m.tdsPpm, 1)           + ",";
+  json += "\"waterQuality\":\""     + std::string(m.waterQuality) + "\",";
+  json += "\"tankLevelPercent\":"   + str(m.tankLevelPercent, 1) + ",";
+  json += "\"tankLevelCm\":"        + str(m.tankLevelCm, 1);
+  json += "}";
+  json += ",\"slave\":{";
+  json += "\"flow1_Lmin\":"        + str(s.flow1_Lmin, 2)       + ",";
+  json += "\"flow2_Lmin\":"        + str(s.flow2_Lmin, 2)       + ",";
+  json += "\"tdsPpm\":"            + str(s.tdsPpm, 1)           + ",";
+  json += "\"waterQualityCode\":"  + str(s.waterQualityCode, 0) + ",";
+  json += "\"waterQuality\":\""    + std::string(slaveQualityText(s.waterQualityCode)) + "\",";
+  json += "\"tankLevelPercent\":"  + str(s.tankLevelPercent, 1) + ",";
+  json += "\"tankLevelCm\":"       + str(s.tankLevelCm, 1);
+  json += "}";
+  json += "}";
+  memcpy(out, json.c_str(), json.size() + 1);
+  return json.size();
+}
+
+static size_t buildSnprintf(const MasterReading &m, const struct_message &s, char *out,
+                            size_t size) {
+  return snprintf(out, size,
+                  "{\"master\":{\"tdsPpm\":%.1f,\"waterQuality\":\"%s\",\"tankLevelPercent\":%.1f,"
+                  "\"tankLevelCm\":%.1f},\"slave\":{\"flow1_Lmin\":%.2f,\"flow2_Lmin\":%.2f,"
+                  "\"tdsPpm\":%.1f,\"waterQualityCode\":%u,\"waterQuality\":\"%s\","
+                  "\"tankLevelPercent\":%.1f,\"tankLevelCm\":%.1f}}",
+                  m.tdsPpm, m.waterQuality, m.tankLevelPercent, m.tankLevelCm, s.flow1_Lmin,
+                  s.flow2_Lmin, s.tdsPpm, s.waterQualityCode, slaveQualityText(s.waterQualityCode),
+                  s.tankLevelPercent, s.tankLevelCm);
+}
+
+// As buildStatusJson() in main_tank.ino
+static void buildStatusJson(JsonWriter &json, const MasterReading &m, const struct_message &s) {
+  json.begin_object();
+  json.key("master").begin_object();
+  json.fields(&m, MASTER_FIELDS, JSON_COUNT(MASTER_FIELDS));
+  json.end_object();
+  json.key("slave").begin_object();
+  json.fields(&s, SLAVE_FIELDS, JSON_COUNT(SLAVE_FIELDS));
+  json.end_object();
+  json.end_object();
+}
+
+static size_t buildWriter(const MasterReading &m, const struct_message &s, char *out,
+                          size_t size) {
+  JsonWriter json(out, size);
+  buildStatusJson(json, m, s);
+  json.finish();
+  return json.length();
+}
+
+// ============================================================
+//  RUNS
+// ============================================================
+
+enum Builder { CONCAT, SNPRINTF, WRITER };
+
+static void run(Builder b, const char *name) {
+  static char body[512];
+  size_t bytes = 0;
+  buildWriter(masters[0], slaves[0], body, sizeof(body));  // Warm up libc (locale, stdio)
+  buildSnprintf(masters[0], slaves[0], body, sizeof(body));
+  uint64_t allocBefore = allocations;
+  int64_t liveBefore = liveBytes;
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < CYCLES; i++) {
+    const MasterReading &m = masters[i % INPUTS];
+    const struct_message &s = slaves[i % INPUTS];
+    if (b == CONCAT) bytes += buildConcat(m, s, body);
+    if (b == SNPRINTF) bytes += buildSnprintf(m, s, body, sizeof(body));
+    if (b == WRITER) bytes += buildWriter(m, s, body, sizeof(body));
+  }
+  double ns = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() * 1e9;
+  printf("%-22s %8.0f %8.1f %9.2f %10lld\n", name, ns / CYCLES, (double)bytes / CYCLES,
+         (double)(allocations - allocBefore) / CYCLES, (long long)(liveBytes - liveBefore));
+}
+
+// Collects what a JsonWriter streams out
+class StringSink : public Print {
+public:
+  std::string data;
+  size_t writes = 0;
+  size_t write(uint8_t c) { data += (char)c; return 1; }
+  size_t write(const uint8_t *buffer, size_t size) {
+    data.append((const char *)buffer, size);
+    writes++;
+    return size;
+  }
+};
+
+int main() {
+  randomSeed(22);
+  makeInputs();
+  printf("Upload serializer bench: main tank status payload, %d payloads per builder\n\n", CYCLES);
+  printf("%-22s %8s %8s %9s %10s\n", "builder", "ns/json", "bytes", "allocs/j", "heap_delta");
+  run(CONCAT, "String concatenation");
+  run(SNPRINTF, "snprintf");
+  run(WRITER, "JsonWriter");
+
+  // Numbers: JsonWriter vs printf over random readings
+  const int NUMBERS = 1000000;
+  int differ[3] = { 0 }, ties[3] = { 0 };
+  char mine[32], ref[32];
+  for (int i = 0; i < NUMBERS; i++) {
+    float x = uniform(-1000, 100000);
+    for (int d = 0; d <= 2; d++) {
+      JsonWriter json(mine, sizeof(mine));
+      json.value(x, d);
+      json.finish();
+      snprintf(ref, sizeof(ref), "%.*f", d, x);
+      if (strcmp(mine, ref) == 0) continue;
+      differ[d]++;
+      // A tie (or the "-0" printf keeps) rounds differently, anything else is a bug
+      double scaled = fabs((double)x) * pow(10, d);
+      if (fabs(scaled - floor(scaled) - 0.5) < 1e-3 || strcmp(ref + (ref[0] == '-'), mine) == 0) {
+        ties[d]++;
+      } else if (differ[d] - ties[d] <= 3) {
+        printf("  MISMATCH %.9g d=%d: %s vs printf %s\n", x, d, mine, ref);
+      }
+    }
+  }
+  printf("\nnumbers vs printf (%d random values in -1000..100000):\n", NUMBERS);
+  for (int d = 0; d <= 2; d++) {
+    printf("  %d decimals: %d differ, %d of them within 0.001 of a tie or printf's \"-0\"\n", d,
+           differ[d], ties[d]);
+  }
+
+  // Streaming through a small staging buffer, and count-only mode
+  static char body[512];
+  size_t full = buildWriter(masters[1], slaves[1], body, sizeof(body));
+  StringSink sink;
+  char stage[32];
+  JsonWriter streamed(stage, sizeof(stage), &sink);
+  buildStatusJson(streamed, masters[1], slaves[1]);
+  streamed.finish();
+  JsonWriter counter(NULL, 0);
+  buildStatusJson(counter, masters[1], slaves[1]);
+  static char small[100];
+  JsonWriter tooSmall(small, sizeof(small));
+  buildStatusJson(tooSmall, masters[1], slaves[1]);
+  printf("\nstreamed via %u-byte stage: %s (%u writes); count-only length %s; "
+         "%u-byte buffer reports %s\n",
+         (unsigned)sizeof(stage), sink.data == body ? "identical" : "DIFFERENT",
+         (unsigned)sink.writes, counter.length() == full ? "matches" : "WRONG",
+         (unsigned)sizeof(small), tooSmall.finish() ? "ok (WRONG)" : "overflow");
+  printf("payload: %s\n", body);
+  printf("\nallocs/j = malloc calls per payload; heap_delta = bytes still allocated after the run\n");
+  printf("ties: JsonWriter rounds half away from zero, printf to the exact binary value\n");
+  return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * OurLoRa mesh routing benchmark
+ *
+ * A gateway and two rows of COLUMNS sub tanks, like tanks along a
+ * valley: each node hears the nodes next to it (strong), the ones
+ * diagonally next to it (weak, little SNR margin) and nothing further
+ * away, so only the first column reaches the gateway directly. Every
+ * node sends a report every REPORT_MS. Compares sending straight to
+ * the gateway with the mesh, and the mesh again with one relay failing
+ * half way through the run. Prints delivery and report latency per
+ * column (= hops). A last run loses 10% of all receptions (so some
+ * hop ACKs get lost and data is resent) while every node, together
+ * with its report, looks for a node that does not exist: the route
+ * request floods must not make the gateway accept a resent report
+ * twice. Time is virtual, so results are repeatable.
+ *
+ * Build and run (from the repository root):
+ *   g++ -std=gnu++11 -O2 -I firmware/emulator \
+ *       firmware/emulator/mesh_bench.cpp -o mesh_bench
+ *   ./mesh_bench
+ */
+#include <Arduino.h>
+#include <SPI.h>
+
+#include <set>
+#include <vector>
+
+#include "air_medium.h"
+#include "sx1278_model.h"
+
+#include "../ourlora_mesh.h"
+
+using emu::AirMedium;
+using emu::Sx1278Model;
+
+typedef OurLoRaMesh<RuntimeLoRaRadio> Mesh;
+
+static const int COLUMNS = 5;
+static const int NODES = 2 * COLUMNS;      // Node i: column i / 2, row i % 2
+static const uint8_t GATEWAY_ID = 1;
+static const int PAYLOAD = 24;             // Roughly one telemetry report
+static const uint32_t REPORT_MS = 60000;
+static const uint32_t RUN_MS = 1200000;
+static const int FAILING = 2;              // Row 0 relay of column 2
+static const double STRONG_DBM = -100;     // SNR 17 dB at SF7 BW125
+static const double WEAK_DBM = -121;       // SNR -4 dB, 3 dB above the floor
+static const uint8_t ABSENT_ID = 200;      // Flood run: nobody answers for it
+static const double FLOOD_LOSS = 0.1;
+
+enum Mode { DIRECT, MESH, MESH_FAILURE, MESH_FLOOD };
+
+struct Report {
+  uint8_t node;
+  uint16_t count;
+  uint32_t takenMs;
+};
+
+struct Column {
+  int sent;
+  int delivered;
+  double latencyMs;
+};
+
+struct Result {
+  Column col[COLUMNS];
+  int duplicates;                          // Reports the gateway application got twice
+  OurLoRaMeshStats mesh;                   // Summed over all nodes
+};
+
+static void add(OurLoRaMeshStats &sum, const OurLoRaMeshStats &s) {
+  sum.routeRequests += s.routeRequests;
+  sum.forwarded += s.forwarded;
+  sum.hopRetries += s.hopRetries;
+  sum.repairs += s.repairs;
+  sum.dropped += s.dropped;
+}
+
+static Result run(Mode mode) {
+  emu::reset_world();
+  randomSeed(2024);
+
+  AirMedium air;
+  air.defaultRssiDbm = -200;               // Out of range unless linked below
+  if (mode == MESH_FLOOD) air.lossRate = FLOOD_LOSS;
+  Sx1278Model gwChip(1, 2, 3);
+  air.attach(&gwChip);
+  RuntimeLoRaRadio gateway(1, 2, 3);
+  std::vector<Sx1278Model *> chips;
+  std::vector<RuntimeLoRaRadio *> radios;
+  for (int i = 0; i < NODES; i++) {
+    uint8_t cs = 10 + 3 * i;
+    chips.push_back(new Sx1278Model(cs, cs + 1, cs + 2));
+    air.attach(chips.back());
+    radios.push_back(new RuntimeLoRaRadio(cs, cs + 1, cs + 2));
+  }
+  for (int i = 0; i < NODES; i++) {
+    int c = i / 2, row = i % 2;
+    if (c == 0) air.setLinkBoth(chips[i], &gwChip, STRONG_DBM);
+    if (row == 0) air.setLinkBoth(chips[i], chips[i + 1], STRONG_DBM);
+    if (c + 1 < COLUMNS) {
+      air.setLinkBoth(chips[i], chips[i + 2], STRONG_DBM);
+      air.setLinkBoth(chips[i], chips[(c + 1) * 2 + (1 - row)], WEAK_DBM);
+    }
+  }
+
+  gateway.setup(433);
+  gateway.enforce_duty_cycle(false);       // Measure routing, not the regulation
+  gateway.enable_interrupts();
+  emu::radio_task(gateway);
+  gateway.start_listening();
+  Mesh gwMesh(gateway, GATEWAY_ID);
+  std::vector<Mesh *> mesh;
+  std::vector<uint32_t> due(NODES);
+  std::vector<uint16_t> count(NODES, 0);
+  for (int i = 0; i < NODES; i++) {
+    radios[i]->setup(433);
+    radios[i]->enforce_duty_cycle(false);
+    radios[i]->enable_interrupts();
+    emu::radio_task(*radios[i]);
+    radios[i]->start_listening();
+    mesh.push_back(new Mesh(*radios[i], i + 2));
+    due[i] = random(REPORT_MS);
+    if (mode == MESH_FLOOD) due[i] = REPORT_MS / 2 + i;  // All at once: bursts of floods
+  }
+
+  Result r;
+  memset(&r, 0, sizeof(r));
+  std::set<std::pair<int, int> > seen;
+  bool failed = false;
+  uint32_t start = millis();
+  while (millis() - start < RUN_MS) {
+    uint32_t now = millis() - start;
+    if (mode == MESH_FAILURE && !failed && now >= RUN_MS / 2) {
+      air.cutLink(chips[FAILING], &gwChip);  // Relay dies: nobody hears it
+      for (int i = 0; i < NODES; i++) {
+        if (i != FAILING) air.cutLink(chips[FAILING], chips[i]);
+      }
+      failed = true;
+    }
+
+    for (int i = 0; i < NODES; i++) {
+      if (failed && i == FAILING) continue;
+      if (now >= due[i]) {
+        Report rep = { (uint8_t)(i + 2), count[i]++, (uint32_t)millis() };
+        uint8_t frame[PAYLOAD] = { 0 };
+        memcpy(frame, &rep, sizeof(rep));
+        if (mode == DIRECT) {
+          radios[i]->send_a_msg(frame, sizeof(frame));
+        } else {
+          mesh[i]->send(GATEWAY_ID, frame, sizeof(frame));
+        }
+        if (mode == MESH_FLOOD) mesh[i]->send(ABSENT_ID, frame, sizeof(frame));
+        r.col[i / 2].sent++;
+        due[i] += REPORT_MS;
+      }
+      OurLoRaRxFrame f;
+      while (radios[i]->rx_pop(&f)) {
+        uint8_t payload[OURLORA_MESH_MAX_PAYLOAD], from;
+        if (mode != DIRECT) mesh[i]->handle_frame(f.data, f.length, f.rssi, f.snr, payload, &from);
+      }
+      if (mode != DIRECT) mesh[i]->poll();
+    }
+
+    OurLoRaRxFrame f;
+    while (gateway.rx_pop(&f)) {
+      uint8_t payload[OURLORA_MESH_MAX_PAYLOAD], from;
+      const uint8_t *data = f.data;
+      int n = f.length;
+      if (mode != DIRECT) {
+        n = gwMesh.handle_frame(f.data, f.length, f.rssi, f.snr, payload, &from);
+        data = payload;
+      }
+      if (n != PAYLOAD) continue;
+      Report rep;
+      memcpy(&rep, data, sizeof(rep));
+      if (seen.insert(std::make_pair((int)rep.node, (int)rep.count)).second) {
+        Column &c = r.col[(rep.node - 2) / 2];
+        c.delivered++;
+        c.latencyMs += f.timestampUs / 1000.0 - rep.takenMs;
+      } else {
+        r.duplicates++;
+      }
+    }
+    if (mode != DIRECT) gwMesh.poll();
+    delay(1);
+  }
+
+  for (int i = 0; i < NODES; i++) add(r.mesh, mesh[i]->stats());
+
+  emu::reset_world();  // Drop pending events before the radios go away
+  for (int i = 0; i < NODES; i++) {
+    delete mesh[i];
+    delete radios[i];
+    delete chips[i];
+  }
+  return r;
+}
+
+int main() {
+  printf("OurLoRa mesh bench: gateway + 2 x %d sub tanks, SF7 BW125, %d-byte report every %u s, "
+         "%u s per run\n\n", COLUMNS, PAYLOAD, (unsigned)(REPORT_MS / 1000), (unsigned)(RUN_MS / 1000));
+
+  Result direct = run(DIRECT);
+  Result mesh = run(MESH);
+  Result failure = run(MESH_FAILURE);
+  Result flood = run(MESH_FLOOD);
+
+  printf("%6s | %7s | %7s %9s | %7s %9s\n", "", "direct", "mesh", "", "relay", "fails");
+  printf("%6s | %7s | %7s %9s | %7s %9s\n", "column", "deliv", "deliv", "lat_ms", "deliv", "lat_ms");
+  for (int c = 0; c < COLUMNS; c++) {
+    const Column &d = direct.col[c], &m = mesh.col[c], &f = failure.col[c];
+    printf("%6d | %6.1f%% | %6.1f%% %9.0f | %6.1f%% %9.0f\n", c + 1, 100.0 * d.delivered / d.sent,
+           100.0 * m.delivered / m.sent, m.delivered ? m.latencyMs / m.delivered : 0,
+           100.0 * f.delivered / f.sent, f.delivered ? f.latencyMs / f.delivered : 0);
+  }
+  const Result *runs[3] = { &mesh, &failure, &flood };
+  const char *names[3] = { "mesh", "relay fails", "floods" };
+  for (int i = 0; i < 3; i++) {
+    const OurLoRaMeshStats &s = runs[i]->mesh;
+    printf("\n%s: %u route requests, %u forwarded, %u hop retries, %u repairs, %u dropped, "
+           "%d duplicates", names[i], s.routeRequests, s.forwarded, s.hopRetries, s.repairs,
+           s.dropped, runs[i]->duplicates);
+  }
+  int sent = 0, delivered = 0;
+  for (int c = 0; c < COLUMNS; c++) {
+    sent += flood.col[c].sent;
+    delivered += flood.col[c].delivered;
+  }
+  printf("\nfloods: %.0f%% loss, route requests for an absent node with every report, "
+         "%.1f%% delivered\n", 100 * FLOOD_LOSS, 100.0 * delivered / sent);
+  printf("\ncolumn n is n hops from the gateway; latency from report taken to gateway\n");
+  printf("duplicates = reports the gateway application got more than once\n");
+
+  bool ok = mesh.duplicates == 0 && failure.duplicates == 0 && flood.duplicates == 0;
+  printf("\n%s\n", ok ? "PASS: no report delivered twice"
+                      : "FAIL: resent reports reached the application twice");
+  return ok ? 0 : 1;
+}
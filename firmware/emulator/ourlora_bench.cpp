@@ -0,0 +1,362 @@
+/*
+ * OurLoRa host benchmark
+ *
+ * Runs firmware/ourlora.h against the SX1278 emulator and prints
+ * throughput, SPI cost and latency per scenario, then the link
+ * statistics the driver counted itself, then the SPI transactions,
+ * driver calls and bus time of single operations done byte-wise (as
+ * before transactions and bursts) and through the driver. Time is
+ * virtual, so results are deterministic and independent of the host
+ * CPU.
+ *
+ * Build and run (from the repository root):
+ *   g++ -std=gnu++11 -O2 -I firmware/emulator \
+ *       firmware/emulator/ourlora_bench.cpp -o ourlora_bench
+ *   ./ourlora_bench
+ */
+#include <Arduino.h>
+#include <SPI.h>
+
+#include "air_medium.h"
+#include "sx1278_model.h"
+
+#include "../ourlora.h"
+
+using emu::AirMedium;
+using emu::Sx1278Model;
+
+// ============================================================
+//  HELPERS
+// ============================================================
+
+struct Sample {
+  uint64_t spiTransactions, spiCalls, spiBytes, csFrames, startUs;
+};
+
+static Sample snapshot(const Sx1278Model &radio) {
+  Sample s;
+  s.spiTransactions = SPI.stats.transactions;
+  s.spiCalls = SPI.stats.calls;
+  s.spiBytes = SPI.stats.bytes;
+  s.csFrames = radio.counters.csFrames;
+  s.startUs = emu::now_us();
+  return s;
+}
+
+static void printHeader() {
+  printf("%-28s %6s %8s %9s %9s %8s %9s %9s\n", "scenario", "pkts", "pkt/s",
+         "spi_txn/p", "spi_call/p", "cs/p", "bytes/p", "lat_ms");
+}
+
+static void printRow(const char *name, const Sx1278Model &radio, const Sample &s, int pkts,
+                     double latencyMs) {
+  Sample e = snapshot(radio);
+  double secs = (e.startUs - s.startUs) / 1e6;
+  printf("%-28s %6d %8.1f %9.1f %9.1f %8.1f %9.1f %9.2f\n", name, pkts,
+         secs > 0 ? pkts / secs : 0, (double)(e.spiTransactions - s.spiTransactions) / pkts,
+         (double)(e.spiCalls - s.spiCalls) / pkts, (double)(e.csFrames - s.csFrames) / pkts,
+         (double)(e.spiBytes - s.spiBytes) / pkts, latencyMs);
+}
+
+static void printLatency(const char *name, const OurLoRaLatencyStats &l) {
+  printf("  %s latency: %u samples, min %.2f / mean %.2f / max %.2f ms\n", name,
+         (unsigned)l.count, l.minUs / 1000.0, l.meanUs / 1000.0, l.maxUs / 1000.0);
+}
+
+// What the driver itself counted over the whole run (link_stats())
+static void printLinkStats(const OurLoRaLinkStats &s) {
+  printf("\ndriver link stats over %.1f s:\n", s.elapsedMs / 1000.0);
+  printf("  TX %u ok, %u timeouts, airtime %u ms; RX %u ok, %u CRC errors, %u truncated, "
+         "%u overruns\n", (unsigned)s.txOk, (unsigned)s.txTimeouts, (unsigned)s.airtimeMs,
+         (unsigned)s.rxOk, (unsigned)s.crcErrors, (unsigned)s.truncated, (unsigned)s.rxOverruns);
+  printf("  mode writes: sleep %u, stdby %u, tx %u, rx %u\n", (unsigned)s.modeSwitches[MODE_SLEEP],
+         (unsigned)s.modeSwitches[MODE_STDBY], (unsigned)s.modeSwitches[MODE_TX],
+         (unsigned)s.modeSwitches[MODE_RX_CONTINUOUS]);
+  printLatency("TX", s.txLatency);
+  printLatency("RX", s.rxLatency);
+  printf("  RSSI histogram (%d dB bins from %d dBm):", OURLORA_STATS_RSSI_STEP,
+         OURLORA_STATS_RSSI_LOW);
+  for (int i = 0; i < OURLORA_STATS_RSSI_BINS; i++) printf(" %u", (unsigned)s.rssiHist[i]);
+  printf("\n  SNR histogram (%d dB bins from %d dB):", OURLORA_STATS_SNR_STEP, OURLORA_STATS_SNR_LOW);
+  for (int i = 0; i < OURLORA_STATS_SNR_BINS; i++) printf(" %u", (unsigned)s.snrHist[i]);
+  printf("\n");
+}
+
+// A radio driven straight through its registers (the "other end")
+static void peerListen(Sx1278Model &peer) {
+  peer.writeReg(Sx1278Model::RegFifoRxBase, 0x00);
+  peer.writeReg(Sx1278Model::RegOpMode, 0x80 | Sx1278Model::ModeRxCont);
+}
+
+static void peerSend(Sx1278Model &peer, const uint8_t *data, int len) {
+  peer.writeReg(Sx1278Model::RegOpMode, 0x80 | Sx1278Model::ModeStdby);
+  peer.loadFifo(data, len);
+  peer.writeReg(Sx1278Model::RegOpMode, 0x80 | Sx1278Model::ModeTx);
+}
+
+static const int PACKETS = 50;
+static const int PAYLOAD = 24;  // Roughly one telemetry report
+
+static uint64_t txEnqueuedUs[256];
+static double txLatencySumMs = 0;
+static int txCompleted = 0;
+
+static void onTxStatus(uint16_t id, uint8_t status) {
+  if (status == LORA_TX_OK) {
+    txLatencySumMs += (emu::now_us() - txEnqueuedUs[id & 0xFF]) / 1000.0;
+    txCompleted++;
+  }
+}
+
+// ============================================================
+//  SCENARIOS
+// ============================================================
+
+static void benchBlockingSend(Sx1278Model &me, Sx1278Model &peer) {
+  uint8_t payload[PAYLOAD];
+  memset(payload, 0xA5, sizeof(payload));
+  peerListen(peer);
+  Sample s = snapshot(me);
+  uint64_t busyUs = 0;
+  for (int i = 0; i < PACKETS; i++) {
+    uint64_t t0 = emu::now_us();
+    send_a_msg(payload, sizeof(payload));
+    busyUs += emu::now_us() - t0;
+  }
+  printRow("send_a_msg (polled)", me, s, PACKETS, busyUs / 1000.0 / PACKETS);
+}
+
+static void benchQueuedSend(Sx1278Model &me, Sx1278Model &peer) {
+  uint8_t payload[PAYLOAD];
+  memset(payload, 0x5A, sizeof(payload));
+  peerListen(peer);
+  on_lora_tx_status(onTxStatus);
+  txCompleted = 0;
+  txLatencySumMs = 0;
+  Sample s = snapshot(me);
+  uint64_t callerUs = 0;
+  int queued = 0;
+  while (txCompleted < PACKETS) {
+    while (queued < PACKETS && lora_tx_queue_depth() < OURLORA_TX_QUEUE_SIZE) {
+      uint64_t t0 = emu::now_us();
+      int id = lora_enqueue(payload, sizeof(payload));
+      callerUs += emu::now_us() - t0;
+      txEnqueuedUs[id & 0xFF] = t0;
+      queued++;
+    }
+    lora_poll();
+    delay(1);
+  }
+  printRow("lora_enqueue (DIO0)", me, s, PACKETS, txLatencySumMs / PACKETS);
+  printf("  caller blocked %.3f ms per enqueue\n", callerUs / 1000.0 / PACKETS);
+  on_lora_tx_status(NULL);
+}
+
+static void benchBurstReceive(Sx1278Model &me, Sx1278Model &peer) {
+  uint8_t payload[PAYLOAD];
+  start_listening();
+  Sample s = snapshot(me);
+  uint32_t overrunsBefore = lora_rx_overruns();
+  int received = 0;
+  double latencyMs = 0;
+  for (int i = 0; i < PACKETS; i++) {
+    memset(payload, i, sizeof(payload));
+    peerSend(peer, payload, sizeof(payload));
+    // Wait for this frame to leave the peer, then a short gap
+    while (peer.mode() == Sx1278Model::ModeTx) delay(1);
+    delay(2);
+    // Drain only every 10 packets, like a busy gateway loop
+    if (i % 10 == 9) {
+      OurLoRaRxFrame f;
+      while (lora_rx_pop(&f)) {
+        latencyMs += (emu::now_us() - f.timestampUs) / 1000.0;
+        received++;
+      }
+    }
+  }
+  printRow("burst RX ring (DIO0)", me, s, received, received ? latencyMs / received : 0);
+  printf("  overruns %u (ring size %d)\n", lora_rx_overruns() - overrunsBefore,
+         OURLORA_RX_RING_SIZE);
+}
+
+// ============================================================
+//  SPI ACCESS: BYTE-WISE VS BURST
+// ============================================================
+
+// Register access the way the driver did it before transactions and
+// bursts: CS by hand, one transfer() per byte, one frame per register
+static void legacyWrite(uint8_t address, uint8_t value) {
+  digitalWrite(LORA_CS_PIN, LOW);
+  SPI.transfer(address | 0x80);
+  SPI.transfer(value);
+  digitalWrite(LORA_CS_PIN, HIGH);
+}
+
+static uint8_t legacyRead(uint8_t address) {
+  digitalWrite(LORA_CS_PIN, LOW);
+  SPI.transfer(address & 0x7F);
+  uint8_t value = SPI.transfer(0x00);
+  digitalWrite(LORA_CS_PIN, HIGH);
+  return value;
+}
+
+static void legacyStartTransmit(const uint8_t *message, uint8_t length) {
+  legacyWrite(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_STDBY);
+  legacyWrite(REG_IRQ_FLAGS, 0xFF);
+  legacyWrite(REG_FIFO_ADDR_PTR, 0x00);
+  digitalWrite(LORA_CS_PIN, LOW);
+  SPI.transfer(REG_FIFO | 0x80);
+  for (int i = 0; i < length; i++) SPI.transfer(message[i]);
+  digitalWrite(LORA_CS_PIN, HIGH);
+  legacyWrite(REG_PAYLOAD_LENGTH, length);
+  legacyWrite(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_TX);
+}
+
+static int legacyReadFrame(uint8_t *buffer) {
+  uint8_t irqFlags = legacyRead(REG_IRQ_FLAGS);
+  legacyWrite(REG_IRQ_FLAGS, 0xFF);
+  if (!(irqFlags & IRQ_RX_DONE_MASK)) return 0;
+  legacyWrite(REG_FIFO_ADDR_PTR, legacyRead(REG_FIFO_RX_CURRENT_ADDR));
+  int length = legacyRead(REG_RX_NB_BYTES);
+  digitalWrite(LORA_CS_PIN, LOW);
+  SPI.transfer(REG_FIFO & 0x7F);
+  for (int i = 0; i < length; i++) buffer[i] = SPI.transfer(0x00);
+  digitalWrite(LORA_CS_PIN, HIGH);
+  legacyRead(REG_PKT_SNR_VALUE);
+  legacyRead(REG_PKT_RSSI_VALUE);
+  return length;
+}
+
+// Frequency, modem config 1/2 and preamble: what a profile switch moves
+static const uint8_t RETUNE_REGS[] = { REG_FRF_MSB, REG_FRF_MID, REG_FRF_LSB, REG_MODEM_CONFIG_1,
+                                       REG_MODEM_CONFIG_2, REG_PREAMBLE_MSB, REG_PREAMBLE_LSB };
+
+struct AccessRow {
+  const char *op, *access;
+  uint64_t transactions, calls, csFrames, bytes, busyNs;
+};
+
+static AccessRow accessRows[6];
+static int accessCount = 0;
+
+static void noteAccess(const char *op, const char *access, const Sx1278Model &radio,
+                       const Sample &s, uint64_t busyNs) {
+  Sample e = snapshot(radio);
+  AccessRow r = { op, access, e.spiTransactions - s.spiTransactions, e.spiCalls - s.spiCalls,
+                  e.csFrames - s.csFrames, e.spiBytes - s.spiBytes, SPI.stats.busyNs - busyNs };
+  accessRows[accessCount++] = r;
+}
+
+// Byte-wise and burst rows of the same operation next to each other
+static void printAccess() {
+  printf("%-22s %-10s %6s %6s %6s %6s %8s\n", "operation", "access", "txn", "calls", "cs",
+         "bytes", "bus_us");
+  int half = accessCount / 2;
+  for (int i = 0; i < half; i++) {
+    const AccessRow *pair[2] = { &accessRows[half + i], &accessRows[i] };
+    for (int j = 0; j < 2; j++) {
+      const AccessRow &r = *pair[j];
+      printf("%-22s %-10s %6llu %6llu %6llu %6llu %8.1f\n", r.op, r.access,
+             (unsigned long long)r.transactions, (unsigned long long)r.calls,
+             (unsigned long long)r.csFrames, (unsigned long long)r.bytes, r.busyNs / 1000.0);
+    }
+  }
+}
+
+static void waitWhileTx(const Sx1278Model &radio) {
+  while (radio.mode() == Sx1278Model::ModeTx) delay(1);
+}
+
+// Same operations through the pre-burst access pattern and the driver,
+// at the same SPI clock, so only the access pattern differs
+static void benchBusAccess(Sx1278Model &me, Sx1278Model &peer) {
+  uint8_t payload[PAYLOAD], buffer[255];
+  uint8_t retune[sizeof(RETUNE_REGS)];
+  memset(payload, 0x3C, sizeof(payload));
+  for (size_t i = 0; i < sizeof(RETUNE_REGS); i++) retune[i] = me.readReg(RETUNE_REGS[i]);
+
+  // Driver: transactions + bursts (interrupt mode, listening)
+  Sample s = snapshot(me);
+  uint64_t busyNs = SPI.stats.busyNs;
+  start_transmit(payload, sizeof(payload));
+  noteAccess("load FIFO + start TX", "burst", me, s, busyNs);
+  waitWhileTx(me);
+  delay(1);
+
+  OurLoRaRxFrame f;
+  s = snapshot(me);
+  busyNs = SPI.stats.busyNs;
+  peerSend(peer, payload, sizeof(payload));
+  waitWhileTx(peer);
+  while (!lora_rx_pop(&f)) delay(1);
+  noteAccess("read RX frame", "burst", me, s, busyNs);
+
+  s = snapshot(me);
+  busyNs = SPI.stats.busyNs;
+  write_lora_burst(REG_FRF_MSB, retune, 3);
+  write_lora_burst(REG_MODEM_CONFIG_1, retune + 3, 2);
+  write_lora_burst(REG_PREAMBLE_MSB, retune + 5, 2);
+  noteAccess("retune (7 registers)", "burst", me, s, busyNs);
+
+  // The same through byte-wise access, with the driver out of the way
+  disable_lora_interrupts();
+  SPI.setFrequency(OURLORA_SPI_CLOCK_HZ);
+  s = snapshot(me);
+  busyNs = SPI.stats.busyNs;
+  legacyStartTransmit(payload, sizeof(payload));
+  noteAccess("load FIFO + start TX", "byte-wise", me, s, busyNs);
+  waitWhileTx(me);
+
+  legacyWrite(REG_IRQ_FLAGS, 0xFF);
+  legacyWrite(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_RX_CONTINUOUS);
+  peerSend(peer, payload, sizeof(payload));
+  waitWhileTx(peer);
+  delay(1);
+  s = snapshot(me);
+  busyNs = SPI.stats.busyNs;
+  int length = legacyReadFrame(buffer);
+  noteAccess("read RX frame", "byte-wise", me, s, busyNs);
+
+  s = snapshot(me);
+  busyNs = SPI.stats.busyNs;
+  for (size_t i = 0; i < sizeof(RETUNE_REGS); i++) legacyWrite(RETUNE_REGS[i], retune[i]);
+  noteAccess("retune (7 registers)", "byte-wise", me, s, busyNs);
+
+  printf("\nSPI access per operation (%d-byte payload): byte-wise vs burst\n", PAYLOAD);
+  printAccess();
+  if (f.length != PAYLOAD || length != PAYLOAD || memcmp(buffer, f.data, PAYLOAD) != 0) {
+    printf("  (frames differ: burst %d bytes, byte-wise %d bytes)\n", f.length, length);
+  }
+}
+
+int main() {
+  AirMedium air;
+  Sx1278Model me(LORA_CS_PIN, LORA_RST_PIN, LORA_DIO0_PIN);
+  Sx1278Model peer(50, 51, 52);
+  air.attach(&me);
+  air.attach(&peer);
+
+  if (!setup_ourlora(433)) {
+    printf("setup_ourlora() failed against the emulator\n");
+    return 1;
+  }
+  peer.copyConfigFrom(me);
+
+  printf("OurLoRa bench: SF%d BW125 CR4/5, %d-byte payload, SPI %u Hz\n", me.sf(), PAYLOAD,
+         (unsigned)OURLORA_SPI_CLOCK_HZ);
+  printf("time on air %.2f ms\n\n", me.timeOnAirUs(PAYLOAD) / 1000.0);
+  printHeader();
+
+  benchBlockingSend(me, peer);
+  enable_lora_interrupts();
+  emu::radio_task(OurLoRa);
+  benchQueuedSend(me, peer);
+  benchBurstReceive(me, peer);
+
+  printf("\nshadowed writes skipped: %u, air: %llu frames, %llu collisions\n",
+         lora_shadow_skipped_writes(), (unsigned long long)air.stats.framesSent,
+         (unsigned long long)air.stats.collisions);
+  printLinkStats(get_link_stats());
+  benchBusAccess(me, peer);
+  return 0;
+}
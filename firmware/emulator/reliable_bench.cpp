@@ -0,0 +1,261 @@
+/*
+ * OurLoRa reliable transport benchmark
+ *
+ * A sub tank node sends a backlog of reports to the main tank while
+ * the air medium corrupts a share of all receptions (data and ACKs).
+ * Compares plain send_a_msg() with OurLoRaReliable in stop-and-wait
+ * (window 1) and windowed mode. Prints delivery ratio, duplicates
+ * seen by the application, frames on air per report and goodput.
+ * Then the node reboots mid-stream: the gateway still acknowledges the
+ * old session while the first frames of the new one are lost on air.
+ * Those frames must be resent, not freed by the stale ACK. In a second
+ * reboot only the first frame is lost; the gateway must still wait for
+ * it. Exits with 1 if any frame of a new session goes missing.
+ * Time is virtual, so results are repeatable.
+ *
+ * Build and run (from the repository root):
+ *   g++ -std=gnu++11 -O2 -I firmware/emulator \
+ *       firmware/emulator/reliable_bench.cpp -o reliable_bench
+ *   ./reliable_bench
+ */
+#include <Arduino.h>
+#include <SPI.h>
+
+#include <vector>
+
+#include "air_medium.h"
+#include "sx1278_model.h"
+
+#include "../ourlora_reliable.h"
+
+using emu::AirMedium;
+using emu::Sx1278Model;
+
+static const uint8_t NODE_ID = 2;
+static const uint8_t GATEWAY_ID = 1;
+static const int REPORTS = 200;
+static const int PAYLOAD = 24;             // Roughly one telemetry report
+static const uint32_t LIMIT_MS = 600000;   // Give up on a run after this
+
+enum Mode { PLAIN, STOP_AND_WAIT, WINDOWED };
+
+struct Result {
+  int delivered;                           // Distinct reports at the gateway
+  int duplicates;                          // Reports the application saw twice
+  double framesPerReport;                  // Everything on air, ACKs included
+  double seconds;
+  OurLoRaReliableStats tx;
+  uint32_t suppressed;                     // Duplicates the gateway dropped
+};
+
+static Result run(Mode mode, double loss) {
+  emu::reset_world();
+  randomSeed(777);
+
+  AirMedium air;
+  air.lossRate = loss;
+  Sx1278Model gwChip(1, 2, 3), nodeChip(4, 5, 6);
+  air.attach(&gwChip);
+  air.attach(&nodeChip);
+  RuntimeLoRaRadio gateway(1, 2, 3), node(4, 5, 6);
+  gateway.setup(433);
+  node.setup(433);
+  gateway.enforce_duty_cycle(false);       // Measure the protocol, not the regulation
+  node.enforce_duty_cycle(false);
+  gateway.enable_interrupts();
+  emu::radio_task(gateway);
+  node.enable_interrupts();
+  emu::radio_task(node);
+  gateway.start_listening();
+  node.start_listening();
+
+  OurLoRaReliable<RuntimeLoRaRadio> gwLink(gateway, GATEWAY_ID);
+  OurLoRaReliable<RuntimeLoRaRadio> nodeLink(node, NODE_ID);
+  nodeLink.set_window(mode == STOP_AND_WAIT ? 1 : OURLORA_REL_WINDOW);
+
+  std::vector<int> seen(REPORTS, 0);
+  uint8_t report[PAYLOAD] = { 0 };
+  int next = 0;
+  uint32_t start = millis();
+  while (millis() - start < LIMIT_MS) {
+    if (mode == PLAIN) {
+      if (next < REPORTS) {
+        report[0] = next;
+        report[1] = next >> 8;
+        node.send_a_msg(report, sizeof(report));
+        next++;
+      }
+    } else {
+      while (next < REPORTS) {
+        report[0] = next;
+        report[1] = next >> 8;
+        if (!nodeLink.send(GATEWAY_ID, report, sizeof(report))) break;
+        next++;
+      }
+    }
+
+    OurLoRaRxFrame f;
+    uint8_t payload[OURLORA_REL_MAX_PAYLOAD], from;
+    while (gateway.rx_pop(&f)) {
+      int n = f.length;
+      const uint8_t *data = f.data;
+      if (mode != PLAIN) {
+        n = gwLink.handle_frame(f.data, f.length, payload, &from);
+        data = payload;
+      }
+      if (n == PAYLOAD) seen[data[0] | (data[1] << 8)]++;
+    }
+    while (node.rx_pop(&f)) {
+      nodeLink.handle_frame(f.data, f.length, payload, &from);
+    }
+    gwLink.poll();
+    nodeLink.poll();
+
+    if (next == REPORTS && nodeLink.in_flight(GATEWAY_ID) == 0 && !gateway.is_transmitting()) {
+      break;
+    }
+    delay(1);
+  }
+
+  Result r;
+  r.seconds = (millis() - start) / 1000.0;
+  r.delivered = 0;
+  r.duplicates = 0;
+  for (int i = 0; i < REPORTS; i++) {
+    if (seen[i] > 0) r.delivered++;
+    if (seen[i] > 1) r.duplicates += seen[i] - 1;
+  }
+  r.framesPerReport = (double)air.stats.framesSent / REPORTS;
+  r.tx = nodeLink.stats();
+  r.suppressed = gwLink.stats().duplicates;
+  emu::reset_world();  // Drop pending events before the radios go away
+  return r;
+}
+
+// The node reboots after RESTART_AFTER reports. Either all its first
+// frames of the new session are lost, then a downlink from the gateway
+// carries an ACK for the old session - or only the very first frame is
+// lost and the gateway hears the new session start with a later one.
+// Returns the new reports delivered.
+static const int RESTART_AFTER = 100;
+static const int RESTART_REPORTS = OURLORA_REL_WINDOW;
+
+static int runRestart(bool onlyFirstLost) {
+  emu::reset_world();
+  randomSeed(778);
+
+  AirMedium air;
+  Sx1278Model gwChip(1, 2, 3), nodeChip(4, 5, 6);
+  air.attach(&gwChip);
+  air.attach(&nodeChip);
+  RuntimeLoRaRadio gateway(1, 2, 3), node(4, 5, 6);
+  gateway.setup(433);
+  node.setup(433);
+  gateway.enforce_duty_cycle(false);
+  node.enforce_duty_cycle(false);
+  gateway.enable_interrupts();
+  emu::radio_task(gateway);
+  node.enable_interrupts();
+  emu::radio_task(node);
+  gateway.start_listening();
+  node.start_listening();
+
+  OurLoRaReliable<RuntimeLoRaRadio> gwLink(gateway, GATEWAY_ID);
+  OurLoRaReliable<RuntimeLoRaRadio> *nodeLink =
+    new OurLoRaReliable<RuntimeLoRaRadio>(node, NODE_ID);
+
+  std::vector<int> seen(RESTART_AFTER + RESTART_REPORTS, 0);
+  uint8_t report[PAYLOAD] = { 0 };
+  int next = 0;
+  bool rebooted = false, downlinkSent = false, restored = false;
+  uint32_t start = millis();
+  while (millis() - start < LIMIT_MS) {
+    if (!rebooted && next == RESTART_AFTER && nodeLink->in_flight(GATEWAY_ID) == 0) {
+      delete nodeLink;                     // Reboot: new session, nothing in flight
+      nodeLink = new OurLoRaReliable<RuntimeLoRaRadio>(node, NODE_ID);
+      air.setLink(&nodeChip, &gwChip, -200);  // The gateway misses the first frames
+      rebooted = true;
+    }
+    int limit = !rebooted ? RESTART_AFTER
+              : (onlyFirstLost && !restored) ? RESTART_AFTER + 1
+              : RESTART_AFTER + RESTART_REPORTS;
+    while (next < limit) {
+      report[0] = next;
+      report[1] = next >> 8;
+      if (!nodeLink->send(GATEWAY_ID, report, sizeof(report))) break;
+      next++;
+    }
+    if (onlyFirstLost && rebooted && !restored && next == limit && !node.is_transmitting()) {
+      air.setLink(&nodeChip, &gwChip, air.defaultRssiDbm);  // The rest gets through
+      restored = true;
+    }
+    if (!onlyFirstLost && rebooted && !downlinkSent && next == limit && !node.is_transmitting()) {
+      uint8_t command[4] = { 0 };
+      gwLink.send(NODE_ID, command, sizeof(command));  // Carries the old session's ACK
+      downlinkSent = true;
+    }
+    if (downlinkSent && !restored && !gateway.is_transmitting()) {
+      air.setLink(&nodeChip, &gwChip, air.defaultRssiDbm);  // Before the retransmissions
+      restored = true;
+    }
+
+    OurLoRaRxFrame f;
+    uint8_t payload[OURLORA_REL_MAX_PAYLOAD], from;
+    while (gateway.rx_pop(&f)) {
+      int n = gwLink.handle_frame(f.data, f.length, payload, &from);
+      if (n == PAYLOAD) seen[payload[0] | (payload[1] << 8)]++;
+    }
+    while (node.rx_pop(&f)) {
+      nodeLink->handle_frame(f.data, f.length, payload, &from);
+    }
+    gwLink.poll();
+    nodeLink->poll();
+
+    if (restored && next == limit && nodeLink->in_flight(GATEWAY_ID) == 0 &&
+        !gateway.is_transmitting()) {
+      break;
+    }
+    delay(1);
+  }
+
+  int delivered = 0;
+  for (int i = RESTART_AFTER; i < RESTART_AFTER + RESTART_REPORTS; i++) {
+    if (seen[i] > 0) delivered++;
+  }
+  delete nodeLink;
+  emu::reset_world();
+  return delivered;
+}
+
+int main() {
+  printf("OurLoRa reliable transport bench: %d reports of %d bytes, SF7 BW125, window %d\n\n",
+         REPORTS, PAYLOAD, OURLORA_REL_WINDOW);
+  printf("%5s %-14s %8s %5s %9s %9s %7s %6s %6s %6s\n", "loss", "mode", "deliv", "dups",
+         "frames/r", "goodput/s", "retx", "sel", "gaveup", "supp");
+
+  const double losses[] = { 0.0, 0.1, 0.3 };
+  const char *names[] = { "plain", "stop-and-wait", "windowed" };
+  for (unsigned i = 0; i < sizeof(losses) / sizeof(losses[0]); i++) {
+    for (int m = PLAIN; m <= WINDOWED; m++) {
+      Result r = run((Mode)m, losses[i]);
+      printf("%4.0f%% %-14s %7.1f%% %5d %9.2f %9.2f %7u %6u %6u %6u\n", 100 * losses[i],
+             names[m], 100.0 * r.delivered / REPORTS, r.duplicates, r.framesPerReport,
+             r.delivered / r.seconds, r.tx.retransmits, r.tx.selectiveRetransmits,
+             r.tx.givenUp, r.suppressed);
+    }
+  }
+  printf("\nloss = share of receptions corrupted (data and ACKs); frames/r counts ACKs too\n");
+  printf("sel = resent because a later frame was ACKed, supp = duplicates the receiver dropped\n");
+
+  int stale = runRestart(false);
+  printf("\nnode reboot after %d reports, first frames lost, stale ACK on a downlink:\n",
+         RESTART_AFTER);
+  printf("  %d/%d reports of the new session delivered\n", stale, RESTART_REPORTS);
+  int first = runRestart(true);
+  printf("node reboot after %d reports, only the first frame lost:\n", RESTART_AFTER);
+  printf("  %d/%d reports of the new session delivered\n", first, RESTART_REPORTS);
+  bool ok = stale == RESTART_REPORTS && first == RESTART_REPORTS;
+  printf("\n%s\n", ok ? "PASS: every frame of the new session was delivered"
+                      : "FAIL: frames of the new session were freed before the gateway got them");
+  return ok ? 0 : 1;
+}
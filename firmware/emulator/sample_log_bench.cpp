@@ -0,0 +1,229 @@
+/*
+ * Store-and-forward sample log benchmark
+ *
+ * The main tank logs a 52-byte sample every SAMPLE_MS while WiFi is
+ * down and drains the log in batches of BATCH records once it is back,
+ * on a modelled NOR flash (erase to 0xFF, programming only clears
+ * bits, 45 ms per 4 KB sector erase). Runs: a short outage, the same
+ * with reboots, with power cuts tearing writes (each followed by a
+ * reboot), an outage longer than the ring holds, and a month of daily
+ * outages for wear. Every sample read back is checked against what
+ * was logged (content and order). Prints samples lost, dropped and
+ * torn, CRC failures found, append and mount times, upload requests
+ * and how evenly the sectors were erased. Time is virtual, so results
+ * are repeatable.
+ *
+ * Build and run (from the repository root):
+ *   g++ -std=gnu++11 -O2 -I firmware/emulator \
+ *       firmware/emulator/sample_log_bench.cpp -o sample_log_bench
+ *   ./sample_log_bench
+ */
+#include <Arduino.h>
+
+#include <vector>
+
+#define SAMPLE_LOG_MAX_SECTORS 64          // 256 KB ring for the bench
+#include "../main_tank_node/sample_log.h"
+
+static const uint32_t SECTORS = 64;
+static const uint32_t SAMPLE_MS = 5000;
+static const uint16_t BATCH = 8;
+static const uint32_t REQUEST_MS = 70;     // Keep-alive PATCH, see upload_bench
+
+// ============================================================
+//  NOR FLASH MODEL
+// ============================================================
+
+class NorFlash {
+public:
+  std::vector<uint8_t> mem;
+  std::vector<uint32_t> erases;
+  int32_t cutAfter = -1;                   // Power fails after this many bytes of the next write
+  bool dead = false;                       // Power is off until reboot
+
+  NorFlash(uint32_t sectors)
+    : mem(sectors * SAMPLE_LOG_SECTOR_SIZE, 0xFF), erases(sectors, 0) {}
+
+  bool read(uint32_t address, void *data, size_t length) {
+    delayMicroseconds(5 + length / 10);    // ~10 MB/s through the SPI flash API
+    memcpy(data, &mem[address], length);
+    return true;
+  }
+
+  bool write(uint32_t address, const void *data, size_t length) {
+    if (dead) return false;
+    if (cutAfter >= 0 && (size_t)cutAfter < length) {
+      length = cutAfter;
+      dead = true;
+    }
+    cutAfter = -1;
+    delayMicroseconds(20 + length * 3);    // Page program
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < length; i++) mem[address + i] &= bytes[i];
+    return !dead;
+  }
+
+  bool erase_sector(uint32_t address) {
+    if (dead) return false;
+    delay(45);
+    memset(&mem[address], 0xFF, SAMPLE_LOG_SECTOR_SIZE);
+    erases[address / SAMPLE_LOG_SECTOR_SIZE]++;
+    return true;
+  }
+
+  uint32_t size() {
+    return mem.size();
+  }
+};
+
+// ============================================================
+//  RUNS
+// ============================================================
+
+typedef struct {
+  uint32_t serial;                         // Sample number, checks order
+  uint32_t epoch;
+  uint32_t uptimeMs;
+  float values[9];
+  uint8_t fill[4];
+} Sample;                                  // 52 bytes, like main_tank's LoggedSample
+
+struct Scenario {
+  const char *name;
+  uint32_t outageS;                        // Per outage
+  uint32_t outages;
+  uint32_t onlineS;                        // Between outages
+  uint32_t rebootEvery;                    // Samples, 0 = never
+  uint32_t tearEvery;                      // Samples, 0 = never
+};
+
+struct Result {
+  uint32_t logged, delivered, lost, outOfOrder, torn;
+  uint32_t requests;
+  double appendMs, appendMaxMs, mountMs;
+  double drainS;                           // Longest backlog drain after an outage
+  SampleLogStats stats;                    // Summed over mounts (corrupt: most at one)
+  uint32_t eraseMin, eraseMax;
+};
+
+static void add(SampleLogStats *sum, const SampleLogStats &s) {
+  sum->appended += s.appended;
+  sum->consumed += s.consumed;
+  sum->dropped += s.dropped;
+  if (s.corrupt > sum->corrupt) sum->corrupt = s.corrupt;  // Seen again at every mount
+  sum->writeErrors += s.writeErrors;
+  sum->erases += s.erases;
+}
+
+static Result run(const Scenario &sc) {
+  emu::reset_world();
+  randomSeed(24);
+  NorFlash flash(SECTORS);
+  SampleLog<NorFlash> *log = new SampleLog<NorFlash>(flash);
+  log->begin();
+
+  Result r;
+  memset(&r, 0, sizeof(r));
+  uint32_t serial = 0, expect = 0, mounts = 1;
+  for (uint32_t o = 0; o < sc.outages; o++) {
+    // Offline: one sample per SAMPLE_MS into flash
+    for (uint32_t t = 0; t < sc.outageS * 1000; t += SAMPLE_MS) {
+      Sample s;
+      memset(&s, 0, sizeof(s));
+      s.serial = ++serial;
+      s.uptimeMs = millis();
+      for (int i = 0; i < 9; i++) s.values[i] = serial * 0.5f + i;
+
+      bool tear = sc.tearEvery && serial % sc.tearEvery == 0;
+      if (tear) flash.cutAfter = random(SAMPLE_LOG_HEADER_SIZE + sizeof(s));
+      unsigned long t0 = micros();
+      bool ok = log->append(&s, sizeof(s));
+      double ms = (micros() - t0) / 1000.0;
+      r.appendMs += ms;
+      if (ms > r.appendMaxMs) r.appendMaxMs = ms;
+      if (ok) r.logged++;
+      if (flash.dead) r.torn++;
+
+      if (flash.dead || (sc.rebootEvery && serial % sc.rebootEvery == 0)) {
+        add(&r.stats, log->stats());       // Reboot: mount again from flash
+        delete log;
+        flash.dead = false;
+        log = new SampleLog<NorFlash>(flash);
+        t0 = micros();
+        log->begin();
+        r.mountMs += (micros() - t0) / 1000.0;
+        mounts++;
+      }
+      delay(SAMPLE_MS - (micros() - t0) / 1000 % SAMPLE_MS);
+    }
+
+    // Online: drain in batches, one live upload per SAMPLE_MS in between
+    uint32_t start = millis();
+    while (millis() - start < sc.onlineS * 1000) {
+      if (log->depth()) {
+        SampleLogCursor c = log->cursor();
+        Sample s;
+        while (c.count < BATCH && log->next(&c, &s, sizeof(s)) == sizeof(s)) {
+          if (s.serial <= expect) r.outOfOrder++;
+          if (s.values[8] != s.serial * 0.5f + 8) r.outOfOrder++;
+          r.lost += s.serial - expect - 1;   // Skipped over: dropped or torn
+          expect = s.serial;
+          r.delivered++;
+        }
+        delay(REQUEST_MS);
+        r.requests++;
+        log->consume(c);
+        if (!log->depth()) {
+          double s = (millis() - start) / 1000.0;
+          if (s > r.drainS) r.drainS = s;
+        }
+        delay(REQUEST_MS);                 // Live upload of this period
+      } else {
+        delay(SAMPLE_MS);
+      }
+    }
+  }
+  r.lost += serial - expect;               // Never read back
+  add(&r.stats, log->stats());
+  r.appendMs /= serial;
+  r.mountMs = mounts > 1 ? r.mountMs / (mounts - 1) : log->stats().mountMs;
+  r.eraseMin = 0xFFFFFFFF;
+  for (uint32_t i = 0; i < SECTORS; i++) {
+    if (flash.erases[i] < r.eraseMin) r.eraseMin = flash.erases[i];
+    if (flash.erases[i] > r.eraseMax) r.eraseMax = flash.erases[i];
+  }
+  delete log;
+  return r;
+}
+
+int main() {
+  printf("Sample log bench: %u x 4 KB ring (%u slots, keeps >= %u samples = %.1f h at %u s), "
+         "batch %u\n\n", (unsigned)SECTORS, (unsigned)(SECTORS * 4096 / SAMPLE_LOG_SLOT_SIZE),
+         (unsigned)((SECTORS - 1) * 4096 / SAMPLE_LOG_SLOT_SIZE),
+         (SECTORS - 1) * 4096 / SAMPLE_LOG_SLOT_SIZE * SAMPLE_MS / 3.6e6, (unsigned)(SAMPLE_MS / 1000),
+         (unsigned)BATCH);
+  printf("%-24s %7s %7s %5s %7s %5s %6s %8s %8s %8s %7s %8s %9s\n", "run", "logged", "deliv",
+         "lost", "dropped", "torn", "crc", "app_ms", "app_max", "mount_ms", "reqs", "drain_s",
+         "erases");
+
+  const Scenario runs[] = {
+    { "2 h outage", 7200, 1, 1800, 0, 0 },
+    { "2 h outage, 10 reboots", 7200, 1, 1800, 144, 0 },
+    { "2 h outage, power cuts", 7200, 1, 1800, 0, 97 },
+    { "12 h outage (ring 5.6 h)", 43200, 1, 3600, 0, 0 },
+    { "30 days, 4 h a day", 14400, 30, 72000, 0, 0 },
+  };
+  for (unsigned i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+    Result r = run(runs[i]);
+    char erases[24];
+    snprintf(erases, sizeof(erases), "%u..%u", (unsigned)r.eraseMin, (unsigned)r.eraseMax);
+    printf("%-24s %7u %7u %5u %7u %5u %6u %8.2f %8.1f %8.1f %7u %8.0f %9s%s\n", runs[i].name,
+           (unsigned)r.logged, (unsigned)r.delivered, (unsigned)r.lost, (unsigned)r.stats.dropped,
+           (unsigned)r.torn, (unsigned)r.stats.corrupt, r.appendMs, r.appendMaxMs, r.mountMs,
+           (unsigned)r.requests, r.drainS, erases, r.outOfOrder ? "  OUT OF ORDER" : "");
+  }
+  printf("\nlost = samples never read back (dropped + torn); crc = torn slots found by CRC\n");
+  printf("app = append time (max includes a sector erase); drain = longest backlog drain online\n");
+  printf("erases = per-sector erase count, fewest..most\n");
+  return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * OurLoRa channel survey benchmark
+ *
+ * One TDMA gateway and NODES sub tank nodes start on the first
+ * channel of an 8-channel plan; every channel has its own interferer
+ * (bursty or steady, some strong enough to wipe out frames, some
+ * not). Every node sends a report every REPORT_MS. Compares staying
+ * on the start channel with the gateway surveying the plan in idle
+ * time and moving the network, once with all nodes following and once
+ * with one node out of range while the move is announced (it has to
+ * search the plan). Prints delivery, frames on air per delivered
+ * report (retransmissions included), receptions lost to interference
+ * and where the network ended up, then the gateway's survey table.
+ * Exits with 1 unless the survey sees the "50% bursts" channel as
+ * occupied and the quiet one as idle. Time is virtual, so results are
+ * repeatable.
+ *
+ * Build and run (from the repository root):
+ *   g++ -std=gnu++11 -O2 -I firmware/emulator \
+ *       firmware/emulator/survey_bench.cpp -o survey_bench
+ *   ./survey_bench
+ */
+#include <Arduino.h>
+#include <SPI.h>
+
+#include <set>
+#include <vector>
+
+#include "air_medium.h"
+#include "sx1278_model.h"
+
+#include "../ourlora_survey.h"
+#include "../ourlora_tdma.h"
+
+using emu::AirMedium;
+using emu::Sx1278Model;
+
+static const uint8_t GATEWAY_ID = 1;
+static const int NODES = 8;
+static const int PAYLOAD = 24;
+static const uint32_t REPORT_MS = 30000;
+static const uint32_t RUN_MS = 1800000;
+static const uint32_t AWAY_FROM_MS = 60000;  // Node 0 out of range in "away" mode
+static const uint32_t AWAY_FOR_MS = 300000;
+static const double LINK_DBM = -100;
+
+static const uint32_t PLAN[] = { 433175000UL, 433375000UL, 433575000UL, 433775000UL,
+                                 433975000UL, 434175000UL, 434375000UL, 434575000UL };
+static const int CHANNELS = sizeof(PLAN) / sizeof(PLAN[0]);
+
+struct Noise {
+  double dbm;
+  uint32_t periodUs, onUs;                 // periodUs 0 = steady
+  const char *what;
+};
+static const Noise NOISE[CHANNELS] = {
+  { -95, 1000000, 400000, "40% bursts, strong" },
+  { -103, 0, 0, "steady, strong" },
+  { -90, 2000000, 200000, "10% bursts, strong" },
+  { -95, 500000, 100000, "20% bursts, strong" },
+  { -200, 0, 0, "quiet" },
+  { -98, 4000000, 200000, "5% bursts, strong" },
+  { -112, 0, 0, "steady, weak" },
+  { -85, 1000000, 500000, "50% bursts, strong" },
+};
+
+enum Mode { FIXED, SURVEY, SURVEY_AWAY };
+
+struct Result {
+  uint32_t generated, delivered;
+  double framesPerReport;
+  uint64_t jammed;
+  uint32_t moves;
+  uint32_t finalHz;
+  double movedAtS;                         // Gateway's first move, -1 = never
+  uint32_t nodesOnFinal;                   // Nodes on the gateway's channel at the end
+  uint32_t hops;                           // Search hops, all nodes
+  OurLoRaChannelStats survey[CHANNELS];
+};
+
+static Result run(Mode mode) {
+  emu::reset_world();
+  randomSeed(11);
+  SPI.chargeClock = false;                 // Separate boards, no shared bus
+
+  AirMedium air;
+  air.defaultRssiDbm = LINK_DBM;
+  for (int c = 0; c < CHANNELS; c++) {
+    air.setInterference(_lora_frf(PLAN[c]), NOISE[c].dbm, NOISE[c].periodUs, NOISE[c].onUs);
+  }
+  Sx1278Model gwChip(1, 2, 3);
+  air.attach(&gwChip);
+  RuntimeLoRaRadio gateway(1, 2, 3);
+  gateway.setup(433);
+  gateway.enable_interrupts();
+  emu::radio_task(gateway);
+  gateway.start_listening();
+  OurLoRaTdmaGateway<RuntimeLoRaRadio> gw(gateway, GATEWAY_ID);
+  OurLoRaChannelSurvey<RuntimeLoRaRadio> survey(gateway, PLAN, CHANNELS);
+  if (mode != FIXED) gw.use_survey(&survey);
+
+  std::vector<Sx1278Model *> chips;
+  std::vector<RuntimeLoRaRadio *> radios;
+  std::vector<OurLoRaTdmaNode<RuntimeLoRaRadio> *> members;
+  for (int i = 0; i < NODES; i++) {
+    int cs = 10 + 3 * i;
+    chips.push_back(new Sx1278Model(cs, cs + 1, cs + 2));
+    air.attach(chips.back());
+    radios.push_back(new RuntimeLoRaRadio(cs, cs + 1, cs + 2));
+    radios[i]->setup(433);
+    radios[i]->enable_interrupts();
+    emu::radio_task(*radios[i]);
+    members.push_back(new OurLoRaTdmaNode<RuntimeLoRaRadio>(*radios[i], i + 2, GATEWAY_ID));
+    if (mode != FIXED) members[i]->set_channel_plan(PLAN, CHANNELS);
+  }
+
+  Result r;
+  memset(&r, 0, sizeof(r));
+  r.movedAtS = -1;
+  std::set<std::pair<int, int> > seen;
+  std::vector<uint32_t> due(NODES);
+  std::vector<uint16_t> count(NODES, 0);
+  uint32_t start = millis();
+  for (int i = 0; i < NODES; i++) due[i] = start + random(REPORT_MS);
+
+  while (millis() - start < RUN_MS) {
+    uint32_t now = millis();
+    for (int i = 0; i < NODES; i++) {
+      if ((int32_t)(now - due[i]) < 0) continue;
+      due[i] += REPORT_MS;
+      if (now - start > RUN_MS - 2 * REPORT_MS) continue;  // Not counted: too late to arrive
+      uint16_t rep[2] = { (uint16_t)i, count[i]++ };
+      uint8_t buf[PAYLOAD] = { 0 };
+      memcpy(buf, rep, sizeof(rep));
+      members[i]->send(buf, sizeof(buf));
+      r.generated++;
+    }
+
+    OurLoRaRxFrame f;
+    while (gateway.rx_pop(&f)) {
+      uint8_t payload[OURLORA_TDMA_MAX_PAYLOAD], from;
+      if (gw.handle_frame(f.data, f.length, payload, &from) != PAYLOAD) continue;
+      uint16_t rep[2];
+      memcpy(rep, payload, sizeof(rep));
+      if (seen.insert(std::make_pair((int)rep[0], (int)rep[1])).second) r.delivered++;
+    }
+    gw.poll();
+    if (r.movedAtS < 0 && gw.stats().channelMoves) r.movedAtS = (now - start) / 1000.0;
+
+    if (mode == SURVEY_AWAY && now - start == AWAY_FROM_MS) air.cutLink(&gwChip, chips[0]);
+    if (mode == SURVEY_AWAY && now - start == AWAY_FROM_MS + AWAY_FOR_MS) {
+      air.setLinkBoth(&gwChip, chips[0], LINK_DBM);
+    }
+    for (int i = 0; i < NODES; i++) {
+      while (radios[i]->rx_pop(&f)) members[i]->handle_frame(f.data, f.length, f.timestampUs);
+      members[i]->poll();
+    }
+    delay(1);
+  }
+
+  uint32_t sent = 0;
+  for (int i = 0; i < NODES; i++) {
+    OurLoRaTdmaNodeStats s = members[i]->stats();
+    sent += s.framesSent + s.joinRequests;
+    r.hops += s.channelHops;
+    if (radios[i]->profile().frequencyHz == gateway.profile().frequencyHz) r.nodesOnFinal++;
+  }
+  r.framesPerReport = r.delivered ? (double)sent / r.delivered : 0;
+  r.jammed = air.stats.jammed;
+  r.moves = gw.stats().channelMoves;
+  r.finalHz = gateway.profile().frequencyHz;
+  for (int c = 0; c < CHANNELS; c++) r.survey[c] = survey.channel(c);
+
+  emu::reset_world();  // Drop pending events before the radios go away
+  for (int i = 0; i < NODES; i++) {
+    delete members[i];
+    delete radios[i];
+    delete chips[i];
+  }
+  return r;
+}
+
+int main() {
+  printf("OurLoRa survey bench: TDMA gateway + %d nodes, SF7 BW125, link %.0f dBm, "
+         "report every %u s, %u s per run\n\n", NODES, LINK_DBM, (unsigned)(REPORT_MS / 1000),
+         (unsigned)(RUN_MS / 1000));
+  printf("%-12s %8s %9s %7s %6s %8s %10s %7s %5s\n", "mode", "deliv", "frames/r", "jammed",
+         "moves", "moved_s", "final_MHz", "nodes", "hops");
+
+  const char *names[] = { "fixed", "survey", "survey+away" };
+  Result last;
+  for (int m = FIXED; m <= SURVEY_AWAY; m++) {
+    Result r = run((Mode)m);
+    printf("%-12s %7.1f%% %9.2f %7llu %6u %8.0f %10.3f %4u/%-2d %5u\n", names[m],
+           100.0 * r.delivered / r.generated, r.framesPerReport, (unsigned long long)r.jammed,
+           (unsigned)r.moves, r.movedAtS, r.finalHz / 1e6, (unsigned)r.nodesOnFinal, NODES,
+           (unsigned)r.hops);
+    if (m == SURVEY) last = r;
+  }
+
+  printf("\ngateway survey (mode \"survey\", %d readings per sweep, one channel every %d ms of idle time)\n",
+         OURLORA_SURVEY_SAMPLES, OURLORA_TDMA_SURVEY_MS);
+  printf("%8s %-20s %9s %9s %9s %9s %6s %7s\n", "MHz", "interferer", "score_dBm", "last_dBm",
+         "peak_dBm", "floor_dBm", "busy", "sweeps");
+  bool ok = true;
+  for (int c = 0; c < CHANNELS; c++) {
+    const OurLoRaChannelStats &s = last.survey[c];
+    printf("%8.3f %-20s %9d %9d %9d %9d %5u%% %7u\n", s.frequencyHz / 1e6, NOISE[c].what,
+           s.scoreDbm, s.noiseDbm, s.peakDbm, s.quietDbm, s.occupancyPct, s.sweeps);
+    if (strcmp(NOISE[c].what, "50% bursts, strong") == 0 && s.occupancyPct == 0) ok = false;
+    if (strcmp(NOISE[c].what, "quiet") == 0 && s.occupancyPct != 0) ok = false;
+  }
+  printf("\nframes/r = frames the nodes sent (retries, keep-alives, joins) per delivered report\n");
+  printf("nodes = nodes on the gateway's channel at the end; hops = channels tried while searching\n");
+  printf("floor = channel's long-term noise floor; busy = share of readings %d dB above the\n"
+         "quietest floor of the plan, smoothed over sweeps\n", OURLORA_SURVEY_BUSY_DB);
+  printf("\n%s\n", ok ? "PASS: bursty channel seen as occupied, quiet channel as idle"
+                      : "FAIL: occupancy does not match the interferers");
+  return ok ? 0 : 1;
+}
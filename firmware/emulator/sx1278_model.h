@@ -0,0 +1,777 @@
+/*
+ * OurLoRa host emulator - SX1278 register-file model (LoRa + FSK)
+ *
+ * Models what the driver can observe over SPI:
+ *   - register file with datasheet reset values and burst access
+ *     (address auto-increment, FIFO access through REG_FIFO)
+ *   - 256-byte FIFO with FifoAddrPtr / TX base / RX base pointers
+ *   - IRQ flags (write-1-to-clear), IrqFlagsMask and DIO0 mapping
+ *   - TX timing computed from ModemConfig1/2/3 and preamble length
+ *   - RX continuous / RX single (symbol timeout) / CAD / sleep
+ *   - RX_NB_BYTES, FifoRxCurrentAddr, packet RSSI and SNR
+ *   - FSK packet mode (variable length): own register page, 64-byte
+ *     FIFO that drains / fills at the bit rate while the driver
+ *     streams, FifoLevel / FifoEmpty / FifoOverrun, PacketSent,
+ *     PayloadReady, CrcOk. An FSK TX FIFO that runs dry or an RX FIFO
+ *     that overflows spoils the packet. DIO pins are LoRa only.
+ *
+ * Frames travel through an Ether (see air_medium.h).
+ */
+#ifndef OURLORA_EMU_SX1278_MODEL_H
+#define OURLORA_EMU_SX1278_MODEL_H
+
+#include <math.h>
+#include <string.h>
+
+#include <vector>
+
+#include "emu_core.h"
+
+namespace emu {
+
+class Sx1278Model;
+
+// One frame on the air
+struct AirFrame {
+  Sx1278Model *from;
+  uint64_t startUs;
+  uint64_t preambleEndUs;  // latest time a receiver can still lock on
+  uint64_t endUs;
+  uint32_t frf;
+  uint8_t sf;
+  uint8_t bw;              // ModemConfig1 bandwidth code
+  uint8_t syncWord;
+  bool implicitHeader;
+  bool crcOn;
+  std::vector<uint8_t> payload;
+  // FSK frames: payload bytes stream from the sender while on air
+  bool fsk = false;
+  uint16_t bitrateReg = 0;
+  uint32_t fskSync = 0;
+};
+
+// What a radio needs from the medium
+class Ether {
+ public:
+  virtual ~Ether() {}
+  virtual void startTx(const AirFrame &frame) = 0;
+  // Called when a radio enters an RX mode (may lock onto a preamble)
+  virtual void radioListening(Sx1278Model *radio) = 0;
+  // Is anyone transmitting on this radio's channel right now, and
+  // has been for at least minOnAirUs?
+  virtual bool channelActive(Sx1278Model *radio, uint64_t minOnAirUs) = 0;
+  // Wideband RSSI (dBm) seen by this radio right now
+  virtual double rssiNow(Sx1278Model *radio) = 0;
+};
+
+class Sx1278Model : public SpiDevice {
+ public:
+  enum {
+    RegFifo = 0x00, RegOpMode = 0x01, RegFrfMsb = 0x06,
+    RegFifoAddrPtr = 0x0D, RegFifoTxBase = 0x0E, RegFifoRxBase = 0x0F,
+    RegFifoRxCurrent = 0x10, RegIrqFlagsMask = 0x11, RegIrqFlags = 0x12,
+    RegRxNbBytes = 0x13, RegRxHeaderCntMsb = 0x14, RegRxHeaderCntLsb = 0x15,
+    RegPktSnr = 0x19, RegPktRssi = 0x1A,
+    RegRssiValue = 0x1B, RegHopChannel = 0x1C, RegModemConfig1 = 0x1D,
+    RegModemConfig2 = 0x1E, RegSymbTimeoutLsb = 0x1F, RegPreambleMsb = 0x20,
+    RegPreambleLsb = 0x21, RegPayloadLength = 0x22, RegFifoRxByteAddr = 0x25,
+    RegModemConfig3 = 0x26, RegSyncWord = 0x39, RegDioMapping1 = 0x40,
+    RegVersion = 0x42
+  };
+  // FSK page (LongRangeMode = 0), 0x0D..0x3F
+  enum {
+    RegBitrateMsb = 0x02, RegBitrateLsb = 0x03, RegFskRssiValue = 0x11, RegRxBw = 0x12,
+    RegFskPreambleMsb = 0x25, RegFskPreambleLsb = 0x26, RegSyncConfig = 0x27,
+    RegSyncValue1 = 0x28, RegPacketConfig1 = 0x30, RegFifoThresh = 0x35,
+    RegIrqFlags1 = 0x3E, RegIrqFlags2 = 0x3F
+  };
+  enum {
+    Irq2FifoFull = 0x80, Irq2FifoEmpty = 0x40, Irq2FifoLevel = 0x20, Irq2FifoOverrun = 0x10,
+    Irq2PacketSent = 0x08, Irq2PayloadReady = 0x04, Irq2CrcOk = 0x02
+  };
+  enum { FskFifoSize = 64 };
+  enum {
+    IrqRxTimeout = 0x80, IrqRxDone = 0x40, IrqCrcError = 0x20,
+    IrqValidHeader = 0x10, IrqTxDone = 0x08, IrqCadDone = 0x04,
+    IrqCadDetected = 0x01
+  };
+  enum {
+    ModeSleep = 0, ModeStdby = 1, ModeTx = 3, ModeRxCont = 5,
+    ModeRxSingle = 6, ModeCad = 7
+  };
+
+  struct Counters {
+    uint64_t csFrames;      // SPI frames (CS low .. CS high)
+    uint64_t regWrites;
+    uint64_t regReads;
+    uint64_t fifoBytes;
+    uint64_t txFrames;
+    uint64_t rxFrames;      // RxDone raised (good or CRC error)
+    uint64_t rxCrcErrors;
+    uint64_t rxTimeouts;
+    uint64_t cadRuns;
+    uint64_t modeUs[8];     // time spent per OpMode
+    uint64_t fskUnderruns;  // FSK TX FIFO ran dry mid-packet
+    uint64_t fskOverruns;   // FSK RX FIFO overflowed
+  };
+
+  int csPin, rstPin, dio0Pin;
+  Ether *ether;
+  Counters counters;
+  int dropDio0Edges = 0;    // Rising DIO0 edges still to lose (noise, bad wiring)
+
+  Sx1278Model(int cs, int rst, int dio0, Ether *medium = 0)
+      : csPin(cs), rstPin(rst), dio0Pin(dio0), ether(medium) {
+    memset(&counters, 0, sizeof(counters));
+    reset();
+    hook_pin(cs, [this](int level) { chipSelect(level == 0); });
+    hook_pin(rst, [this](int level) { if (level == 0) reset(); });
+  }
+
+  // ----------------------------------------------------------
+  //  Power-on / RST defaults (SX1276/77/78/79 datasheet)
+  // ----------------------------------------------------------
+  void reset() {
+    accountMode();
+    memset(_reg, 0, sizeof(_reg));
+    memset(_fifo, 0, sizeof(_fifo));
+    _reg[RegOpMode] = 0x09;            // FSK, LowFrequencyModeOn, STDBY
+    _reg[0x06] = 0x6C; _reg[0x07] = 0x80; _reg[0x08] = 0x00;
+    _reg[0x09] = 0x4F;
+    _reg[0x0A] = 0x09;
+    _reg[0x0B] = 0x2B;
+    _reg[0x0C] = 0x20;
+    _reg[RegFifoTxBase] = 0x80;
+    _reg[RegModemConfig1] = 0x72;
+    _reg[RegModemConfig2] = 0x70;
+    _reg[RegSymbTimeoutLsb] = 0x64;
+    _reg[RegPreambleLsb] = 0x08;
+    _reg[RegPayloadLength] = 0x01;
+    _reg[0x23] = 0xFF;
+    _reg[0x31] = 0xC3;
+    _reg[0x33] = 0x27;
+    _reg[0x37] = 0x0A;
+    _reg[RegSyncWord] = 0x12;
+    _reg[RegVersion] = 0x12;
+    _reg[0x4D] = 0x84;
+    _reg[RegBitrateMsb] = 0x1A;        // 4.8 kbit/s
+    _reg[RegBitrateLsb] = 0x0B;
+    _reg[0x05] = 0x52;                 // Fdev 5 kHz
+    memset(_fsk, 0, sizeof(_fsk));
+    _fsk[RegRxBw] = 0x15;
+    _fsk[0x13] = 0x0B;
+    _fsk[0x1F] = 0x40;
+    _fsk[RegFskPreambleLsb] = 0x03;
+    _fsk[RegSyncConfig] = 0x93;
+    for (int a = RegSyncValue1; a < RegSyncValue1 + 8; a++) _fsk[a] = 0x01;
+    _fsk[RegPacketConfig1] = 0x90;
+    _fsk[0x31] = 0x40;
+    _fsk[0x32] = 0x40;
+    _fsk[RegFifoThresh] = 0x0F;
+    fskClearFifo();
+    _generation++;
+    _receiving = false;
+    _selected = false;
+    updateDio0();
+  }
+
+  // ----------------------------------------------------------
+  //  SPI
+  // ----------------------------------------------------------
+  void chipSelect(bool sel) {
+    if (sel && !_selected) {
+      counters.csFrames++;
+      _expectAddr = true;
+      selected_device() = this;
+    } else if (!sel && _selected && selected_device() == this) {
+      selected_device() = 0;
+    }
+    _selected = sel;
+  }
+
+  uint8_t spiByte(uint8_t out) {
+    if (_expectAddr) {
+      _expectAddr = false;
+      _addr = out & 0x7F;
+      _write = (out & 0x80) != 0;
+      return 0;
+    }
+    if (_addr == RegFifo && !isLoRa()) {
+      counters.fifoBytes++;
+      if (_write) {
+        fskFifoWrite(out);
+        return 0;
+      }
+      return fskFifoRead();
+    }
+    if (_addr == RegFifo) {
+      counters.fifoBytes++;
+      uint8_t &ptr = _reg[RegFifoAddrPtr];
+      if (_write) {
+        _fifo[ptr++] = out;
+        return 0;
+      }
+      return _fifo[ptr++];
+    }
+    uint8_t a = _addr;
+    _addr = (_addr + 1) & 0x7F;
+    if (_write) {
+      counters.regWrites++;
+      writeReg(a, out);
+      return 0;
+    }
+    counters.regReads++;
+    return readReg(a);
+  }
+
+  // ----------------------------------------------------------
+  //  Register side effects
+  // ----------------------------------------------------------
+  uint8_t readReg(uint8_t a) {
+    if (!isLoRa() && a >= 0x0D && a <= 0x3F) return fskReadReg(a);
+    if (a == RegRssiValue && ether) {
+      double rssi = ether->rssiNow(this);
+      int v = (int)lround(rssi + rssiOffset());
+      return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+    return _reg[a];
+  }
+
+  void writeReg(uint8_t a, uint8_t v) {
+    if (!isLoRa() && a >= 0x0D && a <= 0x3F) {
+      fskWriteReg(a, v);
+      return;
+    }
+    switch (a) {
+      case RegOpMode:
+        setOpMode(v);
+        return;
+      case RegIrqFlags:
+        _reg[RegIrqFlags] &= ~v;
+        updateDio0();
+        return;
+      case RegIrqFlagsMask:
+      case RegDioMapping1:
+        _reg[a] = v;
+        updateDio0();
+        return;
+      case RegFifoRxCurrent:
+      case RegRxNbBytes:
+      case RegRxHeaderCntMsb:
+      case RegRxHeaderCntLsb:
+      case RegPktSnr:
+      case RegPktRssi:
+      case RegRssiValue:
+      case RegHopChannel:
+      case RegFifoRxByteAddr:
+      case RegVersion:
+        return;                         // read-only
+      default:
+        _reg[a] = v;
+    }
+  }
+
+  void setOpMode(uint8_t v) {
+    uint8_t oldMode = mode();
+    // LongRangeMode can only change in SLEEP (or on the way into it,
+    // as every LoRa driver's first write after reset does)
+    if ((v & 0x80) != (_reg[RegOpMode] & 0x80) && oldMode != ModeSleep && (v & 0x07) != ModeSleep) {
+      v = (v & 0x7F) | (_reg[RegOpMode] & 0x80);
+    }
+    accountMode();
+    _reg[RegOpMode] = v;
+    uint8_t m = mode();
+    if (m == oldMode && m != ModeTx && m != ModeCad) return;
+    _generation++;
+    if (m != ModeRxCont && m != ModeRxSingle) _receiving = false;
+    if (m == ModeSleep) _reg[RegRxHeaderCntMsb] = _reg[RegRxHeaderCntLsb] = 0;  // Counters reset
+    if (!isLoRa()) {
+      fskSetMode(oldMode, m);
+      return;
+    }
+    switch (m) {
+      case ModeTx:
+        beginTx();
+        break;
+      case ModeRxCont:
+      case ModeRxSingle:
+        _reg[RegFifoRxByteAddr] = _reg[RegFifoRxBase];
+        if (m == ModeRxSingle) armSymbolTimeout();
+        if (ether) ether->radioListening(this);
+        break;
+      case ModeCad:
+        beginCad();
+        break;
+      default:
+        break;
+    }
+  }
+
+  // ----------------------------------------------------------
+  //  Modem parameters
+  // ----------------------------------------------------------
+  bool isLoRa() const { return (_reg[RegOpMode] & 0x80) != 0; }
+  uint8_t mode() const { return _reg[RegOpMode] & 0x07; }
+  uint8_t sf() const { return _reg[RegModemConfig2] >> 4; }
+  uint8_t bwCode() const { return _reg[RegModemConfig1] >> 4; }
+  uint8_t cr() const { return (_reg[RegModemConfig1] >> 1) & 0x07; }  // 1..4
+  bool implicitHeader() const { return _reg[RegModemConfig1] & 0x01; }
+  bool crcOn() const { return (_reg[RegModemConfig2] & 0x04) != 0; }
+  bool ldro() const { return (_reg[RegModemConfig3] & 0x08) != 0; }
+  uint8_t syncWord() const { return _reg[RegSyncWord]; }
+  uint16_t preamble() const { return (_reg[RegPreambleMsb] << 8) | _reg[RegPreambleLsb]; }
+  uint32_t frf() const { return ((uint32_t)_reg[0x06] << 16) | (_reg[0x07] << 8) | _reg[0x08]; }
+  double freqMhz() const { return frf() * 32.0 / 524288.0; }
+  bool receiving() const { return mode() == ModeRxCont || mode() == ModeRxSingle; }
+  uint8_t reg(uint8_t a) const { return _reg[a]; }
+
+  // Copy the modem setup of another radio (used for scripted peers)
+  void copyConfigFrom(const Sx1278Model &o) {
+    for (int a = 0x01; a < 0x80; a++) {
+      if (a == RegOpMode || a == RegIrqFlags || a == RegDioMapping1) continue;
+      _reg[a] = o._reg[a];
+    }
+    accountMode();
+    _reg[RegOpMode] = (o._reg[RegOpMode] & 0x80) | ModeStdby;
+    _generation++;
+  }
+
+  // Drive the chip directly, bypassing SPI (scripted peers)
+  void loadFifo(const uint8_t *data, int len) {
+    _reg[RegFifoAddrPtr] = _reg[RegFifoTxBase];
+    for (int i = 0; i < len; i++) _fifo[(uint8_t)(_reg[RegFifoTxBase] + i)] = data[i];
+    _reg[RegPayloadLength] = (uint8_t)len;
+  }
+  int readFifoPacket(uint8_t *out) const {
+    int len = _reg[RegRxNbBytes];
+    for (int i = 0; i < len; i++) out[i] = _fifo[(uint8_t)(_reg[RegFifoRxCurrent] + i)];
+    return len;
+  }
+
+  double bandwidthHz() const {
+    static const double bw[] = {7800, 10400, 15600, 20800, 31250,
+                                41700, 62500, 125000, 250000, 500000};
+    uint8_t c = bwCode();
+    return c < 10 ? bw[c] : 500000;
+  }
+
+  double symbolUs() const { return (double)(1u << sf()) / bandwidthHz() * 1e6; }
+
+  // Semtech AN1200.13 time on air, for this radio's current config
+  uint64_t timeOnAirUs(int payloadLen) const {
+    double tsym = symbolUs();
+    double tpre = (preamble() + 4.25) * tsym;
+    int s = sf();
+    int de = ldro() ? 1 : 0;
+    int ih = implicitHeader() ? 1 : 0;
+    double num = 8.0 * payloadLen - 4.0 * s + 28 + 16 * (crcOn() ? 1 : 0) - 20 * ih;
+    double den = 4.0 * (s - 2 * de);
+    double n = ceil(num / den) * (cr() + 4);
+    if (n < 0) n = 0;
+    return (uint64_t)(tpre + (8 + n) * tsym + 0.5);
+  }
+
+  // SX1276 sensitivity / demodulation floor per SF (dB SNR)
+  double requiredSnr() const {
+    if (!isLoRa()) return 10;                // FSK, modulation index ~1
+    static const double snr[] = {-5, -7.5, -10, -12.5, -15, -17.5, -20};
+    int s = sf();
+    return (s >= 6 && s <= 12) ? snr[s - 6] : -7.5;
+  }
+
+  double noiseFloorDbm() const {
+    return -174 + 10 * log10(isLoRa() ? bandwidthHz() : 2 * fskRxBwHz()) + 6;
+  }
+
+  // FSK modem parameters
+  uint16_t fskBitrateReg() const { return (_reg[RegBitrateMsb] << 8) | _reg[RegBitrateLsb]; }
+  double fskByteUs() const { return fskBitrateReg() / 4.0; }  // 8 bits / (32 MHz / reg)
+  double fskRxBwHz() const {                 // Single side, RxBwMant / RxBwExp
+    static const int mant[] = {16, 20, 24, 24};
+    return 32e6 / (mant[(_fsk[RegRxBw] >> 3) & 3] << ((_fsk[RegRxBw] & 7) + 2));
+  }
+  uint32_t fskSync() const {
+    if (!(_fsk[RegSyncConfig] & 0x10)) return 0;
+    uint32_t sync = 0;
+    for (int i = 0; i <= (_fsk[RegSyncConfig] & 7) && i < 4; i++) sync = (sync << 8) | _fsk[RegSyncValue1 + i];
+    return sync;
+  }
+  uint8_t fskReg(uint8_t a) const { return _fsk[a]; }
+
+  int rssiOffset() const { return freqMhz() < 525 ? 164 : 157; }
+
+  // ----------------------------------------------------------
+  //  Events from the medium
+  // ----------------------------------------------------------
+  // Medium: this radio locked onto a preamble (FSK: if the FIFO is free)
+  void lockReceive(uint64_t frameId, const AirFrame &f) {
+    if (!isLoRa()) {
+      if (_fskRxFrom) return;
+      _fskRxFrom = f.from;
+      _fskRxDataUs = f.startUs + (uint64_t)((f.from->fskPreambleBytes() + f.from->fskSyncBytes()) * fskByteUs());
+      _fskRxLen = f.from->_fskTx.empty() ? 1 : 1 + f.from->_fskTx[0];
+    }
+    _receiving = true;
+    _lockId = frameId;
+  }
+  bool locked() const { return _receiving; }
+  bool lockedOn(uint64_t frameId) const { return _receiving && _lockId == frameId; }
+
+  // Medium: frame finished. ok=false means collided / corrupted.
+  void deliver(const AirFrame &f, double rssiDbm, double snrDb, bool ok) {
+    if (!receiving() || !_receiving) return;
+    _receiving = false;
+    if (!isLoRa()) {
+      fskDeliver(f, ok);
+      return;
+    }
+    int len = implicitHeader() ? _reg[RegPayloadLength] : (int)f.payload.size();
+    bool crc = implicitHeader() ? crcOn() : f.crcOn;
+    if (implicitHeader() != f.implicitHeader) ok = false;
+    if (implicitHeader() && len != (int)f.payload.size()) ok = false;
+
+    uint8_t addr = _reg[RegFifoRxByteAddr];
+    _reg[RegFifoRxCurrent] = addr;
+    for (int i = 0; i < len; i++) {
+      uint8_t b = i < (int)f.payload.size() ? f.payload[i] : 0;
+      if (!ok && i == len / 2) b ^= 0x5A;  // corrupted payload
+      _fifo[(uint8_t)(addr + i)] = b;
+    }
+    _reg[RegFifoRxByteAddr] = (uint8_t)(addr + len);
+    _reg[RegRxNbBytes] = (uint8_t)len;
+    int r = (int)lround(rssiDbm + rssiOffset());
+    _reg[RegPktRssi] = (uint8_t)(r < 0 ? 0 : (r > 255 ? 255 : r));
+    if (snrDb > 10) snrDb = 10;              // Packet SNR saturates near +10 dB
+    int s4 = (int)lround(snrDb * 4);
+    _reg[RegPktSnr] = (uint8_t)(int8_t)(s4 < -128 ? -128 : (s4 > 127 ? 127 : s4));
+    _reg[RegHopChannel] = crc ? 0x40 : 0x00;
+    uint16_t headers = ((_reg[RegRxHeaderCntMsb] << 8) | _reg[RegRxHeaderCntLsb]) + 1;
+    _reg[RegRxHeaderCntMsb] = headers >> 8;
+    _reg[RegRxHeaderCntLsb] = headers & 0xFF;
+
+    uint8_t flags = IrqRxDone | IrqValidHeader;
+    if (!ok && crc) {
+      flags |= IrqCrcError;
+      counters.rxCrcErrors++;
+    }
+    counters.rxFrames++;
+    if (mode() == ModeRxSingle) {
+      accountMode();
+      _reg[RegOpMode] = (_reg[RegOpMode] & 0xF8) | ModeStdby;
+      _generation++;
+    }
+    raise(flags);
+  }
+
+  // Let the model account the time spent in each mode up to now
+  void accountMode() {
+    uint64_t t = now_us();
+    counters.modeUs[_reg[RegOpMode] & 0x07] += t - _modeSinceUs;
+    _modeSinceUs = t;
+  }
+
+ private:
+  uint8_t _reg[0x80];
+  uint8_t _fsk[0x40];                  // FSK page, 0x0D..0x3F
+  uint8_t _fifo[256];
+  bool _selected = false;
+  bool _expectAddr = false;
+  bool _write = false;
+  uint8_t _addr = 0;
+  bool _receiving = false;
+  uint64_t _lockId = 0;
+  bool _dio0 = false;
+  uint64_t _generation = 0;
+  uint64_t _modeSinceUs = 0;
+
+  // FSK packet engine. TX: every byte written to the FIFO for the
+  // current packet, length byte first; the chip takes byte i at
+  // _fskTxDataUs + i bytes. RX: byte i of the sender's stream is in
+  // the FIFO from _fskRxDataUs + (i + 1) bytes.
+  std::vector<uint8_t> _fskTx;
+  uint64_t _fskTxDataUs = 0;           // 0 = not on air
+  size_t _fskTxLen = 0;
+  bool _fskUnderrun = false;
+  Sx1278Model *_fskRxFrom = 0;         // Packet being received / read out
+  uint64_t _fskRxDataUs = 0;
+  size_t _fskRxLen = 0;
+  size_t _fskRxRead = 0;
+  std::vector<uint8_t> _fskRx;         // Sender's stream, kept after the end
+  bool _fskRxEnded = false;
+  uint8_t _fskFlags2 = 0;              // Latched: overrun, sent, ready, CRC
+
+  uint16_t fskPreambleBytes() const { return (_fsk[RegFskPreambleMsb] << 8) | _fsk[RegFskPreambleLsb]; }
+  int fskSyncBytes() const { return (_fsk[RegSyncConfig] & 0x10) ? (_fsk[RegSyncConfig] & 7) + 1 : 0; }
+
+  void fskClearFifo() {
+    _fskTx.clear();
+    _fskTxDataUs = 0;
+    _fskTxLen = 0;
+    _fskUnderrun = false;
+    _fskRxFrom = 0;
+    _fskRxRead = 0;
+    _fskRx.clear();
+    _fskRxEnded = false;
+    _fskFlags2 &= ~(Irq2FifoOverrun | Irq2PayloadReady | Irq2CrcOk);
+  }
+
+  // Bytes the TX side has taken from the FIFO by now
+  size_t fskTxTaken() const {
+    if (!_fskTxDataUs || now_us() < _fskTxDataUs) return 0;
+    size_t n = (size_t)((now_us() - _fskTxDataUs) / fskByteUs());
+    return n < _fskTxLen ? n : _fskTxLen;
+  }
+
+  // Bytes of the received packet that reached the FIFO by now
+  size_t fskRxArrived() const {
+    if (!_fskRxFrom) return 0;
+    if (_fskRxEnded) return _fskRxLen;
+    if (now_us() < _fskRxDataUs) return 0;
+    size_t n = (size_t)((now_us() - _fskRxDataUs) / fskByteUs());
+    return n < _fskRxLen ? n : _fskRxLen;
+  }
+
+  int fskFifoLevel() const {
+    if (_fskRxFrom) return (int)(fskRxArrived() - _fskRxRead);
+    size_t taken = fskTxTaken();
+    return (int)(_fskTx.size() - (taken < _fskTx.size() ? taken : _fskTx.size()));
+  }
+
+  void fskCheckUnderrun() {
+    if (_fskTxDataUs && fskTxTaken() > _fskTx.size() && !_fskUnderrun) {
+      _fskUnderrun = true;
+      counters.fskUnderruns++;
+    }
+  }
+
+  void fskCheckOverrun() {
+    if (_fskRxFrom && fskRxArrived() - _fskRxRead > FskFifoSize &&
+        !(_fskFlags2 & Irq2FifoOverrun)) {
+      _fskFlags2 |= Irq2FifoOverrun;
+      counters.fskOverruns++;
+    }
+  }
+
+  void fskFifoWrite(uint8_t v) {
+    if (_fskRxFrom) return;
+    fskCheckUnderrun();
+    if (fskFifoLevel() >= FskFifoSize) {
+      _fskFlags2 |= Irq2FifoOverrun;
+      return;
+    }
+    _fskTx.push_back(v);
+  }
+
+  uint8_t fskFifoRead() {
+    if (!_fskRxFrom) return 0;
+    fskCheckOverrun();
+    if (_fskRxRead >= fskRxArrived()) return 0;  // FifoEmpty: reads garbage
+    size_t i = _fskRxRead++;
+    const std::vector<uint8_t> &src = _fskRxEnded ? _fskRx : _fskRxFrom->_fskTx;
+    uint8_t b = i < src.size() ? src[i] : 0;
+    if (_fskRxEnded && _fskRxRead >= _fskRxLen) {
+      _fskRxFrom = 0;                    // Read out: PayloadReady clears,
+      _fskRxRead = 0;                    // the receiver restarts
+      _fskRx.clear();
+      _fskRxEnded = false;
+      _fskFlags2 &= ~(Irq2PayloadReady | Irq2CrcOk);
+      if (ether && mode() == ModeRxCont) ether->radioListening(this);
+    }
+    return b;
+  }
+
+  uint8_t fskReadReg(uint8_t a) {
+    if (a == RegIrqFlags1) {
+      return 0x80 | (mode() == ModeRxCont ? 0x40 : 0) | (mode() == ModeTx ? 0x20 : 0) |
+             (_receiving ? 0x03 : 0);
+    }
+    if (a == RegIrqFlags2) {
+      fskCheckUnderrun();
+      fskCheckOverrun();
+      int level = fskFifoLevel();
+      return _fskFlags2 | (level >= FskFifoSize ? Irq2FifoFull : 0) |
+             (level == 0 ? Irq2FifoEmpty : 0) |
+             (level > (_fsk[RegFifoThresh] & 0x3F) ? Irq2FifoLevel : 0);
+    }
+    if (a == RegFskRssiValue && ether) {
+      int v = (int)lround(-2 * ether->rssiNow(this));
+      return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+    return _fsk[a];
+  }
+
+  void fskWriteReg(uint8_t a, uint8_t v) {
+    if (a == RegIrqFlags2) {
+      if (v & Irq2FifoOverrun) fskClearFifo();  // Also empties the FIFO
+      return;
+    }
+    if (a == RegIrqFlags1 || a == RegFskRssiValue) return;
+    _fsk[a] = v;
+  }
+
+  void fskSetMode(uint8_t oldMode, uint8_t m) {
+    if (oldMode == ModeTx) _fskFlags2 &= ~Irq2PacketSent;
+    // Sleep, the end of a TX and an RX left mid-packet empty the FIFO;
+    // a packet already received stays readable until read out
+    bool rxAborted = oldMode == ModeRxCont && _fskRxFrom && !_fskRxEnded;
+    if (m == ModeSleep || oldMode == ModeTx || rxAborted || (m == ModeRxCont && !_fskRxFrom)) {
+      fskClearFifo();
+    }
+    if (m == ModeTx) {
+      fskBeginTx();
+    } else if (m == ModeRxCont && ether) {
+      ether->radioListening(this);
+    }
+  }
+
+  void fskBeginTx() {
+    _fskTxLen = _fskTx.empty() ? 1 : 1 + _fskTx[0];
+    bool crc = (_fsk[RegPacketConfig1] & 0x10) != 0;
+    AirFrame f;
+    f.from = this;
+    f.startUs = now_us();
+    _fskTxDataUs = f.startUs + (uint64_t)((fskPreambleBytes() + fskSyncBytes()) * fskByteUs());
+    f.endUs = _fskTxDataUs + (uint64_t)((_fskTxLen + (crc ? 2 : 0)) * fskByteUs());
+    uint16_t detect = fskPreambleBytes() > 2 ? fskPreambleBytes() - 2 : 1;
+    f.preambleEndUs = f.startUs + (uint64_t)(detect * fskByteUs());
+    f.frf = frf();
+    f.sf = 0;
+    f.bw = 0;
+    f.syncWord = 0;
+    f.implicitHeader = false;
+    f.crcOn = crc;
+    f.fsk = true;
+    f.bitrateReg = fskBitrateReg();
+    f.fskSync = fskSync();
+    counters.txFrames++;
+    if (ether) ether->startTx(f);
+    uint64_t gen = _generation;
+    schedule_at(f.endUs, [this, gen]() {
+      if (gen != _generation || mode() != ModeTx) return;
+      fskCheckUnderrun();
+      if (_fskTx.size() < _fskTxLen && !_fskUnderrun) {
+        _fskUnderrun = true;
+        counters.fskUnderruns++;
+      }
+      _fskFlags2 |= Irq2PacketSent;        // Stays in TX until the driver leaves
+    });
+  }
+
+  void fskDeliver(const AirFrame &f, bool ok) {
+    if (!_fskRxFrom || _fskRxFrom != f.from) return;
+    fskCheckOverrun();
+    Sx1278Model *from = _fskRxFrom;
+    bool intact = !from->_fskUnderrun && from->_fskTx.size() >= _fskRxLen;
+    _fskRx = from->_fskTx;
+    _fskRx.resize(_fskRxLen, 0);
+    _fskRxEnded = true;
+    counters.rxFrames++;
+    bool crcOk = ok && intact && !(_fskFlags2 & Irq2FifoOverrun);
+    if (!crcOk) counters.rxCrcErrors++;
+    _fskFlags2 |= Irq2PayloadReady | (crcOk ? Irq2CrcOk : 0);
+  }
+
+  void raise(uint8_t flags) {
+    _reg[RegIrqFlags] |= flags;
+    updateDio0();
+  }
+
+  void updateDio0() {
+    uint8_t map = _reg[RegDioMapping1] >> 6;
+    uint8_t src = map == 0 ? IrqRxDone : (map == 1 ? IrqTxDone : (map == 2 ? IrqCadDone : 0));
+    if (!isLoRa()) src = 0;
+    bool level = (_reg[RegIrqFlags] & src & ~_reg[RegIrqFlagsMask]) != 0;
+    if (level != _dio0) {
+      _dio0 = level;
+      if (level && dropDio0Edges > 0) {
+        dropDio0Edges--;        // The pin never rises, the MCU sees nothing
+        return;
+      }
+      drive_pin(dio0Pin, level ? 1 : 0);
+    }
+  }
+
+  void beginTx() {
+    int len = _reg[RegPayloadLength];
+    AirFrame f;
+    f.from = this;
+    f.startUs = now_us();
+    f.endUs = f.startUs + timeOnAirUs(len);
+    f.preambleEndUs = f.startUs + (uint64_t)((preamble() - 4 > 0 ? preamble() - 4 : 1) * symbolUs());
+    f.frf = frf();
+    f.sf = sf();
+    f.bw = bwCode();
+    f.syncWord = syncWord();
+    f.implicitHeader = implicitHeader();
+    f.crcOn = crcOn();
+    uint8_t base = _reg[RegFifoTxBase];
+    for (int i = 0; i < len; i++) f.payload.push_back(_fifo[(uint8_t)(base + i)]);
+    // Note: the driver sets FifoAddrPtr, the chip sends from TX base
+    counters.txFrames++;
+    if (ether) ether->startTx(f);
+    uint64_t gen = _generation;
+    schedule_at(f.endUs, [this, gen]() {
+      if (gen != _generation || mode() != ModeTx) return;
+      accountMode();
+      _reg[RegOpMode] = (_reg[RegOpMode] & 0xF8) | ModeStdby;
+      _generation++;
+      raise(IrqTxDone);
+    });
+  }
+
+  void armSymbolTimeout() {
+    uint16_t symbols = ((_reg[RegModemConfig2] & 0x03) << 8) | _reg[RegSymbTimeoutLsb];
+    uint64_t gen = _generation;
+    schedule_in((uint64_t)(symbols * symbolUs()), [this, gen]() {
+      if (gen != _generation || mode() != ModeRxSingle || _receiving) return;
+      counters.rxTimeouts++;
+      accountMode();
+      _reg[RegOpMode] = (_reg[RegOpMode] & 0xF8) | ModeStdby;
+      _generation++;
+      raise(IrqRxTimeout);
+    });
+  }
+
+  void beginCad() {
+    counters.cadRuns++;
+    uint64_t gen = _generation;
+    // CAD listens for ~2 symbols then correlates (AN1200.21)
+    schedule_in((uint64_t)(2 * symbolUs()), [this, gen]() {
+      if (gen != _generation || mode() != ModeCad) return;
+      // A frame that started during the last symbol is missed
+      bool busy = ether && ether->channelActive(this, (uint64_t)symbolUs());
+      accountMode();
+      _reg[RegOpMode] = (_reg[RegOpMode] & 0xF8) | ModeStdby;
+      _generation++;
+      raise(IrqCadDone | (busy ? IrqCadDetected : 0));
+    });
+  }
+};
+
+// How long a FreeRTOS task notified from the DIO0 interrupt takes to run
+#ifndef EMU_RADIO_TASK_WAKE_US
+#define EMU_RADIO_TASK_WAKE_US 50
+#endif
+
+// Wake the radio task: it runs once the node's code blocks, never in
+// the middle of one of its driver calls
+template <class Radio> void wake_radio_task(Radio *radio) {
+  schedule_in(EMU_RADIO_TASK_WAKE_US, [radio]() {
+    if (task_may_run()) radio->handle_dio0();
+    else wake_radio_task(radio);
+  });
+}
+
+/*
+ * Give a driver its own radio task, as each node in a bench has its own
+ * CPU: the DIO0 interrupt (via on_dio0()) wakes it, and it services the
+ * edge a task switch later. Without this a node only sees RxDone/TxDone
+ * when the bench loop gets round to calling into it.
+ */
+template <class Radio> void radio_task(Radio &radio) {
+  radio.on_dio0([](void *arg) { wake_radio_task(static_cast<Radio *>(arg)); }, &radio);
+}
+
+}  // namespace emu
+
+#endif  // OURLORA_EMU_SX1278_MODEL_H
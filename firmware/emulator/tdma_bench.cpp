@@ -0,0 +1,222 @@
+/*
+ * OurLoRa TDMA scaling benchmark
+ *
+ * One gateway and N sub tank nodes (N up to 200), every node sends a
+ * report every REPORT_MS with a random phase. Compares the beacon
+ * scheduled TDMA network with plain ALOHA (each report queued as soon
+ * as it is taken). Prints the delivery ratio next to how long the
+ * TDMA network took to join all nodes before it (delivery is measured
+ * once every node has its slot), report latency and how long each
+ * node's radio is in RX or TX. Time is virtual, so results are
+ * repeatable.
+ *
+ * 200 nodes need 600 pins, more than uint8_t pin numbers allow, so
+ * the radios use a wide pins policy (the emulator's pins are int).
+ * SPI time is not charged to the shared clock: 200 nodes reading the
+ * same beacon would otherwise queue up behind one another.
+ *
+ * Build and run (from the repository root):
+ *   g++ -std=gnu++11 -O2 -I firmware/emulator \
+ *       firmware/emulator/tdma_bench.cpp -o tdma_bench
+ *   ./tdma_bench
+ */
+#include <Arduino.h>
+#include <SPI.h>
+
+#include <algorithm>
+#include <set>
+#include <vector>
+
+#include "air_medium.h"
+#include "sx1278_model.h"
+
+#define OURLORA_TDMA_MAX_SLOTS 200
+#include "../ourlora_tdma.h"
+
+using emu::AirMedium;
+using emu::Sx1278Model;
+
+static const uint8_t GATEWAY_ID = 1;
+static const int PAYLOAD = 24;             // Roughly one telemetry report
+static const uint32_t REPORT_MS = 60000;
+static const uint32_t JOIN_LIMIT_MS = 1800000;
+static const uint32_t MEASURE_MS = 600000;
+static const uint32_t SETTLE_MS = 90000;   // Reports taken in the last 90 s are not counted
+
+// Pins beyond 255 for large emulated networks
+struct WidePins {
+  int csPin, rstPin, dio0Pin;
+  WidePins(int cs, int rst, int dio0) : csPin(cs), rstPin(rst), dio0Pin(dio0) {}
+  int cs() const   { return csPin; }
+  int rst() const  { return rstPin; }
+  int dio0() const { return dio0Pin; }
+};
+typedef OurLoRaRadio<WidePins> BenchRadio;
+
+struct Report {
+  uint16_t node;
+  uint16_t count;
+  uint32_t takenMs;
+  uint8_t counted;                         // Taken early enough to be measured
+};
+
+struct Result {
+  double joinS;                            // TDMA: until every node had a slot
+  uint32_t generated, delivered;
+  double meanLatencyMs, maxLatencyMs;
+  double radioOnPct;                       // Per node: RX + TX time
+  uint32_t periodMs;
+  uint64_t collisions;                     // While measuring (TDMA: joins done)
+};
+
+static uint64_t radioOnUs(Sx1278Model *chip) {
+  chip->accountMode();
+  return chip->counters.modeUs[3] + chip->counters.modeUs[5] + chip->counters.modeUs[6] +
+         chip->counters.modeUs[7];
+}
+
+static Result run(int nodes, bool tdma) {
+  emu::reset_world();
+  randomSeed(4242);
+
+  AirMedium air;
+  Sx1278Model gwChip(1, 2, 3);
+  air.attach(&gwChip);
+  BenchRadio gateway(WidePins(1, 2, 3));
+  gateway.setup(433);
+  gateway.enable_interrupts();
+  emu::radio_task(gateway);
+  gateway.start_listening();
+  OurLoRaTdmaGateway<BenchRadio> gw(gateway, GATEWAY_ID);
+
+  std::vector<Sx1278Model *> chips;
+  std::vector<BenchRadio *> radios;
+  std::vector<OurLoRaTdmaNode<BenchRadio> *> members;
+  std::vector<uint32_t> due(nodes);
+  std::vector<uint16_t> count(nodes, 0);
+  for (int i = 0; i < nodes; i++) {
+    int cs = 10 + 3 * i;
+    chips.push_back(new Sx1278Model(cs, cs + 1, cs + 2));
+    air.attach(chips.back());
+    radios.push_back(new BenchRadio(WidePins(cs, cs + 1, cs + 2)));
+    radios[i]->setup(433);
+    radios[i]->enable_interrupts();
+    emu::radio_task(*radios[i]);
+    members.push_back(new OurLoRaTdmaNode<BenchRadio>(*radios[i], i + 2, GATEWAY_ID));
+    if (!tdma) radios[i]->go_to_sleep();
+  }
+
+  Result r;
+  memset(&r, 0, sizeof(r));
+  std::set<std::pair<int, int> > seen;
+  std::vector<double> latencies;
+  uint32_t start = millis(), measureStart = 0;
+  std::vector<uint64_t> onStart(nodes);
+  uint64_t collisionsStart = 0;
+  bool measuring = !tdma;
+  if (measuring) {
+    measureStart = start;
+    for (int i = 0; i < nodes; i++) onStart[i] = radioOnUs(chips[i]);
+  }
+  for (int i = 0; i < nodes; i++) due[i] = start + random(REPORT_MS);
+
+  while (true) {
+    uint32_t now = millis();
+    if (!measuring) {
+      bool all = true;
+      for (int i = 0; i < nodes && all; i++) all = members[i]->slot() != OURLORA_TDMA_NO_SLOT;
+      if (all || now - start > JOIN_LIMIT_MS) {
+        measuring = true;
+        measureStart = now;
+        r.joinS = all ? (now - start) / 1000.0 : -1;
+        for (int i = 0; i < nodes; i++) {
+          due[i] = now + random(REPORT_MS);
+          onStart[i] = radioOnUs(chips[i]);
+        }
+        collisionsStart = air.stats.collisions;
+      }
+    }
+    if (measuring && now - measureStart >= MEASURE_MS) {
+      break;
+    }
+    for (int i = 0; i < nodes; i++) {
+      if (!measuring || (int32_t)(now - due[i]) < 0) continue;
+      due[i] += REPORT_MS;
+      Report rep = { (uint16_t)i, count[i]++, now, now - measureStart < MEASURE_MS - SETTLE_MS };
+      if (rep.counted) r.generated++;
+      uint8_t buf[PAYLOAD] = { 0 };
+      memcpy(buf, &rep, sizeof(rep));
+      if (tdma) members[i]->send(buf, sizeof(buf));
+      else radios[i]->enqueue(buf, sizeof(buf));
+    }
+
+    OurLoRaRxFrame f;
+    while (gateway.rx_pop(&f)) {
+      uint8_t payload[OURLORA_TDMA_MAX_PAYLOAD], from;
+      const uint8_t *data = f.data;
+      int n = f.length;
+      if (tdma) {
+        n = gw.handle_frame(f.data, f.length, payload, &from);
+        data = payload;
+      }
+      if (n != PAYLOAD || !measuring) continue;
+      Report rep;
+      memcpy(&rep, data, sizeof(rep));
+      if (!rep.counted || rep.takenMs < measureStart) continue;
+      if (seen.insert(std::make_pair((int)rep.node, (int)rep.count)).second) {
+        r.delivered++;
+        latencies.push_back(f.timestampUs / 1000.0 - rep.takenMs);
+      }
+    }
+    if (tdma) {
+      gw.poll();
+      for (int i = 0; i < nodes; i++) {
+        while (radios[i]->rx_pop(&f)) members[i]->handle_frame(f.data, f.length, f.timestampUs);
+        members[i]->poll();
+      }
+    }
+    delay(1);
+  }
+
+  uint64_t onUs = 0;
+  for (int i = 0; i < nodes; i++) onUs += radioOnUs(chips[i]) - onStart[i];
+  r.radioOnPct = 100.0 * onUs / nodes / (MEASURE_MS * 1000.0);
+  for (size_t i = 0; i < latencies.size(); i++) {
+    r.meanLatencyMs += latencies[i];
+    r.maxLatencyMs = std::max(r.maxLatencyMs, latencies[i]);
+  }
+  if (!latencies.empty()) r.meanLatencyMs /= latencies.size();
+  r.periodMs = tdma ? gw.stats().periodMs : 0;
+  r.collisions = air.stats.collisions - collisionsStart;
+
+  emu::reset_world();  // Drop pending events before the radios go away
+  for (int i = 0; i < nodes; i++) {
+    delete members[i];
+    delete radios[i];
+    delete chips[i];
+  }
+  return r;
+}
+
+int main() {
+  SPI.chargeClock = false;
+  printf("OurLoRa TDMA bench: 1 gateway, SF7 BW125, %d-byte report every %u s per node, "
+         "%u s measured\n\n", PAYLOAD, (unsigned)(REPORT_MS / 1000), (unsigned)(MEASURE_MS / 1000));
+  printf("%5s %-6s %8s %7s %9s %9s %9s %8s %6s\n", "nodes", "mac", "deliv", "join_s", "period_s",
+         "lat_avg_s", "lat_max_s", "radio_on", "coll");
+
+  const int sizes[] = { 10, 50, 100, 200 };
+  for (unsigned i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    for (int t = 0; t < 2; t++) {
+      Result r = run(sizes[i], t == 1);
+      printf("%5d %-6s %7.1f%% %7.1f %9.1f %9.2f %9.2f %7.2f%% %6llu\n", sizes[i],
+             t ? "tdma" : "aloha", r.generated ? 100.0 * r.delivered / r.generated : 0.0,
+             r.joinS, r.periodMs / 1000.0, r.meanLatencyMs / 1000,
+             r.maxLatencyMs / 1000, r.radioOnPct, (unsigned long long)r.collisions);
+    }
+  }
+  printf("\njoin_s = until every node had a slot, before the %u s measured\n",
+         (unsigned)(MEASURE_MS / 1000));
+  printf("radio_on = share of time a node's radio is in RX or TX (rest: sleep/standby)\n");
+  return 0;
+}
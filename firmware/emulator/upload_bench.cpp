@@ -0,0 +1,110 @@
+/*
+ * Firebase upload session benchmark
+ *
+ * The main tank PUTs its ~280-byte status payload every INTERVAL_MS
+ * for an hour to a modelled HTTPS server (https_model.h): every new
+ * connection costs a TCP connect and a full TLS 1.2 handshake, every
+ * request one round trip plus the server's time. Compares a new connection per upload (what
+ * HTTPClient begin()/end() did) with UploadSession keeping the
+ * connection open, also when the server drops idle connections or
+ * connections die silently (reset seen only on the next request).
+ * Prints delivery, upload latency, handshakes and retries, and how
+ * long WiFi was busy per upload. Time is virtual, so results are
+ * repeatable.
+ *
+ * Build and run (from the repository root):
+ *   g++ -std=gnu++11 -O2 -I firmware/emulator \
+ *       firmware/emulator/upload_bench.cpp -o upload_bench
+ *   ./upload_bench
+ */
+#include <Arduino.h>
+
+#include "https_model.h"
+
+#include "../main_tank_node/upload_session.h"
+
+using emu::HttpsModel;
+
+static const uint32_t INTERVAL_MS = 5000;
+static const int UPLOADS = 720;              // One hour
+static const char *HOST = "hydronet-monitor-default-rtdb.firebaseio.com";
+static const char *PATH = "/waterSystem/status.json?auth=0123456789abcdef0123456789abcdef01234567";
+
+struct ServerModel {
+  uint32_t idleCloseMs;                      // Server drops idle connections
+  double dropRate;                           // Silent resets between uploads
+  bool chunked;                              // Chunked responses
+};
+
+// ============================================================
+//  RUNS
+// ============================================================
+
+struct Result {
+  int ok;
+  double latencyMs;                          // put() call, handshake included
+  double busyMs;                             // Handshake + request time per upload
+  UploadSessionStats stats;
+  uint32_t badRequests;
+};
+
+static Result run(const ServerModel &server, bool keepAlive) {
+  emu::reset_world();
+  randomSeed(23);
+  HttpsModel tls;
+  tls.idleCloseMs = server.idleCloseMs;
+  tls.dropRate = server.dropRate;
+  tls.chunked = server.chunked;
+  UploadSession<HttpsModel> session(tls, HOST);
+
+  char body[300];
+  Result r;
+  memset(&r, 0, sizeof(r));
+  for (int i = 0; i < UPLOADS; i++) {
+    int n = snprintf(body, sizeof(body), "{\"master\":{\"tdsPpm\":%d.5,\"n\":%d}}", 100 + i % 50, i);
+    uint32_t t0 = millis();
+    int code = session.put(PATH, body, n);
+    r.latencyMs += millis() - t0;
+    if (code == 200) r.ok++;
+    if (!keepAlive) session.close();         // HTTPClient end()
+    delay(INTERVAL_MS - (millis() - t0) % INTERVAL_MS);
+    tls.idle();
+  }
+  r.stats = session.stats();
+  r.latencyMs /= UPLOADS;
+  r.busyMs = (double)(r.stats.handshakeMs + r.stats.requestMs) / UPLOADS;
+  r.badRequests = tls.stats.badRequests;
+  emu::reset_world();
+  return r;
+}
+
+int main() {
+  HttpsModel link;
+  printf("Upload session bench: %d uploads every %u s, RTT %u ms, TLS handshake CPU %u ms\n\n",
+         UPLOADS, (unsigned)(INTERVAL_MS / 1000), (unsigned)link.rttMs, (unsigned)link.handshakeCpuMs);
+  printf("%-28s %7s %8s %8s %10s %7s %7s %8s\n", "mode", "ok", "lat_ms", "busy_ms", "handshakes",
+         "reused", "stale", "failures");
+
+  struct Case {
+    const char *name;
+    ServerModel server;
+    bool keepAlive;
+  };
+  const Case cases[] = {
+    { "new connection per upload", { 60000, 0, false }, false },
+    { "keep-alive", { 60000, 0, false }, true },
+    { "keep-alive, chunked", { 60000, 0, true }, true },
+    { "keep-alive, 2% silent drops", { 60000, 0.02, false }, true },
+    { "keep-alive, server idle 4 s", { 4000, 0, false }, true },
+  };
+  for (unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    Result r = run(cases[i].server, cases[i].keepAlive);
+    printf("%-28s %6.1f%% %8.1f %8.1f %10u %7u %7u %8u%s\n", cases[i].name, 100.0 * r.ok / UPLOADS,
+           r.latencyMs, r.busyMs, (unsigned)r.stats.handshakes, (unsigned)r.stats.reused,
+           (unsigned)r.stats.staleRetries, (unsigned)r.stats.failures,
+           r.badRequests ? "  BAD REQUESTS" : "");
+  }
+  printf("\nlat = time in put(); busy = handshake + request time per upload (WiFi and CPU awake)\n");
+  printf("stale = reused connection was dead, request sent again on a new one\n");
+  return 0;
+}
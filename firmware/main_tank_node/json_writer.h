@@ -0,0 +1,434 @@
+/*
+ * JsonWriter - allocation-free JSON output for the upload path
+
+ * Builds JSON straight into a caller-supplied buffer (usually a
+ * static one) or, through that buffer, into any Print such as an
+ * HTTP client stream. No String, no heap, no printf: numbers are
+ * formatted with integer arithmetic. Records are described by
+ * compile-time field tables (quoted key, type, offset), so a whole
+ * struct goes out with one call and the keys never get rebuilt.
+ *
+ * Three ways to run it:
+ *   buffer only     - output in the buffer, ok() false if it overflowed
+ *   buffer + Print  - buffer is a staging area, flushed when full
+ *                     and by finish()
+ *   neither         - count only: length() is the size the same calls
+ *                     produce (e.g. for a Content-Length header)
+ *
+ * Example:
+ *   static char body[512];
+ *   JsonWriter json(body, sizeof(body));
+ *   json.begin_object();
+ *   json.key("master").begin_object();
+ *   json.fields(&master, MASTER_FIELDS, JSON_COUNT(MASTER_FIELDS));
+ *   json.end_object();
+ *   json.end_object();
+ *   if (json.finish()) http.PUT((uint8_t *)body, json.length());
+ */
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <Arduino.h>
+#include <stddef.h>
+
+// ============================================================
+//  FIELD TABLES
+// ============================================================
+#define JSON_MAX_DECIMALS  6
+
+// Field types
+#define JSON_FLOAT         0     // float, `decimals` after the point
+#define JSON_INT32         1     // int32_t
+#define JSON_UINT8         2     // uint8_t
+#define JSON_TEXT          3     // const char * (NULL = null)
+#define JSON_LOOKUP        4     // uint8_t code, written as lookup(code)
+
+typedef const char *(*JsonLookup)(uint8_t code);
+
+// One member of a record, see fields()
+typedef struct {
+  const char *key;                     // Quoted with the colon: "\"tdsPpm\":"
+  uint8_t type;                        // JSON_*
+  uint8_t decimals;                    // JSON_FLOAT only
+  uint16_t offset;                     // offsetof(record, member)
+  JsonLookup lookup;                   // JSON_LOOKUP only
+} JsonField;
+
+// Fails to compile if the member is not `bytes` long (wrong macro)
+#define JSON_SIZE_CHECK(Record, member, bytes) \
+  (0 * sizeof(char[sizeof(((Record *)0)->member) == (bytes) ? 1 : -1]))
+
+// Table entries, keyed by the member name
+#define JSON_FIELD_FLOAT(Record, member, decimals) \
+  { "\"" #member "\":", JSON_FLOAT, decimals, \
+    offsetof(Record, member) + JSON_SIZE_CHECK(Record, member, sizeof(float)), NULL }
+#define JSON_FIELD_INT32(Record, member) \
+  { "\"" #member "\":", JSON_INT32, 0, \
+    offsetof(Record, member) + JSON_SIZE_CHECK(Record, member, sizeof(int32_t)), NULL }
+#define JSON_FIELD_UINT8(Record, member) \
+  { "\"" #member "\":", JSON_UINT8, 0, \
+    offsetof(Record, member) + JSON_SIZE_CHECK(Record, member, 1), NULL }
+#define JSON_FIELD_TEXT(Record, member) \
+  { "\"" #member "\":", JSON_TEXT, 0, \
+    offsetof(Record, member) + JSON_SIZE_CHECK(Record, member, sizeof(const char *)), NULL }
+// A code member written as text under its own key, e.g. "waterQuality"
+#define JSON_FIELD_LOOKUP(Record, member, name, lookup) \
+  { "\"" name "\":", JSON_LOOKUP, 0, \
+    offsetof(Record, member) + JSON_SIZE_CHECK(Record, member, 1), lookup }
+
+#define JSON_COUNT(table) ((uint8_t)(sizeof(table) / sizeof((table)[0])))
+
+// ============================================================
+//  WRITER
+// ============================================================
+
+class JsonWriter {
+public:
+  /*
+   * Parameters:
+   *   buffer - Output (or staging area when out is set), NULL = count only
+   *   size   - Bytes in buffer, one is kept for the closing NUL
+   *            (a staging area needs at least 2)
+   *   out    - Optional sink the buffer is flushed into
+   */
+  JsonWriter(char *buffer, size_t size, Print *out = NULL)
+    : _buffer(buffer), _capacity(buffer && size ? size - 1 : 0), _out(_capacity ? out : NULL) {
+    _used = 0;
+    _length = 0;
+    _comma = false;
+    _failed = out && !_out;              // A Print needs a staging buffer
+    if (_buffer && size) {
+      _buffer[0] = '\0';
+    }
+  }
+
+  // ==========================================================
+  //  STRUCTURE
+  // ==========================================================
+
+  JsonWriter &begin_object() {
+    _separator();
+    _putc('{');
+    _comma = false;
+    return *this;
+  }
+
+  JsonWriter &end_object() {
+    _putc('}');
+    _comma = true;
+    return *this;
+  }
+
+  JsonWriter &begin_array() {
+    _separator();
+    _putc('[');
+    _comma = false;
+    return *this;
+  }
+
+  JsonWriter &end_array() {
+    _putc(']');
+    _comma = true;
+    return *this;
+  }
+
+  /*
+   * Object key; the value (or begin_object/begin_array) follows
+   * The name is written as is - keys are identifiers, not user text.
+   */
+  JsonWriter &key(const char *name) {
+    _separator();
+    _putc('"');
+    _puts(name);
+    _put("\":", 2);
+    _comma = false;
+    return *this;
+  }
+
+  // ==========================================================
+  //  VALUES
+  // ==========================================================
+
+  /*
+   * Fixed-point number with `decimals` digits after the point
+   * NaN, infinities and values beyond +-2e9 are written as null
+   * (JSON has no NaN). Rounds half away from zero.
+   *
+   * Example:
+   *   json.key("tdsPpm").value(231.46f, 1);  // "tdsPpm":231.5
+   */
+  JsonWriter &value(float number, uint8_t decimals) {
+    _separator();
+    _comma = true;
+    if (isnan(number) || isinf(number) || number >= 2e9f || number <= -2e9f) {
+      _put("null", 4);
+      return *this;
+    }
+    if (decimals > JSON_MAX_DECIMALS) {
+      decimals = JSON_MAX_DECIMALS;
+    }
+    bool negative = number < 0;
+    float magnitude = negative ? -number : number;
+    uint32_t whole = (uint32_t)magnitude;
+    uint32_t scale = _pow10(decimals);
+    uint32_t fraction = (uint32_t)((magnitude - whole) * scale + 0.5f);
+    if (fraction >= scale) {
+      whole++;                           // 9.96 with one decimal -> 10.0
+      fraction -= scale;
+    }
+    if (negative && (whole || fraction)) {
+      _putc('-');                        // No "-0.0"
+    }
+    _put_uint(whole, 1);
+    if (decimals) {
+      _putc('.');
+      _put_uint(fraction, decimals);
+    }
+    return *this;
+  }
+
+  JsonWriter &value(int32_t number) {
+    _separator();
+    _comma = true;
+    if (number < 0) {
+      _putc('-');
+      _put_uint(0 - (uint32_t)number, 1);
+    } else {
+      _put_uint(number, 1);
+    }
+    return *this;
+  }
+
+  /*
+   * Quoted string, escaped; NULL is written as null
+   */
+  JsonWriter &value(const char *text) {
+    _separator();
+    _comma = true;
+    if (!text) {
+      _put("null", 4);
+      return *this;
+    }
+    _putc('"');
+    _put_escaped(text);
+    _putc('"');
+    return *this;
+  }
+
+  JsonWriter &value_bool(bool flag) {
+    _separator();
+    _comma = true;
+    if (flag) {
+      _put("true", 4);
+    } else {
+      _put("false", 5);
+    }
+    return *this;
+  }
+
+  // key() + value() in one call
+  JsonWriter &field(const char *name, float number, uint8_t decimals) {
+    return key(name).value(number, decimals);
+  }
+  JsonWriter &field(const char *name, int32_t number) {
+    return key(name).value(number);
+  }
+  JsonWriter &field(const char *name, const char *text) {
+    return key(name).value(text);
+  }
+
+  /*
+   * Write the members of a record as described by a field table
+   * (inside an object the caller opened)
+   *
+   * Example:
+   *   static const JsonField SLAVE_FIELDS[] = {
+   *     JSON_FIELD_FLOAT(struct_message, flow1_Lmin, 2),
+   *     JSON_FIELD_UINT8(struct_message, waterQualityCode),
+   *   };
+   *   json.fields(&rxData, SLAVE_FIELDS, JSON_COUNT(SLAVE_FIELDS));
+   */
+  JsonWriter &fields(const void *record, const JsonField *table, uint8_t count) {
+    const uint8_t *base = (const uint8_t *)record;
+    for (uint8_t i = 0; i < count; i++) {
+      const JsonField &f = table[i];
+      const uint8_t *member = base + f.offset;
+      _separator();
+      _puts(f.key);
+      _comma = false;
+      switch (f.type) {
+        case JSON_FLOAT: {
+          float number;
+          memcpy(&number, member, sizeof(number));  // Packed structs too
+          value(number, f.decimals);
+          break;
+        }
+        case JSON_INT32: {
+          int32_t number;
+          memcpy(&number, member, sizeof(number));
+          value(number);
+          break;
+        }
+        case JSON_UINT8:
+          value((int32_t)*member);
+          break;
+        case JSON_TEXT: {
+          const char *text;
+          memcpy(&text, member, sizeof(text));
+          value(text);
+          break;
+        }
+        case JSON_LOOKUP:
+          value(f.lookup(*member));
+          break;
+      }
+    }
+    return *this;
+  }
+
+  // ==========================================================
+  //  RESULT
+  // ==========================================================
+
+  /*
+   * Flush what is left into the Print (if any) and NUL-terminate
+   *
+   * Returns:
+   *   true  - Complete JSON in the buffer / handed to the Print
+   *   false - Buffer too small, or the Print took fewer bytes
+   */
+  bool finish() {
+    _flush();
+    if (_buffer && !_out) {
+      _buffer[_used] = '\0';
+    }
+    return !_failed;
+  }
+
+  bool ok() const {
+    return !_failed;
+  }
+
+  // Bytes produced so far (including any that did not fit)
+  size_t length() const {
+    return _length;
+  }
+
+  // The buffer, valid after finish() in buffer-only mode
+  const char *c_str() const {
+    return _buffer ? _buffer : "";
+  }
+
+private:
+  char *_buffer;
+  size_t _capacity;                    // Buffer size minus the NUL
+  Print *_out;
+  size_t _used;                        // Bytes in the buffer
+  size_t _length;                      // Bytes produced in total
+  bool _comma;                         // Next value needs a ','
+  bool _failed;                        // Overflow or short write
+
+  JsonWriter(const JsonWriter &);      // Would share the buffer
+  JsonWriter &operator=(const JsonWriter &);
+
+  static uint32_t _pow10(uint8_t exponent) {
+    static const uint32_t powers[JSON_MAX_DECIMALS + 1] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+    return powers[exponent];
+  }
+
+  inline void _separator() {
+    if (_comma) {
+      _putc(',');
+    }
+  }
+
+  void _flush() {
+    if (_out && _used) {
+      if (_out->write((const uint8_t *)_buffer, _used) != _used) {
+        _failed = true;
+      }
+      _used = 0;
+    }
+  }
+
+  inline void _putc(char c) {
+    _length++;
+    if (_used == _capacity) {
+      if (!_out) {
+        if (_buffer) {
+          _failed = true;                // Counting goes on, ok() is false
+        }
+        return;
+      }
+      _flush();
+    }
+    _buffer[_used++] = c;
+  }
+
+  void _put(const char *text, size_t n) {
+    while (n) {
+      size_t room = _capacity - _used;
+      if (room == 0) {
+        if (!_out) {
+          _length += n;
+          if (_buffer) {
+            _failed = true;
+          }
+          return;
+        }
+        _flush();
+        continue;
+      }
+      size_t chunk = n < room ? n : room;
+      memcpy(_buffer + _used, text, chunk);
+      _used += chunk;
+      _length += chunk;
+      text += chunk;
+      n -= chunk;
+    }
+  }
+
+  inline void _puts(const char *text) {
+    _put(text, strlen(text));
+  }
+
+  // Decimal digits, zero-padded to at least min_digits
+  void _put_uint(uint32_t number, uint8_t min_digits) {
+    char digits[10];
+    uint8_t n = 0;
+    do {
+      digits[sizeof(digits) - 1 - n++] = '0' + number % 10;
+      number /= 10;
+    } while (number);
+    while (n < min_digits) {
+      digits[sizeof(digits) - 1 - n++] = '0';
+    }
+    _put(digits + sizeof(digits) - n, n);
+  }
+
+  // Runs of plain characters go out in one piece
+  void _put_escaped(const char *text) {
+    static const char hex[] = "0123456789abcdef";
+    const char *run = text;
+    for (; *text; text++) {
+      uint8_t c = *text;
+      if (c >= 0x20 && c != '"' && c != '\\') {
+        continue;
+      }
+      _put(run, text - run);
+      run = text + 1;
+      if (c == '"' || c == '\\') {
+        char escaped[2] = { '\\', (char)c };
+        _put(escaped, 2);
+      } else if (c == '\n') {
+        _put("\\n", 2);
+      } else {
+        char escaped[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0x0F] };
+        _put(escaped, 6);
+      }
+    }
+    _put(run, text - run);
+  }
+};
+
+#endif
@@ -11,19 +11,35 @@
     - flow1_Lmin, flow2_Lmin
     - sub-tank TDS, waterQualityCode, tankLevel
 
-  Uploads combined data to Firebase RTDB every 5 seconds:
-    Path: /waterSystem/status  (PUT)
+  Uploads every sample of both tanks to Firebase RTDB in batches
+  (default: every 45 s), one multi-path request each:
+    Path: /waterSystem.json  (PATCH: status + history entries)
     Project: hydronet-monitor
 
+  Offline (WiFi down or upload failed): samples are kept in flash
+  and backfilled to /waterSystem/history once back online.
+
   Libraries needed:
-    - (built-in) WiFi, esp_now, HTTPClient, WiFiClientSecure
+    - (built-in) WiFi, esp_now, WiFiClientSecure
+    - json_writer.h (this folder) — payload built without String/heap
+    - upload_session.h (this folder) — keep-alive HTTPS connection
+    - sample_batch.h (this folder) — samples waiting for the next batch
+    - sample_log.h (this folder) — flash ring log for offline samples
   ================================================================
 */
 
 #include <WiFi.h>
 #include <esp_now.h>
 #include <WiFiClientSecure.h>
-#include <HTTPClient.h>
+#include <sys/time.h>
+#include <time.h>
+
+#define SAMPLE_LOG_MAX_SECTORS 0  // Whole partition
+
+#include "json_writer.h"
+#include "sample_batch.h"
+#include "sample_log.h"
+#include "upload_session.h"
 
 // ── WiFi & Firebase Config ─────────────────────────────────────
 const char* WIFI_SSID     = "11i";
@@ -38,6 +54,9 @@ const char* FIREBASE_AUTH = "IKwfkB1eVB2szYTYMRtvPbbrgUZo5fahyDMXUEQ3";
 
 WiFiClientSecure fbClient;  // TLS client (setInsecure — skips cert check)
 
+// One TLS connection kept open across uploads (reconnects on failure)
+UploadSession<WiFiClientSecure> firebase(fbClient, FIREBASE_HOST);
+
 // ── Pin Config (Master Local Sensors) ─────────────────────────
 const int TDS_PIN  = 34;  // TDS sensor analog → ADC1_CH6
 const int TRIG_PIN = 26;  // Ultrasonic Trigger
@@ -53,9 +72,36 @@ const float TANK_HEIGHT_CM = 100.0; // Master tank height in cm
 // ── TDS Calibration ───────────────────────────────────────────
 const float TDS_FACTOR = 500.0; // 1.0V → 500 ppm; calibrate per your probe
 
-// ── Firebase Upload Interval ───────────────────────────────────
-unsigned long lastFirebaseMillis = 0;
-const unsigned long FIREBASE_INTERVAL = 5000; // 5 seconds
+// ── Batched Upload ─────────────────────────────────────────────
+// Every sample (slave: one per ESP-NOW packet, ~1 s; master: one per
+// loop() pass) is kept. A batch goes up as ONE PATCH of
+// /waterSystem.json that adds the samples to /waterSystem/history and
+// refreshes /waterSystem/status: at 45 s that is 80 requests an hour
+// instead of ~570 status PUTs, at full resolution. Batches must follow
+// each other within UPLOAD_IDLE_MS (upload_session.h), or every one
+// reconnects with a full TLS handshake. Lower UPLOAD_FLUSH_MS for a
+// fresher status on the dashboard.
+const uint16_t      UPLOAD_BATCH_SAMPLES = 96;     // Flush once this many wait (per tank)
+const unsigned long UPLOAD_FLUSH_MS      = 45000;  // ... or the oldest has waited this long
+static_assert(UPLOAD_FLUSH_MS + 5000 <= UPLOAD_IDLE_MS,  // + one loop() pass
+              "UPLOAD_FLUSH_MS would let the upload connection idle out");
+
+// ── Upload Buffers (static: no heap churn per upload) ──────────
+char uploadPath[128];   // Built once in setup()
+char uploadStage[512];  // JSON staging, streamed into the connection
+
+// ── Store-and-Forward (batches that did not go up) ─────────────
+// Raw flash ring in the default table's "spiffs" partition (unused
+// by this sketch, 1.4 MB): 23000+ samples, ~5 h of both tanks at
+// full rate. Oldest samples are dropped when it is full.
+const char *SAMPLE_LOG_PARTITION = "spiffs";
+const uint16_t BACKFILL_BATCH = 64;              // Samples per history PATCH
+const unsigned long BACKFILL_BUDGET_MS = 1500;   // Per loop() pass, after the live upload
+
+PartitionFlash logFlash;
+SampleLog<PartitionFlash> sampleLog(logFlash);
+bool sampleLogReady = false;
+uint32_t bootId = 0;    // Random per boot: ties uptime stamps to this boot
 
 // ── ESP-NOW Data Struct (identical to slave) ───────────────────
 typedef struct struct_message {
@@ -71,6 +117,42 @@ struct_message rxData;
 bool newDataReceived = false;
 bool hasSlaveData    = false;
 
+// ── Master Reading (one loop() pass) ──────────────────────────
+typedef struct {
+  float       tdsPpm;
+  const char *waterQuality;
+  float       tankLevelPercent;
+  float       tankLevelCm;
+} MasterReading;
+
+// ── Sample (one tank, one reading: batch entry and flash record) ──
+#define NODE_MASTER 0
+#define NODE_SLAVE  1
+
+typedef struct {
+  float tdsPpm;              // Quality text is derived again
+  float tankLevelPercent;
+  float tankLevelCm;
+} MasterSample;
+
+typedef struct {
+  uint32_t bootId;
+  uint32_t epoch;            // UTC seconds, 0 = clock not set yet
+  uint16_t epochMs;          // ... and milliseconds
+  uint8_t  node;             // NODE_MASTER / NODE_SLAVE
+  uint8_t  spare;
+  uint32_t uptimeMs;
+  union {
+    MasterSample   master;
+    struct_message slave;
+  };
+} Sample;                    // 40 bytes
+
+static_assert(sizeof(Sample) <= SAMPLE_LOG_MAX_DATA, "Sample does not fit a log slot");
+
+SampleBatch<Sample, 128> slaveBatch(UPLOAD_BATCH_SAMPLES, UPLOAD_FLUSH_MS);   // Filled by OnDataRecv
+SampleBatch<Sample, 128> masterBatch(UPLOAD_BATCH_SAMPLES, UPLOAD_FLUSH_MS);  // Filled by loop()
+
 // =====================================================
 // MASTER LOCAL: Ultrasonic Distance (cm)
 // =====================================================
@@ -103,7 +185,7 @@ float readTDSppm() {
 // =====================================================
 // MASTER: TDS → water quality text
 // =====================================================
-String getWaterQualityStatus(float ppm) {
+const char *getWaterQualityStatus(float ppm) {
   if (ppm <= 0)         return "Sensor Error / No Reading";
   if (ppm <= 50)        return "Very Low Minerals (RO Water) - Not Ideal";
   if (ppm <= 150)       return "Excellent Drinking Water";
@@ -115,7 +197,7 @@ String getWaterQualityStatus(float ppm) {
 // =====================================================
 // SLAVE: quality code → text
 // =====================================================
-String slaveQualityText(uint8_t code) {
+const char *slaveQualityText(uint8_t code) {
   switch (code) {
     case 0:  return "Sensor Error / No Reading";
     case 1:  return "Excellent Drinking Water";
@@ -126,6 +208,41 @@ String slaveQualityText(uint8_t code) {
   }
 }
 
+// =====================================================
+// UPLOAD SCHEMAS (key, type, decimals per member)
+// =====================================================
+const JsonField MASTER_FIELDS[] = {
+  JSON_FIELD_FLOAT(MasterReading, tdsPpm, 1),
+  JSON_FIELD_TEXT(MasterReading, waterQuality),
+  JSON_FIELD_FLOAT(MasterReading, tankLevelPercent, 1),
+  JSON_FIELD_FLOAT(MasterReading, tankLevelCm, 1),
+};
+
+const JsonField SLAVE_FIELDS[] = {
+  JSON_FIELD_FLOAT(struct_message, flow1_Lmin, 2),
+  JSON_FIELD_FLOAT(struct_message, flow2_Lmin, 2),
+  JSON_FIELD_FLOAT(struct_message, tdsPpm, 1),
+  JSON_FIELD_UINT8(struct_message, waterQualityCode),
+  JSON_FIELD_LOOKUP(struct_message, waterQualityCode, "waterQuality", slaveQualityText),
+  JSON_FIELD_FLOAT(struct_message, tankLevelPercent, 1),
+  JSON_FIELD_FLOAT(struct_message, tankLevelCm, 1),
+};
+
+// =====================================================
+// SAMPLES: time stamp (UTC once SNTP answered, uptime always)
+// =====================================================
+void stampSample(Sample *s, uint8_t node) {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  bool synced = tv.tv_sec >= 1600000000;
+  s->bootId   = bootId;
+  s->epoch    = synced ? tv.tv_sec : 0;
+  s->epochMs  = synced ? tv.tv_usec / 1000 : 0;
+  s->node     = node;
+  s->spare    = 0;
+  s->uptimeMs = millis();
+}
+
 // =====================================================
 // ESP-NOW: Receive Callback (data from SLAVE)
 // =====================================================
@@ -135,6 +252,14 @@ void OnDataRecv(const uint8_t *mac, const uint8_t *incomingData, int len) {
     memcpy(&rxData, incomingData, sizeof(rxData));
     newDataReceived = true;
     hasSlaveData    = true;
+
+    // Every packet is kept for the next batch (the status only shows the latest)
+    Sample sample;
+    stampSample(&sample, NODE_SLAVE);
+    memcpy(&sample.slave, incomingData, sizeof(sample.slave));
+    if (!slaveBatch.push(sample)) {
+      Serial.println("[Batch] Slave batch full — sample dropped");
+    }
     Serial.printf("  Sub TDS   : %.1f ppm (code %d)\n", rxData.tdsPpm, rxData.waterQualityCode);
     Serial.printf("  Sub Level : %.1f%% (%.1f cm)\n", rxData.tankLevelPercent, rxData.tankLevelCm);
     Serial.printf("  Flow1     : %.2f L/min | Flow2: %.2f L/min\n", rxData.flow1_Lmin, rxData.flow2_Lmin);
@@ -168,7 +293,7 @@ void connectWiFi() {
 }
 
 // =====================================================
-// FIREBASE: PUT /waterSystem/status.json
+// FIREBASE: status object (/waterSystem/status)
 //
 // JSON structure (matches backend server.js listener):
 // {
@@ -183,65 +308,232 @@ void connectWiFi() {
 //     "tankLevelPercent": ..., "tankLevelCm": ...
 //   }
 // }
+//
+// Written by JsonWriter: no String temporaries. slave is NULL until
+// the SLAVE has reported.
 // =====================================================
-void sendToFirebase(
-  float masterTds,
-  float masterLevelPercent,
-  float masterLevelCm,
-  String masterQuality
-) {
-  if (WiFi.status() != WL_CONNECTED) {
-    Serial.println("[Firebase] WiFi not connected — skipping upload");
-    return;
+void writeStatusJson(JsonWriter &json, const MasterReading &master, const struct_message *slave) {
+  json.begin_object();
+
+  json.key("master").begin_object();
+  json.fields(&master, MASTER_FIELDS, JSON_COUNT(MASTER_FIELDS));
+  json.end_object();
+
+  if (slave) {
+    json.key("slave").begin_object();
+    json.fields(slave, SLAVE_FIELDS, JSON_COUNT(SLAVE_FIELDS));
+    json.end_object();
   }
 
-  // Build JSON payload
-  String json = "{";
-
-  json += "\"master\":{";
-  json += "\"tdsPpm\":"             + String(masterTds, 1)           + ",";
-  json += "\"waterQuality\":\""     + masterQuality                  + "\",";
-  json += "\"tankLevelPercent\":"   + String(masterLevelPercent, 1)  + ",";
-  json += "\"tankLevelCm\":"        + String(masterLevelCm, 1);
-  json += "}";
-
-  if (hasSlaveData) {
-    json += ",\"slave\":{";
-    json += "\"flow1_Lmin\":"        + String(rxData.flow1_Lmin, 2)       + ",";
-    json += "\"flow2_Lmin\":"        + String(rxData.flow2_Lmin, 2)       + ",";
-    json += "\"tdsPpm\":"            + String(rxData.tdsPpm, 1)           + ",";
-    json += "\"waterQualityCode\":"  + String(rxData.waterQualityCode)    + ",";
-    json += "\"waterQuality\":\""    + slaveQualityText(rxData.waterQualityCode) + "\",";
-    json += "\"tankLevelPercent\":"  + String(rxData.tankLevelPercent, 1) + ",";
-    json += "\"tankLevelCm\":"       + String(rxData.tankLevelCm, 1);
-    json += "}";
+  json.end_object();
+}
+
+// =====================================================
+// FIREBASE: one history entry
+//
+//   "history/master/t1760600000123": {
+//     ...MASTER_FIELDS / SLAVE_FIELDS..., "timestamp": "2026-10-16T07:33:20Z"
+//   }
+//
+// Keyed by UTC milliseconds: slave samples come ~1 s apart.
+// =====================================================
+void writeHistoryEntry(JsonWriter &json, const Sample &s, uint64_t utcMs) {
+  char key[40];
+  char timestamp[24];
+  time_t seconds = utcMs / 1000;
+  struct tm utc;
+  strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&seconds, &utc));
+  snprintf(key, sizeof(key), "history/%s/t%lu%03u", s.node == NODE_MASTER ? "master" : "slave",
+           (unsigned long)seconds, (unsigned)(utcMs % 1000));
+
+  json.key(key).begin_object();
+  if (s.node == NODE_MASTER) {
+    MasterReading master = { s.master.tdsPpm, getWaterQualityStatus(s.master.tdsPpm),
+                             s.master.tankLevelPercent, s.master.tankLevelCm };
+    json.fields(&master, MASTER_FIELDS, JSON_COUNT(MASTER_FIELDS));
+  } else {
+    json.fields(&s.slave, SLAVE_FIELDS, JSON_COUNT(SLAVE_FIELDS));
   }
+  json.field("timestamp", timestamp);
+  json.end_object();
+}
 
-  json += "}";
+// UTC ms at millis() == 0; 0 = SNTP has not answered yet
+uint64_t bootEpochMs() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  if (tv.tv_sec < 1600000000) {
+    return 0;
+  }
+  return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000 - millis();
+}
 
-  // Full Firebase REST URL
-  String url = "https://" + String(FIREBASE_HOST) +
-               "/waterSystem/status.json?auth=" + String(FIREBASE_AUTH);
+// UTC ms of a sample: its own stamp, or its uptime against the clock
+// (same boot only); 0 = unknown
+uint64_t sampleTimeMs(const Sample &s, uint64_t bootMs) {
+  if (s.epoch) {
+    return (uint64_t)s.epoch * 1000 + s.epochMs;
+  }
+  if (bootMs && s.bootId == bootId) {
+    return bootMs + s.uptimeMs;
+  }
+  return 0;
+}
 
-  Serial.println("[Firebase] Uploading...");
-  Serial.println("  URL    : " + url);
-  Serial.println("  Payload: " + json);
+// =====================================================
+// FIREBASE: batched PATCH /waterSystem.json
+//
+// One multi-path update per batch:
+// {
+//   "status": { ...status object, latest readings... },
+//   "history/master/t1760600000123": { ... },
+//   "history/slave/t1760600000456":  { ... },
+//   ...
+// }
+//
+// Tens of KB, so it is streamed (request_stream()): written once to
+// count it for Content-Length, then again into the connection. Both
+// passes must write the same bytes, so nothing in here may read state
+// the ESP-NOW callback changes meanwhile.
+// =====================================================
+struct BatchBody {
+  const MasterReading *status;
+  const struct_message *slave;  // Copy of rxData taken when the flush started
+  uint16_t masters;  // Batch sizes when the flush started; the
+  uint16_t slaves;   // ESP-NOW callback may add more meanwhile
+  uint64_t bootMs;
+  uint16_t untimed;  // Samples without a time (not in the body)
+
+  size_t operator()(Print *out) {
+    JsonWriter json(out ? uploadStage : NULL, out ? sizeof(uploadStage) : 0, out);
+    untimed = 0;
+    json.begin_object();
+    json.key("status");
+    writeStatusJson(json, *status, slave);
+    for (uint16_t i = 0; i < masters + slaves; i++) {
+      const Sample &s = i < masters ? masterBatch.at(i) : slaveBatch.at(i - masters);
+      uint64_t utcMs = sampleTimeMs(s, bootMs);
+      if (utcMs) {
+        writeHistoryEntry(json, s, utcMs);
+      } else {
+        untimed++;
+      }
+    }
+    json.end_object();
+    json.finish();
+    return json.length();
+  }
+};
 
-  HTTPClient http;
-  if (!http.begin(fbClient, url)) {
-    Serial.println("[Firebase] HTTP begin FAILED");
-    return;
+// Keep a sample in flash until it can be uploaded
+void logSample(const Sample &s) {
+  if (sampleLogReady && !sampleLog.append(&s, sizeof(s))) {
+    Serial.println("[Log] Flash write FAILED — sample lost");
   }
+}
+
+// Returns true once Firebase stored the batch (200)
+bool flushBatch(const MasterReading &latest) {
+  bool haveSlave = hasSlaveData;
+  struct_message slave = rxData;  // OnDataRecv may rewrite rxData during the upload
+  BatchBody body = { &latest, haveSlave ? &slave : NULL, masterBatch.size(), slaveBatch.size(),
+                     bootEpochMs(), 0 };
+  int httpCode = UPLOAD_ERR_CONNECT;
 
-  http.addHeader("Content-Type", "application/json");
-  int httpCode = http.PUT(json);
+  if (WiFi.status() != WL_CONNECTED) {
+    Serial.println("[Firebase] WiFi not connected — batch goes to flash");
+  } else {
+    Serial.printf("[Firebase] Uploading %u master + %u slave samples...\n",
+                  (unsigned)body.masters, (unsigned)body.slaves);
+
+    // Reuses the open connection; a TLS handshake only when it was closed
+    uint32_t handshakesBefore = firebase.stats().handshakes;
+    httpCode = firebase.request_stream("PATCH", uploadPath, body);
+
+    UploadSessionStats s = firebase.stats();
+    if (s.handshakes != handshakesBefore) {
+      Serial.printf("[Firebase] Response code: %d (handshake %lu ms + request %lu ms)\n", httpCode,
+                    (unsigned long)s.lastHandshakeMs, (unsigned long)s.lastRequestMs);
+    } else {
+      Serial.printf("[Firebase] Response code: %d (request %lu ms, connection reused)\n", httpCode,
+                    (unsigned long)s.lastRequestMs);
+    }
+    Serial.printf("[Firebase] %lu requests, %lu handshakes, %lu failures\n",
+                  (unsigned long)s.requests, (unsigned long)s.handshakes, (unsigned long)s.failures);
+  }
 
-  Serial.printf("[Firebase] Response code: %d\n", httpCode);
-  if (httpCode > 0) {
-    Serial.println("[Firebase] Response: " + http.getString());
+  // Uploaded samples are done; the rest (or all, on failure) go to flash
+  bool ok = httpCode == 200;
+  for (uint16_t i = 0; i < body.masters + body.slaves; i++) {
+    const Sample &s = i < body.masters ? masterBatch.at(i) : slaveBatch.at(i - body.masters);
+    if (!ok || !sampleTimeMs(s, body.bootMs)) {
+      logSample(s);
+    }
   }
+  masterBatch.drop(body.masters);
+  slaveBatch.drop(body.slaves);
+  if (!ok && sampleLogReady) {
+    Serial.printf("[Log] Batch kept in flash — %lu samples queued\n",
+                  (unsigned long)sampleLog.depth());
+  }
+  return ok;
+}
 
-  http.end();
+// =====================================================
+// BACKFILL: samples from flash, same PATCH without "status"
+// =====================================================
+struct BacklogBody {
+  SampleLogCursor start;
+  SampleLogCursor end;     // Where the last pass stopped, for consume()
+  uint64_t bootMs;
+  uint16_t untimed;
+
+  size_t operator()(Print *out) {
+    JsonWriter json(out ? uploadStage : NULL, out ? sizeof(uploadStage) : 0, out);
+    SampleLogCursor c = start;
+    Sample s;
+    untimed = 0;
+    json.begin_object();
+    while (c.count < BACKFILL_BATCH && sampleLog.next(&c, &s, sizeof(s)) == sizeof(s)) {
+      uint64_t utcMs = sampleTimeMs(s, bootMs);
+      if (utcMs) {
+        writeHistoryEntry(json, s, utcMs);
+      } else {
+        untimed++;  // Earlier boot that never had the clock: no place in history
+      }
+    }
+    json.end_object();
+    json.finish();
+    end = c;
+    return json.length();
+  }
+};
+
+// Called after a successful live upload: the backlog only gets the
+// time left in BACKFILL_BUDGET_MS, so live data never waits on it
+void backfillFromLog() {
+  uint64_t bootMs = bootEpochMs();
+  if (!sampleLogReady || !sampleLog.depth() || !bootMs) {
+    return;  // Nothing queued, or no clock yet to stamp samples with
+  }
+  unsigned long start = millis();
+  while (sampleLog.depth() && millis() - start < BACKFILL_BUDGET_MS) {
+    BacklogBody body = { sampleLog.cursor(), sampleLog.cursor(), bootMs, 0 };
+    body(NULL);
+    if (body.end.count > body.untimed) {
+      int httpCode = firebase.request_stream("PATCH", uploadPath, body);
+      if (httpCode != 200) {
+        Serial.printf("[Backfill] Response code: %d — retrying next pass\n", httpCode);
+        return;
+      }
+    }
+    sampleLog.consume(body.end);
+    Serial.printf("[Backfill] %u samples sent, %lu queued\n",
+                  (unsigned)(body.end.count - body.untimed), (unsigned long)sampleLog.depth());
+    if (body.untimed) {
+      Serial.printf("[Backfill] %u samples dropped: no timestamp\n", (unsigned)body.untimed);
+    }
+  }
 }
 
 // =====================================================
@@ -256,6 +548,8 @@ void setup() {
   pinMode(ECHO_PIN, INPUT);
   pinMode(TDS_PIN,  INPUT);
 
+  bootId = esp_random();  // Before the first sample is stamped
+
   // WiFi STA mode (required for both ESP-NOW & HTTP)
   // Note: WiFi.begin() is called inside connectWiFi()
   WiFi.mode(WIFI_STA);
@@ -273,7 +567,23 @@ void setup() {
   // Connect WiFi
   connectWiFi();
 
-  Serial.println("[MASTER NODE] Ready — Firebase upload every 5s");
+  // Firebase REST path (fixed, so built once)
+  snprintf(uploadPath, sizeof(uploadPath), "/waterSystem.json?auth=%s", FIREBASE_AUTH);
+
+  // UTC clock for sample timestamps (SNTP keeps retrying in the background)
+  configTime(0, 0, "pool.ntp.org", "time.google.com");
+
+  // Samples still in flash from before the reboot are backfilled too
+  sampleLogReady = logFlash.begin(SAMPLE_LOG_PARTITION) && sampleLog.begin();
+  if (sampleLogReady) {
+    Serial.printf("[Log] Flash log ready — %lu samples queued (mounted in %lu ms)\n",
+                  (unsigned long)sampleLog.depth(), (unsigned long)sampleLog.stats().mountMs);
+  } else {
+    Serial.printf("[Log] No '%s' partition — offline samples are lost\n", SAMPLE_LOG_PARTITION);
+  }
+
+  Serial.printf("[MASTER NODE] Ready — Firebase batch every %lu s or %u samples\n",
+                UPLOAD_FLUSH_MS / 1000, (unsigned)UPLOAD_BATCH_SAMPLES);
 }
 
 // =====================================================
@@ -282,7 +592,7 @@ void setup() {
 void loop() {
   // ── Read local master sensors ──────────────────────────
   float masterTdsPpm      = readTDSppm();
-  String masterQualityStr = getWaterQualityStatus(masterTdsPpm);
+  const char *masterQualityStr = getWaterQualityStatus(masterTdsPpm);
 
   float masterDist        = readDistanceCm();
   float masterLevelCm     = -1;
@@ -298,7 +608,7 @@ void loop() {
   Serial.println("MASTER TANK — Local Sensors");
   Serial.println("-------------------------------------------------");
   Serial.printf("TDS          : %.1f ppm\n", masterTdsPpm);
-  Serial.printf("Water Status : %s\n", masterQualityStr.c_str());
+  Serial.printf("Water Status : %s\n", masterQualityStr);
   if (masterDist < 0) {
     Serial.println("Ultrasonic   : ERROR (no echo)");
   } else {
@@ -314,20 +624,30 @@ void loop() {
     Serial.printf("Flow Line 1  : %.2f L/min\n", rxData.flow1_Lmin);
     Serial.printf("Flow Line 2  : %.2f L/min\n", rxData.flow2_Lmin);
     Serial.printf("TDS          : %.1f ppm (code %d)\n", rxData.tdsPpm, rxData.waterQualityCode);
-    Serial.printf("Water Status : %s\n", slaveQualityText(rxData.waterQualityCode).c_str());
+    Serial.printf("Water Status : %s\n", slaveQualityText(rxData.waterQualityCode));
     Serial.printf("Tank Level   : %.1f%% (%.1f cm)\n", rxData.tankLevelPercent, rxData.tankLevelCm);
   }
 
-  // ── Firebase upload every FIREBASE_INTERVAL ms ─────────
-  unsigned long now = millis();
-  if (now - lastFirebaseMillis >= FIREBASE_INTERVAL) {
-    lastFirebaseMillis = now;
-    sendToFirebase(masterTdsPpm, masterLevelPct, masterLevelCm, masterQualityStr);
+  // ── Master sample into the batch (every pass) ──────────
+  Sample sample;
+  stampSample(&sample, NODE_MASTER);
+  sample.master.tdsPpm           = masterTdsPpm;
+  sample.master.tankLevelPercent = masterLevelPct;
+  sample.master.tankLevelCm      = masterLevelCm;
+  masterBatch.push(sample);
+
+  // ── Firebase upload when a batch is due ────────────────
+  if (masterBatch.due() || slaveBatch.due()) {
+    MasterReading latest = { masterTdsPpm, masterQualityStr, masterLevelPct, masterLevelCm };
+    if (flushBatch(latest)) {
+      backfillFromLog();  // Batch is up: catch up on the backlog
+    }
   }
 
   // WiFi reconnect guard
   if (WiFi.status() != WL_CONNECTED) {
     Serial.println("[WiFi] Reconnecting...");
+    firebase.close();  // The TLS connection did not survive
     connectWiFi();
   }
 
@@ -0,0 +1,117 @@
+/*
+ * SampleBatch - samples waiting for the next batched upload
+
+ * A ring of Capacity samples with one producer and one consumer, which
+ * may run in different tasks (the ESP-NOW receive callback and
+ * loop()): push() copies the sample in without blocking or allocating;
+ * the consumer reads the oldest size() samples with at() and removes
+ * them with drop() once they are uploaded. A full ring refuses new
+ * samples (counted in stats().overflows) rather than overwrite ones
+ * the consumer may be reading.
+ *
+ * due() is the flush rule: flush_count samples waiting, or the oldest
+ * has waited flush_ms.
+ *
+ * Example:
+ *   SampleBatch<Sample, 128> slaveBatch(96, 45000);
+ *   slaveBatch.push(sample);                        // producer
+ *   if (slaveBatch.due()) {                          // consumer
+ *     uint16_t n = slaveBatch.size();
+ *     ... upload slaveBatch.at(0) .. at(n - 1) ...
+ *     slaveBatch.drop(n);
+ *   }
+ */
+#ifndef SAMPLE_BATCH_H
+#define SAMPLE_BATCH_H
+
+#include <Arduino.h>
+
+// Batch statistics, see stats()
+typedef struct {
+  uint32_t pushed;
+  uint32_t overflows;                  // Refused: ring full
+  uint16_t maxSize;                    // Most samples waiting at once
+} SampleBatchStats;
+
+template <class Sample, uint16_t Capacity>
+class SampleBatch {
+public:
+  /*
+   * Parameters:
+   *   flush_count - due() once this many samples wait (<= Capacity)
+   *   flush_ms    - ... or once the oldest is this old
+   */
+  SampleBatch(uint16_t flush_count, unsigned long flush_ms)
+    : _flushCount(flush_count), _flushMs(flush_ms) {
+    _head = 0;
+    _tail = 0;
+    memset(&_stats, 0, sizeof(_stats));
+  }
+
+  // Producer: false if the ring is full
+  bool push(const Sample &sample) {
+    uint16_t head = _head;
+    if ((uint16_t)(head - _tail) >= Capacity) {
+      _stats.overflows++;
+      return false;
+    }
+    uint16_t i = head & (Capacity - 1);
+    _ring[i] = sample;
+    _pushedMs[i] = millis();
+    __sync_synchronize();                // Sample complete before the consumer sees it
+    _head = head + 1;
+    _stats.pushed++;
+    uint16_t waiting = _head - _tail;
+    if (waiting > _stats.maxSize) {
+      _stats.maxSize = waiting;
+    }
+    return true;
+  }
+
+  // Consumer: samples waiting
+  uint16_t size() const {
+    return (uint16_t)(_head - _tail);
+  }
+
+  // Consumer: i-th oldest, i < size()
+  const Sample &at(uint16_t i) const {
+    return _ring[(uint16_t)(_tail + i) & (Capacity - 1)];
+  }
+
+  // Consumer: remove the n oldest
+  void drop(uint16_t n) {
+    if (n > size()) {
+      n = size();
+    }
+    __sync_synchronize();                // Done reading before the slots are reused
+    _tail = _tail + n;
+  }
+
+  // Consumer: time to flush
+  bool due() const {
+    uint16_t n = size();
+    return n && (n >= _flushCount || millis() - _pushedMs[_tail & (Capacity - 1)] >= _flushMs);
+  }
+
+  // Consumer: age of the oldest sample, 0 if empty
+  unsigned long oldest_ms() const {
+    return size() ? millis() - _pushedMs[_tail & (Capacity - 1)] : 0;
+  }
+
+  SampleBatchStats stats() const {
+    return _stats;
+  }
+
+private:
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+  Sample _ring[Capacity];
+  unsigned long _pushedMs[Capacity];
+  volatile uint16_t _head;             // Written by the producer only
+  volatile uint16_t _tail;             // Written by the consumer only
+  uint16_t _flushCount;
+  unsigned long _flushMs;
+  SampleBatchStats _stats;             // Producer's, read racily
+};
+
+#endif
@@ -0,0 +1,414 @@
+/*
+ * SampleLog - store-and-forward ring log in a raw flash partition
+
+ * Keeps samples that could not be uploaded (WiFi down, server error)
+ * in flash until a backfill uploader has sent them. The partition is
+ * used as a circular log of fixed-size slots:
+ *
+ *   slot = seq (4) | length (2) | done (1) | spare (1) | crc32 (4) | data
+ *
+ * Records are appended at the head and read from the tail in order.
+ * Uploaded records are not erased: the last record of an uploaded
+ * batch gets its `done` byte programmed 0xFF -> 0x00 (NOR flash can
+ * clear bits without an erase), and everything up to that sequence
+ * number counts as sent. A sector is erased only when the head wraps
+ * into it, so every sector is erased once per lap of the ring - the
+ * wear is spread evenly without a wear-levelling layer (LittleFS would
+ * add metadata writes and block copies on every append).
+ *
+ * Survives reboot: begin() scans the slots, checks every CRC and finds
+ * head, tail and depth again. A record torn by a power cut fails its
+ * CRC and is skipped; appending resumes after it.
+ *
+ * Bounded: when the ring is full the oldest sector is erased and its
+ * pending records are dropped (counted in stats().dropped). At least
+ * (sectors - 1) * slots-per-sector records are kept.
+ *
+ * The flash is a template parameter with read(), write(),
+ * erase_sector() and size(); PartitionFlash below wraps an ESP32 data
+ * partition, the emulator benches use a model.
+ *
+ * Example:
+ *   PartitionFlash flash;
+ *   SampleLog<PartitionFlash> log(flash);
+ *   if (flash.begin("spiffs")) log.begin();
+ *   log.append(&sample, sizeof(sample));              // while offline
+ *
+ *   SampleLogCursor c = log.cursor();                  // once online
+ *   while (n < 8 && log.next(&c, &sample, sizeof(sample)) > 0) { ... }
+ *   if (upload_ok) log.consume(c);
+ */
+#ifndef SAMPLE_LOG_H
+#define SAMPLE_LOG_H
+
+#include <Arduino.h>
+#include <stddef.h>
+#include <string.h>
+
+// ============================================================
+//  CONFIGURATION
+// ============================================================
+#ifndef SAMPLE_LOG_SLOT_SIZE
+#define SAMPLE_LOG_SLOT_SIZE    64    // Bytes per record incl. header, divides the sector
+#endif
+#ifndef SAMPLE_LOG_MAX_SECTORS
+#define SAMPLE_LOG_MAX_SECTORS  128   // Flash used at most (x 4 KB), 0 = whole partition
+#endif
+#define SAMPLE_LOG_SECTOR_SIZE  4096  // Erase unit
+#define SAMPLE_LOG_HEADER_SIZE  12
+#define SAMPLE_LOG_MAX_DATA     (SAMPLE_LOG_SLOT_SIZE - SAMPLE_LOG_HEADER_SIZE)
+#define SAMPLE_LOG_BLANK_SEQ    0xFFFFFFFFUL
+
+// Log statistics, see stats()
+typedef struct {
+  uint32_t appended;                   // Records written since begin()
+  uint32_t consumed;                   // ... marked uploaded
+  uint32_t dropped;                    // Pending records lost to a full ring
+  uint32_t corrupt;                    // Slots that failed their CRC (torn writes)
+  uint32_t writeErrors;                // Appends that did not read back, retried
+  uint32_t erases;                     // Sectors erased
+  uint32_t mountMs;                    // Time in begin()
+} SampleLogStats;
+
+// Read position for next() / consume()
+typedef struct {
+  uint32_t slot;                       // Next slot to look at
+  uint32_t lastSeq;                    // Last record returned, 0 = none
+  uint32_t lastSlot;
+  uint16_t count;                      // Records returned
+} SampleLogCursor;
+
+// ============================================================
+//  FLASH
+// ============================================================
+#if defined(ARDUINO_ARCH_ESP32)
+#include <esp_partition.h>
+
+// Raw data partition (any subtype), e.g. the default "spiffs" one
+class PartitionFlash {
+public:
+  PartitionFlash() : _part(NULL) {}
+
+  bool begin(const char *label) {
+    _part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    return _part != NULL;
+  }
+
+  bool read(uint32_t address, void *data, size_t length) {
+    return esp_partition_read(_part, address, data, length) == ESP_OK;
+  }
+
+  bool write(uint32_t address, const void *data, size_t length) {
+    return esp_partition_write(_part, address, data, length) == ESP_OK;
+  }
+
+  bool erase_sector(uint32_t address) {
+    return esp_partition_erase_range(_part, address, SAMPLE_LOG_SECTOR_SIZE) == ESP_OK;
+  }
+
+  uint32_t size() {
+    return _part ? _part->size : 0;
+  }
+
+private:
+  const esp_partition_t *_part;
+};
+#endif
+
+// ============================================================
+//  LOG
+// ============================================================
+
+template <class Flash>
+class SampleLog {
+public:
+  SampleLog(Flash &flash) : _flash(flash) {
+    _slots = 0;
+    _head = 0;
+    _tail = 0;
+    _nextSeq = 1;
+    _doneSeq = 0;
+    _depth = 0;
+    memset(&_stats, 0, sizeof(_stats));
+  }
+
+  /*
+   * Mount: find head, tail and depth from what is in flash
+   *
+   * Returns:
+   *   false if the flash is smaller than two sectors
+   */
+  bool begin() {
+    unsigned long start = millis();
+    uint32_t sectors = _flash.size() / SAMPLE_LOG_SECTOR_SIZE;
+    if (SAMPLE_LOG_MAX_SECTORS && sectors > SAMPLE_LOG_MAX_SECTORS) {
+      sectors = SAMPLE_LOG_MAX_SECTORS;
+    }
+    _slots = sectors >= 2 ? sectors * SLOTS_PER_SECTOR : 0;
+    _head = _tail = 0;
+    _nextSeq = 1;
+    _doneSeq = 0;
+    _depth = 0;
+    memset(&_stats, 0, sizeof(_stats));
+    if (!_slots) {
+      return false;
+    }
+
+    // Pass 1: newest record (head follows it) and newest done mark
+    Header h;
+    for (uint32_t slot = 0; slot < _slots; slot++) {
+      if (!_load(slot, &h, NULL, 0, true)) {
+        continue;
+      }
+      if (h.seq >= _nextSeq) {
+        _nextSeq = h.seq + 1;
+        _head = (slot + 1) % _slots;
+      }
+      if (h.done == 0 && h.seq > _doneSeq) {
+        _doneSeq = h.seq;
+      }
+    }
+
+    // Pass 2: oldest pending record (tail) and how many are pending
+    uint32_t oldest = SAMPLE_LOG_BLANK_SEQ;
+    _tail = _head;
+    for (uint32_t slot = 0; slot < _slots; slot++) {
+      if (!_load(slot, &h, NULL, 0, false) || h.seq <= _doneSeq) {
+        continue;
+      }
+      _depth++;
+      if (h.seq < oldest) {
+        oldest = h.seq;
+        _tail = slot;
+      }
+    }
+    _stats.mountMs = millis() - start;
+    return true;
+  }
+
+  /*
+   * Append one record
+   *
+   * Parameters:
+   *   data   - Record bytes
+   *   length - 1 .. SAMPLE_LOG_MAX_DATA
+   *
+   * Returns:
+   *   true if written and read back intact
+   */
+  bool append(const void *data, uint16_t length) {
+    if (!_slots || length == 0 || length > SAMPLE_LOG_MAX_DATA) {
+      return false;
+    }
+    uint8_t slot[SAMPLE_LOG_SLOT_SIZE];
+    memset(slot, 0xFF, sizeof(slot));
+    Header h;
+    h.seq = _nextSeq;
+    h.length = length;
+    h.done = 0xFF;
+    h.spare = 0xFF;
+    memcpy(slot + SAMPLE_LOG_HEADER_SIZE, data, length);
+    h.crc = _crc(h, slot + SAMPLE_LOG_HEADER_SIZE);
+    memcpy(slot, &h, sizeof(h));
+
+    uint8_t attempts = 0;
+    while (attempts < 3) {
+      if (_head % SLOTS_PER_SECTOR == 0) {
+        _erase_for_head();
+      } else if (!_blank(_head)) {
+        _head = (_head + 1) % _slots;    // Torn or foreign data: step over
+        continue;
+      }
+      uint32_t at = _head;
+      _head = (_head + 1) % _slots;
+      _flash.write(at * SAMPLE_LOG_SLOT_SIZE, slot, SAMPLE_LOG_HEADER_SIZE + length);
+      Header check;
+      if (_load(at, &check, NULL, 0, false) && check.seq == h.seq) {
+        if (_depth == 0) {
+          _tail = at;
+        }
+        _nextSeq++;
+        _depth++;
+        _stats.appended++;
+        return true;
+      }
+      _stats.writeErrors++;
+      attempts++;
+    }
+    return false;
+  }
+
+  /*
+   * Start reading at the oldest pending record
+   */
+  SampleLogCursor cursor() const {
+    SampleLogCursor c;
+    c.slot = _tail;
+    c.lastSeq = 0;
+    c.lastSlot = 0;
+    c.count = 0;
+    return c;
+  }
+
+  /*
+   * Copy the next pending record out and advance the cursor
+   *
+   * Returns:
+   *   Record length, 0 when there are no more. Records longer than
+   *   size are skipped.
+   */
+  uint16_t next(SampleLogCursor *c, void *data, uint16_t size) {
+    Header h;
+    for (uint32_t n = 0; n < _slots && c->count < _depth; n++) {  // A full ring has head == tail
+      uint32_t slot = c->slot;
+      c->slot = (c->slot + 1) % _slots;
+      if (!_load(slot, &h, data, size, false) || h.seq <= _doneSeq || h.seq <= c->lastSeq ||
+          h.length > size) {
+        continue;
+      }
+      c->lastSeq = h.seq;
+      c->lastSlot = slot;
+      c->count++;
+      return h.length;
+    }
+    return 0;
+  }
+
+  /*
+   * Mark everything next() returned as uploaded
+   *
+   * One flash write (the done byte of the last record), so a batch of
+   * any size costs the same.
+   */
+  void consume(const SampleLogCursor &c) {
+    if (!c.count || c.lastSeq <= _doneSeq) {
+      return;                            // Nothing read, or already dropped
+    }
+    Header h;
+    if (_load(c.lastSlot, &h, NULL, 0, false) && h.seq == c.lastSeq) {
+      uint8_t done = 0;
+      _flash.write(c.lastSlot * SAMPLE_LOG_SLOT_SIZE + offsetof(Header, done), &done, 1);
+    }
+    uint16_t count = c.count < _depth ? c.count : _depth;
+    _doneSeq = c.lastSeq;
+    _depth -= count;
+    _tail = _depth ? c.slot : _head;
+    _stats.consumed += count;
+  }
+
+  // Records waiting for upload
+  uint32_t depth() const {
+    return _depth;
+  }
+
+  // Records the ring always keeps (more fit until the head wraps)
+  uint32_t capacity() const {
+    return _slots ? _slots - SLOTS_PER_SECTOR : 0;
+  }
+
+  SampleLogStats stats() const {
+    return _stats;
+  }
+
+private:
+  static const uint32_t SLOTS_PER_SECTOR = SAMPLE_LOG_SECTOR_SIZE / SAMPLE_LOG_SLOT_SIZE;
+
+  typedef struct {
+    uint32_t seq;                      // SAMPLE_LOG_BLANK_SEQ = erased slot
+    uint16_t length;
+    uint8_t done;                      // 0x00 = this and all earlier records uploaded
+    uint8_t spare;
+    uint32_t crc;                      // Over seq, length and data
+  } Header;
+
+  Flash &_flash;
+  uint32_t _slots;
+  uint32_t _head;                      // Next slot to write
+  uint32_t _tail;                      // Oldest pending record (or _head)
+  uint32_t _nextSeq;
+  uint32_t _doneSeq;                   // Records up to this one are uploaded
+  uint32_t _depth;
+  SampleLogStats _stats;
+
+  SampleLog(const SampleLog &);        // Owns the flash area
+  SampleLog &operator=(const SampleLog &);
+
+  // Header (+ data into `data` when given); false if blank or corrupt
+  bool _load(uint32_t slot, Header *h, void *data, uint16_t size, bool count_corrupt) {
+    uint8_t buffer[SAMPLE_LOG_SLOT_SIZE];
+    if (!_flash.read(slot * SAMPLE_LOG_SLOT_SIZE, buffer, sizeof(buffer))) {
+      return false;
+    }
+    memcpy(h, buffer, sizeof(*h));
+    if (h->seq == SAMPLE_LOG_BLANK_SEQ && h->length == 0xFFFF) {
+      return false;
+    }
+    if (h->length == 0 || h->length > SAMPLE_LOG_MAX_DATA ||
+        h->crc != _crc(*h, buffer + SAMPLE_LOG_HEADER_SIZE)) {
+      if (count_corrupt) {
+        _stats.corrupt++;
+      }
+      return false;
+    }
+    if (data) {
+      memcpy(data, buffer + SAMPLE_LOG_HEADER_SIZE, h->length < size ? h->length : size);
+    }
+    return true;
+  }
+
+  bool _blank(uint32_t slot) {
+    uint8_t buffer[SAMPLE_LOG_SLOT_SIZE];
+    if (!_flash.read(slot * SAMPLE_LOG_SLOT_SIZE, buffer, sizeof(buffer))) {
+      return false;
+    }
+    for (uint16_t i = 0; i < sizeof(buffer); i++) {
+      if (buffer[i] != 0xFF) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // The head enters a sector: drop what is still pending there, erase it
+  void _erase_for_head() {
+    uint32_t first = _head;
+    Header h;
+    for (uint32_t slot = first; slot < first + SLOTS_PER_SECTOR; slot++) {
+      if (_load(slot, &h, NULL, 0, false) && h.seq > _doneSeq && _depth) {
+        _depth--;
+        _stats.dropped++;
+      }
+    }
+    if (!_depth) {
+      _tail = _head;
+    } else if (_tail >= first && _tail < first + SLOTS_PER_SECTOR) {
+      _tail = (first + SLOTS_PER_SECTOR) % _slots;
+    }
+    _flash.erase_sector(first * SAMPLE_LOG_SLOT_SIZE);
+    _stats.erases++;
+  }
+
+  // CRC-32 (IEEE, reflected), 4 bits at a time
+  static uint32_t _crc(const Header &h, const uint8_t *data) {
+    uint32_t crc = 0xFFFFFFFFUL;
+    crc = _crc_update(crc, (const uint8_t *)&h.seq, sizeof(h.seq));
+    crc = _crc_update(crc, (const uint8_t *)&h.length, sizeof(h.length));
+    crc = _crc_update(crc, data, h.length <= SAMPLE_LOG_MAX_DATA ? h.length : 0);
+    return ~crc;
+  }
+
+  static uint32_t _crc_update(uint32_t crc, const uint8_t *data, size_t length) {
+    static const uint32_t table[16] = {
+      0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+      0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    while (length--) {
+      crc ^= *data++;
+      crc = (crc >> 4) ^ table[crc & 0x0F];
+      crc = (crc >> 4) ^ table[crc & 0x0F];
+    }
+    return crc;
+  }
+};
+
+#endif
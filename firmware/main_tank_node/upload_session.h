@@ -0,0 +1,428 @@
+/*
+ * UploadSession - persistent HTTPS connection for periodic uploads
+
+ * Keeps one TLS connection to the server open between uploads (HTTP/1.1
+ * keep-alive) instead of connecting, handshaking and closing for every
+ * request the way HTTPClient begin() / end() does. A request goes out
+ * in a single write (one TLS record); the response is parsed and
+ * drained through a small line buffer so the connection is ready for
+ * the next one. No String, no heap.
+ *
+ * Reconnect on failure: a connection the server closed (idle timeout,
+ * restart, WiFi drop) is reopened on the next request. A request that
+ * dies on a reused connection is sent once more on a fresh one - PUT
+ * is idempotent, so a duplicate is harmless.
+ *
+ * TLS session resumption is up to the client: WiFiClientSecure has no
+ * session-ticket API, so every reconnect is a full handshake. stats()
+ * times handshakes apart from requests, so that cost stays visible.
+ *
+ * Bodies too big for a buffer (batched uploads) are generated while
+ * they are sent, see request_stream().
+ *
+ * Works with any Arduino Client (WiFiClientSecure, WiFiClient).
+ *
+ * Example:
+ *   WiFiClientSecure tls;
+ *   UploadSession<WiFiClientSecure> firebase(tls, "example.firebaseio.com");
+ *   int code = firebase.put("/status.json", body, length);  // 200
+ */
+#ifndef UPLOAD_SESSION_H
+#define UPLOAD_SESSION_H
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <strings.h>
+
+// ============================================================
+//  CONFIGURATION
+// ============================================================
+#ifndef UPLOAD_REQUEST_SIZE
+#define UPLOAD_REQUEST_SIZE    1024  // Header + body sent in one write
+#endif
+#ifndef UPLOAD_TIMEOUT_MS
+#define UPLOAD_TIMEOUT_MS      5000  // Response must start (and finish) within this
+#endif
+#ifndef UPLOAD_IDLE_MS
+#define UPLOAD_IDLE_MS         50000 // Reconnect instead of reusing a connection idle this long
+#endif
+#define UPLOAD_LINE_SIZE       128   // Status / header line, longer ones are cut
+
+// Errors returned instead of an HTTP status (same sign as HTTPClient's)
+#define UPLOAD_ERR_CONNECT     -1    // TCP connect or TLS handshake failed
+#define UPLOAD_ERR_SEND        -2    // Write failed, also after a reconnect
+#define UPLOAD_ERR_TIMEOUT     -3    // No (complete) response in time
+#define UPLOAD_ERR_RESPONSE    -4    // Not an HTTP response
+
+// Session statistics, see stats()
+typedef struct {
+  uint32_t requests;                   // Responses received
+  uint32_t failures;                   // Requests that ended with an error
+  uint32_t handshakes;                 // Connections opened (TCP + TLS)
+  uint32_t connectFailures;
+  uint32_t reused;                     // Requests sent on an already open connection
+  uint32_t staleRetries;               // ... of which died and were sent again
+  uint32_t handshakeMs;                // Total time in connect()
+  uint32_t lastHandshakeMs;
+  uint32_t requestMs;                  // Total time from write to end of response
+  uint32_t lastRequestMs;
+  uint32_t bytesSent;
+  uint32_t bytesReceived;
+} UploadSessionStats;
+
+// ============================================================
+//  SESSION
+// ============================================================
+
+template <class Client>
+class UploadSession {
+public:
+  UploadSession(Client &client, const char *host, uint16_t port = 443)
+    : _client(client), _host(host), _port(port) {
+    _open = false;
+    _lastUseMs = 0;
+    memset(&_stats, 0, sizeof(_stats));
+  }
+
+  /*
+   * Send a PUT with a JSON body and wait for the response
+   *
+   * Parameters:
+   *   path   - Request target incl. query, e.g. "/status.json?auth=..."
+   *   body   - Payload (not NUL-terminated necessarily)
+   *   length - Bytes in body
+   *
+   * Returns:
+   *   HTTP status code (200 = stored), or UPLOAD_ERR_*
+   */
+  int put(const char *path, const char *body, size_t length) {
+    return request("PUT", path, body, length);
+  }
+
+  /*
+   * Send any request with a JSON body (POST, PATCH, ...)
+   */
+  int request(const char *method, const char *path, const char *body, size_t length) {
+    bool reused = _prepare();
+    int status = _attempt(method, path, body, length);
+    if (status < 0 && reused && status != UPLOAD_ERR_CONNECT) {
+      _stats.staleRetries++;             // Connection died while idle: once more, fresh
+      status = _attempt(method, path, body, length);
+    }
+    if (status < 0) {
+      _stats.failures++;
+    }
+    return status;
+  }
+
+  /*
+   * Send a request whose body is generated while it is sent
+   *
+   * body(NULL) returns the body length (for Content-Length);
+   * body(out) writes the same bytes into out and returns the count.
+   * It is called once to count and once per attempt, so it has to
+   * produce the same output every time.
+   *
+   * Example:
+   *   struct Body {
+   *     size_t operator()(Print *out) {
+   *       static char stage[512];
+   *       JsonWriter json(out ? stage : NULL, out ? sizeof(stage) : 0, out);
+   *       ...
+   *       json.finish();
+   *       return json.length();
+   *     }
+   *   } body;
+   *   int code = firebase.request_stream("PATCH", "/.json", body);
+   */
+  template <class Body>
+  int request_stream(const char *method, const char *path, Body &body) {
+    size_t length = body(NULL);
+    bool reused = _prepare();
+    int status = _attempt_stream(method, path, length, body);
+    if (status < 0 && reused && status != UPLOAD_ERR_CONNECT) {
+      _stats.staleRetries++;
+      status = _attempt_stream(method, path, length, body);
+    }
+    if (status < 0) {
+      _stats.failures++;
+    }
+    return status;
+  }
+
+  /*
+   * Close the connection (e.g. when WiFi went down)
+   */
+  void close() {
+    if (_open) {
+      _client.stop();
+      _open = false;
+    }
+  }
+
+  bool connected() {
+    return _open && _client.connected();
+  }
+
+  UploadSessionStats stats() const {
+    return _stats;
+  }
+
+private:
+  Client &_client;
+  const char *_host;
+  uint16_t _port;
+  bool _open;                          // Connection usable for the next request
+  unsigned long _lastUseMs;            // End of the last response
+  char _request[UPLOAD_REQUEST_SIZE];
+  char _line[UPLOAD_LINE_SIZE];
+  UploadSessionStats _stats;
+
+  UploadSession(const UploadSession &);  // Owns the connection
+  UploadSession &operator=(const UploadSession &);
+
+  // Streamed body into the connection, counted
+  class Sink : public Print {
+  public:
+    Sink(UploadSession *session) : _session(session), _ok(true) {}
+
+    size_t write(uint8_t c) {
+      return write(&c, 1);
+    }
+
+    size_t write(const uint8_t *data, size_t length) {
+      if (_ok && !_session->_write((const char *)data, length)) {
+        _ok = false;
+      }
+      return _ok ? length : 0;
+    }
+
+    bool ok() const {
+      return _ok;
+    }
+
+  private:
+    UploadSession *_session;
+    bool _ok;
+  };
+
+  // Drop a connection the server closed or is about to; true = reusing
+  bool _prepare() {
+    if (_open && (!_client.connected() || millis() - _lastUseMs > UPLOAD_IDLE_MS)) {
+      close();
+    }
+    return _open;
+  }
+
+  bool _connect() {
+    unsigned long start = millis();
+    bool ok = _client.connect(_host, _port);
+    uint32_t ms = millis() - start;
+    if (!ok) {
+      _stats.connectFailures++;
+      return false;
+    }
+    _open = true;
+    _stats.handshakes++;
+    _stats.handshakeMs += ms;
+    _stats.lastHandshakeMs = ms;
+    return true;
+  }
+
+  // One request on the open connection (opened first if needed)
+  int _attempt(const char *method, const char *path, const char *body, size_t length) {
+    if (!_begin()) {
+      return UPLOAD_ERR_CONNECT;
+    }
+    unsigned long start = millis();
+    if (!_send(method, path, body, length)) {
+      close();
+      return UPLOAD_ERR_SEND;
+    }
+    return _end(start);
+  }
+
+  template <class Body>
+  int _attempt_stream(const char *method, const char *path, size_t length, Body &body) {
+    if (!_begin()) {
+      return UPLOAD_ERR_CONNECT;
+    }
+    unsigned long start = millis();
+    Sink sink(this);
+    int header = _header(method, path, length);
+    if (header < 0 || !_write(_request, header) || body(&sink) != length || !sink.ok()) {
+      close();
+      return UPLOAD_ERR_SEND;
+    }
+    return _end(start);
+  }
+
+  bool _begin() {
+    if (_open) {
+      _stats.reused++;
+      return true;
+    }
+    return _connect();
+  }
+
+  // Response, statistics, keep or close the connection
+  int _end(unsigned long start) {
+    bool keepAlive = true;
+    int status = _read_response(&keepAlive);
+    if (status < 0 || !keepAlive) {
+      close();
+    }
+    if (status > 0) {
+      uint32_t ms = millis() - start;
+      _stats.requests++;
+      _stats.requestMs += ms;
+      _stats.lastRequestMs = ms;
+      _lastUseMs = millis();
+    }
+    return status;
+  }
+
+  // Request header into _request; its length, -1 if the path is too long
+  int _header(const char *method, const char *path, size_t length) {
+    int header = snprintf(_request, sizeof(_request),
+                          "%s %s HTTP/1.1\r\n"
+                          "Host: %s\r\n"
+                          "Content-Type: application/json\r\n"
+                          "Content-Length: %u\r\n"
+                          "Connection: keep-alive\r\n"
+                          "\r\n",
+                          method, path, _host, (unsigned)length);
+    return header < 0 || (size_t)header >= sizeof(_request) ? -1 : header;
+  }
+
+  bool _send(const char *method, const char *path, const char *body, size_t length) {
+    int header = _header(method, path, length);
+    if (header < 0) {
+      return false;
+    }
+    if (header + length <= sizeof(_request)) {
+      memcpy(_request + header, body, length);
+      return _write(_request, header + length);
+    }
+    return _write(_request, header) && _write(body, length);  // Body too big to merge
+  }
+
+  bool _write(const char *data, size_t length) {
+    size_t n = _client.write((const uint8_t *)data, length);
+    _stats.bytesSent += n;
+    return n == length;
+  }
+
+  // Wait until a byte can be read; false on timeout or hang-up
+  bool _wait(unsigned long start) {
+    while (!_client.available()) {
+      if (!_client.connected() || millis() - start > UPLOAD_TIMEOUT_MS) {
+        return false;
+      }
+      delay(1);
+    }
+    return true;
+  }
+
+  // One CRLF-terminated line into _line (cut at UPLOAD_LINE_SIZE - 1)
+  bool _read_line(unsigned long start) {
+    size_t n = 0;
+    for (;;) {
+      if (!_wait(start)) {
+        return false;
+      }
+      int c = _client.read();
+      if (c < 0) {
+        continue;
+      }
+      _stats.bytesReceived++;
+      if (c == '\n') {
+        break;
+      }
+      if (c != '\r' && n < sizeof(_line) - 1) {
+        _line[n++] = c;
+      }
+    }
+    _line[n] = '\0';
+    return true;
+  }
+
+  // Skip `length` body bytes
+  bool _drain(size_t length, unsigned long start) {
+    while (length) {
+      if (!_wait(start)) {
+        return false;
+      }
+      size_t chunk = length < sizeof(_line) ? length : sizeof(_line);
+      int n = _client.read((uint8_t *)_line, chunk);
+      if (n > 0) {
+        length -= n;
+        _stats.bytesReceived += n;
+      }
+    }
+    return true;
+  }
+
+  // Status line, headers, body; *keep_alive false if the server closes
+  int _read_response(bool *keep_alive) {
+    unsigned long start = millis();
+    if (!_read_line(start)) {
+      return UPLOAD_ERR_TIMEOUT;
+    }
+    int status = 0;
+    if (strncmp(_line, "HTTP/1.", 7) != 0 || sscanf(_line + 8, " %d", &status) != 1 ||
+        status < 100) {
+      return UPLOAD_ERR_RESPONSE;
+    }
+    if (_line[7] == '0') {
+      *keep_alive = false;               // HTTP/1.0 closes unless asked otherwise
+    }
+
+    long contentLength = -1;
+    bool chunked = false;
+    for (;;) {
+      if (!_read_line(start)) {
+        return UPLOAD_ERR_TIMEOUT;
+      }
+      if (_line[0] == '\0') {
+        break;                           // End of headers
+      }
+      if (strncasecmp(_line, "Content-Length:", 15) == 0) {
+        contentLength = atol(_line + 15);
+      } else if (strncasecmp(_line, "Transfer-Encoding:", 18) == 0) {
+        chunked = strstr(_line + 18, "chunked") != NULL;
+      } else if (strncasecmp(_line, "Connection:", 11) == 0) {
+        *keep_alive = strstr(_line + 11, "close") == NULL && strstr(_line + 11, "Close") == NULL;
+      }
+    }
+
+    if (chunked) {
+      for (;;) {
+        if (!_read_line(start)) {
+          return UPLOAD_ERR_TIMEOUT;
+        }
+        long size = strtol(_line, NULL, 16);
+        if (size <= 0) {
+          break;
+        }
+        if (!_drain(size, start) || !_read_line(start)) {  // Data + its CRLF
+          return UPLOAD_ERR_TIMEOUT;
+        }
+      }
+      do {                               // Trailer up to the empty line
+        if (!_read_line(start)) {
+          return UPLOAD_ERR_TIMEOUT;
+        }
+      } while (_line[0] != '\0');
+    } else if (contentLength >= 0) {
+      if (!_drain(contentLength, start)) {
+        return UPLOAD_ERR_TIMEOUT;
+      }
+    } else if (status != 204 && status != 304) {
+      *keep_alive = false;               // Body runs until the server closes
+    }
+    return status;
+  }
+};
+
+#endif
@@ -6,6 +6,19 @@
  * 
  * Compatible with: SX1278, SX1276 LoRa modules
  * Frequency: 433 MHz / 868 MHz / 915 MHz (configurable)
+ * 
+ * One radio: use the classic functions (setup_ourlora(), send_a_msg(),
+ * ...), which drive the radio on LORA_CS_PIN / LORA_RST_PIN.
+ * Several radios: create one LoRaRadio<CS, RST, DIO0> per module.
+ * 
+ * Protocol layers live in their own headers, each including this one:
+ *   ourlora_adr.h      - adaptive data rate (OurLoRaAdr)
+ *   ourlora_reliable.h - ACKs and retransmission (OurLoRaReliable)
+ *   ourlora_survey.h   - channel noise survey (OurLoRaChannelSurvey)
+ *   ourlora_tdma.h     - TDMA star network (OurLoRaTdmaGateway / Node)
+ *   ourlora_mesh.h     - multi-hop routing (OurLoRaMesh)
+ *   ourlora_fec.h      - erasure code (OurLoRaFec)
+ *   ourlora_frag.h     - fragmentation of large messages (OurLoRaFragmenter)
 
  * Date: February 2026
  * DevisGit18 ( devisreesumesh@gmail.com )
@@ -21,10 +34,16 @@
 //  HARDWARE PIN CONFIGURATION
 // ============================================================
 // Change these if you wire LoRa module to different pins
+// (pins of the default radio used by the classic functions)
 #define LORA_CS_PIN    5   // Chip Select (NSS)
 #define LORA_RST_PIN   2   // Reset
 #define LORA_DIO0_PIN  4   // Digital I/O 0 (interrupt, optional)
 
+// SPI clock for the LoRa chip (SX127x supports up to 10 MHz)
+#ifndef OURLORA_SPI_CLOCK_HZ
+#define OURLORA_SPI_CLOCK_HZ  8000000
+#endif
+
 // ============================================================
 //  SX1278 CHIP REGISTER ADDRESSES
 // ============================================================
@@ -43,15 +62,22 @@
 #define REG_FIFO_RX_CURRENT_ADDR 0x10  // Current RX address
 #define REG_IRQ_FLAGS            0x12  // Interrupt flags
 #define REG_RX_NB_BYTES          0x13  // Number of bytes received
+#define REG_RX_HEADER_CNT_MSB    0x14  // Valid headers received (MSB, LSB at 0x15)
 #define REG_PKT_RSSI_VALUE       0x1A  // Packet signal strength
 #define REG_PKT_SNR_VALUE        0x19  // Packet signal to noise (FIXED: was 0x1B)
+#define REG_RSSI_VALUE           0x1B  // Current wideband RSSI (in RX)
+#define REG_HOP_CHANNEL          0x1C  // RX header info (CRC on payload)
 #define REG_MODEM_CONFIG_1       0x1D  // Modem configuration 1
 #define REG_MODEM_CONFIG_2       0x1E  // Modem configuration 2
+#define REG_SYMB_TIMEOUT_LSB     0x1F  // RX single timeout (LSB)
 #define REG_PREAMBLE_MSB         0x20  // Preamble length (MSB)
 #define REG_PREAMBLE_LSB         0x21  // Preamble length (LSB)
 #define REG_PAYLOAD_LENGTH       0x22  // Payload length
 #define REG_MODEM_CONFIG_3       0x26  // Modem configuration 3
+#define REG_DETECTION_OPTIMIZE   0x31  // LoRa detection optimize
+#define REG_DETECTION_THRESHOLD  0x37  // LoRa detection threshold
 #define REG_SYNC_WORD            0x39  // Network sync word
+#define REG_DIO_MAPPING_1        0x40  // DIO0..DIO3 pin function mapping
 #define REG_VERSION              0x42  // Chip version
 #define REG_PA_DAC               0x4D  // High power PA settings
 
@@ -63,13 +89,19 @@
 #define MODE_STDBY               0x01  // Standby mode
 #define MODE_TX                  0x03  // Transmit mode
 #define MODE_RX_CONTINUOUS       0x05  // Continuous receive
+#define MODE_RX_SINGLE           0x06  // Receive one packet, then STDBY
+#define MODE_CAD                 0x07  // Channel activity detection
 
 // ============================================================
 //  INTERRUPT FLAGS
 // ============================================================
 #define IRQ_TX_DONE_MASK         0x08  // TX complete flag
+#define IRQ_RX_TIMEOUT_MASK      0x80  // RX single: no preamble in time
 #define IRQ_RX_DONE_MASK         0x40  // RX complete flag
 #define IRQ_PAYLOAD_CRC_ERROR    0x20  // CRC error flag
+#define IRQ_CAD_DONE_MASK        0x04  // CAD finished
+#define IRQ_CAD_DETECTED_MASK    0x01  // CAD saw LoRa symbols
+#define HOP_CRC_ON_PAYLOAD       0x40  // REG_HOP_CHANNEL: header said CRC on
 
 // ============================================================
 //  POWER AMPLIFIER SETTINGS
@@ -77,379 +109,3067 @@
 #define PA_BOOST                 0x80  // Use PA_BOOST pin
 
 // ============================================================
-//  GLOBAL VARIABLES (Private)
+//  DIO0 PIN MAPPING (REG_DIO_MAPPING_1 bits 7-6)
 // ============================================================
-static int _lastRssi = 0;        // Last received signal strength
-static int _lastSnr = 0;         // Last signal to noise ratio
-static long _currentFreq = 0;    // Current frequency setting
+#define DIO0_RX_DONE             0x00  // DIO0 rises on RxDone
+#define DIO0_TX_DONE             0x40  // DIO0 rises on TxDone
+#define DIO0_CAD_DONE            0x80  // DIO0 rises on CadDone
+
+// Functions called from the DIO0 interrupt must live in IRAM on ESP32
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+// Completion callbacks (run from the driver call that services DIO0,
+// e.g. poll() - never from the interrupt itself)
+typedef void (*OurLoRaTxDoneCallback)(bool success);
+typedef void (*OurLoRaRxDoneCallback)(int packetLength);
+// Called from the DIO0 interrupt itself, see on_dio0()
+typedef void (*OurLoRaDio0Callback)(void *arg);
 
 // ============================================================
-//  LOW-LEVEL REGISTER ACCESS FUNCTIONS
+//  ASYNC TX QUEUE
 // ============================================================
+#ifndef OURLORA_TX_QUEUE_SIZE
+#define OURLORA_TX_QUEUE_SIZE    4     // Packets waiting to be sent
+#endif
+#define OURLORA_TX_TIMEOUT_MS    2000  // Margin on top of the airtime
 
-/*
- * Write a value to a register in the LoRa chip
- * 
- * Parameters:
- *   address - Register address (0x00 to 0x7F)
- *   value   - Byte value to write
- */
-void write_lora_register(uint8_t address, uint8_t value) {
-  digitalWrite(LORA_CS_PIN, LOW);        // Select chip
-  SPI.transfer(address | 0x80);          // Write mode (MSB = 1)
-  SPI.transfer(value);                   // Send value
-  digitalWrite(LORA_CS_PIN, HIGH);       // Deselect chip
-}
+// Per-packet completion status
+#define LORA_TX_OK               0     // TxDone seen
+#define LORA_TX_TIMEOUT          1     // No TxDone within the timeout
+#define LORA_TX_CHANNEL_BUSY     2     // LBT: channel busy on every attempt
 
-/*
- * Read a value from a register in the LoRa chip
- * 
- * Parameters:
- *   address - Register address (0x00 to 0x7F)
- * 
- * Returns:
- *   Byte value from register
- */
-uint8_t read_lora_register(uint8_t address) {
-  digitalWrite(LORA_CS_PIN, LOW);        // Select chip
-  SPI.transfer(address & 0x7F);          // Read mode (MSB = 0)
-  uint8_t value = SPI.transfer(0x00);    // Read value
-  digitalWrite(LORA_CS_PIN, HIGH);       // Deselect chip
-  return value;
-}
+// Called once per queued packet (from poll() or the call that saw TxDone)
+typedef void (*OurLoRaTxStatusCallback)(uint16_t packetId, uint8_t status);
+
+// Queue statistics, see tx_queue_stats()
+typedef struct {
+  uint8_t  depth;                      // Packets queued (incl. on air)
+  uint8_t  maxDepth;                   // High-water mark
+  uint32_t enqueued;                   // Accepted by enqueue()
+  uint32_t sent;                       // Completed with LORA_TX_OK
+  uint32_t timeouts;                   // Completed with LORA_TX_TIMEOUT
+  uint32_t dropped;                    // Rejected because queue was full
+} OurLoRaTxQueueStats;
+
+// ============================================================
+//  RX RING (filled when a DIO0 RxDone is serviced)
+// ============================================================
+#ifndef OURLORA_RX_RING_SIZE
+#define OURLORA_RX_RING_SIZE     8     // Frames buffered, power of 2
+#endif
+#if (OURLORA_RX_RING_SIZE & (OURLORA_RX_RING_SIZE - 1)) != 0
+#error "OURLORA_RX_RING_SIZE must be a power of 2"
+#endif
+
+// One received frame, see rx_pop()
+typedef struct {
+  int16_t  length;                     // Bytes in data, -1 = CRC error
+  int16_t  rssi;                       // Packet RSSI in dBm
+  int8_t   snr;                        // Packet SNR in dB
+  uint32_t timestampUs;                // micros() when DIO0 rose for RxDone
+  uint8_t  data[255];
+} OurLoRaRxFrame;
+
+// Async TX queue slot (internal)
+typedef struct {
+  uint16_t id;
+  uint8_t  length;
+  uint32_t queuedUs;                   // micros() at enqueue(), for the TX latency
+  uint8_t  data[255];
+} OurLoRaTxSlot;
+
+// ============================================================
+//  LISTEN BEFORE TALK (CAD)
+// ============================================================
+#ifndef OURLORA_LBT_MAX_ATTEMPTS
+#define OURLORA_LBT_MAX_ATTEMPTS 8     // CAD runs before giving up
+#endif
+#define OURLORA_LBT_MAX_BACKOFF_EXP 5  // Backoff window: up to 32 airtimes
+
+// Listen-before-talk statistics, see lbt_stats()
+typedef struct {
+  uint32_t cadRuns;                    // CAD operations started
+  uint32_t channelBusy;                // CAD found activity
+  uint32_t gaveUp;                     // Packets dropped, channel always busy
+  uint32_t backoffMs;                  // Total time spent backing off
+} OurLoRaLbtStats;
+
+// ============================================================
+//  DUTY-CYCLED RX (PREAMBLE SNIFFING)
+// ============================================================
+// The receiver sleeps and wakes every interval for a CAD (~2 symbols).
+// Senders stretch their preamble over a whole interval, so a CAD
+// always falls into it; on CadDetected the receiver stays in RX single
+// until the packet is in, then sleeps again.
+#ifndef OURLORA_SNIFF_INTERVAL_MS
+#define OURLORA_SNIFF_INTERVAL_MS    1000  // Sleep between two CADs
+#endif
+#ifndef OURLORA_SNIFF_MARGIN_SYMBOLS
+#define OURLORA_SNIFF_MARGIN_SYMBOLS 8     // Wake preamble beyond the interval
+#endif
+#ifndef OURLORA_SNIFF_RX_SYMBOLS
+#define OURLORA_SNIFF_RX_SYMBOLS     16    // RX single timeout after a detection
+#endif
+
+// Sniffing statistics, see sniff_stats()
+typedef struct {
+  uint32_t wakeups;                    // CAD windows run
+  uint32_t detections;                 // CAD saw LoRa symbols
+  uint32_t frames;                     // Packets received (CRC errors too)
+  uint32_t falseWakes;                 // Detection, but no packet followed
+  uint32_t awakeMs;                    // Time in CAD or RX
+  uint32_t elapsedMs;                  // Time since start_sniffing()
+  uint32_t rxDutyPpm;                  // awakeMs / elapsedMs, per million
+} OurLoRaSniffStats;
+
+// ============================================================
+//  NOISE FLOOR
+// ============================================================
+// The wideband RSSI (REG_RSSI_VALUE, valid in RX) read a few dozen
+// times on a channel: the average catches steady noise and, weighted
+// by how often they are on, bursty interferers (other networks, ISM
+// band gadgets).
+#ifndef OURLORA_SURVEY_SAMPLES
+#define OURLORA_SURVEY_SAMPLES     32    // RSSI readings per channel
+#endif
+#ifndef OURLORA_SURVEY_SAMPLE_US
+#define OURLORA_SURVEY_SAMPLE_US   250   // Between two readings
+#endif
+#define OURLORA_SURVEY_SETTLE_US   500   // PLL lock and first RSSI after a retune
+#define OURLORA_SURVEY_MAX_SAMPLES 64
+#define OURLORA_SURVEY_BUSY_DB     6     // Reading this far above the floor = busy
+#define OURLORA_SURVEY_NO_FLOOR    0x7FFF  // measure_noise(): no long-term floor known
+
+// One channel measurement, see measure_noise()
+typedef struct {
+  int16_t meanDbm;                     // Average of the readings
+  int16_t floorDbm;                    // Quietest reading
+  int16_t peakDbm;                     // Loudest reading
+  uint8_t busyPct;                     // Readings OURLORA_SURVEY_BUSY_DB above the floor
+} OurLoRaNoiseReading;
+
+// ============================================================
+//  LINK STATISTICS
+// ============================================================
+// Counters kept by every radio (LoRa mode; FSK has fsk_stats()).
+// RSSI and SNR of good frames go into fixed-width histogram bins,
+// the outer bins also take everything beyond them.
+#define OURLORA_STATS_RSSI_BINS    8
+#define OURLORA_STATS_RSSI_LOW     -130  // Bin 0: below -120 dBm
+#define OURLORA_STATS_RSSI_STEP    10    // dB per bin
+#define OURLORA_STATS_SNR_BINS     8
+#define OURLORA_STATS_SNR_LOW      -20   // Bin 0: below -16 dB
+#define OURLORA_STATS_SNR_STEP     4     // dB per bin
+
+// Min / max / mean of a latency, see link_stats()
+typedef struct {
+  uint32_t count;                      // Samples
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint32_t meanUs;
+} OurLoRaLatencyStats;
+
+// Link and radio counters since setup() or reset_link_stats()
+typedef struct {
+  uint32_t txOk;                       // TxDone seen
+  uint32_t txTimeouts;                 // No TxDone within the timeout
+  uint32_t rxOk;                       // Frames with a good CRC
+  uint32_t crcErrors;                  // Frames with a bad CRC
+  uint32_t noCrc;                      // Frames without CRC, dropped
+  uint32_t truncated;                  // Longer than the caller's buffer
+  uint32_t rxOverruns;                 // Lost, RX ring full
+  uint32_t rxMissed;                   // Lost, next frame arrived before RxDone was serviced
+  uint32_t airtimeMs;                  // Time on air of all transmissions (FSK too)
+  uint32_t modeSwitches[8];            // REG_OP_MODE writes per mode (MODE_SLEEP..MODE_CAD)
+  uint32_t rssiHist[OURLORA_STATS_RSSI_BINS];  // Bin i from LOW + i x STEP dBm
+  uint32_t snrHist[OURLORA_STATS_SNR_BINS];
+  OurLoRaLatencyStats txLatency;       // send / enqueue to TxDone
+  OurLoRaLatencyStats rxLatency;       // RxDone to rx_pop() / check_for_msg()
+  uint32_t elapsedMs;                  // Time the counters cover
+} OurLoRaLinkStats;
 
 // ============================================================
-//  MAIN LORA FUNCTIONS
+//  MODEM PROFILES
 // ============================================================
+// Bandwidth (RegModemConfig1 bits 7-4)
+#define LORA_BW_7_8              0     // 7.8 kHz
+#define LORA_BW_10_4             1     // 10.4 kHz
+#define LORA_BW_15_6             2     // 15.6 kHz
+#define LORA_BW_20_8             3     // 20.8 kHz
+#define LORA_BW_31_25            4     // 31.25 kHz
+#define LORA_BW_41_7             5     // 41.7 kHz
+#define LORA_BW_62_5             6     // 62.5 kHz
+#define LORA_BW_125              7     // 125 kHz
+#define LORA_BW_250              8     // 250 kHz
+#define LORA_BW_500              9     // 500 kHz
+
+// Coding rate (RegModemConfig1 bits 3-1)
+#define LORA_CR_4_5              1
+#define LORA_CR_4_6              2
+#define LORA_CR_4_7              3
+#define LORA_CR_4_8              4
+
+// Low data rate optimize
+#define LORA_LDRO_AUTO           0     // On when a symbol lasts > 16 ms
+#define LORA_LDRO_OFF            1
+#define LORA_LDRO_ON             2
+
+static constexpr uint32_t _loraBwHz[10] = {
+  7810, 10420, 15630, 20830, 31250, 41670, 62500, 125000, 250000, 500000
+};
+
+static constexpr uint32_t _lora_bw_hz(uint8_t bw) {
+  return bw < 10 ? _loraBwHz[bw] : 500000;
+}
+
+// Symbol duration in microseconds: 2^SF / BW
+static constexpr uint32_t _lora_symbol_us(uint8_t sf, uint8_t bw) {
+  return (uint32_t)(((uint64_t)1 << (sf <= 12 ? sf : 12)) * 1000000ULL / _lora_bw_hz(bw));
+}
+
+// Semtech: LDRO is mandatory above 16 ms per symbol
+static constexpr bool _lora_ldro_needed(uint8_t sf, uint8_t bw) {
+  return _lora_symbol_us(sf, bw) > 16000;
+}
+
+// FRF = Frequency × 2^19 / 32 MHz
+static constexpr uint32_t _lora_frf(uint32_t frequency_hz) {
+  return (uint32_t)(((uint64_t)frequency_hz << 19) / 32000000ULL);
+}
+
+// Payload bits term of the Semtech time-on-air formula (AN1200.13)
+static constexpr int32_t _lora_payload_bits(uint8_t length, uint8_t sf, bool crc, bool implicit_header) {
+  return 8 * (int32_t)length - 4 * (int32_t)sf + 28 + (crc ? 16 : 0) - (implicit_header ? 20 : 0);
+}
+
+static constexpr uint32_t _lora_ceil_div(int32_t num, int32_t den) {
+  return num > 0 ? (uint32_t)((num + den - 1) / den) : 0;
+}
+
+// Symbols after the preamble: 8 + max(ceil(bits / 4(SF - 2DE)) × (CR + 4), 0)
+static constexpr uint32_t _lora_payload_symbols(uint8_t length, uint8_t sf, uint8_t cr,
+                                                bool crc, bool implicit_header, bool ldro) {
+  return 8 + _lora_ceil_div(_lora_payload_bits(length, sf, crc, implicit_header),
+                            4 * ((int32_t)sf - (ldro ? 2 : 0))) * (cr + 4);
+}
+
+// Time on air in µs: (preamble + 4.25 + payload symbols) × 2^SF / BW
+static constexpr uint32_t _lora_time_on_air_us(uint8_t length, uint8_t sf, uint8_t bw, uint8_t cr,
+                                               bool crc, bool implicit_header, bool ldro,
+                                               uint16_t preamble) {
+  return (uint32_t)((((uint64_t)4 * preamble + 17 +
+                      4 * (uint64_t)_lora_payload_symbols(length, sf, cr, crc, implicit_header, ldro))
+                     << (sf <= 12 ? sf : 12)) * 1000000ULL / (4ULL * _lora_bw_hz(bw)));
+}
 
 /*
- * Initialize the LoRa module
- * 
- * Parameters:
- *   frequency_mhz - Operating frequency in MHz (433, 868, or 915)
- * 
- * Returns:
- *   true  - Initialization successful
- *   false - Initialization failed (module not detected)
- * 
- * Example:
- *   if (!setup_ourlora(433)) {
- *     Serial.println("LoRa init failed!");
- *   }
+ * Profile rule checks
+ * These are deliberately not constexpr: a constexpr profile that
+ * breaks a rule calls one of them and fails to compile, with the
+ * rule in the error message. Profiles built at run time pass the
+ * value through unchanged - check them with valid().
  */
-bool setup_ourlora(long frequency_mhz) {
-  Serial.println("\n=== Initializing OurLoRa ===");
-  
-  // Configure pins
-  pinMode(LORA_CS_PIN, OUTPUT);
-  pinMode(LORA_RST_PIN, OUTPUT);
-  pinMode(LORA_DIO0_PIN, INPUT);
-  digitalWrite(LORA_CS_PIN, HIGH);
-  
-  // Hardware reset
-  digitalWrite(LORA_RST_PIN, LOW);
-  delay(10);
-  digitalWrite(LORA_RST_PIN, HIGH);
-  delay(10);
-  
-  // Check chip version (SX1278 should return 0x12)
-  uint8_t version = read_lora_register(REG_VERSION);
-  Serial.print("LoRa Chip Version: 0x");
-  Serial.println(version, HEX);
-  
-  if (version != 0x12) {
-    Serial.println("ERROR: LoRa module not detected!");
-    return false;
-  }
-  
-  // Enter sleep mode to configure
-  write_lora_register(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_SLEEP);
-  delay(10);
-  
-  // Calculate and set frequency
-  // Formula: FRF = (Frequency × 2^19) / 32000000
-  uint32_t frf = ((uint64_t)frequency_mhz * 1000000 << 19) / 32000000;
-  write_lora_register(REG_FRF_MSB, (uint8_t)(frf >> 16));
-  write_lora_register(REG_FRF_MID, (uint8_t)(frf >> 8));
-  write_lora_register(REG_FRF_LSB, (uint8_t)(frf >> 0));
-  _currentFreq = frequency_mhz;
-  
-  // Set FIFO base addresses
-  write_lora_register(REG_FIFO_TX_BASE_ADDR, 0x00);
-  write_lora_register(REG_FIFO_RX_BASE_ADDR, 0x00);
-  
-  // Enable LNA boost
-  write_lora_register(REG_LNA, read_lora_register(REG_LNA) | 0x03);
-  
-  // Configure modem
-  // Bandwidth = 125 kHz, Coding Rate = 4/5, Explicit Header
-  write_lora_register(REG_MODEM_CONFIG_1, 0x72);
-  
-  // Spreading Factor = 7, CRC enabled
-  write_lora_register(REG_MODEM_CONFIG_2, 0x74);
-  
-  // Low data rate optimize OFF, AGC auto ON
-  write_lora_register(REG_MODEM_CONFIG_3, 0x04);
-  
-  // Set preamble length (8 symbols)
-  write_lora_register(REG_PREAMBLE_MSB, 0x00);
-  write_lora_register(REG_PREAMBLE_LSB, 0x08);
-  
-  // Set sync word (0x12 = private network)
-  write_lora_register(REG_SYNC_WORD, 0x12);
-  
-  // Set output power (17 dBm using PA_BOOST)
-  write_lora_register(REG_PA_CONFIG, PA_BOOST | 0x0F);
-  
-  // Enable high power mode
-  write_lora_register(REG_PA_DAC, 0x87);
-  
-  // Enter standby mode
-  write_lora_register(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_STDBY);
-  delay(10);
-  
-  Serial.print("OurLoRa initialized at ");
-  Serial.print(frequency_mhz);
-  Serial.println(" MHz!");
-  
-  return true;
-}
+inline uint32_t ourlora_profile_error_frequency_out_of_range(uint32_t v) { return v; }
+inline uint8_t  ourlora_profile_error_sf_out_of_range(uint8_t v) { return v; }   // SF6..SF12
+inline uint8_t  ourlora_profile_error_sf6_needs_implicit_header(uint8_t v) { return v; }
+inline uint8_t  ourlora_profile_error_bandwidth_invalid(uint8_t v) { return v; }
+inline uint8_t  ourlora_profile_error_coding_rate_invalid(uint8_t v) { return v; }
+inline uint16_t ourlora_profile_error_preamble_too_short(uint16_t v) { return v; } // >= 6
+inline bool     ourlora_profile_error_ldro_required(bool v) { return v; }       // > 16 ms symbols
+inline uint32_t ourlora_profile_error_fsk_bitrate_out_of_range(uint32_t v) { return v; } // 1.2k..300k
+inline uint32_t ourlora_profile_error_fsk_deviation_too_wide(uint32_t v) { return v; }   // see below
 
 /*
- * Send a message via LoRa
+ * Complete modem setup plus the register image that applies it
  * 
- * Parameters:
- *   message - Pointer to data buffer to send
- *   length  - Number of bytes to send
+ * Declare profiles constexpr: the rules are checked and the register
+ * bytes computed by the compiler, so switching profile is a couple of
+ * burst writes (and nothing at all for registers that already match).
  * 
- * Returns:
- *   true  - Message sent successfully
- *   false - Transmission failed (timeout)
+ * Parameters:
+ *   frequency_hz - Carrier, 137 MHz to 1020 MHz
+ *   sf           - Spreading factor 7..12
+ *   bw           - LORA_BW_*
+ *   cr           - LORA_CR_*
+ *   crc          - Payload CRC on/off
+ *   ldro         - LORA_LDRO_AUTO / _OFF / _ON (OFF fails when required)
+ *   preamble     - Preamble symbols (6 or more)
+ *   sync_word    - Network ID (0x12 private, 0x34 LoRaWAN)
+ *   implicit_length - 0 = explicit header (default). 1..255 = implicit
+ *                  header with this fixed payload length: no header
+ *                  symbols on air, both sides must use the same profile
+ *                  and every packet must have exactly this length.
+ *                  SF6 is only allowed in implicit mode.
  * 
  * Example:
- *   String msg = "Hello";
- *   send_a_msg((uint8_t*)msg.c_str(), msg.length());
+ *   constexpr OurLoRaModemProfile FAR(433175000UL, 12, LORA_BW_125);  // LDRO auto-on
+ *   radio.setup(FAR);
+ *   constexpr OurLoRaModemProfile BAD(433175000UL, 12, LORA_BW_125,
+ *                                     LORA_CR_4_5, true, LORA_LDRO_OFF);  // Compile error
+ *   constexpr OurLoRaModemProfile REPORT(433175000UL, 7, LORA_BW_125, LORA_CR_4_5,
+ *                                        true, LORA_LDRO_AUTO, 8, 0x12,
+ *                                        sizeof(struct_message));   // Implicit header
  */
-bool send_a_msg(uint8_t *message, uint8_t length) {
-  // Enter standby mode
-  write_lora_register(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_STDBY);
+struct OurLoRaModemProfile {
+  uint32_t frequencyHz;
+  uint8_t  spreadingFactor;
+  uint8_t  bandwidth;                  // LORA_BW_*
+  uint8_t  codingRate;                 // LORA_CR_*
+  bool     crc;
+  bool     lowDataRateOptimize;        // Resolved from LORA_LDRO_*
+  uint16_t preambleLength;
+  uint8_t  syncWord;
+  uint8_t  implicitLength;             // 0 = explicit header
   
-  // Clear all interrupt flags
-  write_lora_register(REG_IRQ_FLAGS, 0xFF);
+  // Register image
+  uint8_t  frf[3];                     // REG_FRF_MSB..REG_FRF_LSB
+  uint8_t  modem[5];                   // REG_MODEM_CONFIG_1..REG_PREAMBLE_LSB
+  uint8_t  modemConfig3;               // REG_MODEM_CONFIG_3
+  uint8_t  detectionOptimize;          // REG_DETECTION_OPTIMIZE
+  uint8_t  detectionThreshold;         // REG_DETECTION_THRESHOLD
   
-  // Set FIFO pointer to TX base
-  write_lora_register(REG_FIFO_ADDR_PTR, 0x00);
+  constexpr OurLoRaModemProfile(uint32_t frequency_hz,
+                                uint8_t sf = 7,
+                                uint8_t bw = LORA_BW_125,
+                                uint8_t cr = LORA_CR_4_5,
+                                bool crc_on = true,
+                                uint8_t ldro = LORA_LDRO_AUTO,
+                                uint16_t preamble = 8,
+                                uint8_t sync_word = 0x12,
+                                uint8_t implicit_length = 0)
+    : frequencyHz(frequency_hz >= 137000000UL && frequency_hz <= 1020000000UL
+                  ? frequency_hz : ourlora_profile_error_frequency_out_of_range(frequency_hz)),
+      spreadingFactor(sf < 6 || sf > 12 ? ourlora_profile_error_sf_out_of_range(sf) :
+                      sf == 6 && implicit_length == 0 ? ourlora_profile_error_sf6_needs_implicit_header(sf) :
+                      sf),
+      bandwidth(bw <= LORA_BW_500 ? bw : ourlora_profile_error_bandwidth_invalid(bw)),
+      codingRate(cr >= LORA_CR_4_5 && cr <= LORA_CR_4_8 ? cr : ourlora_profile_error_coding_rate_invalid(cr)),
+      crc(crc_on),
+      lowDataRateOptimize(ldro == LORA_LDRO_ON ? true :
+                          ldro == LORA_LDRO_AUTO ? _lora_ldro_needed(sf, bw) :
+                          _lora_ldro_needed(sf, bw) ? ourlora_profile_error_ldro_required(false) : false),
+      preambleLength(preamble >= 6 ? preamble : ourlora_profile_error_preamble_too_short(preamble)),
+      syncWord(sync_word),
+      implicitLength(implicit_length),
+      frf{ (uint8_t)(_lora_frf(frequency_hz) >> 16),
+           (uint8_t)(_lora_frf(frequency_hz) >> 8),
+           (uint8_t)(_lora_frf(frequency_hz) >> 0) },
+      modem{ (uint8_t)((bw << 4) | (cr << 1) | (implicit_length ? 0x01 : 0x00)),
+             (uint8_t)((sf << 4) | (crc_on ? 0x04 : 0x00)),  // Symbol timeout MSB = 0
+             0x64,                                           // Symbol timeout LSB (reset value)
+             (uint8_t)(preamble >> 8),
+             (uint8_t)(preamble & 0xFF) },
+      modemConfig3((uint8_t)((ldro == LORA_LDRO_ON || (ldro == LORA_LDRO_AUTO && _lora_ldro_needed(sf, bw))
+                             ? 0x08 : 0x00) | 0x04)),        // AGC auto ON
+      detectionOptimize(sf == 6 ? 0xC5 : 0xC3),
+      detectionThreshold(sf == 6 ? 0x0C : 0x0A) {}
   
-  // Write data to FIFO buffer
-  digitalWrite(LORA_CS_PIN, LOW);
-  SPI.transfer(REG_FIFO | 0x80);  // Write mode
-  for (int i = 0; i < length; i++) {
-    SPI.transfer(message[i]);
+  // All rules met? (constexpr profiles always are)
+  constexpr bool valid() const {
+    return frequencyHz >= 137000000UL && frequencyHz <= 1020000000UL &&
+           spreadingFactor >= 6 && spreadingFactor <= 12 &&
+           (spreadingFactor != 6 || implicitLength != 0) &&
+           bandwidth <= LORA_BW_500 &&
+           codingRate >= LORA_CR_4_5 && codingRate <= LORA_CR_4_8 &&
+           preambleLength >= 6 &&
+           (lowDataRateOptimize || !_lora_ldro_needed(spreadingFactor, bandwidth));
   }
-  digitalWrite(LORA_CS_PIN, HIGH);
-  
-  // Set payload length
-  write_lora_register(REG_PAYLOAD_LENGTH, length);
-  
-  // Start transmission
-  write_lora_register(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_TX);
   
-  // Wait for TX done (timeout after 2 seconds)
-  unsigned long startTime = millis();
-  while (!(read_lora_register(REG_IRQ_FLAGS) & IRQ_TX_DONE_MASK)) {
-    if (millis() - startTime > 2000) {
-      Serial.println("TX timeout!");
-      return false;
-    }
-    delay(1);
+  constexpr uint32_t symbolUs() const {
+    return _lora_symbol_us(spreadingFactor, bandwidth);
   }
   
-  // Clear TX done flag
-  write_lora_register(REG_IRQ_FLAGS, IRQ_TX_DONE_MASK);
-  
-  // Return to standby
-  write_lora_register(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_STDBY);
-  
-  return true;
+  /*
+   * How long a packet occupies the air, in microseconds
+   * Example:
+   *   static_assert(LORA_PROFILE_433_SF7.timeOnAirUs(24) < 100000, "report too slow");
+   */
+  constexpr uint32_t timeOnAirUs(uint8_t payload_length) const {
+    return _lora_time_on_air_us(payload_length, spreadingFactor, bandwidth, codingRate,
+                                crc, implicitLength != 0, lowDataRateOptimize, preambleLength);
+  }
+};
+
+// Ready-made profiles (BW 125 kHz, CR 4/5, CRC on, sync word 0x12).
+// 433 MHz ones sit on 433.175 MHz, inside the 433.05-434.79 MHz ISM band.
+static constexpr OurLoRaModemProfile LORA_PROFILE_433_SF7(433175000UL);       // setup_ourlora(433)
+static constexpr OurLoRaModemProfile LORA_PROFILE_433_SF12(433175000UL, 12);  // Long range
+static constexpr OurLoRaModemProfile LORA_PROFILE_868_SF7(868100000UL);       // setup_ourlora(868)
+static constexpr OurLoRaModemProfile LORA_PROFILE_915_SF7(915000000UL);
+
+// Lowest SNR (dB) each SF still demodulates, SF7..SF12 (SX1276 datasheet)
+static constexpr int8_t _loraRequiredSnr[6] = { -7, -10, -12, -15, -17, -20 };
+
+// ============================================================
+//  FSK PACKET MODE
+// ============================================================
+// The SX1278 also speaks FSK, up to 300 kbit/s against 5.5 kbit/s for
+// LoRa SF7/BW125, over a much shorter range. Good for moving history or
+// configuration between neighbouring nodes. FSK and LoRa have separate
+// register pages at 0x0D..0x3F (the chip keeps both while the other
+// mode is active), so switching back and forth is a few writes.
+//
+// Packets use variable length: a length byte, up to 255 bytes, CRC.
+// The FIFO holds only 64 bytes, so longer packets are streamed: the
+// driver tops it up while sending and drains it while receiving,
+// whenever the fill level crosses OURLORA_FSK_FIFO_THRESHOLD.
+#define REG_BITRATE_MSB          0x02  // FSK: bit rate = 32 MHz / value
+#define REG_FDEV_MSB             0x04  // FSK: deviation in 61 Hz steps
+#define REG_RX_CONFIG            0x0D  // FSK: AFC / AGC triggers
+#define REG_FSK_RSSI_VALUE       0x11  // FSK: -RSSI × 2
+#define REG_RX_BW                0x12  // FSK: channel filter
+#define REG_AFC_BW               0x13  // FSK: filter while AFC runs
+#define REG_PREAMBLE_DETECT      0x1F  // FSK: preamble detector
+#define REG_FSK_PREAMBLE_MSB     0x25  // FSK: preamble length in bytes
+#define REG_SYNC_CONFIG          0x27  // FSK: sync word on/size, auto restart
+#define REG_SYNC_VALUE_1         0x28  // FSK: first sync byte
+#define REG_PACKET_CONFIG_1      0x30  // FSK: length format, whitening, CRC
+#define REG_FIFO_THRESH          0x35  // FSK: TX start, FIFO threshold
+#define REG_IRQ_FLAGS_2          0x3F  // FSK: FIFO and packet flags
+
+#define MODE_FSK_RX              0x05  // FSK receive (continuous)
+
+#define IRQ2_FIFO_EMPTY          0x40  // REG_IRQ_FLAGS_2
+#define IRQ2_FIFO_LEVEL          0x20  // More than the threshold in the FIFO
+#define IRQ2_FIFO_OVERRUN        0x10  // Write 1: clears flag and FIFO
+#define IRQ2_PACKET_SENT         0x08
+#define IRQ2_PAYLOAD_READY       0x04
+#define IRQ2_CRC_OK              0x02
+
+#define OURLORA_FSK_FIFO_SIZE    64
+#ifndef OURLORA_FSK_FIFO_THRESHOLD
+#define OURLORA_FSK_FIFO_THRESHOLD 32  // Refill / drain point (bytes)
+#endif
+#ifndef OURLORA_FSK_POLL_US
+#define OURLORA_FSK_POLL_US      100   // fsk_send() polling step
+#endif
+
+// FSK statistics, see fsk_stats()
+typedef struct {
+  uint32_t sent;                       // Packets with PacketSent
+  uint32_t received;                   // Packets into the RX ring
+  uint32_t crcErrors;                  // Packets with a bad CRC
+  uint32_t fifoTopUps;                 // TX FIFO refills + RX FIFO drains
+  uint32_t fifoOverruns;               // RX FIFO overflowed (poll too slow)
+  uint32_t timeouts;                   // PacketSent never came
+  uint32_t switches;                   // start_fsk() calls
+  uint32_t lastSwitchUs;               // Time start_fsk() took last time
+} OurLoRaFskStats;
+
+// RxBwMant (bits 4-3) / RxBwExp (bits 2-0) of the narrowest channel
+// filter of at least need_hz (single side): 32 MHz / (mant × 2^(exp+2)).
+// step walks from 2.6 kHz (24, 7) up to 250 kHz (16, 1).
+static constexpr uint8_t _fsk_rx_bw(uint32_t need_hz, uint8_t step = 0) {
+  return step >= 20 ? 0x01 :
+         32000000UL / ((16UL + 4 * (2 - step % 3)) << (7 - step / 3 + 2)) >= need_hz
+           ? (uint8_t)(((2 - step % 3) << 3) | (7 - step / 3))
+           : _fsk_rx_bw(need_hz, step + 1);
 }
 
 /*
- * Check if a message has been received
+ * FSK modem setup (see start_fsk())
  * 
  * Parameters:
- *   buffer    - Pointer to buffer where received data will be stored
- *   maxLength - Maximum size of buffer
- * 
- * Returns:
- *   > 0  - Number of bytes received
- *   0    - No packet received
- *   -1   - CRC error (corrupted packet)
+ *   frequency_hz   - Carrier, usually the LoRa channel
+ *   bitrate_bps    - 1200..300000
+ *   deviation_hz   - Frequency deviation, 0 = bitrate / 2 (index 1).
+ *                    deviation + bitrate / 2 must fit the widest
+ *                    filter, 250 kHz.
+ *   preamble_bytes - 0x55 bytes before the sync word
+ *   sync_word      - Last of three sync bytes (network id)
  * 
  * Example:
- *   uint8_t rxBuffer[256];
- *   int size = check_for_msg(rxBuffer, sizeof(rxBuffer));
- *   if (size > 0) {
- *     Serial.print("Received: ");
- *     for (int i = 0; i < size; i++) {
- *       Serial.print((char)rxBuffer[i]);
- *     }
- *   }
+ *   constexpr OurLoRaFskProfile BULK(433175000UL, 100000);
+ *   radio.start_fsk(BULK);
  */
-int check_for_msg(uint8_t *buffer, uint8_t maxLength) {
-  // Read interrupt flags
-  uint8_t irqFlags = read_lora_register(REG_IRQ_FLAGS);
+struct OurLoRaFskProfile {
+  uint32_t frequencyHz;
+  uint32_t bitrate;
+  uint32_t deviationHz;
+  uint8_t  preambleBytes;
+  uint8_t  syncWord;
   
-  // Check if packet received
-  if (!(irqFlags & IRQ_RX_DONE_MASK)) {
-    return 0;  // No packet
-  }
-  
-  // Clear RX done flag
-  write_lora_register(REG_IRQ_FLAGS, IRQ_RX_DONE_MASK);
+  // Register image
+  uint8_t  frf[3];                     // REG_FRF_MSB..REG_FRF_LSB
+  uint8_t  rate[4];                    // REG_BITRATE_MSB..REG_FDEV_LSB
+  uint8_t  rxBw;                       // REG_RX_BW and REG_AFC_BW
   
-  // Check for CRC error
-  if (irqFlags & IRQ_PAYLOAD_CRC_ERROR) {
-    Serial.println("CRC error - packet corrupted!");
-    write_lora_register(REG_IRQ_FLAGS, IRQ_PAYLOAD_CRC_ERROR);
-    return -1;
-  }
+  constexpr OurLoRaFskProfile(uint32_t frequency_hz,
+                              uint32_t bitrate_bps = 250000,
+                              uint32_t deviation_hz = 0,
+                              uint8_t preamble_bytes = 5,
+                              uint8_t sync_word = 0x12)
+    : frequencyHz(frequency_hz >= 137000000UL && frequency_hz <= 1020000000UL
+                  ? frequency_hz : ourlora_profile_error_frequency_out_of_range(frequency_hz)),
+      bitrate(bitrate_bps >= 1200 && bitrate_bps <= 300000
+              ? bitrate_bps : ourlora_profile_error_fsk_bitrate_out_of_range(bitrate_bps)),
+      deviationHz((deviation_hz ? deviation_hz : bitrate_bps / 2) + bitrate_bps / 2 <= 250000
+                  ? (deviation_hz ? deviation_hz : bitrate_bps / 2)
+                  : ourlora_profile_error_fsk_deviation_too_wide(deviation_hz)),
+      preambleBytes(preamble_bytes),
+      syncWord(sync_word),
+      frf{ (uint8_t)(_lora_frf(frequency_hz) >> 16),
+           (uint8_t)(_lora_frf(frequency_hz) >> 8),
+           (uint8_t)(_lora_frf(frequency_hz) >> 0) },
+      rate{ (uint8_t)((32000000UL / bitrate_bps) >> 8),
+            (uint8_t)(32000000UL / bitrate_bps),
+            (uint8_t)(((uint64_t)(deviation_hz ? deviation_hz : bitrate_bps / 2) << 19) / 32000000ULL >> 8),
+            (uint8_t)(((uint64_t)(deviation_hz ? deviation_hz : bitrate_bps / 2) << 19) / 32000000ULL) },
+      rxBw(_fsk_rx_bw((deviation_hz ? deviation_hz : bitrate_bps / 2) + bitrate_bps / 2)) {}
   
-  // Get packet length
-  uint8_t packetLength = read_lora_register(REG_RX_NB_BYTES);
-  if (packetLength > maxLength) {
-    packetLength = maxLength;  // Truncate if too large
+  constexpr bool valid() const {
+    return frequencyHz >= 137000000UL && frequencyHz <= 1020000000UL &&
+           bitrate >= 1200 && bitrate <= 300000 &&
+           deviationHz + bitrate / 2 <= 250000;
   }
   
-  // Get current FIFO RX address
-  uint8_t currentAddr = read_lora_register(REG_FIFO_RX_CURRENT_ADDR);
-  write_lora_register(REG_FIFO_ADDR_PTR, currentAddr);
-  
-  // Read data from FIFO
-  digitalWrite(LORA_CS_PIN, LOW);
-  SPI.transfer(REG_FIFO & 0x7F);  // Read mode
-  for (int i = 0; i < packetLength; i++) {
-    buffer[i] = SPI.transfer(0x00);
+  // Preamble, 3 sync bytes, length byte, payload, CRC
+  constexpr uint32_t timeOnAirUs(uint8_t payload_length) const {
+    return (uint32_t)(((uint64_t)preambleBytes + 3 + 1 + payload_length + 2) * 8000000ULL / bitrate);
   }
-  digitalWrite(LORA_CS_PIN, HIGH);
-  
-  // Read signal quality
-  // Use frequency-dependent offset for accurate RSSI
-  // < 525 MHz uses offset 164, >= 525 MHz uses offset 157
-  int rssi_offset = (_currentFreq < 525) ? 164 : 157;
-  _lastRssi = read_lora_register(REG_PKT_RSSI_VALUE) - rssi_offset;
-  _lastSnr = (int8_t)read_lora_register(REG_PKT_SNR_VALUE) / 4;
-  
-  return packetLength;
-}
+};
 
-/*
- * Start continuous receive mode
- * Call this once in setup() to enable receiving
- * 
- * Example:
- *   start_listening();
- */
-void start_listening() {
-  // Enter standby
-  write_lora_register(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_STDBY);
-  
-  // Clear interrupt flags
-  write_lora_register(REG_IRQ_FLAGS, 0xFF);
-  
-  // Set FIFO RX base
-  write_lora_register(REG_FIFO_ADDR_PTR, 0x00);
-  
-  // Enter continuous RX mode
-  write_lora_register(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_RX_CONTINUOUS);
-}
+static constexpr OurLoRaFskProfile FSK_PROFILE_433_250K(433175000UL);          // ~45x SF7
+static constexpr OurLoRaFskProfile FSK_PROFILE_433_50K(433175000UL, 50000);    // More range
 
-/*
- * Get signal strength of last received packet
- * 
- * Returns:
- *   RSSI value in dBm (typically -120 to -30)
- *   More negative = weaker signal
- * 
- * Example:
- *   int rssi = get_signal_strength();
- *   Serial.print("Signal: ");
- *   Serial.print(rssi);
- *   Serial.println(" dBm");
- */
-int get_signal_strength() {
-  return _lastRssi;
-}
+// ============================================================
+//  DUTY CYCLE
+// ============================================================
+// Airtime is counted over a sliding window split into slots; a
+// transmission is allowed when the airtime of the last window plus
+// the new packet fits the band's limit.
+#ifndef OURLORA_DUTY_WINDOW_MS
+#define OURLORA_DUTY_WINDOW_MS   3600000UL  // Regulatory window (1 hour)
+#endif
+#ifndef OURLORA_DUTY_SLOTS
+#define OURLORA_DUTY_SLOTS       6          // Window resolution
+#endif
 
-/*
- * Get signal to noise ratio of last received packet
- * 
- * Returns:
- *   SNR value in dB
- *   Higher = better quality
- * 
- * Example:
- *   int snr = get_signal_quality();
- *   Serial.print("SNR: ");
- *   Serial.print(snr);
- *   Serial.println(" dB");
- */
-int get_signal_quality() {
-  return _lastSnr;
-}
+// One regulated sub-band, duty cycle in 0.01 % steps (100 = 1 %)
+typedef struct {
+  uint32_t lowHz;
+  uint32_t highHz;
+  uint16_t dutyCycleBp;
+} OurLoRaDutyBand;
 
-/*
- * Put LoRa module in sleep mode (low power)
- * Use when you want to save battery
- * 
- * Example:
- *   go_to_sleep();
- */
-void go_to_sleep() {
-  write_lora_register(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_SLEEP);
+// ETSI EN 300 220 / ERC Rec 70-03 (Europe). Frequencies not listed
+// (e.g. US 915 MHz) have no duty-cycle limit.
+static constexpr OurLoRaDutyBand _loraDutyBands[] = {
+  { 433050000UL, 434790000UL, 1000 },  // 433 MHz ISM:   10 %
+  { 863000000UL, 868000000UL,  100 },  // Band g:        1 %
+  { 868000000UL, 868600000UL,  100 },  // Band g1:       1 %
+  { 868700000UL, 869200000UL,   10 },  // Band g2:       0.1 %
+  { 869400000UL, 869650000UL, 1000 },  // Band g3:       10 %
+  { 869700000UL, 870000000UL,  100 },  // Band g4:       1 %
+};
+#define OURLORA_DUTY_BANDS  (sizeof(_loraDutyBands) / sizeof(_loraDutyBands[0]))
+
+// Index of the band holding frequency_hz, -1 = not regulated
+static constexpr int8_t _lora_duty_band(uint32_t frequency_hz, uint8_t i = 0) {
+  return i >= OURLORA_DUTY_BANDS ? -1 :
+         (frequency_hz >= _loraDutyBands[i].lowHz && frequency_hz < _loraDutyBands[i].highHz)
+         ? (int8_t)i : _lora_duty_band(frequency_hz, i + 1);
 }
 
+// Duty cycle statistics for the active band, see duty_cycle_stats()
+typedef struct {
+  uint16_t dutyCycleBp;                // Band limit in 0.01 % (0 = none)
+  uint32_t limitUs;                    // Airtime allowed per window
+  uint32_t usedUs;                     // Airtime used in the last window
+  uint32_t remainingUs;                // limitUs - usedUs
+  uint32_t rejected;                   // send_a_msg()/start_transmit() refused
+  uint32_t deferred;                   // Queued packets held back
+} OurLoRaDutyCycleStats;
+
+// ============================================================
+//  PIN BINDING
+// ============================================================
+
 /*
- * Wake up LoRa module (exit sleep mode)
- * 
- * Example:
- *   wake_up_lora();
+ * Pins fixed at compile time - no RAM, calls fold to constants
+ * Use through LoRaRadio<CsPin, RstPin, Dio0Pin>.
  */
-void wake_up_lora() {
-  write_lora_register(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_STDBY);
-  delay(10);
-}
+template <uint8_t CsPin, uint8_t RstPin, uint8_t Dio0Pin>
+struct OurLoRaPins {
+  static uint8_t cs()   { return CsPin; }
+  static uint8_t rst()  { return RstPin; }
+  static uint8_t dio0() { return Dio0Pin; }
+};
 
 /*
- * Change transmission power
- * 
- * Parameters:
- *   power_dbm - Power in dBm (2 to 17)
- *               Higher = longer range, more battery use
- * 
- * Example:
- *   set_tx_power(17);  // Maximum power
+ * Pins chosen at run time (e.g. read from a config)
+ * Use through RuntimeLoRaRadio.
  */
-void set_tx_power(int power_dbm) {
-  if (power_dbm < 2) power_dbm = 2;
-  if (power_dbm > 17) power_dbm = 17;
-  
-  write_lora_register(REG_PA_CONFIG, PA_BOOST | (power_dbm - 2));
-}
+struct OurLoRaRuntimePins {
+  uint8_t csPin, rstPin, dio0Pin;
+  OurLoRaRuntimePins(uint8_t cs, uint8_t rst, uint8_t dio0)
+    : csPin(cs), rstPin(rst), dio0Pin(dio0) {}
+  uint8_t cs() const   { return csPin; }
+  uint8_t rst() const  { return rstPin; }
+  uint8_t dio0() const { return dio0Pin; }
+};
+
+// ============================================================
+//  RADIO CLASS
+// ============================================================
 
 /*
- * Change sync word (network ID)
- * Both sender and receiver must use same sync word
+ * One SX127x radio with all of its driver state
  * 
- * Parameters:
- *   sync_word - Byte value (0x00 to 0xFF)
- *               Default: 0x12 (private network)
- *               LoRaWAN: 0x34
+ * Every instance owns its pins, RX ring, TX queue, register shadow
+ * and callbacks, so several radios (e.g. a dual-channel gateway)
+ * can run in the same firmware. Pins come from the Pins policy:
+ * OurLoRaPins<...> binds them at compile time, OurLoRaRuntimePins
+ * keeps them in RAM.
  * 
  * Example:
- *   set_network_id(0x42);  // Custom network
+ *   LoRaRadio<5, 2, 4>   uplink;      // CS=5,  RST=2,  DIO0=4
+ *   LoRaRadio<15, 13, 12> downlink;   // CS=15, RST=13, DIO0=12
+ *   uplink.setup(433);
+ *   downlink.setup(434);
  */
-void set_network_id(uint8_t sync_word) {
-  write_lora_register(REG_SYNC_WORD, sync_word);
-}
+template <class Pins>
+class OurLoRaRadio : private Pins {
+public:
+  OurLoRaRadio(SPIClass &spi = SPI)
+    : Pins(), _spi(&spi), _profile(LORA_PROFILE_433_SF7), _fskProfile(FSK_PROFILE_433_250K) { _init_state(); }
+  OurLoRaRadio(const Pins &pins, SPIClass &spi = SPI)
+    : Pins(pins), _spi(&spi), _profile(LORA_PROFILE_433_SF7), _fskProfile(FSK_PROFILE_433_250K) { _init_state(); }
+
+  // ==========================================================
+  //  LOW-LEVEL REGISTER ACCESS
+  // ==========================================================
+
+  /*
+   * Write a value to a register in the LoRa chip
+   * 
+   * Parameters:
+   *   address - Register address (0x00 to 0x7F)
+   *   value   - Byte value to write
+   */
+  void write_register(uint8_t address, uint8_t value) {
+    uint8_t frame[2] = { (uint8_t)(address | 0x80), value };  // Write mode (MSB = 1)
+    _spi_select();
+    _spi->writeBytes(frame, 2);            // Address + value in one go
+    _spi_deselect();
+    _shadow_store(address, value);
+    if (address == REG_OP_MODE) {
+      _linkStats.modeSwitches[value & 0x07]++;
+    }
+  }
+
+  /*
+   * Read a value from a register in the LoRa chip
+   * 
+   * Parameters:
+   *   address - Register address (0x00 to 0x7F)
+   * 
+   * Returns:
+   *   Byte value from register
+   */
+  uint8_t read_register(uint8_t address) {
+    uint8_t frame[2] = { (uint8_t)(address & 0x7F), 0x00 };   // Read mode (MSB = 0)
+    _spi_select();
+    _spi->transferBytes(frame, frame, 2);  // Value comes back in frame[1]
+    _spi_deselect();
+    return frame[1];
+  }
+
+  /*
+   * Write consecutive registers in one SPI transaction
+   * The chip auto-increments the address after every byte, except
+   * for REG_FIFO where every byte goes into the FIFO.
+   * 
+   * Parameters:
+   *   address - First register address
+   *   data    - Values to write
+   *   length  - Number of bytes
+   * 
+   * Example:
+   *   uint8_t frf[3] = { 0x6C, 0x80, 0x00 };
+   *   radio.write_burst(REG_FRF_MSB, frf, 3);
+   */
+  void write_burst(uint8_t address, const uint8_t *data, uint8_t length) {
+    _spi_select();
+    _spi->transfer(address | 0x80);        // Write mode (MSB = 1)
+    _spi->writeBytes(data, length);        // Whole block, one driver call
+    _spi_deselect();
+    if (address != REG_FIFO) {
+      for (uint8_t i = 0; i < length; i++) {
+        _shadow_store(address + i, data[i]);
+      }
+    }
+  }
+
+  /*
+   * Read consecutive registers (or the FIFO) in one SPI transaction
+   * 
+   * Parameters:
+   *   address - First register address
+   *   data    - Buffer for the values read
+   *   length  - Number of bytes
+   */
+  void read_burst(uint8_t address, uint8_t *data, uint8_t length) {
+    memset(data, 0x00, length);            // Dummy bytes clocked out
+    _spi_select();
+    _spi->transfer(address & 0x7F);        // Read mode (MSB = 0)
+    _spi->transferBytes(data, data, length); // Read block in place
+    _spi_deselect();
+  }
+
+  // ==========================================================
+  //  REGISTER SHADOW
+  // ==========================================================
+
+  /*
+   * Write a configuration register only if its value changes
+   * Registers that are not shadowed are always written.
+   * 
+   * Parameters:
+   *   address - Register address (0x00 to 0x7F)
+   *   value   - Byte value to write
+   * 
+   * Returns:
+   *   true  - SPI write issued
+   *   false - Chip already holds this value, write skipped
+   */
+  bool write_register_cached(uint8_t address, uint8_t value) {
+    if (_shadow_valid(address) && _regShadow[address] == value) {
+      _shadowSkipped++;
+      return false;
+    }
+    write_register(address, value);
+    return true;
+  }
+
+  /*
+   * Burst-write consecutive configuration registers, skipped
+   * entirely if the chip already holds every byte
+   * 
+   * Returns:
+   *   true  - SPI burst issued
+   *   false - All bytes already match, nothing sent
+   */
+  bool write_burst_cached(uint8_t address, const uint8_t *data, uint8_t length) {
+    for (uint8_t i = 0; i < length; i++) {
+      uint8_t a = address + i;
+      if (!_shadow_valid(a) || _regShadow[a] != data[i]) {
+        write_burst(address, data, length);
+        return true;
+      }
+    }
+    _shadowSkipped++;
+    return false;
+  }
+
+  /*
+   * Read a configuration register from RAM when it is shadowed
+   * Falls back to (and then caches) an SPI read otherwise.
+   */
+  uint8_t read_register_cached(uint8_t address) {
+    if (_shadow_valid(address)) {
+      return _regShadow[address];
+    }
+    uint8_t value = read_register(address);
+    _shadow_store(address, value);
+    return value;
+  }
+
+  /*
+   * Forget the shadow copy (e.g. after the chip was reset)
+   */
+  void shadow_invalidate() {
+    memset(_regShadowValid, 0, sizeof(_regShadowValid));
+    _fskLoaded = false;
+  }
+
+  /*
+   * Reload the shadow copy from the chip
+   * One burst read of REG_OP_MODE..REG_PA_DAC; call after a reset.
+   */
+  void shadow_resync() {
+    uint8_t regs[REG_PA_DAC - REG_OP_MODE + 1];
+    read_burst(REG_OP_MODE, regs, sizeof(regs));
+    shadow_invalidate();
+    for (uint8_t i = 0; i < sizeof(regs); i++) {
+      _shadow_store(REG_OP_MODE + i, regs[i]);
+    }
+  }
+
+  /*
+   * Compare the shadow copy with the chip
+   * A mismatch means the chip was reset or reconfigured behind the
+   * driver's back (e.g. brown-out); call shadow_resync() or
+   * setup() again in that case.
+   * 
+   * Returns:
+   *   Number of shadowed registers whose chip value differs
+   * 
+   * Example:
+   *   if (radio.shadow_verify() > 0) {
+   *     radio.setup(433);  // Radio lost its configuration
+   *   }
+   */
+  int shadow_verify() {
+    uint8_t regs[REG_PA_DAC - REG_OP_MODE + 1];
+    read_burst(REG_OP_MODE, regs, sizeof(regs));
+    int mismatches = 0;
+    for (uint8_t i = 0; i < sizeof(regs); i++) {
+      uint8_t address = REG_OP_MODE + i;
+      if (_shadow_valid(address) && _regShadow[address] != regs[i]) {
+        mismatches++;
+      }
+    }
+    return mismatches;
+  }
+
+  /*
+   * Number of register writes skipped because the value was unchanged
+   */
+  uint32_t shadow_skipped_writes() const {
+    return _shadowSkipped;
+  }
+
+  // ==========================================================
+  //  MAIN LORA FUNCTIONS
+  // ==========================================================
+
+  /*
+   * Initialize the LoRa module
+   * 
+   * Parameters:
+   *   frequency_mhz - Operating frequency in MHz (433, 868, or 915)
+   *                   SF7, BW 125 kHz, CR 4/5, CRC on, sync word 0x12
+   *                   433 and 868 use the channel of LORA_PROFILE_433_SF7
+   *                   / LORA_PROFILE_868_SF7, inside the regulated band
+   * 
+   * Returns:
+   *   true  - Initialization successful
+   *   false - Initialization failed (module not detected)
+   * 
+   * Example:
+   *   if (!radio.setup(433)) {
+   *     Serial.println("LoRa init failed!");
+   *   }
+   */
+  bool setup(long frequency_mhz) {
+    uint32_t hz = frequency_mhz == 433 ? LORA_PROFILE_433_SF7.frequencyHz
+                : frequency_mhz == 868 ? LORA_PROFILE_868_SF7.frequencyHz
+                : (uint32_t)frequency_mhz * 1000000UL;
+    OurLoRaModemProfile profile(hz);
+    if (!profile.valid()) {
+      Serial.println("ERROR: Frequency out of range!");
+      return false;
+    }
+    return setup(profile);
+  }
+
+  /*
+   * Initialize the LoRa module with a modem profile
+   * 
+   * Example:
+   *   radio.setup(LORA_PROFILE_433_SF12);
+   */
+  bool setup(const OurLoRaModemProfile &profile) {
+    Serial.println("\n=== Initializing OurLoRa ===");
+    
+    // Configure pins
+    _spi->begin();
+    pinMode(this->cs(), OUTPUT);
+    pinMode(this->rst(), OUTPUT);
+    pinMode(this->dio0(), INPUT);
+    digitalWrite(this->cs(), HIGH);
+    
+    // Hardware reset
+    digitalWrite(this->rst(), LOW);
+    delay(10);
+    digitalWrite(this->rst(), HIGH);
+    delay(10);
+    shadow_invalidate();  // Chip is back at its reset defaults
+    _fskActive = false;   // LoRa mode from the writes below on
+    
+    // Check chip version (SX1278 should return 0x12)
+    uint8_t version = read_register(REG_VERSION);
+    Serial.print("LoRa Chip Version: 0x");
+    Serial.println(version, HEX);
+    
+    if (version != 0x12) {
+      Serial.println("ERROR: LoRa module not detected!");
+      return false;
+    }
+    
+    // Enter sleep mode to configure
+    write_register(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_SLEEP);
+    delay(10);
+    
+    // Load the LoRa register page into the shadow copy
+    shadow_resync();
+    
+    // Frequency, modem config, preamble and sync word
+    _write_profile(profile);
+    if (_dutyBand < 0 && profile.frequencyHz < 870000000UL) {
+      // Europe has no licence-free band here that we know the rules of
+      Serial.println("WARNING: frequency outside the duty-cycle bands - no limit applied!");
+    }
+    
+    // Set FIFO base addresses (TX and RX base are adjacent)
+    uint8_t fifoBase[2] = { 0x00, 0x00 };
+    write_burst(REG_FIFO_TX_BASE_ADDR, fifoBase, 2);
+    
+    // Enable LNA boost
+    write_register_cached(REG_LNA, read_register_cached(REG_LNA) | 0x03);
+    
+    // Set output power (17 dBm using PA_BOOST)
+    write_register_cached(REG_PA_CONFIG, PA_BOOST | 0x0F);
+    
+    // Enable high power mode
+    write_register_cached(REG_PA_DAC, 0x87);
+    
+    // Enter standby mode
+    _set_mode(MODE_STDBY);
+    delay(10);
+    
+    Serial.print("OurLoRa initialized at ");
+    Serial.print(_currentFreq);
+    Serial.println(" MHz!");
+    
+    reset_link_stats();  // Count from here, not the configuration writes
+    return true;
+  }
+
+  /*
+   * Switch to another modem profile at run time
+   * Only registers that differ from the active profile are written
+   * (at most two bursts and four single writes). Both sides of a
+   * link must switch to the same profile.
+   * 
+   * Returns:
+   *   true  - Profile applied
+   *   false - A transmission is in progress (try again later), or
+   *           FSK is active
+   * 
+   * Example:
+   *   constexpr OurLoRaModemProfile FAST(433175000UL, 7, LORA_BW_250);
+   *   radio.set_profile(FAST);
+   */
+  bool set_profile(const OurLoRaModemProfile &profile) {
+    _dio0_service();
+    if (_txBusy || _cadRunning || _fskActive) {
+      return false;
+    }
+    _sniff_end_window();
+    
+    // Config registers are written in SLEEP or STDBY only
+    if ((read_register_cached(REG_OP_MODE) & 0x07) != MODE_SLEEP) {
+      _set_mode(MODE_STDBY);
+    }
+    
+    _write_profile(profile);
+    
+    if (_listening) {
+      _enter_rx();
+    }
+    return true;
+  }
+
+  /*
+   * The modem profile currently applied
+   */
+  const OurLoRaModemProfile &profile() const {
+    return _profile;
+  }
+
+  /*
+   * Send a message via LoRa
+   * 
+   * Blocks until the chip reports TxDone. In interrupt mode the wait
+   * is on the DIO0 edge, so no SPI polling happens until it rises.
+   * Use start_transmit() or enqueue() if you do not want to wait.
+   * 
+   * Parameters:
+   *   message - Pointer to data buffer to send
+   *   length  - Number of bytes to send
+   * 
+   * Returns:
+   *   true  - Message sent successfully
+   *   false - Transmission failed (timeout, duty cycle used up, or
+   *           length differs from the implicit-header length)
+   * 
+   * Example:
+   *   String msg = "Hello";
+   *   radio.send_a_msg((uint8_t*)msg.c_str(), msg.length());
+   */
+  bool send_a_msg(const uint8_t *message, uint8_t length) {
+    _dio0_service();
+    if (_txBusy || _cadRunning || _fskActive) {
+      return false;  // Previous start_transmit() still on air, or in FSK mode
+    }
+    
+    if (!_length_ok(length)) {
+      Serial.println("Implicit header: wrong packet length!");
+      return false;
+    }
+    
+    if (!_duty_allows(time_on_air_us(length))) {
+      Serial.println("Duty cycle limit - TX refused!");
+      _dutyRejected++;
+      return false;
+    }
+    
+    _begin_transmit(message, length);
+    
+    // Wait for TX done (timeout: airtime + 2 seconds)
+    unsigned long startTime = millis();
+    if (_interruptMode) {
+      // Servicing the DIO0 edge clears _txBusy and handles the flags
+      while (_txBusy) {
+        _dio0_service();
+        if (!_txBusy) {
+          break;
+        }
+        if (millis() - startTime > _txTimeoutMs) {
+          Serial.println("TX timeout!");
+          _txBusy = false;
+          _note_tx_done(false);
+          return false;
+        }
+        delay(1);
+      }
+      return true;
+    }
+    
+    while (!(read_register(REG_IRQ_FLAGS) & IRQ_TX_DONE_MASK)) {
+      if (millis() - startTime > _txTimeoutMs) {
+        Serial.println("TX timeout!");
+        _txBusy = false;
+        _note_tx_done(false);
+        return false;
+      }
+      delay(1);
+    }
+    _txBusy = false;
+    _note_auto_standby();
+    _note_tx_done(true);
+    
+    // Clear TX done flag
+    write_register(REG_IRQ_FLAGS, IRQ_TX_DONE_MASK);
+    
+    // Return to standby (no SPI write if the chip is already there)
+    _set_mode(MODE_STDBY);
+    
+    return true;
+  }
+
+  /*
+   * Check if a message has been received
+   * 
+   * In interrupt mode (and FSK mode) this returns the oldest frame
+   * from the RX ring (see rx_pop()); the SPI bus is only used to
+   * service a DIO0 edge that came since the last call.
+   * 
+   * Parameters:
+   *   buffer    - Pointer to buffer where received data will be stored
+   *   maxLength - Maximum size of buffer
+   * 
+   * Returns:
+   *   > 0  - Number of bytes received
+   *   0    - No packet received
+   *   -1   - CRC error (corrupted packet)
+   * 
+   * Example:
+   *   uint8_t rxBuffer[256];
+   *   int size = radio.check_for_msg(rxBuffer, sizeof(rxBuffer));
+   *   if (size > 0) {
+   *     Serial.print("Received: ");
+   *     for (int i = 0; i < size; i++) {
+   *       Serial.print((char)rxBuffer[i]);
+   *     }
+   *   }
+   */
+  int check_for_msg(uint8_t *buffer, uint8_t maxLength) {
+    if (_interruptMode || _fskActive) {
+      _dio0_service();
+      if (_rxHead == _rxTail) {
+        return 0;  // No packet
+      }
+      OurLoRaRxFrame *frame = &_rxRing[_rxTail & (OURLORA_RX_RING_SIZE - 1)];
+      int packetLength = frame->length;
+      if (packetLength > maxLength) {
+        packetLength = maxLength;  // Truncate if too large
+        _linkStats.truncated++;
+      }
+      if (packetLength > 0) {
+        memcpy(buffer, frame->data, packetLength);
+        _lastRssi = frame->rssi;
+        _lastSnr = frame->snr;
+      }
+      _note_rx_latency(frame->timestampUs);
+      __sync_synchronize();  // Finish reading before freeing the slot
+      _rxTail = _rxTail + 1;
+      return packetLength;
+    }
+    
+    // Read interrupt flags
+    uint8_t irqFlags = read_register(REG_IRQ_FLAGS);
+    
+    // Check if packet received
+    if (!(irqFlags & IRQ_RX_DONE_MASK)) {
+      return 0;  // No packet
+    }
+    
+    // Clear RX done flag
+    write_register(REG_IRQ_FLAGS, IRQ_RX_DONE_MASK);
+    
+    // Check for CRC error
+    if (irqFlags & IRQ_PAYLOAD_CRC_ERROR) {
+      Serial.println("CRC error - packet corrupted!");
+      write_register(REG_IRQ_FLAGS, IRQ_PAYLOAD_CRC_ERROR);
+      _linkStats.crcErrors++;
+      return -1;
+    }
+    
+    int packetLength = _read_rx_frame(buffer, maxLength, &_lastRssi, &_lastSnr);
+    _note_rx(packetLength, _lastRssi, _lastSnr);
+    if (packetLength < 0) {
+      Serial.println("Packet without CRC - dropped!");
+    }
+    return packetLength;
+  }
+
+  /*
+   * Start continuous receive mode
+   * Call this once in setup() to enable receiving
+   * In interrupt mode the radio goes back to RX after every TX.
+   * In FSK mode, LoRa RX starts with stop_fsk().
+   */
+  void start_listening() {
+    stop_sniffing();
+    _listening = true;
+    if (!_fskActive) {
+      _enter_rx();
+    }
+  }
+
+  /*
+   * Get signal strength of last received packet
+   * 
+   * Returns:
+   *   RSSI value in dBm (typically -120 to -30)
+   *   More negative = weaker signal
+   */
+  int get_signal_strength() const {
+    return _lastRssi;
+  }
+
+  /*
+   * Get signal to noise ratio of last received packet
+   * 
+   * Returns:
+   *   SNR value in dB
+   *   Higher = better quality
+   */
+  int get_signal_quality() const {
+    return _lastSnr;
+  }
+
+  /*
+   * Put LoRa module in sleep mode (low power)
+   */
+  void go_to_sleep() {
+    stop_fsk();
+    stop_sniffing();
+    _listening = false;
+    _set_mode(MODE_SLEEP);
+  }
+
+  /*
+   * Wake up LoRa module (exit sleep mode)
+   */
+  void wake_up() {
+    _set_mode(MODE_STDBY);
+    delay(10);
+  }
+
+  /*
+   * Change transmission power
+   * 
+   * Parameters:
+   *   power_dbm - Power in dBm (2 to 17)
+   *               Higher = longer range, more battery use
+   */
+  void set_tx_power(int power_dbm) {
+    if (power_dbm < 2) power_dbm = 2;
+    if (power_dbm > 17) power_dbm = 17;
+    
+    write_register_cached(REG_PA_CONFIG, PA_BOOST | (power_dbm - 2));
+  }
+
+  /*
+   * Current transmission power in dBm (2 to 17)
+   */
+  int get_tx_power() {
+    return (read_register_cached(REG_PA_CONFIG) & 0x0F) + 2;
+  }
+
+  /*
+   * Change sync word (network ID)
+   * Both sender and receiver must use same sync word
+   * 
+   * Parameters:
+   *   sync_word - Byte value (0x00 to 0xFF)
+   *               Default: 0x12 (private network)
+   *               LoRaWAN: 0x34
+   */
+  void set_network_id(uint8_t sync_word) {
+    write_register_cached(REG_SYNC_WORD, sync_word);
+    _profile.syncWord = sync_word;
+  }
+
+  // ==========================================================
+  //  ASYNC TX QUEUE
+  // ==========================================================
+
+  /*
+   * Queue a message for sending and return immediately
+   * The message is copied, so the caller can reuse its buffer.
+   * Packets are sent in order by poll() or, in interrupt mode, by
+   * whichever driver call services the TxDone of the previous one.
+   * 
+   * Parameters:
+   *   message - Pointer to data buffer to send
+   *   length  - Number of bytes to send
+   * 
+   * Packets that would exceed the duty cycle wait in the queue until
+   * enough airtime budget is free again.
+   * 
+   * Returns:
+   *   >= 0 - Packet ID (reported again to the on_tx_status() callback)
+   *   -1   - Queue full, message dropped
+   * 
+   * Example:
+   *   int id = radio.enqueue(data, sizeof(data));
+   *   if (id < 0) Serial.println("TX queue full");
+   */
+  int enqueue(const uint8_t *message, uint8_t length) {
+    if (_txCount >= OURLORA_TX_QUEUE_SIZE || !_length_ok(length) ||
+        (_dutyEnforced && time_on_air_us(length) > _duty_limit_us())) {
+      _txStats.dropped++;  // Full, wrong length, or could never fit the duty cycle
+      return -1;
+    }
+    
+    OurLoRaTxSlot *slot = &_txQueue[_txTail];
+    slot->id = _txNextId++;
+    slot->length = length;
+    slot->queuedUs = micros();
+    memcpy(slot->data, message, length);
+    
+    noInterrupts();
+    _txTail = (_txTail + 1) % OURLORA_TX_QUEUE_SIZE;
+    _txCount++;
+    _txStats.enqueued++;
+    if (_txCount > _txStats.maxDepth) {
+      _txStats.maxDepth = _txCount;
+    }
+    interrupts();
+    _tx_queue_kick();  // Radio idle? Start right away
+    
+    return slot->id;
+  }
+
+  /*
+   * Drive the TX queue - call from loop()
+   * Polled mode: checks TxDone and starts the next packet.
+   * Interrupt mode: services the last DIO0 edge (see handle_dio0()).
+   * Both modes: retires transmissions (queued or not) that never
+   * reported TxDone, and
+   * schedules the wake-ups of start_sniffing().
+   * FSK mode: services the FIFO (see start_fsk()).
+   * Runs with interrupts enabled: the DIO0 interrupt only latches the
+   * edge, so it never touches the chip or the queue under our feet.
+   */
+  void poll() {
+    _dio0_service();
+    if (_fskActive) {
+      _fsk_poll();
+      return;
+    }
+    if (_cadRunning && _cadForQueue) {
+      uint8_t irqFlags = _interruptMode ? 0 : read_register(REG_IRQ_FLAGS);
+      if (irqFlags & IRQ_CAD_DONE_MASK) {
+        write_register(REG_IRQ_FLAGS, IRQ_CAD_DONE_MASK | IRQ_CAD_DETECTED_MASK);
+        _cad_done(irqFlags);
+      } else if (millis() - _cadStartMs > OURLORA_TX_TIMEOUT_MS) {
+        _set_mode(MODE_STDBY);  // CadDone never came - try again
+        _cadRunning = false;
+      }
+    }
+    if (_txBusy && _txFromQueue && !_interruptMode &&
+        (read_register(REG_IRQ_FLAGS) & IRQ_TX_DONE_MASK)) {
+      write_register(REG_IRQ_FLAGS, IRQ_TX_DONE_MASK);
+      _txBusy = false;
+      _note_auto_standby();
+      _note_tx_done(true);
+      _tx_queue_done(LORA_TX_OK);
+      if (!_txBusy && _listening) {
+        _enter_rx();
+      }
+    }
+    _tx_watchdog();
+    _tx_queue_kick();
+    if (_sniffState != _SNIFF_OFF) {
+      _sniff_poll();
+    }
+  }
+
+  /*
+   * Register a function to call when a queued packet completes
+   */
+  void on_tx_status(OurLoRaTxStatusCallback callback) {
+    _onTxStatus = callback;
+  }
+
+  /*
+   * Number of packets waiting in (or being sent from) the TX queue
+   */
+  int tx_queue_depth() const {
+    return _txCount;
+  }
+
+  /*
+   * Copy of the TX queue statistics
+   */
+  OurLoRaTxQueueStats tx_queue_stats() {
+    noInterrupts();
+    OurLoRaTxQueueStats stats = _txStats;
+    stats.depth = _txCount;
+    interrupts();
+    return stats;
+  }
+
+  // ==========================================================
+  //  TIME ON AIR + DUTY CYCLE
+  // ==========================================================
+
+  /*
+   * Time on air of a packet with the active profile, in microseconds
+   * 
+   * Example:
+   *   Serial.println(radio.time_on_air_us(24));  // 61696 at SF7/BW125
+   */
+  uint32_t time_on_air_us(uint8_t length) const {
+    return _profile.timeOnAirUs(length);
+  }
+
+  /*
+   * Airtime still available in the active band's window, in microseconds
+   * Returns 0xFFFFFFFF on bands without a duty-cycle limit.
+   * 
+   * Example:
+   *   if (radio.duty_cycle_remaining_us() < radio.time_on_air_us(len)) {
+   *     // Report later, or send a shorter message
+   *   }
+   */
+  uint32_t duty_cycle_remaining_us() {
+    if (_dutyBand < 0) {
+      return 0xFFFFFFFF;
+    }
+    uint32_t used = _duty_used_us();
+    uint32_t limit = _duty_limit_us();
+    return used < limit ? limit - used : 0;
+  }
+
+  /*
+   * Duty cycle statistics for the active band
+   */
+  OurLoRaDutyCycleStats duty_cycle_stats() {
+    OurLoRaDutyCycleStats stats;
+    stats.dutyCycleBp = _dutyBand < 0 ? 0 : _loraDutyBands[_dutyBand].dutyCycleBp;
+    stats.limitUs = _dutyBand < 0 ? 0 : _duty_limit_us();
+    stats.usedUs = _dutyBand < 0 ? 0 : _duty_used_us();
+    stats.remainingUs = duty_cycle_remaining_us();
+    stats.rejected = _dutyRejected;
+    stats.deferred = _dutyDeferred;
+    return stats;
+  }
+
+  /*
+   * Turn duty-cycle enforcement on (default) or off
+   * Airtime is still counted while off, e.g. for bench tests.
+   */
+  void enforce_duty_cycle(bool enabled) {
+    _dutyEnforced = enabled;
+  }
+
+  // ==========================================================
+  //  LISTEN BEFORE TALK (CAD)
+  // ==========================================================
+
+  /*
+   * Check the channel for LoRa activity (blocks ~2 symbols)
+   * Uses CAD mode: the chip listens for preamble symbols and reports
+   * CadDone / CadDetected. Continuous RX resumes afterwards if
+   * start_listening() was called.
+   * 
+   * Returns:
+   *   1  - Channel busy (another node is transmitting)
+   *   0  - Channel free
+   *   -1 - Radio busy (TX or queued CAD running, FSK active) or timeout
+   */
+  int channel_activity_detect() {
+    _dio0_service();
+    if (_txBusy || _cadRunning || _fskActive) {
+      return -1;
+    }
+    _start_cad(false);
+    
+    unsigned long startTime = millis();
+    while (_cadRunning) {
+      if (_interruptMode) {
+        _dio0_service();
+        if (!_cadRunning) {
+          break;
+        }
+      } else {
+        uint8_t irqFlags = read_register(REG_IRQ_FLAGS);
+        if (irqFlags & IRQ_CAD_DONE_MASK) {
+          write_register(REG_IRQ_FLAGS, IRQ_CAD_DONE_MASK | IRQ_CAD_DETECTED_MASK);
+          _cad_done(irqFlags);
+          break;
+        }
+      }
+      if (millis() - startTime > OURLORA_TX_TIMEOUT_MS) {
+        _set_mode(MODE_STDBY);
+        _cadRunning = false;
+        return -1;
+      }
+      delay(1);
+    }
+    
+    if (_cadDetected) {
+      _lbtStats.channelBusy++;
+    }
+    if (_listening) {
+      _enter_rx();
+    }
+    return _cadDetected ? 1 : 0;
+  }
+
+  /*
+   * Send a message only when the channel is free (blocking)
+   * Runs CAD before transmitting; if the channel is busy, waits a
+   * random backoff whose window doubles every attempt, up to
+   * OURLORA_LBT_MAX_ATTEMPTS.
+   * 
+   * Returns:
+   *   true  - Message sent
+   *   false - Channel stayed busy, TX timeout or duty cycle used up
+   * 
+   * Example:
+   *   if (!radio.send_lbt(data, len)) {
+   *     Serial.println("Channel busy, try later");
+   *   }
+   */
+  bool send_lbt(const uint8_t *message, uint8_t length) {
+    for (uint8_t attempt = 1; attempt <= OURLORA_LBT_MAX_ATTEMPTS; attempt++) {
+      int busy = channel_activity_detect();
+      if (busy == 0) {
+        return send_a_msg(message, length);
+      }
+      if (busy < 0) {
+        return false;
+      }
+      uint32_t wait = _lbt_backoff_ms(attempt, length);
+      _lbtStats.backoffMs += wait;
+      delay(wait);
+    }
+    _lbtStats.gaveUp++;
+    return false;
+  }
+
+  /*
+   * Make the TX queue listen before talking
+   * Each queued packet then starts with CAD; a busy channel delays
+   * it by a random, exponentially growing backoff (driven by poll()).
+   * After OURLORA_LBT_MAX_ATTEMPTS busy checks the packet completes
+   * with LORA_TX_CHANNEL_BUSY.
+   */
+  void use_lbt(bool enabled) {
+    _lbtEnabled = enabled;
+  }
+
+  OurLoRaLbtStats lbt_stats() const {
+    return _lbtStats;
+  }
+
+  // ==========================================================
+  //  DUTY-CYCLED RX (PREAMBLE SNIFFING)
+  // ==========================================================
+
+  /*
+   * Stretch the preamble of every packet over interval_ms
+   * A receiver sniffing with the same interval then cannot miss a
+   * packet, at the price of up to interval_ms extra airtime per packet
+   * (counted against the duty cycle). Call it on every node of the
+   * network, receivers too: the chip should expect the preamble
+   * length the senders use.
+   * 
+   * Parameters:
+   *   interval_ms - Sniff interval of the receivers, 0 = back to the
+   *                 8-symbol default preamble
+   * 
+   * Returns:
+   *   true  - Profile switched
+   *   false - A transmission is in progress, try again later
+   * 
+   * Example:
+   *   radio.use_wake_preamble(1000);  // 985 symbols at SF7/BW125
+   */
+  bool use_wake_preamble(uint16_t interval_ms) {
+    uint32_t symbols = 8;
+    if (interval_ms) {
+      uint32_t symbolUs = _profile.symbolUs();
+      symbols = (interval_ms * 1000UL + symbolUs - 1) / symbolUs + OURLORA_SNIFF_MARGIN_SYMBOLS;
+      if (symbols > 0xFFFF) {
+        symbols = 0xFFFF;
+      }
+    }
+    const OurLoRaModemProfile &cur = _profile;
+    OurLoRaModemProfile next(cur.frequencyHz, cur.spreadingFactor, cur.bandwidth, cur.codingRate,
+                             cur.crc, cur.lowDataRateOptimize ? LORA_LDRO_ON : LORA_LDRO_OFF,
+                             (uint16_t)symbols, cur.syncWord, cur.implicitLength);
+    return set_profile(next);
+  }
+
+  /*
+   * Receive in short windows instead of continuously
+   * The chip sleeps and wakes every interval_ms for a CAD (~2 symbols).
+   * If that sees a preamble it receives the packet in RX single mode -
+   * into the RX ring, as with start_listening() - and sleeps again.
+   * Senders must use use_wake_preamble() with the same interval.
+   * A longer interval saves current but delays every packet by up to
+   * interval_ms; sniff_stats() reports the share of time spent awake.
+   * Own transmissions interrupt the current window.
+   * Requires enable_interrupts() and poll() in loop(), which schedules
+   * the wake-ups. Ended by stop_sniffing(), start_listening() or
+   * go_to_sleep().
+   * 
+   * Returns:
+   *   true  - Sniffing
+   *   false - Not in interrupt mode, or FSK active
+   * 
+   * Example:
+   *   radio.enable_interrupts();
+   *   radio.use_wake_preamble(1000);
+   *   radio.start_sniffing(1000);
+   *   ...
+   *   radio.poll();                     // In loop()
+   *   while (radio.rx_pop(&f)) { ... }
+   */
+  bool start_sniffing(uint16_t interval_ms = OURLORA_SNIFF_INTERVAL_MS) {
+    if (!_interruptMode || _fskActive) {
+      return false;
+    }
+    _listening = false;
+    memset(&_sniffStats, 0, sizeof(_sniffStats));
+    _sniffAwakeUs = 0;
+    _sniffIntervalMs = interval_ms;
+    _sniffStartMs = millis();
+    _sniffWakeMs = _sniffStartMs;  // First CAD right away
+    _sniffState = _SNIFF_SLEEP;
+    if (!_txBusy && !_cadRunning) {
+      _set_mode(MODE_SLEEP);
+    }
+    return true;
+  }
+
+  /*
+   * Stop sniffing; the chip stays in standby
+   * The statistics keep their final values.
+   */
+  void stop_sniffing() {
+    if (_sniffState == _SNIFF_OFF) {
+      return;
+    }
+    _sniff_end_window();
+    _sniffStats.elapsedMs = millis() - _sniffStartMs;
+    _sniffState = _SNIFF_OFF;
+    if (!_txBusy && !_cadRunning) {
+      _set_mode(MODE_STDBY);
+    }
+  }
+
+  /*
+   * Sniffing statistics
+   * rxDutyPpm is the measured share of time the receiver was on
+   * (CAD + RX) since start_sniffing(), to weigh the current an
+   * interval costs against the latency it adds.
+   * 
+   * Example:
+   *   OurLoRaSniffStats s = radio.sniff_stats();
+   *   Serial.printf("RX on %.2f %%\n", s.rxDutyPpm / 10000.0);
+   */
+  OurLoRaSniffStats sniff_stats() {
+    noInterrupts();
+    OurLoRaSniffStats stats = _sniffStats;
+    uint64_t awakeUs = _sniffAwakeUs;
+    interrupts();
+    if (_sniffState != _SNIFF_OFF) {
+      stats.elapsedMs = millis() - _sniffStartMs;
+    }
+    stats.awakeMs = awakeUs / 1000;
+    stats.rxDutyPpm = stats.elapsedMs ? (uint32_t)(awakeUs * 1000 / stats.elapsedMs) : 0;
+    return stats;
+  }
+
+  // ==========================================================
+  //  FSK (HIGH-RATE, SHORT RANGE)
+  // ==========================================================
+
+  /*
+   * Switch the chip to FSK packet mode and receive
+   * Packets arrive in the RX ring (rx_pop(), check_for_msg()). poll()
+   * moves them out of the 64-byte FIFO, so call it often: at 250 kbit/s
+   * the FIFO fills in 2 ms. LoRa sending, the TX queue, CAD and
+   * sniffing wait until stop_fsk(). The FSK registers are only written
+   * when the profile differs from the one loaded last, so after the
+   * first call a switch costs a few register writes.
+   * Both ends must use the same profile.
+   * 
+   * Returns:
+   *   true  - FSK active
+   *   false - A LoRa transmission or CAD is still running
+   * 
+   * Example:
+   *   radio.start_fsk(FSK_PROFILE_433_250K);
+   *   radio.fsk_send(history, 255);
+   *   radio.stop_fsk();  // Back to the LoRa profile
+   */
+  bool start_fsk(const OurLoRaFskProfile &profile = FSK_PROFILE_433_250K) {
+    _dio0_service();
+    if (_txBusy || _cadRunning) {
+      return false;
+    }
+    unsigned long startUs = micros();
+    stop_sniffing();
+    if (!_fskActive) {
+      _set_mode(MODE_SLEEP);
+      write_register(REG_OP_MODE, MODE_SLEEP);  // LongRangeMode only changes in sleep
+      _fskActive = true;
+    }
+    write_burst_cached(REG_FRF_MSB, profile.frf, 3);
+    if (!_fskLoaded || !_fsk_same(profile)) {
+      _write_fsk_profile(profile);
+    }
+    _fskTxMessage = NULL;
+    _fsk_enter_rx();
+    _fskStats.switches++;
+    _fskStats.lastSwitchUs = micros() - startUs;
+    return true;
+  }
+
+  /*
+   * Back to LoRa with the active modem profile
+   * Continuous RX resumes if start_listening() was called.
+   */
+  void stop_fsk() {
+    if (!_fskActive) {
+      return;
+    }
+    write_register_cached(REG_OP_MODE, MODE_SLEEP);
+    _fskActive = false;
+    _fskTxMessage = NULL;
+    _set_mode(MODE_SLEEP);
+    write_burst_cached(REG_FRF_MSB, _profile.frf, 3);
+    _set_mode(MODE_STDBY);
+    if (_listening) {
+      _enter_rx();
+    }
+  }
+
+  bool fsk_active() const {
+    return _fskActive;
+  }
+
+  /*
+   * Start sending an FSK packet and return immediately
+   * poll() keeps the FIFO topped up, so message must stay valid until
+   * fsk_transmitting() returns false. The radio receives again
+   * afterwards.
+   * 
+   * Returns:
+   *   true  - Transmission started
+   *   false - Not in FSK mode, previous packet still going, or duty
+   *           cycle used up
+   */
+  bool fsk_start_transmit(const uint8_t *message, uint8_t length) {
+    if (!_fskActive || _fskTxMessage) {
+      return false;
+    }
+    uint32_t airtime = _fskProfile.timeOnAirUs(length);
+    if (!_duty_allows(airtime)) {
+      _dutyRejected++;
+      return false;
+    }
+    write_register_cached(REG_OP_MODE, MODE_STDBY);
+    write_register(REG_IRQ_FLAGS_2, IRQ2_FIFO_OVERRUN);  // Drop a half-received packet
+    _fskRxLength = -1;
+    _duty_charge(airtime);
+    _linkAirtimeUs += airtime;
+    
+    // Length byte and what fits; TX starts as soon as the FIFO is not empty
+    uint8_t first = length < OURLORA_FSK_FIFO_SIZE - 1 ? length : OURLORA_FSK_FIFO_SIZE - 1;
+    write_register(REG_FIFO, length);
+    if (first > 0) {
+      write_burst(REG_FIFO, message, first);
+    }
+    _fskTxMessage = message;
+    _fskTxLength = length;
+    _fskTxSent = first;
+    _fskTxStartMs = millis();
+    _fskTxTimeoutMs = airtime / 1000 + OURLORA_TX_TIMEOUT_MS;
+    write_register_cached(REG_OP_MODE, MODE_TX);
+    return true;
+  }
+
+  /*
+   * Is an FSK packet still being sent?
+   */
+  bool fsk_transmitting() const {
+    return _fskTxMessage != NULL;
+  }
+
+  /*
+   * Send an FSK packet (blocking, polls every OURLORA_FSK_POLL_US)
+   * 
+   * Returns:
+   *   true  - Packet sent
+   *   false - Not in FSK mode, duty cycle used up, or TX timeout
+   * 
+   * Example:
+   *   for (uint16_t i = 0; i < sizeof(history); i += 255) {
+   *     radio.fsk_send(history + i, min(255, sizeof(history) - i));
+   *   }
+   */
+  bool fsk_send(const uint8_t *message, uint8_t length) {
+    if (!fsk_start_transmit(message, length)) {
+      return false;
+    }
+    while (_fskTxMessage) {
+      delayMicroseconds(OURLORA_FSK_POLL_US);
+      poll();
+    }
+    return _fskTxOk;
+  }
+
+  OurLoRaFskStats fsk_stats() const {
+    return _fskStats;
+  }
+
+  // ==========================================================
+  //  NOISE FLOOR
+  // ==========================================================
+
+  /*
+   * Wideband RSSI of the current channel in dBm
+   * Only meaningful while receiving (start_listening()).
+   */
+  int16_t rssi_now() {
+    int rssi_offset = (_currentFreq < 525) ? 164 : 157;
+    return read_register(REG_RSSI_VALUE) - rssi_offset;
+  }
+
+  /*
+   * Sample the noise on a channel
+   * Tunes to frequency_hz, reads the wideband RSSI `samples` times,
+   * OURLORA_SURVEY_SAMPLE_US apart, and tunes back (the whole thing
+   * takes about OURLORA_SURVEY_SETTLE_US + samples x
+   * OURLORA_SURVEY_SAMPLE_US). Frames on our own channel are missed
+   * meanwhile; frames on the surveyed channel are ignored.
+   * 
+   * busyPct counts readings OURLORA_SURVEY_BUSY_DB above the quietest
+   * one of the sweep, or above floor_dbm if that is lower. A sweep
+   * lasts a few ms, so without floor_dbm an interferer that covers the
+   * whole sweep reads as 0% busy; pass the channel's long-term floor
+   * (OurLoRaChannelSurvey in ourlora_survey.h keeps one) to see it.
+   * 
+   * Parameters:
+   *   frequency_hz - Channel to measure (may be the current one)
+   *   reading      - Gets the result
+   *   samples      - 1..OURLORA_SURVEY_MAX_SAMPLES
+   *   floor_dbm    - Quietest level known for this channel, or
+   *                  OURLORA_SURVEY_NO_FLOOR
+   * 
+   * Returns:
+   *   true  - Measured
+   *   false - Radio busy (TX, CAD, sniffing, FSK) or bad arguments
+   * 
+   * Example:
+   *   OurLoRaNoiseReading n;
+   *   if (radio.measure_noise(433175000UL, &n)) {
+   *     Serial.println(n.meanDbm);  // -118 on a quiet channel
+   *   }
+   */
+  bool measure_noise(uint32_t frequency_hz, OurLoRaNoiseReading *reading,
+                     uint8_t samples = OURLORA_SURVEY_SAMPLES,
+                     int16_t floor_dbm = OURLORA_SURVEY_NO_FLOOR) {
+    _dio0_service();
+    if (_txBusy || _cadRunning || _fskActive || _sniffState != _SNIFF_OFF ||
+        samples == 0 || samples > OURLORA_SURVEY_MAX_SAMPLES ||
+        frequency_hz < 137000000UL || frequency_hz > 1020000000UL) {
+      return false;
+    }
+    uint32_t frf = _lora_frf(frequency_hz);
+    uint8_t channel[3] = { (uint8_t)(frf >> 16), (uint8_t)(frf >> 8), (uint8_t)frf };
+    uint8_t mode = read_register_cached(REG_OP_MODE) & 0x07;
+    _set_mode(MODE_STDBY);
+    if (_interruptMode) {
+      write_register_cached(REG_DIO_MAPPING_1, DIO0_TX_DONE);  // No RxDone from over there
+    }
+    write_burst_cached(REG_FRF_MSB, channel, 3);
+    _set_mode(MODE_RX_CONTINUOUS);
+    delayMicroseconds(OURLORA_SURVEY_SETTLE_US);
+    
+    uint8_t raw[OURLORA_SURVEY_MAX_SAMPLES];
+    for (uint8_t i = 0; i < samples; i++) {
+      if (i > 0) {
+        delayMicroseconds(OURLORA_SURVEY_SAMPLE_US);
+      }
+      raw[i] = read_register(REG_RSSI_VALUE);
+    }
+    
+    _set_mode(MODE_STDBY);
+    write_burst_cached(REG_FRF_MSB, _profile.frf, 3);
+    write_register(REG_IRQ_FLAGS, 0xFF);  // Whatever the other channel raised
+    if (_listening) {
+      _enter_rx();
+    } else if (mode == MODE_SLEEP) {
+      _set_mode(MODE_SLEEP);
+    }
+    
+    uint16_t sum = 0;
+    uint8_t lo = 255, hi = 0, busy = 0;
+    for (uint8_t i = 0; i < samples; i++) {
+      sum += raw[i];
+      lo = raw[i] < lo ? raw[i] : lo;
+      hi = raw[i] > hi ? raw[i] : hi;
+    }
+    int offset = frequency_hz < 525000000UL ? 164 : 157;
+    int ref = lo;
+    if (floor_dbm != OURLORA_SURVEY_NO_FLOOR && floor_dbm + offset < ref) {
+      ref = floor_dbm + offset;
+    }
+    for (uint8_t i = 0; i < samples; i++) {
+      if (raw[i] > ref + OURLORA_SURVEY_BUSY_DB) busy++;
+    }
+    reading->meanDbm = (int16_t)((sum + samples / 2) / samples) - offset;
+    reading->floorDbm = lo - offset;
+    reading->peakDbm = hi - offset;
+    reading->busyPct = (uint16_t)busy * 100 / samples;
+    return true;
+  }
+
+  /*
+   * Move to another channel, keeping the rest of the modem profile
+   * The other side has to move too (see OurLoRaTdmaGateway::move_to()
+   * in ourlora_tdma.h for a network that moves together).
+   * 
+   * Returns:
+   *   true  - Retuned
+   *   false - A transmission is in progress, FSK is active, or the
+   *           frequency is out of range
+   */
+  bool set_frequency(uint32_t frequency_hz) {
+    if (frequency_hz < 137000000UL || frequency_hz > 1020000000UL) {
+      return false;
+    }
+    const OurLoRaModemProfile &cur = _profile;
+    OurLoRaModemProfile next(frequency_hz, cur.spreadingFactor, cur.bandwidth, cur.codingRate,
+                             cur.crc, cur.lowDataRateOptimize ? LORA_LDRO_ON : LORA_LDRO_OFF,
+                             cur.preambleLength, cur.syncWord, cur.implicitLength);
+    return set_profile(next);
+  }
+
+  // ==========================================================
+  //  INTERRUPT (DIO0) MODE
+  // ==========================================================
+
+  /*
+   * Service a DIO0 rising edge
+   * The DIO0 interrupt only notes that the pin rose, and when: SPI
+   * (whose transactions take a mutex on ESP32) is not used from an
+   * interrupt. The edge is handled here, in task context, by the next
+   * poll() - or by any driver call that needs the radio state
+   * (rx_pop(), check_for_msg(), is_transmitting(), send_a_msg(), ...).
+   * Call poll() at least once per frame airtime while listening:
+   * RxDone stays set until it is serviced, and a second frame in the
+   * meantime replaces the first in the FIFO (DIO0 is still high, so
+   * no new edge). Frames lost this way are counted in
+   * link_stats().rxMissed, from the chip's header counter. A gateway
+   * whose loop() can block should drive the radio from its own task,
+   * woken by on_dio0(). Can also be called by hand if DIO0 is wired
+   * to a polled input.
+   * 
+   * TxDone: marks the transmitter idle, starts the next queued
+   *         packet (if any), otherwise goes back to RX if
+   *         start_listening() was called, then calls the TX callback.
+   * CadDone: finishes a listen-before-talk check (see use_lbt()) or
+   *         a sniff window (see start_sniffing()).
+   * RxDone: copies the packet, RSSI, SNR and a timestamp into the
+   *         RX ring and calls the RX callback with its length
+   *         (-1 = CRC error). If the ring is full the frame is
+   *         dropped and counted as an overrun.
+   */
+  void handle_dio0() {
+    noInterrupts();
+    bool latched = _dio0Pending;
+    uint32_t edgeUs = _dio0Us;
+    _dio0Pending = false;
+    interrupts();
+    if (!latched) {
+      edgeUs = micros();  // Called by hand
+    }
+    if (_fskActive) {
+      return;  // PayloadReady / PacketSent in FSK mode, poll() has those
+    }
+    uint8_t irqFlags = read_register(REG_IRQ_FLAGS);
+    
+    // Clear exactly the flags we are about to handle
+    write_register(REG_IRQ_FLAGS, irqFlags);
+    
+    if ((irqFlags & IRQ_CAD_DONE_MASK) && _cadRunning) {
+      _cad_done(irqFlags);
+    } else if ((irqFlags & IRQ_CAD_DONE_MASK) && _sniffState == _SNIFF_CAD) {
+      _sniff_cad_done(irqFlags);
+    }
+    
+    if ((irqFlags & IRQ_TX_DONE_MASK) && _txBusy) {
+      _txBusy = false;
+      _note_auto_standby();
+      _note_tx_done(true);
+      if (_txFromQueue) {
+        _tx_queue_done(LORA_TX_OK);  // May start the next queued packet
+      }
+      if (!_txBusy && _listening) {
+        _enter_rx();  // Chip drops to STDBY after TX on its own
+      }
+      if (_onTxDone) {
+        _onTxDone(true);
+      }
+    }
+    
+    if (irqFlags & IRQ_RX_DONE_MASK) {
+      if (_sniffState == _SNIFF_RX) {
+        _note_auto_standby();  // RX single ends in STDBY, FIFO still intact
+        _sniffStats.frames++;
+        _sniff_end_window();   // poll() puts the chip back to sleep
+      }
+      
+      uint8_t head = _rxHead;
+      if ((uint8_t)(head - _rxTail) >= OURLORA_RX_RING_SIZE) {
+        _rxOverruns++;  // Consumer too slow - drop the new frame
+        return;
+      }
+      
+      OurLoRaRxFrame *frame = &_rxRing[head & (OURLORA_RX_RING_SIZE - 1)];
+      frame->timestampUs = edgeUs;
+      bool crcError = (irqFlags & IRQ_PAYLOAD_CRC_ERROR) != 0;
+      int rssi, snr;
+      int length = _read_rx_frame(frame->data, crcError ? 0 : sizeof(frame->data), &rssi, &snr);
+      frame->length = crcError ? -1 : length;
+      if (crcError) {
+        _linkStats.crcErrors++;
+      } else {
+        _note_rx(length, rssi, snr);
+      }
+      frame->rssi = rssi;
+      frame->snr = snr;
+      
+      __sync_synchronize();  // Frame contents visible before the index
+      _rxHead = head + 1;
+      
+      if (_onRxDone) {
+        _onRxDone(frame->length);
+      }
+    }
+  }
+
+  /*
+   * Register a function to call when a transmission completes
+   */
+  void on_tx_done(OurLoRaTxDoneCallback callback) {
+    _onTxDone = callback;
+  }
+
+  /*
+   * Register a function to call when a packet arrives
+   */
+  void on_rx_done(OurLoRaRxDoneCallback callback) {
+    _onRxDone = callback;
+  }
+
+  /*
+   * Register a function the DIO0 interrupt calls after latching the
+   * edge, to wake the task that drives the radio instead of waiting
+   * for its next poll(). It runs in interrupt context: no SPI, no
+   * driver calls - only things like a FreeRTOS task notification.
+   * That task must be the only one using the radio.
+   *
+   * Example:
+   *   void wakeRadio(void *arg) {
+   *     vTaskNotifyGiveFromISR((TaskHandle_t)arg, NULL);
+   *   }
+   *   radio.on_dio0(wakeRadio, radioTaskHandle);
+   *   // In the radio task:
+   *   //   ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+   *   //   radio.poll();
+   */
+  void on_dio0(OurLoRaDio0Callback callback, void *arg) {
+    noInterrupts();
+    _onDio0 = callback;
+    _onDio0Arg = arg;
+    interrupts();
+  }
+
+  /*
+   * Switch to interrupt mode: TxDone/RxDone are signalled on DIO0
+   * instead of being polled over SPI. Call after setup(), and call
+   * poll() from loop() (see handle_dio0()).
+   * 
+   * Example:
+   *   radio.setup(433);
+   *   radio.on_rx_done(rxDone);
+   *   radio.enable_interrupts();
+   *   radio.start_listening();
+   */
+  void enable_interrupts() {
+    _interruptMode = true;
+    _rxTail = _rxHead;  // Discard anything left from an earlier session
+    _dio0Pending = false;
+    write_register_cached(REG_DIO_MAPPING_1, DIO0_RX_DONE);
+    attachInterruptArg(digitalPinToInterrupt(this->dio0()), _dio0_isr, this, RISING);
+  }
+
+  /*
+   * Go back to polled mode (send_a_msg / check_for_msg poll SPI)
+   */
+  void disable_interrupts() {
+    detachInterrupt(digitalPinToInterrupt(this->dio0()));
+    _interruptMode = false;
+  }
+
+  /*
+   * Start sending a message and return immediately
+   * Completion is reported through the on_tx_done() callback; it gets
+   * false if TxDone does not come within the airtime plus
+   * OURLORA_TX_TIMEOUT_MS (noticed by poll() or is_transmitting()).
+   * Requires enable_interrupts().
+   * 
+   * Returns:
+   *   true  - Transmission started
+   *   false - Not in interrupt mode, previous TX still running,
+   *           duty cycle used up, or FSK active
+   */
+  bool start_transmit(const uint8_t *message, uint8_t length) {
+    _dio0_service();
+    if (!_interruptMode || _txBusy || _cadRunning || _fskActive || !_length_ok(length)) {
+      return false;
+    }
+    if (!_duty_allows(time_on_air_us(length))) {
+      _dutyRejected++;
+      return false;
+    }
+    _begin_transmit(message, length);
+    return true;
+  }
+
+  /*
+   * Is a transmission still in progress?
+   */
+  bool is_transmitting() {
+    _dio0_service();
+    _tx_watchdog();
+    return _txBusy || _cadRunning;
+  }
+
+  // ==========================================================
+  //  RX RING
+  // ==========================================================
+
+  /*
+   * Number of frames waiting in the RX ring
+   */
+  int rx_available() {
+    _dio0_service();
+    return (uint8_t)(_rxHead - _rxTail);
+  }
+
+  /*
+   * Take the oldest frame out of the RX ring (interrupt mode)
+   * Unlike check_for_msg() this keeps the per-frame RSSI, SNR and
+   * arrival time, so a gateway can drain bursts after the fact.
+   * 
+   * Returns:
+   *   true  - frame copied (frame->length == -1 means CRC error)
+   *   false - ring empty
+   * 
+   * Example:
+   *   OurLoRaRxFrame f;
+   *   while (radio.rx_pop(&f)) {
+   *     Serial.printf("%d bytes, %d dBm at %lu us\n", f.length, f.rssi, f.timestampUs);
+   *   }
+   */
+  bool rx_pop(OurLoRaRxFrame *frame) {
+    _dio0_service();
+    if (_rxHead == _rxTail) {
+      return false;
+    }
+    OurLoRaRxFrame *slot = &_rxRing[_rxTail & (OURLORA_RX_RING_SIZE - 1)];
+    memcpy(frame, slot, sizeof(OurLoRaRxFrame));
+    _note_rx_latency(frame->timestampUs);
+    __sync_synchronize();  // Finish reading before freeing the slot
+    _rxTail = _rxTail + 1;
+    return true;
+  }
+
+  /*
+   * Number of frames dropped because the RX ring was full
+   */
+  uint32_t rx_overruns() const {
+    return _rxOverruns;
+  }
+
+  // ==========================================================
+  //  LINK STATISTICS
+  // ==========================================================
+
+  /*
+   * Copy of the link counters, histograms and latencies
+   * Counting costs a few increments per frame; the copy is taken
+   * with interrupts off, so all fields belong to the same moment.
+   * TX latency runs from send_a_msg() / start_transmit() /
+   * enqueue() to TxDone (queue wait, LBT and airtime included), RX
+   * latency from RxDone until the frame is taken out of the RX ring.
+   * 
+   * Example:
+   *   OurLoRaLinkStats s = radio.link_stats();
+   *   Serial.printf("TX %lu ok, %lu timeouts, RX %lu ok, %lu CRC errors\n",
+   *                 s.txOk, s.txTimeouts, s.rxOk, s.crcErrors);
+   *   radio.reset_link_stats();  // Next report covers the next period
+   */
+  OurLoRaLinkStats link_stats() {
+    noInterrupts();
+    OurLoRaLinkStats stats = _linkStats;
+    uint64_t txSumUs = _txLatencySumUs;
+    uint64_t rxSumUs = _rxLatencySumUs;
+    stats.rxOverruns = _rxOverruns - _linkOverrunBase;
+    stats.airtimeMs = _linkAirtimeUs / 1000;
+    interrupts();
+    stats.txLatency.meanUs = stats.txLatency.count ? txSumUs / stats.txLatency.count : 0;
+    stats.rxLatency.meanUs = stats.rxLatency.count ? rxSumUs / stats.rxLatency.count : 0;
+    stats.elapsedMs = millis() - _linkSinceMs;
+    return stats;
+  }
+
+  /*
+   * Start counting again from zero (e.g. after every report)
+   */
+  void reset_link_stats() {
+    noInterrupts();
+    memset(&_linkStats, 0, sizeof(_linkStats));
+    _txLatencySumUs = 0;
+    _rxLatencySumUs = 0;
+    _linkAirtimeUs = 0;
+    _linkOverrunBase = _rxOverruns;
+    _linkSinceMs = millis();
+    interrupts();
+  }
+
+private:
+  SPIClass *_spi;
+  OurLoRaModemProfile _profile;   // Active modem setup
+
+  int _lastRssi;                  // Last received signal strength
+  int _lastSnr;                   // Last signal to noise ratio
+  long _currentFreq;              // Current frequency setting
+
+  // Interrupt (DIO0) mode state
+  bool _interruptMode;                         // DIO0 interrupt attached?
+  bool _listening;                             // Return to RX after TX?
+  volatile bool _txBusy;                       // TX started, TxDone not seen
+  unsigned long _txStartMs;                    // When current TX started
+  OurLoRaTxDoneCallback _onTxDone;
+  OurLoRaRxDoneCallback _onRxDone;
+  volatile bool _dio0Pending;                  // DIO0 rose, not serviced yet (set by ISR)
+  volatile uint32_t _dio0Us;                   // micros() of that edge
+  OurLoRaDio0Callback _onDio0;                 // Wakes the radio task, see on_dio0()
+  void *_onDio0Arg;
+
+  // RX ring: single producer (handle_dio0() / FSK poll), single consumer
+  OurLoRaRxFrame _rxRing[OURLORA_RX_RING_SIZE];
+  volatile uint8_t _rxHead;                    // Written by the producer only
+  volatile uint8_t _rxTail;                    // Written by consumer only
+  volatile uint32_t _rxOverruns;               // Frames lost, ring full
+  uint16_t _rxHeaderCnt;                       // Chip header counter at the last frame read
+
+  // Async TX queue (single producer: enqueue(), single consumer: poll() / DIO0 service)
+  OurLoRaTxSlot _txQueue[OURLORA_TX_QUEUE_SIZE];
+  volatile uint8_t _txHead;                    // Next packet to send
+  volatile uint8_t _txTail;                    // Next free slot
+  volatile uint8_t _txCount;
+  volatile bool _txFromQueue;                  // Current TX is _txHead
+  uint16_t _txNextId;
+  OurLoRaTxQueueStats _txStats;
+  OurLoRaTxStatusCallback _onTxStatus;
+
+  // Shadow copy of the configuration registers
+  uint8_t _regShadow[0x80];
+  uint8_t _regShadowValid[0x80 / 8];           // One bit per register
+  uint32_t _shadowSkipped;                     // Redundant writes avoided
+
+  // Duty cycle: airtime per band and window slot
+  int8_t _dutyBand;                            // -1 = not regulated
+  bool _dutyEnforced;
+  volatile bool _txDeferred;                   // Queue head held back
+  unsigned long _txTimeoutMs;                  // Airtime + margin
+  uint32_t _dutyEpoch;                         // Current slot number
+  uint32_t _dutyUsedUs[OURLORA_DUTY_BANDS][OURLORA_DUTY_SLOTS + 1];
+  uint32_t _dutyRejected;
+  uint32_t _dutyDeferred;
+
+  // Listen before talk
+  bool _lbtEnabled;
+  volatile bool _cadRunning;                   // CAD started, CadDone not seen
+  volatile bool _cadDetected;                  // Result of the last CAD
+  bool _cadForQueue;                           // CAD belongs to the queue head
+  unsigned long _cadStartMs;
+  uint8_t _lbtAttempt;                         // Busy CADs for the queue head
+  unsigned long _lbtRetryAtMs;                 // Backoff end
+  OurLoRaLbtStats _lbtStats;
+
+  // Duty-cycled RX
+  enum { _SNIFF_OFF, _SNIFF_SLEEP, _SNIFF_CAD, _SNIFF_RX };
+  volatile uint8_t _sniffState;                // _SNIFF_*
+  uint16_t _sniffIntervalMs;
+  unsigned long _sniffStartMs;                 // start_sniffing() called
+  unsigned long _sniffWakeMs;                  // Next CAD due
+  unsigned long _sniffWindowUs;                // Current CAD/RX window started
+  uint64_t _sniffAwakeUs;                      // Sum of all windows
+  OurLoRaSniffStats _sniffStats;
+
+  // FSK mode
+  bool _fskActive;                             // LongRangeMode off
+  bool _fskLoaded;                             // FSK page holds _fskProfile
+  OurLoRaFskProfile _fskProfile;
+  const uint8_t *_fskTxMessage;                // Packet being sent, NULL = idle
+  uint8_t _fskTxLength;
+  uint8_t _fskTxSent;                          // Bytes in the FIFO so far
+  bool _fskTxOk;
+  unsigned long _fskTxStartMs;
+  unsigned long _fskTxTimeoutMs;
+  int16_t _fskRxLength;                        // Packet being drained, -1 = none
+  uint8_t _fskRxGot;
+  int16_t _fskRxRssi;
+  OurLoRaFskStats _fskStats;
+
+  // Link statistics
+  OurLoRaLinkStats _linkStats;                 // Means, rxOverruns, airtime filled in by link_stats()
+  uint64_t _txLatencySumUs;
+  uint64_t _rxLatencySumUs;
+  uint64_t _linkAirtimeUs;
+  uint32_t _linkOverrunBase;                   // _rxOverruns at the last reset
+  unsigned long _linkSinceMs;
+  uint32_t _txRequestUs;                       // Current TX asked for (send or enqueue)
+
+  OurLoRaRadio(const OurLoRaRadio &);          // Not copyable (ISR holds this)
+  OurLoRaRadio &operator=(const OurLoRaRadio &);
+
+  void _init_state() {
+    _lastRssi = 0;
+    _lastSnr = 0;
+    _currentFreq = 0;
+    _interruptMode = false;
+    _listening = false;
+    _txBusy = false;
+    _txStartMs = 0;
+    _onTxDone = NULL;
+    _onRxDone = NULL;
+    _dio0Pending = false;
+    _dio0Us = 0;
+    _onDio0 = NULL;
+    _onDio0Arg = NULL;
+    _rxHead = 0;
+    _rxTail = 0;
+    _rxOverruns = 0;
+    _rxHeaderCnt = 0;
+    _txHead = 0;
+    _txTail = 0;
+    _txCount = 0;
+    _txFromQueue = false;
+    _txNextId = 0;
+    memset(&_txStats, 0, sizeof(_txStats));
+    _onTxStatus = NULL;
+    memset(_regShadowValid, 0, sizeof(_regShadowValid));
+    _shadowSkipped = 0;
+    _dutyBand = -1;
+    _dutyEnforced = true;
+    _txDeferred = false;
+    _txTimeoutMs = OURLORA_TX_TIMEOUT_MS;
+    _dutyEpoch = 0;
+    memset(_dutyUsedUs, 0, sizeof(_dutyUsedUs));
+    _dutyRejected = 0;
+    _dutyDeferred = 0;
+    _lbtEnabled = false;
+    _cadRunning = false;
+    _cadDetected = false;
+    _cadForQueue = false;
+    _cadStartMs = 0;
+    _lbtAttempt = 0;
+    _lbtRetryAtMs = 0;
+    memset(&_lbtStats, 0, sizeof(_lbtStats));
+    _sniffState = _SNIFF_OFF;
+    _sniffIntervalMs = OURLORA_SNIFF_INTERVAL_MS;
+    _sniffStartMs = 0;
+    _sniffWakeMs = 0;
+    _sniffWindowUs = 0;
+    _sniffAwakeUs = 0;
+    memset(&_sniffStats, 0, sizeof(_sniffStats));
+    _fskActive = false;
+    _fskLoaded = false;
+    _fskTxMessage = NULL;
+    _fskTxLength = 0;
+    _fskTxSent = 0;
+    _fskTxOk = false;
+    _fskTxStartMs = 0;
+    _fskTxTimeoutMs = 0;
+    _fskRxLength = -1;
+    _fskRxGot = 0;
+    _fskRxRssi = 0;
+    memset(&_fskStats, 0, sizeof(_fskStats));
+    memset(&_linkStats, 0, sizeof(_linkStats));
+    _txLatencySumUs = 0;
+    _rxLatencySumUs = 0;
+    _linkAirtimeUs = 0;
+    _linkOverrunBase = 0;
+    _linkSinceMs = 0;
+    _txRequestUs = 0;
+  }
+
+  // The DIO0 interrupt: no SPI, no driver callbacks - handle_dio0() does those
+  static void IRAM_ATTR _dio0_isr(void *arg) {
+    OurLoRaRadio *radio = static_cast<OurLoRaRadio *>(arg);
+    radio->_dio0Us = micros();
+    radio->_dio0Pending = true;
+    if (radio->_onDio0) {
+      radio->_onDio0(radio->_onDio0Arg);
+    }
+  }
+
+  // Handle a DIO0 edge the interrupt latched since the last call
+  inline void _dio0_service() {
+    if (_dio0Pending) {
+      handle_dio0();
+    }
+  }
+
+  /*
+   * Claim the SPI bus and select the chip
+   * The transaction applies our clock even if other devices on the
+   * bus use different settings.
+   */
+  inline void _spi_select() {
+    _spi->beginTransaction(SPISettings(OURLORA_SPI_CLOCK_HZ, MSBFIRST, SPI_MODE0));
+    digitalWrite(this->cs(), LOW);
+  }
+
+  inline void _spi_deselect() {
+    digitalWrite(this->cs(), HIGH);
+    _spi->endTransaction();
+  }
+
+  /*
+   * Can this register be served from the shadow copy?
+   * Only registers that the chip never changes on its own, plus
+   * REG_OP_MODE whose automatic TX/RX-single -> STDBY transitions
+   * the driver records itself. FIFO pointers, IRQ flags and status
+   * registers always go to the chip.
+   */
+  static inline bool _shadow_cacheable(uint8_t address) {
+    return address == REG_OP_MODE ||
+           (address >= REG_FRF_MSB && address <= REG_LNA) ||
+           address == REG_FIFO_TX_BASE_ADDR ||
+           address == REG_FIFO_RX_BASE_ADDR ||
+           (address >= REG_MODEM_CONFIG_1 && address <= REG_PAYLOAD_LENGTH) ||
+           address == REG_MODEM_CONFIG_3 ||
+           address == REG_DETECTION_OPTIMIZE ||
+           address == REG_DETECTION_THRESHOLD ||
+           address == REG_SYNC_WORD ||
+           address == REG_DIO_MAPPING_1 ||
+           address == REG_PA_DAC;
+  }
+
+  inline bool _shadow_valid(uint8_t address) const {
+    return _regShadowValid[address >> 3] & (1 << (address & 7));
+  }
+
+  // Record a value the chip now holds (the shadow mirrors the LoRa
+  // page; in FSK mode 0x0D..0x3F are FSK registers)
+  inline void _shadow_store(uint8_t address, uint8_t value) {
+    if (_shadow_cacheable(address) && !(_fskActive && address >= 0x0D && address <= 0x3F)) {
+      _regShadow[address] = value;
+      _regShadowValid[address >> 3] |= (1 << (address & 7));
+    }
+  }
+
+  // Switch operating mode, skipping the write if already there
+  inline void _set_mode(uint8_t mode) {
+    write_register_cached(REG_OP_MODE, MODE_LONG_RANGE_MODE | mode);
+  }
+
+  // The chip dropped to STDBY by itself after TxDone / CadDone
+  inline void _note_auto_standby() {
+    _shadow_store(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_STDBY);
+  }
+
+  // Write a profile's register image (skipping what already matches)
+  void _write_profile(const OurLoRaModemProfile &profile) {
+    write_burst_cached(REG_FRF_MSB, profile.frf, 3);
+    write_burst_cached(REG_MODEM_CONFIG_1, profile.modem, 5);
+    write_register_cached(REG_MODEM_CONFIG_3, profile.modemConfig3);
+    write_register_cached(REG_DETECTION_OPTIMIZE, profile.detectionOptimize);
+    write_register_cached(REG_DETECTION_THRESHOLD, profile.detectionThreshold);
+    write_register_cached(REG_SYNC_WORD, profile.syncWord);
+    if (profile.implicitLength) {
+      write_register_cached(REG_PAYLOAD_LENGTH, profile.implicitLength);  // RX expects this many bytes
+    }
+    _profile = profile;
+    _currentFreq = profile.frequencyHz / 1000000UL;
+    _dutyBand = _lora_duty_band(profile.frequencyHz);
+  }
+
+  // Drop window slots that have aged out
+  void _duty_roll() {
+    uint32_t epoch = millis() / (OURLORA_DUTY_WINDOW_MS / OURLORA_DUTY_SLOTS);
+    uint32_t steps = epoch - _dutyEpoch;
+    if (steps > OURLORA_DUTY_SLOTS + 1) {
+      steps = OURLORA_DUTY_SLOTS + 1;
+    }
+    while (steps--) {
+      _dutyEpoch++;
+      for (uint8_t b = 0; b < OURLORA_DUTY_BANDS; b++) {
+        _dutyUsedUs[b][_dutyEpoch % (OURLORA_DUTY_SLOTS + 1)] = 0;
+      }
+    }
+    _dutyEpoch = epoch;
+  }
+
+  // Airtime of the active band over the last window (plus the
+  // current partial slot, so the estimate never falls short)
+  uint32_t _duty_used_us() {
+    _duty_roll();
+    uint32_t used = 0;
+    for (uint8_t i = 0; i <= OURLORA_DUTY_SLOTS; i++) {
+      used += _dutyUsedUs[_dutyBand][i];
+    }
+    return used;
+  }
+
+  uint32_t _duty_limit_us() const {
+    if (_dutyBand < 0) {
+      return 0xFFFFFFFF;
+    }
+    return (uint32_t)((uint64_t)OURLORA_DUTY_WINDOW_MS * _loraDutyBands[_dutyBand].dutyCycleBp / 10);
+  }
+
+  bool _duty_allows(uint32_t airtime_us) {
+    if (!_dutyEnforced || _dutyBand < 0) {
+      return true;
+    }
+    return (uint64_t)_duty_used_us() + airtime_us <= _duty_limit_us();
+  }
+
+  void _duty_charge(uint32_t airtime_us) {
+    if (_dutyBand < 0) {
+      return;
+    }
+    _duty_roll();
+    _dutyUsedUs[_dutyBand][_dutyEpoch % (OURLORA_DUTY_SLOTS + 1)] += airtime_us;
+  }
+
+  /*
+   * Load a packet into the FIFO and start transmitting
+   * Does not wait - TxDone is reported by the chip in REG_IRQ_FLAGS
+   */
+  void _begin_transmit(const uint8_t *message, uint8_t length) {
+    // A sniff window ends here, poll() resumes sleeping afterwards
+    _sniff_end_window();
+    
+    // Enter standby mode
+    _set_mode(MODE_STDBY);
+    
+    // Clear all interrupt flags
+    write_register(REG_IRQ_FLAGS, 0xFF);
+    
+    // Route TxDone to DIO0 (only matters in interrupt mode)
+    if (_interruptMode) {
+      write_register_cached(REG_DIO_MAPPING_1, DIO0_TX_DONE);
+    }
+    
+    // Set FIFO pointer to TX base
+    write_register(REG_FIFO_ADDR_PTR, 0x00);
+    
+    // Write data to FIFO buffer (one burst)
+    write_burst(REG_FIFO, message, length);
+    
+    // Set payload length
+    write_register_cached(REG_PAYLOAD_LENGTH, length);
+    
+    // Count the airtime against the band's duty cycle
+    uint32_t airtime = time_on_air_us(length);
+    _duty_charge(airtime);
+    _linkAirtimeUs += airtime;
+    
+    // Start transmission
+    _txBusy = true;
+    _txFromQueue = false;
+    _txStartMs = millis();
+    _txRequestUs = micros();
+    _txTimeoutMs = airtime / 1000 + OURLORA_TX_TIMEOUT_MS;
+    _set_mode(MODE_TX);
+  }
+
+  /*
+   * Read the packet that is waiting in the FIFO, with its RSSI/SNR
+   * REG_FIFO_RX_CURRENT_ADDR..REG_HOP_CHANNEL arrive in one burst.
+   * 
+   * Returns:
+   *   Number of bytes copied into buffer (truncated to maxLength)
+   *   -1 if the header says "no CRC" but our profile requires one
+   *   (explicit header only - in implicit mode the CRC setting is ours)
+   */
+  int _read_rx_frame(uint8_t *buffer, int maxLength, int *rssi, int *snr) {
+    uint8_t regs[REG_HOP_CHANNEL - REG_FIFO_RX_CURRENT_ADDR + 1];
+    read_burst(REG_FIFO_RX_CURRENT_ADDR, regs, sizeof(regs));
+    
+    // Use frequency-dependent offset for accurate RSSI
+    // < 525 MHz uses offset 164, >= 525 MHz uses offset 157
+    int rssi_offset = (_currentFreq < 525) ? 164 : 157;
+    *rssi = regs[REG_PKT_RSSI_VALUE - REG_FIFO_RX_CURRENT_ADDR] - rssi_offset;
+    *snr = (int8_t)regs[REG_PKT_SNR_VALUE - REG_FIFO_RX_CURRENT_ADDR] / 4;
+    
+    if (_profile.crc && !_profile.implicitLength &&
+        !(regs[REG_HOP_CHANNEL - REG_FIFO_RX_CURRENT_ADDR] & HOP_CRC_ON_PAYLOAD)) {
+      return -1;  // Unprotected packet, cannot be trusted
+    }
+    
+    // The chip counts every header it receives: a jump of more than
+    // one since the last frame read out means frames were overwritten.
+    // (It restarts from 0 in sleep; a jump backwards is not counted.)
+    uint16_t headers = (regs[REG_RX_HEADER_CNT_MSB - REG_FIFO_RX_CURRENT_ADDR] << 8) |
+                       regs[REG_RX_HEADER_CNT_MSB + 1 - REG_FIFO_RX_CURRENT_ADDR];
+    uint16_t jump = headers - _rxHeaderCnt;
+    if (jump > 1 && jump < 0x8000) {
+      _linkStats.rxMissed += jump - 1;
+    }
+    _rxHeaderCnt = headers;
+    
+    // Get packet length
+    int packetLength = regs[REG_RX_NB_BYTES - REG_FIFO_RX_CURRENT_ADDR];
+    if (packetLength > maxLength) {
+      packetLength = maxLength;  // Truncate if too large
+      if (maxLength > 0) {
+        _linkStats.truncated++;  // (0 = CRC error, payload not wanted)
+      }
+    }
+    
+    if (packetLength > 0) {
+      // Point at the packet and read it (one burst)
+      write_register(REG_FIFO_ADDR_PTR, regs[0]);
+      read_burst(REG_FIFO, buffer, packetLength);
+    }
+    
+    return packetLength;
+  }
+
+  // Implicit-header profiles only carry packets of their fixed length
+  inline bool _length_ok(uint8_t length) const {
+    return _profile.implicitLength == 0 || length == _profile.implicitLength;
+  }
+
+  // Enter continuous RX with the FIFO reset
+  void _enter_rx() {
+    // Enter standby
+    _set_mode(MODE_STDBY);
+    
+    // Clear interrupt flags
+    write_register(REG_IRQ_FLAGS, 0xFF);
+    
+    // Route RxDone to DIO0 (only matters in interrupt mode)
+    if (_interruptMode) {
+      write_register_cached(REG_DIO_MAPPING_1, DIO0_RX_DONE);
+    }
+    
+    // Set FIFO RX base
+    write_register(REG_FIFO_ADDR_PTR, 0x00);
+    
+    // Enter continuous RX mode
+    _set_mode(MODE_RX_CONTINUOUS);
+  }
+
+  // Start the packet at the head of the queue if the radio is free
+  void _tx_queue_kick() {
+    if (_txBusy || _cadRunning || _fskActive || _txCount == 0) {
+      return;
+    }
+    OurLoRaTxSlot *slot = &_txQueue[_txHead];
+    if (!_duty_allows(time_on_air_us(slot->length))) {
+      if (!_txDeferred) {
+        _txDeferred = true;  // poll() retries once budget frees up
+        _dutyDeferred++;
+      }
+      return;
+    }
+    _txDeferred = false;
+    if (_lbtEnabled) {
+      if ((long)(millis() - _lbtRetryAtMs) < 0) {
+        return;  // Still backing off
+      }
+      _start_cad(true);  // TX starts from _cad_done() if the channel is free
+      return;
+    }
+    _begin_transmit(slot->data, slot->length);
+    _txFromQueue = true;
+    _txRequestUs = slot->queuedUs;
+  }
+
+  // Put the chip into CAD mode (~2 symbols, then CadDone)
+  void _start_cad(bool for_queue) {
+    _sniff_end_window();
+    _set_mode(MODE_STDBY);
+    write_register(REG_IRQ_FLAGS, IRQ_CAD_DONE_MASK | IRQ_CAD_DETECTED_MASK);
+    if (_interruptMode) {
+      write_register_cached(REG_DIO_MAPPING_1, DIO0_CAD_DONE);
+    }
+    _cadRunning = true;
+    _cadForQueue = for_queue;
+    _cadStartMs = millis();
+    _lbtStats.cadRuns++;
+    _set_mode(MODE_CAD);
+  }
+
+  // CadDone seen (DIO0 or polled): start the queued packet or back off
+  void _cad_done(uint8_t irq_flags) {
+    _cadRunning = false;
+    _cadDetected = (irq_flags & IRQ_CAD_DETECTED_MASK) != 0;
+    _note_auto_standby();
+    if (!_cadForQueue) {
+      return;  // channel_activity_detect() picks up the result
+    }
+    
+    if (!_cadDetected) {
+      _lbtAttempt = 0;
+      OurLoRaTxSlot *slot = &_txQueue[_txHead];
+      _begin_transmit(slot->data, slot->length);
+      _txFromQueue = true;
+      _txRequestUs = slot->queuedUs;
+      return;
+    }
+    
+    _lbtStats.channelBusy++;
+    if (++_lbtAttempt >= OURLORA_LBT_MAX_ATTEMPTS) {
+      _lbtAttempt = 0;
+      _lbtStats.gaveUp++;
+      _tx_queue_done(LORA_TX_CHANNEL_BUSY);  // Next packet starts its own CAD
+    } else {
+      uint32_t wait = _lbt_backoff_ms(_lbtAttempt, _txQueue[_txHead].length);
+      _lbtStats.backoffMs += wait;
+      _lbtRetryAtMs = millis() + wait;
+    }
+    if (!_cadRunning && !_txBusy && _listening) {
+      _enter_rx();
+    }
+  }
+
+  // Sniff schedule, run from poll()
+  void _sniff_poll() {
+    if (_txBusy || _cadRunning) {
+      return;  // Own TX or LBT has the chip, the window already ended
+    }
+    if (_sniffState == _SNIFF_SLEEP) {
+      _set_mode(MODE_SLEEP);  // No SPI write unless a TX or RX woke the chip
+      if ((long)(millis() - _sniffWakeMs) >= 0) {
+        _sniff_wake();
+      }
+      return;
+    }
+    // RxTimeout is not routed to DIO0, so it is polled
+    if (_sniffState == _SNIFF_RX && (read_register(REG_IRQ_FLAGS) & IRQ_RX_TIMEOUT_MASK)) {
+      write_register(REG_IRQ_FLAGS, IRQ_RX_TIMEOUT_MASK);
+      _note_auto_standby();
+      _sniffStats.falseWakes++;
+      _sniff_end_window();
+      _set_mode(MODE_SLEEP);
+      return;
+    }
+    // CadDone or RxDone never came
+    if (micros() - _sniffWindowUs > time_on_air_us(255) + OURLORA_TX_TIMEOUT_MS * 1000UL) {
+      _sniff_end_window();
+      _set_mode(MODE_SLEEP);
+    }
+  }
+
+  // Start a sniff window with a CAD
+  void _sniff_wake() {
+    _sniffWakeMs += _sniffIntervalMs;
+    if ((long)(millis() - _sniffWakeMs) >= 0) {
+      _sniffWakeMs = millis() + _sniffIntervalMs;  // Fell behind (e.g. own TX)
+    }
+    _sniffStats.wakeups++;
+    _sniffWindowUs = micros();
+    _sniffState = _SNIFF_CAD;
+    _set_mode(MODE_STDBY);
+    write_register(REG_IRQ_FLAGS, IRQ_CAD_DONE_MASK | IRQ_CAD_DETECTED_MASK);
+    write_register_cached(REG_DIO_MAPPING_1, DIO0_CAD_DONE);
+    _set_mode(MODE_CAD);
+  }
+
+  // Sniff CAD finished (DIO0): receive the packet or go back to sleep
+  void _sniff_cad_done(uint8_t irq_flags) {
+    _note_auto_standby();
+    if (!(irq_flags & IRQ_CAD_DETECTED_MASK)) {
+      _sniff_end_window();
+      _set_mode(MODE_SLEEP);
+      return;
+    }
+    _sniffStats.detections++;
+    _sniffState = _SNIFF_RX;
+    write_register_cached(REG_SYMB_TIMEOUT_LSB, OURLORA_SNIFF_RX_SYMBOLS);
+    write_register(REG_IRQ_FLAGS, 0xFF);
+    write_register_cached(REG_DIO_MAPPING_1, DIO0_RX_DONE);
+    write_register(REG_FIFO_ADDR_PTR, 0x00);
+    _set_mode(MODE_RX_SINGLE);  // Times out unless the preamble is still on
+  }
+
+  // Add the running CAD/RX window (if any) to the awake time
+  void _sniff_end_window() {
+    if (_sniffState == _SNIFF_CAD || _sniffState == _SNIFF_RX) {
+      _sniffAwakeUs += micros() - _sniffWindowUs;
+      _sniffState = _SNIFF_SLEEP;
+    }
+  }
+
+  bool _fsk_same(const OurLoRaFskProfile &profile) const {
+    return memcmp(profile.rate, _fskProfile.rate, sizeof(profile.rate)) == 0 &&
+           profile.rxBw == _fskProfile.rxBw &&
+           profile.preambleBytes == _fskProfile.preambleBytes &&
+           profile.syncWord == _fskProfile.syncWord;
+  }
+
+  // Load the FSK page (chip in FSK sleep or standby)
+  void _write_fsk_profile(const OurLoRaFskProfile &profile) {
+    write_burst(REG_BITRATE_MSB, profile.rate, 4);
+    write_register(REG_RX_CONFIG, 0x1E);            // AFC + AGC on preamble
+    uint8_t bw[2] = { profile.rxBw, profile.rxBw };
+    write_burst(REG_RX_BW, bw, 2);
+    write_register(REG_PREAMBLE_DETECT, 0xAA);      // On, 2 bytes, 10 chips tolerance
+    uint8_t sync[6] = {
+      0x00, profile.preambleBytes,                  // REG_FSK_PREAMBLE_MSB/LSB
+      0x52,                                         // Auto restart RX, sync on, 3 bytes
+      0xC1, 0x94, profile.syncWord                  // REG_SYNC_VALUE_1..3
+    };
+    write_burst(REG_FSK_PREAMBLE_MSB, sync, sizeof(sync));
+    uint8_t packet[3] = {
+      0xD8,                                         // Variable length, whitening, CRC, keep FIFO on CRC error
+      0x40,                                         // Packet mode
+      0xFF                                          // Longest packet accepted
+    };
+    write_burst(REG_PACKET_CONFIG_1, packet, sizeof(packet));
+    write_register(REG_FIFO_THRESH, 0x80 | OURLORA_FSK_FIFO_THRESHOLD);  // TX on FIFO not empty
+    _fskProfile = profile;
+    _fskLoaded = true;
+  }
+
+  // Empty the FIFO and receive (FSK)
+  void _fsk_enter_rx() {
+    write_register_cached(REG_OP_MODE, MODE_STDBY);
+    write_register(REG_IRQ_FLAGS_2, IRQ2_FIFO_OVERRUN);  // Clears the FIFO too
+    _fskRxLength = -1;
+    write_register_cached(REG_OP_MODE, MODE_FSK_RX);
+  }
+
+  // FSK FIFO service, run from poll()
+  void _fsk_poll() {
+    uint8_t flags = read_register(REG_IRQ_FLAGS_2);
+    if (_fskTxMessage) {
+      if (flags & IRQ2_PACKET_SENT) {
+        _fskTxMessage = NULL;
+        _fskTxOk = true;
+        _fskStats.sent++;
+        _fsk_enter_rx();
+      } else if (_fskTxSent < _fskTxLength && !(flags & IRQ2_FIFO_LEVEL)) {
+        // At most OURLORA_FSK_FIFO_THRESHOLD bytes left in the FIFO
+        uint8_t n = _fskTxLength - _fskTxSent;
+        if (n > OURLORA_FSK_FIFO_SIZE - OURLORA_FSK_FIFO_THRESHOLD) {
+          n = OURLORA_FSK_FIFO_SIZE - OURLORA_FSK_FIFO_THRESHOLD;
+        }
+        write_burst(REG_FIFO, _fskTxMessage + _fskTxSent, n);
+        _fskTxSent += n;
+        _fskStats.fifoTopUps++;
+      } else if (millis() - _fskTxStartMs > _fskTxTimeoutMs) {
+        _fskTxMessage = NULL;
+        _fskTxOk = false;
+        _fskStats.timeouts++;
+        _fsk_enter_rx();
+      }
+      return;
+    }
+    if (flags & IRQ2_FIFO_OVERRUN) {
+      _fskStats.fifoOverruns++;  // Packet lost, start over
+      _fsk_enter_rx();
+      return;
+    }
+    
+    if (_fskRxLength < 0) {
+      if (flags & IRQ2_FIFO_EMPTY) {
+        return;
+      }
+      _fskRxLength = read_register(REG_FIFO);
+      _fskRxGot = 0;
+      _fskRxRssi = -(read_register(REG_FSK_RSSI_VALUE) / 2);
+      flags = read_register(REG_IRQ_FLAGS_2);
+    }
+    
+    // Drain into the RX ring slot; with the ring full the packet is
+    // still read out (into a scratch buffer) and then dropped
+    uint8_t head = _rxHead;
+    bool room = (uint8_t)(head - _rxTail) < OURLORA_RX_RING_SIZE;
+    OurLoRaRxFrame *frame = &_rxRing[head & (OURLORA_RX_RING_SIZE - 1)];
+    uint8_t remaining = _fskRxLength - _fskRxGot;
+    uint8_t n = 0;
+    if (flags & IRQ2_PAYLOAD_READY) {
+      n = remaining;
+    } else if (flags & IRQ2_FIFO_LEVEL) {
+      n = OURLORA_FSK_FIFO_THRESHOLD + 1;  // Known to be in the FIFO
+      _fskStats.fifoTopUps++;
+    }
+    if (n > remaining) {
+      n = remaining;
+    }
+    if (n > 0) {
+      uint8_t scratch[OURLORA_FSK_FIFO_SIZE];
+      read_burst(REG_FIFO, room ? frame->data + _fskRxGot : scratch,
+                 room ? n : (n < sizeof(scratch) ? n : sizeof(scratch)));
+      _fskRxGot += n;
+    }
+    if (!(flags & IRQ2_PAYLOAD_READY)) {
+      return;
+    }
+    
+    bool crcOk = (flags & IRQ2_CRC_OK) != 0;
+    if (crcOk) {
+      _fskStats.received++;
+    } else {
+      _fskStats.crcErrors++;
+    }
+    _fskRxLength = crcOk ? _fskRxLength : -1;
+    if (!room) {
+      _rxOverruns++;
+    } else {
+      frame->length = _fskRxLength;
+      frame->rssi = _fskRxRssi;
+      frame->snr = 0;
+      frame->timestampUs = micros();
+      __sync_synchronize();  // Frame contents visible before the index
+      _rxHead = head + 1;
+      if (_onRxDone) {
+        _onRxDone(frame->length);
+      }
+    }
+    _fskRxLength = -1;
+  }
+
+  // Random backoff, window doubling per busy CAD: [0, airtime × 2^n)
+  uint32_t _lbt_backoff_ms(uint8_t attempt, uint8_t length) {
+    uint8_t exp = attempt < OURLORA_LBT_MAX_BACKOFF_EXP ? attempt : OURLORA_LBT_MAX_BACKOFF_EXP;
+    uint32_t window = (time_on_air_us(length) / 1000 + 1) << exp;
+    return random(window);
+  }
+
+  // Histogram bin of a value; the outer bins take everything beyond
+  static inline uint8_t _stats_bin(int value, int low, int step, int bins) {
+    int bin = value < low ? 0 : (value - low) / step;
+    return bin < bins ? bin : bins - 1;
+  }
+
+  static void _latency_add(OurLoRaLatencyStats *latency, uint64_t *sumUs, uint32_t us) {
+    if (latency->count == 0 || us < latency->minUs) {
+      latency->minUs = us;
+    }
+    if (us > latency->maxUs) {
+      latency->maxUs = us;
+    }
+    latency->count++;
+    *sumUs += us;
+  }
+
+  // TxDone never came (DIO0 edge lost, chip browned out): give up on
+  // the packet so send, enqueue, CAD and profile changes work again
+  void _tx_watchdog() {
+    if (!_txBusy || _fskActive || millis() - _txStartMs <= _txTimeoutMs) {
+      return;
+    }
+    Serial.println("TX timeout!");
+    write_register(REG_OP_MODE, MODE_LONG_RANGE_MODE | MODE_STDBY);
+    _txBusy = false;
+    _note_tx_done(false);
+    if (_txFromQueue) {
+      _tx_queue_done(LORA_TX_TIMEOUT);  // May start the next queued packet
+    }
+    if (!_txBusy && _listening) {
+      _enter_rx();
+    }
+    if (_onTxDone) {
+      _onTxDone(false);
+    }
+  }
+
+  // A transmission ended (DIO0 or polled)
+  void _note_tx_done(bool ok) {
+    if (ok) {
+      _linkStats.txOk++;
+      _latency_add(&_linkStats.txLatency, &_txLatencySumUs, micros() - _txRequestUs);
+    } else {
+      _linkStats.txTimeouts++;
+    }
+  }
+
+  // A frame with a good CRC was read out (length -1: sent without CRC)
+  void _note_rx(int length, int rssi, int snr) {
+    if (length < 0) {
+      _linkStats.noCrc++;
+      return;
+    }
+    _linkStats.rxOk++;
+    _linkStats.rssiHist[_stats_bin(rssi, OURLORA_STATS_RSSI_LOW, OURLORA_STATS_RSSI_STEP,
+                                   OURLORA_STATS_RSSI_BINS)]++;
+    _linkStats.snrHist[_stats_bin(snr, OURLORA_STATS_SNR_LOW, OURLORA_STATS_SNR_STEP,
+                                  OURLORA_STATS_SNR_BINS)]++;
+  }
+
+  // A frame left the RX ring
+  void _note_rx_latency(uint32_t rx_done_us) {
+    _latency_add(&_linkStats.rxLatency, &_rxLatencySumUs, micros() - rx_done_us);
+  }
+
+  // Retire the packet at the head of the queue and start the next one
+  void _tx_queue_done(uint8_t status) {
+    uint16_t id = _txQueue[_txHead].id;
+    _txFromQueue = false;
+    _txHead = (_txHead + 1) % OURLORA_TX_QUEUE_SIZE;
+    _txCount--;
+    if (status == LORA_TX_OK) {
+      _txStats.sent++;
+    } else if (status == LORA_TX_TIMEOUT) {
+      _txStats.timeouts++;
+    }
+    if (_onTxStatus) {
+      _onTxStatus(id, status);
+    }
+    _tx_queue_kick();
+  }
+};
+
+// Radio with pins fixed at compile time (zero RAM for pins)
+template <uint8_t CsPin, uint8_t RstPin, uint8_t Dio0Pin>
+using LoRaRadio = OurLoRaRadio<OurLoRaPins<CsPin, RstPin, Dio0Pin> >;
+
+// Radio with pins chosen at run time
+class RuntimeLoRaRadio : public OurLoRaRadio< ::OurLoRaRuntimePins> {
+public:
+  RuntimeLoRaRadio(uint8_t csPin, uint8_t rstPin, uint8_t dio0Pin, SPIClass &spi = SPI)
+    : OurLoRaRadio< ::OurLoRaRuntimePins>(::OurLoRaRuntimePins(csPin, rstPin, dio0Pin), spi) {}
+};
+
+// ============================================================
+//  DEFAULT RADIO + CLASSIC FUNCTIONS
+// ============================================================
+// The radio wired to LORA_CS_PIN / LORA_RST_PIN / LORA_DIO0_PIN.
+// The functions below keep the original single-radio API working;
+// each one forwards to the matching OurLoRa method.
+typedef LoRaRadio<LORA_CS_PIN, LORA_RST_PIN, LORA_DIO0_PIN> OurLoRaDefaultRadio;
+static OurLoRaDefaultRadio OurLoRa;
+
+void write_lora_register(uint8_t address, uint8_t value) { OurLoRa.write_register(address, value); }
+uint8_t read_lora_register(uint8_t address) { return OurLoRa.read_register(address); }
+void write_lora_burst(uint8_t address, const uint8_t *data, uint8_t length) { OurLoRa.write_burst(address, data, length); }
+void read_lora_burst(uint8_t address, uint8_t *data, uint8_t length) { OurLoRa.read_burst(address, data, length); }
+bool write_lora_register_cached(uint8_t address, uint8_t value) { return OurLoRa.write_register_cached(address, value); }
+uint8_t read_lora_register_cached(uint8_t address) { return OurLoRa.read_register_cached(address); }
+void lora_shadow_invalidate() { OurLoRa.shadow_invalidate(); }
+void lora_shadow_resync() { OurLoRa.shadow_resync(); }
+int lora_shadow_verify() { return OurLoRa.shadow_verify(); }
+uint32_t lora_shadow_skipped_writes() { return OurLoRa.shadow_skipped_writes(); }
+
+bool setup_ourlora(long frequency_mhz) { return OurLoRa.setup(frequency_mhz); }
+bool setup_ourlora(const OurLoRaModemProfile &profile) { return OurLoRa.setup(profile); }
+bool set_lora_profile(const OurLoRaModemProfile &profile) { return OurLoRa.set_profile(profile); }
+bool send_a_msg(uint8_t *message, uint8_t length) { return OurLoRa.send_a_msg(message, length); }
+int check_for_msg(uint8_t *buffer, uint8_t maxLength) { return OurLoRa.check_for_msg(buffer, maxLength); }
+void start_listening() { OurLoRa.start_listening(); }
+int get_signal_strength() { return OurLoRa.get_signal_strength(); }
+int get_signal_quality() { return OurLoRa.get_signal_quality(); }
+void go_to_sleep() { OurLoRa.go_to_sleep(); }
+void wake_up_lora() { OurLoRa.wake_up(); }
+void set_tx_power(int power_dbm) { OurLoRa.set_tx_power(power_dbm); }
+int get_tx_power() { return OurLoRa.get_tx_power(); }
+void set_network_id(uint8_t sync_word) { OurLoRa.set_network_id(sync_word); }
+
+int lora_enqueue(const uint8_t *message, uint8_t length) { return OurLoRa.enqueue(message, length); }
+void lora_poll() { OurLoRa.poll(); }
+void on_lora_tx_status(OurLoRaTxStatusCallback callback) { OurLoRa.on_tx_status(callback); }
+int lora_tx_queue_depth() { return OurLoRa.tx_queue_depth(); }
+OurLoRaTxQueueStats get_tx_queue_stats() { return OurLoRa.tx_queue_stats(); }
+
+uint32_t lora_time_on_air_us(uint8_t length) { return OurLoRa.time_on_air_us(length); }
+uint32_t lora_duty_cycle_remaining_us() { return OurLoRa.duty_cycle_remaining_us(); }
+OurLoRaDutyCycleStats get_duty_cycle_stats() { return OurLoRa.duty_cycle_stats(); }
+void lora_enforce_duty_cycle(bool enabled) { OurLoRa.enforce_duty_cycle(enabled); }
+
+int lora_channel_activity() { return OurLoRa.channel_activity_detect(); }
+bool send_a_msg_lbt(const uint8_t *message, uint8_t length) { return OurLoRa.send_lbt(message, length); }
+void lora_use_lbt(bool enabled) { OurLoRa.use_lbt(enabled); }
+OurLoRaLbtStats get_lbt_stats() { return OurLoRa.lbt_stats(); }
+
+bool lora_use_wake_preamble(uint16_t interval_ms) { return OurLoRa.use_wake_preamble(interval_ms); }
+bool start_lora_sniffing(uint16_t interval_ms) { return OurLoRa.start_sniffing(interval_ms); }
+void stop_lora_sniffing() { OurLoRa.stop_sniffing(); }
+OurLoRaSniffStats get_sniff_stats() { return OurLoRa.sniff_stats(); }
+
+bool start_lora_fsk(const OurLoRaFskProfile &profile) { return OurLoRa.start_fsk(profile); }
+void stop_lora_fsk() { OurLoRa.stop_fsk(); }
+bool lora_fsk_send(const uint8_t *message, uint8_t length) { return OurLoRa.fsk_send(message, length); }
+bool lora_fsk_start_transmit(const uint8_t *message, uint8_t length) { return OurLoRa.fsk_start_transmit(message, length); }
+bool lora_fsk_transmitting() { return OurLoRa.fsk_transmitting(); }
+OurLoRaFskStats get_fsk_stats() { return OurLoRa.fsk_stats(); }
+
+int16_t lora_rssi_now() { return OurLoRa.rssi_now(); }
+bool lora_measure_noise(uint32_t frequency_hz, OurLoRaNoiseReading *reading) { return OurLoRa.measure_noise(frequency_hz, reading); }
+bool set_lora_frequency(uint32_t frequency_hz) { return OurLoRa.set_frequency(frequency_hz); }
+
+void lora_handle_dio0() { OurLoRa.handle_dio0(); }
+void on_lora_tx_done(OurLoRaTxDoneCallback callback) { OurLoRa.on_tx_done(callback); }
+void on_lora_rx_done(OurLoRaRxDoneCallback callback) { OurLoRa.on_rx_done(callback); }
+void enable_lora_interrupts() { OurLoRa.enable_interrupts(); }
+void disable_lora_interrupts() { OurLoRa.disable_interrupts(); }
+bool start_transmit(const uint8_t *message, uint8_t length) { return OurLoRa.start_transmit(message, length); }
+bool is_transmitting() { return OurLoRa.is_transmitting(); }
+
+int lora_rx_available() { return OurLoRa.rx_available(); }
+bool lora_rx_pop(OurLoRaRxFrame *frame) { return OurLoRa.rx_pop(frame); }
+uint32_t lora_rx_overruns() { return OurLoRa.rx_overruns(); }
+
+OurLoRaLinkStats get_link_stats() { return OurLoRa.link_stats(); }
+void lora_reset_link_stats() { OurLoRa.reset_link_stats(); }
 
-#endif // OUR_LORA_H
\ No newline at end of file
+#endif // OUR_LORA_H
@@ -0,0 +1,516 @@
+/*
+ * OurLoRa ADR - adaptive data rate and TX power
+
+ * OurLoRaAdr: the gateway settles every peer on the fastest data rate
+ * the weakest one can still decode, and the lowest TX power each needs.
+ */
+#ifndef OURLORA_ADR_H
+#define OURLORA_ADR_H
+
+#include "ourlora.h"
+
+// ============================================================
+//  ADAPTIVE DATA RATE (ADR)
+// ============================================================
+// One node (the controller, usually the gateway) watches the SNR of
+// every peer it hears, picks the fastest data rate all peers can
+// still decode with OURLORA_ADR_MARGIN_DB to spare, and the lowest
+// TX power each peer needs at that rate. Changes are negotiated with
+// small control frames; both sides fall back to slower rates when
+// the link goes quiet.
+// 
+// A single SX127x receives one data rate at a time, so all peers of
+// a controller share the link data rate (set by the weakest peer);
+// TX power is chosen per peer.
+
+// Control frame: [marker, type, dst, src, seq, data rate, power, snr]
+#define OURLORA_ADR_MARKER       0xA5  // First byte of every control frame
+#define OURLORA_ADR_FRAME_LEN    8
+#define OURLORA_ADR_REQ          0x01  // Controller -> peer: use this DR/power
+#define OURLORA_ADR_ANS          0x02  // Peer -> controller: accepted (+ its SNR of us)
+#define OURLORA_ADR_LINK_CHECK   0x03  // Peer -> controller: are you there?
+#define OURLORA_ADR_LINK_ANS     0x04  // Controller -> peer: yes
+#define OURLORA_ADR_BROADCAST    0xFF
+
+#ifndef OURLORA_ADR_MAX_PEERS
+#define OURLORA_ADR_MAX_PEERS    4
+#endif
+#define OURLORA_ADR_HISTORY      8     // SNR samples kept per link
+#define OURLORA_ADR_MIN_SAMPLES  4     // Needed before deciding
+#ifndef OURLORA_ADR_MARGIN_DB
+#define OURLORA_ADR_MARGIN_DB    5     // Spare SNR above demodulation floor
+#endif
+#define OURLORA_ADR_RETRY_MS     5000  // Resend unanswered requests
+#define OURLORA_ADR_MAX_RETRIES  3
+#ifndef OURLORA_ADR_LINK_CHECK_MS
+#define OURLORA_ADR_LINK_CHECK_MS 60000 // Peer: controller silent this long -> check
+#endif
+#define OURLORA_ADR_FALLBACK_MS  10000 // Unanswered check -> one data rate slower
+
+// Data rate ladder, DR0 = slowest (SF12 / 125 kHz)
+#define OURLORA_ADR_DATA_RATES   8
+static constexpr uint8_t _loraAdrSf[OURLORA_ADR_DATA_RATES] = { 12, 11, 10, 9, 8, 7, 7, 7 };
+static constexpr uint8_t _loraAdrBw[OURLORA_ADR_DATA_RATES] = {
+  LORA_BW_125, LORA_BW_125, LORA_BW_125, LORA_BW_125,
+  LORA_BW_125, LORA_BW_125, LORA_BW_250, LORA_BW_500
+};
+
+// 10 × log10(bandwidth in Hz) per LORA_BW_* code
+static constexpr uint8_t _loraBwDb[10] = { 39, 40, 42, 43, 45, 46, 48, 51, 54, 57 };
+
+// One link as seen by this node
+typedef struct {
+  bool     used;
+  uint8_t  peer;                       // Node ID
+  uint8_t  count;                      // Valid samples in snr[]
+  uint8_t  next;
+  int8_t   snr[OURLORA_ADR_HISTORY];   // Effective SNR of frames from peer
+  int16_t  lastRssi;
+  uint32_t lastHeardMs;
+  uint8_t  txPower;                    // Power the peer uses (dBm)
+  int8_t   reportedSnr;                // Peer's minimum SNR of our frames
+  uint8_t  reportedDr;                 // Data rate that report was taken at
+  bool     pending;                    // Request not answered yet
+  uint8_t  pendingPower;
+  uint8_t  retries;
+  uint32_t sentMs;
+} OurLoRaLinkHistory;
+
+// ADR statistics, see OurLoRaAdr::stats()
+typedef struct {
+  uint8_t  dataRate;                   // Current DR index (0 = slowest)
+  uint8_t  txPower;                    // Current TX power (dBm)
+  uint32_t requests;                   // ADR_REQ sent (incl. retries)
+  uint32_t answers;                    // ADR_ANS sent or received
+  uint32_t dataRateChanges;
+  uint32_t fallbacks;                  // Steps down after a lost link
+} OurLoRaAdrStats;
+
+/*
+ * ADR engine for one radio
+ * 
+ * The node whose ID equals controllerId runs the decisions, every
+ * other node follows. Feed every received frame to the engine and
+ * call poll() from loop().
+ * 
+ * Example (gateway, ID 1):
+ *   OurLoRaAdr<OurLoRaDefaultRadio> adr(OurLoRa, 1, 1);
+ *   
+ *   void loop() {
+ *     OurLoRaRxFrame f;
+ *     while (lora_rx_pop(&f)) {
+ *       if (adr.handle_frame(f.data, f.length, f.rssi, f.snr)) continue;
+ *       adr.observe(f.data[0], f.rssi, f.snr);  // App header carries the sender
+ *       ...
+ *     }
+ *     adr.poll();
+ *   }
+ * 
+ * Application frames must not start with OURLORA_ADR_MARKER. With an
+ * implicit-header profile control frames are padded to its length,
+ * which must be at least OURLORA_ADR_FRAME_LEN.
+ */
+template <class Radio>
+class OurLoRaAdr {
+public:
+  OurLoRaAdr(Radio &radio, uint8_t nodeId, uint8_t controllerId)
+    : _radio(radio), _nodeId(nodeId), _controllerId(controllerId) {
+    memset(_links, 0, sizeof(_links));
+    memset(&_stats, 0, sizeof(_stats));
+    _dr = _data_rate_of(radio.profile());
+    _prevDr = _dr;
+    _targetDr = _dr;
+    _seq = 0;
+    _lastSeqSeen = 0xFF;
+    _reqSeq = 0xFF;
+    _reqDr = _dr;
+    _reqPending = false;
+    _checkSentMs = 0;
+    _checkPending = false;
+  }
+
+  bool is_controller() const {
+    return _nodeId == _controllerId;
+  }
+
+  /*
+   * Record signal quality of a frame received from a peer
+   * 
+   * Parameters:
+   *   peer - Sender's node ID (from the application header)
+   *   rssi - Packet RSSI in dBm
+   *   snr  - Packet SNR in dB
+   */
+  void observe(uint8_t peer, int rssi, int snr) {
+    OurLoRaLinkHistory *link = _link(peer, true);
+    if (link == NULL) {
+      return;  // Peer table full
+    }
+    
+    // SNR saturates around +10 dB on strong links - estimate it from
+    // RSSI over the noise floor instead (-174 dBm/Hz + BW + 6 dB NF)
+    int effective = snr;
+    if (snr >= 5) {
+      int fromRssi = rssi + 174 - _loraBwDb[_radio.profile().bandwidth] - 6;
+      if (fromRssi > effective) {
+        effective = fromRssi;
+      }
+    }
+    if (effective > 127) effective = 127;
+    if (effective < -128) effective = -128;
+    
+    link->snr[link->next] = effective;
+    link->next = (link->next + 1) % OURLORA_ADR_HISTORY;
+    if (link->count < OURLORA_ADR_HISTORY) {
+      link->count++;
+    }
+    link->lastRssi = rssi;
+    link->lastHeardMs = millis();
+    if (peer == _controllerId) {
+      _checkPending = false;
+    }
+  }
+
+  /*
+   * Process a received frame if it is an ADR control frame
+   * 
+   * Returns:
+   *   true  - Control frame, consumed by the engine
+   *   false - Application frame, handle it yourself
+   */
+  bool handle_frame(const uint8_t *data, int length, int rssi, int snr) {
+    if (length < OURLORA_ADR_FRAME_LEN || data[0] != OURLORA_ADR_MARKER) {
+      return false;
+    }
+    uint8_t type = data[1], dst = data[2], src = data[3], seq = data[4];
+    if (dst != _nodeId && dst != OURLORA_ADR_BROADCAST) {
+      return true;  // Someone else's
+    }
+    observe(src, rssi, snr);
+    
+    if (is_controller()) {
+      OurLoRaLinkHistory *link = _link(src, false);
+      if (type == OURLORA_ADR_ANS && link != NULL && link->pending && seq == _seq) {
+        link->pending = false;
+        link->txPower = link->pendingPower;
+        link->reportedSnr = (int8_t)data[7];
+        link->reportedDr = _dr;
+        _stats.answers++;
+        _try_commit();
+      } else if (type == OURLORA_ADR_LINK_CHECK) {
+        _send(OURLORA_ADR_LINK_ANS, src, seq, _dr, link ? link->txPower : 17, 0);
+      }
+      return true;
+    }
+    
+    if (src != _controllerId) {
+      return true;
+    }
+    if (type == OURLORA_ADR_REQ) {
+      // Answer at the current rate, then switch
+      _radio.set_tx_power(data[6]);
+      _send(OURLORA_ADR_ANS, src, seq, data[5], data[6], _min_snr(_link(src, false)));
+      _stats.answers++;
+      if (seq != _lastSeqSeen) {
+        _reqSeq = seq;
+        _reqDr = data[5];
+        _apply_request();
+      }
+    }
+    return true;
+  }
+
+  /*
+   * Run the engine - call from loop()
+   * Controller: decides and (re)sends requests.
+   * Peer: checks the link and falls back if the controller is gone.
+   */
+  void poll() {
+    uint32_t now = millis();
+    if (is_controller()) {
+      _check_silent_peers(now);
+      if (_any_pending()) {
+        _retry(now);
+      } else {
+        _decide();
+      }
+      return;
+    }
+    
+    if (_reqPending) {
+      _apply_request();  // Last switch failed (radio busy) - try again
+    }
+    OurLoRaLinkHistory *ctrl = _link(_controllerId, true);
+    uint32_t lastHeard = ctrl ? ctrl->lastHeardMs : 0;
+    if (!_checkPending && now - lastHeard > OURLORA_ADR_LINK_CHECK_MS) {
+      _send(OURLORA_ADR_LINK_CHECK, _controllerId, ++_seq, _dr, _radio.get_tx_power(), 0);
+      _checkPending = true;
+      _checkSentMs = now;
+    } else if (_checkPending && now - _checkSentMs > OURLORA_ADR_FALLBACK_MS) {
+      // No answer: one step slower, full power, and ask again
+      _checkPending = false;
+      _reqPending = false;
+      _radio.set_tx_power(17);
+      if (_dr > 0) {
+        _switch(_dr - 1);
+        _stats.fallbacks++;
+      }
+      if (ctrl) {
+        ctrl->lastHeardMs = now - OURLORA_ADR_LINK_CHECK_MS;  // Check again right away
+      }
+    }
+  }
+
+  /*
+   * History of one link, NULL if the peer was never heard
+   */
+  const OurLoRaLinkHistory *link(uint8_t peer) {
+    return _link(peer, false);
+  }
+
+  /*
+   * Current data rate index (0 = SF12/125 kHz ... 7 = SF7/500 kHz)
+   */
+  uint8_t data_rate() const {
+    return _dr;
+  }
+
+  OurLoRaAdrStats stats() {
+    OurLoRaAdrStats s = _stats;
+    s.dataRate = _dr;
+    s.txPower = _radio.get_tx_power();
+    return s;
+  }
+
+private:
+  Radio &_radio;
+  uint8_t _nodeId;
+  uint8_t _controllerId;
+  OurLoRaLinkHistory _links[OURLORA_ADR_MAX_PEERS];
+  OurLoRaAdrStats _stats;
+  uint8_t _dr;                    // Data rate in use
+  uint8_t _prevDr;
+  uint8_t _targetDr;              // Controller: rate being negotiated
+  uint8_t _ownPower;              // Controller: power once committed
+  uint8_t _seq;
+  uint8_t _lastSeqSeen;           // Peer: last request applied
+  uint8_t _reqSeq;                // Peer: request being applied
+  uint8_t _reqDr;
+  bool _reqPending;               // Peer: its switch failed, retry from poll()
+  uint32_t _checkSentMs;
+  bool _checkPending;
+
+  OurLoRaLinkHistory *_link(uint8_t peer, bool create) {
+    OurLoRaLinkHistory *free = NULL;
+    for (uint8_t i = 0; i < OURLORA_ADR_MAX_PEERS; i++) {
+      if (_links[i].used && _links[i].peer == peer) {
+        return &_links[i];
+      }
+      if (!_links[i].used && free == NULL) {
+        free = &_links[i];
+      }
+    }
+    if (!create || free == NULL) {
+      return NULL;
+    }
+    memset(free, 0, sizeof(*free));
+    free->used = true;
+    free->peer = peer;
+    free->txPower = 17;
+    free->reportedSnr = 127;       // Unknown
+    free->lastHeardMs = millis();
+    return free;
+  }
+
+  static uint8_t _data_rate_of(const OurLoRaModemProfile &p) {
+    for (uint8_t dr = 0; dr < OURLORA_ADR_DATA_RATES; dr++) {
+      if (_loraAdrSf[dr] == p.spreadingFactor && _loraAdrBw[dr] == p.bandwidth) {
+        return dr;
+      }
+    }
+    return 0;
+  }
+
+  // Lowest SNR in the history (127 = no data)
+  static int _min_snr(const OurLoRaLinkHistory *link) {
+    if (link == NULL || link->count == 0) {
+      return 127;
+    }
+    int m = 127;
+    for (uint8_t i = 0; i < link->count; i++) {
+      if (link->snr[i] < m) m = link->snr[i];
+    }
+    return m;
+  }
+
+  // Spare SNR at data rate `to` for a link measured at `from`
+  // (a wider channel lets in more noise: 10·log10 of the BW ratio)
+  static int _margin(int snr, uint8_t from, uint8_t to) {
+    return snr - (_loraBwDb[_loraAdrBw[to]] - _loraBwDb[_loraAdrBw[from]])
+               - _loraRequiredSnr[_loraAdrSf[to] - 7] - OURLORA_ADR_MARGIN_DB;
+  }
+
+  static uint8_t _best_dr(int snr, uint8_t from) {
+    for (int dr = OURLORA_ADR_DATA_RATES - 1; dr > 0; dr--) {
+      if (_margin(snr, from, dr) >= 0) {
+        return dr;
+      }
+    }
+    return 0;
+  }
+
+  // Power that leaves exactly the target margin at data rate `to`
+  static uint8_t _needed_power(int snr, uint8_t from, uint8_t to, uint8_t power) {
+    int p = (int)power - _margin(snr, from, to);
+    return p < 2 ? 2 : (p > 17 ? 17 : p);
+  }
+
+  // A peer unheard for two check periods has probably fallen back to
+  // a slower rate: follow it down, and forget it once at DR0
+  void _check_silent_peers(uint32_t now) {
+    for (uint8_t i = 0; i < OURLORA_ADR_MAX_PEERS; i++) {
+      OurLoRaLinkHistory *link = &_links[i];
+      if (!link->used || now - link->lastHeardMs <= 2UL * OURLORA_ADR_LINK_CHECK_MS) continue;
+      if (_dr == 0) {
+        link->used = false;
+        continue;
+      }
+      link->pending = false;
+      link->lastHeardMs = now;
+      link->reportedSnr = 127;  // Old report no longer trusted
+      link->txPower = 17;       // Peers fall back at full power
+      _radio.set_tx_power(17);
+      _switch(_dr - 1);
+      _stats.fallbacks++;
+    }
+  }
+
+  bool _any_pending() const {
+    for (uint8_t i = 0; i < OURLORA_ADR_MAX_PEERS; i++) {
+      if (_links[i].used && _links[i].pending) return true;
+    }
+    return false;
+  }
+
+  void _decide() {
+    int linkDr = OURLORA_ADR_DATA_RATES - 1;
+    bool ready = false;
+    for (uint8_t i = 0; i < OURLORA_ADR_MAX_PEERS; i++) {
+      if (!_links[i].used) continue;
+      if (_links[i].count < OURLORA_ADR_MIN_SAMPLES) return;  // Wait for everyone
+      uint8_t best = _best_dr(_min_snr(&_links[i]), _dr);
+      if (best < linkDr) linkDr = best;
+      ready = true;
+    }
+    if (!ready) {
+      return;
+    }
+    
+    // Per-peer power at the link rate, and our own from their reports
+    bool change = linkDr != _dr;
+    int own = 2;
+    for (uint8_t i = 0; i < OURLORA_ADR_MAX_PEERS; i++) {
+      OurLoRaLinkHistory *link = &_links[i];
+      if (!link->used) continue;
+      link->pendingPower = _needed_power(_min_snr(link), _dr, linkDr, link->txPower);
+      if (abs((int)link->pendingPower - (int)link->txPower) >= 3) change = true;
+      int mine = link->reportedSnr == 127 ? 17 :
+                 _needed_power(link->reportedSnr, link->reportedDr, linkDr, _radio.get_tx_power());
+      if (mine > own) own = mine;
+    }
+    _ownPower = own;
+    if (!change) {
+      if (abs(own - _radio.get_tx_power()) >= 3) {
+        _radio.set_tx_power(own);  // Our own power needs no negotiation
+      }
+      return;
+    }
+    
+    _targetDr = linkDr;
+    _seq++;
+    for (uint8_t i = 0; i < OURLORA_ADR_MAX_PEERS; i++) {
+      OurLoRaLinkHistory *link = &_links[i];
+      if (!link->used) continue;
+      link->pending = true;
+      link->retries = 0;
+      _send_request(link);
+    }
+  }
+
+  void _send_request(OurLoRaLinkHistory *link) {
+    _send(OURLORA_ADR_REQ, link->peer, _seq, _targetDr, link->pendingPower, 0);
+    link->sentMs = millis();
+    _stats.requests++;
+  }
+
+  void _retry(uint32_t now) {
+    for (uint8_t i = 0; i < OURLORA_ADR_MAX_PEERS; i++) {
+      OurLoRaLinkHistory *link = &_links[i];
+      if (!link->used || !link->pending || now - link->sentMs < OURLORA_ADR_RETRY_MS) continue;
+      if (link->retries >= OURLORA_ADR_MAX_RETRIES) {
+        link->pending = false;  // Peer may have switched; its fallback brings it back
+        _try_commit();
+        continue;
+      }
+      link->retries++;
+      _send_request(link);
+    }
+  }
+
+  // Peer: switch as the controller asked. The request only counts as
+  // seen once the switch worked, so a failed one is retried by poll()
+  // and by a resent request with the same sequence number.
+  void _apply_request() {
+    _reqPending = !_switch(_reqDr);
+    if (!_reqPending) {
+      _lastSeqSeen = _reqSeq;
+    }
+  }
+
+  // Every peer answered (or gave up): switch together
+  void _try_commit() {
+    if (_any_pending()) {
+      return;
+    }
+    _radio.set_tx_power(_ownPower);
+    _switch(_targetDr);
+  }
+
+  // Returns false if the radio was busy (TX, CAD, FSK) and nothing
+  // changed: the controller decides again from poll(), a peer retries
+  // its request
+  bool _switch(uint8_t dr) {
+    if (dr != _dr) {
+      const OurLoRaModemProfile &cur = _radio.profile();
+      OurLoRaModemProfile next(cur.frequencyHz, _loraAdrSf[dr], _loraAdrBw[dr], cur.codingRate,
+                               cur.crc, LORA_LDRO_AUTO, cur.preambleLength, cur.syncWord,
+                               cur.implicitLength);
+      if (!_radio.set_profile(next)) {
+        return false;
+      }
+      _prevDr = _dr;
+      _dr = dr;
+      _stats.dataRateChanges++;
+    }
+    // Old samples describe the old setup
+    for (uint8_t i = 0; i < OURLORA_ADR_MAX_PEERS; i++) {
+      _links[i].count = 0;
+      _links[i].next = 0;
+    }
+    return true;
+  }
+
+  void _send(uint8_t type, uint8_t dst, uint8_t seq, uint8_t dr, uint8_t power, int snr) {
+    uint8_t frame[255] = {
+      OURLORA_ADR_MARKER, type, dst, _nodeId, seq, dr, power, (uint8_t)(int8_t)snr
+    };
+    // Implicit header: pad to the fixed length
+    uint8_t length = _radio.profile().implicitLength;
+    _radio.send_a_msg(frame, length ? length : OURLORA_ADR_FRAME_LEN);
+  }
+
+  OurLoRaAdr(const OurLoRaAdr &);
+  OurLoRaAdr &operator=(const OurLoRaAdr &);
+};
+
+#endif // OURLORA_ADR_H
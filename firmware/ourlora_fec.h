@@ -0,0 +1,244 @@
+/*
+ * OurLoRa FEC - erasure code for multi-frame payloads
+
+ * OurLoRaFec: Reed-Solomon parity blocks that rebuild frames lost to
+ * CRC errors without a retransmission. No radio code; used by
+ * ourlora_frag.h.
+ */
+#ifndef OURLORA_FEC_H
+#define OURLORA_FEC_H
+
+#include "ourlora.h"
+
+// ============================================================
+//  FORWARD ERROR CORRECTION
+// ============================================================
+// Erasure code for payloads that span several frames. A frame with a
+// CRC error is simply missing, so the code only has to fill gaps:
+// from k data blocks the sender makes m parity blocks, and the
+// receiver rebuilds up to m lost data blocks from any m parity blocks
+// that arrived - no retransmission.
+// 
+// Reed-Solomon over GF(2^8) with a Cauchy matrix, scaled so the first
+// parity block is the plain XOR of the data (cheap, and all that one
+// lost frame needs). The others use split-nibble multiply tables: two
+// 16-entry tables per coefficient, one lookup pair per byte. All
+// blocks have the same length; pad the last one with zeros.
+
+#define OURLORA_FEC_MAX_PARITY   8     // Parity blocks per group (at most)
+#define OURLORA_FEC_MAX_DATA     (256 - OURLORA_FEC_MAX_PARITY)
+
+/*
+ * Erasure codec (no radio involved)
+ * 
+ * Example (4 data frames + 2 parity frames of 64 bytes):
+ *   uint8_t *blocks[6] = { d0, d1, d2, d3, p0, p1 };
+ *   OurLoRaFec::encode(blocks, 4, blocks + 4, 2, 64);
+ *   ... send all 6, d1 and d3 get lost ...
+ *   bool present[6] = { true, false, true, false, true, true };
+ *   OurLoRaFec::decode(blocks, present, 4, 2, 64);  // d1, d3 rebuilt
+ */
+class OurLoRaFec {
+public:
+  /*
+   * Make parity blocks
+   * 
+   * Parameters:
+   *   data   - k data blocks
+   *   k      - 1..OURLORA_FEC_MAX_DATA
+   *   parity - Gets m parity blocks
+   *   m      - 0..OURLORA_FEC_MAX_PARITY
+   *   length - Bytes per block
+   */
+  static void encode(const uint8_t *const *data, uint8_t k, uint8_t *const *parity, uint8_t m,
+                     uint16_t length) {
+    for (uint8_t r = 0; r < m; r++) {
+      memset(parity[r], 0, length);
+      for (uint8_t i = 0; i < k; i++) {
+        _mul_add(parity[r], data[i], coefficient(r, i), length);
+      }
+    }
+  }
+
+  /*
+   * Rebuild missing data blocks
+   * 
+   * Parameters:
+   *   blocks  - k data blocks followed by m parity blocks; missing data
+   *             blocks are written in place. Parity blocks used for
+   *             the repair are overwritten.
+   *   present - k + m flags, false = block was lost
+   *   k, m    - As for encode()
+   *   length  - Bytes per block
+   * 
+   * Returns:
+   *   true  - All data blocks present now
+   *   false - More data blocks lost than parity blocks arrived
+   *           (nothing changed)
+   */
+  static bool decode(uint8_t *const *blocks, const bool *present, uint8_t k, uint8_t m,
+                     uint16_t length) {
+    uint8_t missing[OURLORA_FEC_MAX_PARITY], rows[OURLORA_FEC_MAX_PARITY];
+    uint8_t e = 0, p = 0;
+    for (uint8_t i = 0; i < k; i++) {
+      if (present[i]) continue;
+      if (e == OURLORA_FEC_MAX_PARITY) {
+        return false;
+      }
+      missing[e++] = i;
+    }
+    if (e == 0) {
+      return true;
+    }
+    for (uint8_t r = 0; r < m && p < e; r++) {
+      if (present[k + r]) rows[p++] = r;
+    }
+    if (p < e) {
+      return false;
+    }
+    
+    // Parity minus the known data leaves a combination of the missing
+    // blocks only: s = A * missing, with A a square Cauchy submatrix
+    uint8_t a[OURLORA_FEC_MAX_PARITY][OURLORA_FEC_MAX_PARITY];
+    for (uint8_t j = 0; j < e; j++) {
+      uint8_t *s = blocks[k + rows[j]];
+      for (uint8_t i = 0; i < k; i++) {
+        if (present[i]) _mul_add(s, blocks[i], coefficient(rows[j], i), length);
+      }
+      for (uint8_t l = 0; l < e; l++) {
+        a[j][l] = coefficient(rows[j], missing[l]);
+      }
+    }
+    uint8_t inv[OURLORA_FEC_MAX_PARITY][OURLORA_FEC_MAX_PARITY];
+    _invert(a, inv, e);  // Never singular: every Cauchy submatrix inverts
+    
+    for (uint8_t l = 0; l < e; l++) {
+      memset(blocks[missing[l]], 0, length);
+      for (uint8_t j = 0; j < e; j++) {
+        _mul_add(blocks[missing[l]], blocks[k + rows[j]], inv[l][j], length);
+      }
+    }
+    return true;
+  }
+
+  /*
+   * Weight of data block `column` in parity block `row`
+   * Row 0 is all ones (XOR parity).
+   */
+  static uint8_t coefficient(uint8_t row, uint8_t column) {
+    // Cauchy 1 / (x_r + y_c) with x_r = row, y_c = MAX_PARITY + column,
+    // column c scaled by (x_0 + y_c)
+    uint8_t y = OURLORA_FEC_MAX_PARITY + column;
+    return _div(y, row ^ y);
+  }
+
+  static uint8_t mul(uint8_t a, uint8_t b) {
+    if (a == 0 || b == 0) {
+      return 0;
+    }
+    const _Gf &gf = _gf();
+    return gf.exp[gf.log[a] + gf.log[b]];
+  }
+
+private:
+  struct _Gf {
+    uint8_t exp[512];             // Doubled, so log sums need no modulo
+    uint8_t log[256];
+    
+    _Gf() {
+      uint16_t x = 1;
+      for (uint16_t i = 0; i < 255; i++) {
+        exp[i] = x;
+        exp[i + 255] = x;
+        log[x] = i;
+        x <<= 1;
+        if (x & 0x100) x ^= 0x11D;  // x^8 + x^4 + x^3 + x^2 + 1
+      }
+      exp[510] = exp[0];
+      exp[511] = exp[1];
+      log[0] = 0;
+    }
+  };
+
+  static const _Gf &_gf() {
+    static _Gf gf;
+    return gf;
+  }
+
+  static uint8_t _div(uint8_t a, uint8_t b) {
+    if (a == 0) {
+      return 0;
+    }
+    const _Gf &gf = _gf();
+    return gf.exp[gf.log[a] + 255 - gf.log[b]];
+  }
+
+  // dst ^= c * src
+  static void _mul_add(uint8_t *dst, const uint8_t *src, uint8_t c, uint16_t length) {
+    if (c == 0) {
+      return;
+    }
+    uint16_t i = 0;
+    if (c == 1) {
+      // 4 bytes per step (memcpy: blocks need not be aligned)
+      for (; i + 4 <= length; i += 4) {
+        uint32_t d, s;
+        memcpy(&d, dst + i, 4);
+        memcpy(&s, src + i, 4);
+        d ^= s;
+        memcpy(dst + i, &d, 4);
+      }
+      for (; i < length; i++) {
+        dst[i] ^= src[i];
+      }
+      return;
+    }
+    uint8_t lo[16], hi[16];
+    for (uint8_t x = 0; x < 16; x++) {
+      lo[x] = mul(c, x);
+      hi[x] = mul(c, x << 4);
+    }
+    for (; i < length; i++) {
+      dst[i] ^= lo[src[i] & 0x0F] ^ hi[src[i] >> 4];
+    }
+  }
+
+  // Gauss-Jordan over GF(2^8), n <= OURLORA_FEC_MAX_PARITY
+  static void _invert(uint8_t a[][OURLORA_FEC_MAX_PARITY], uint8_t inv[][OURLORA_FEC_MAX_PARITY],
+                      uint8_t n) {
+    for (uint8_t i = 0; i < n; i++) {
+      for (uint8_t j = 0; j < n; j++) {
+        inv[i][j] = i == j;
+      }
+    }
+    for (uint8_t col = 0; col < n; col++) {
+      uint8_t pivot = col;
+      while (a[pivot][col] == 0) {
+        pivot++;
+      }
+      for (uint8_t j = 0; j < n; j++) {
+        uint8_t t = a[col][j];
+        a[col][j] = a[pivot][j];
+        a[pivot][j] = t;
+        t = inv[col][j];
+        inv[col][j] = inv[pivot][j];
+        inv[pivot][j] = t;
+      }
+      uint8_t scale = _div(1, a[col][col]);
+      for (uint8_t j = 0; j < n; j++) {
+        a[col][j] = mul(a[col][j], scale);
+        inv[col][j] = mul(inv[col][j], scale);
+      }
+      for (uint8_t i = 0; i < n; i++) {
+        uint8_t f = a[i][col];
+        if (i == col || f == 0) continue;
+        for (uint8_t j = 0; j < n; j++) {
+          a[i][j] ^= mul(f, a[col][j]);
+          inv[i][j] ^= mul(f, inv[col][j]);
+        }
+      }
+    }
+  }
+};
+
+#endif // OURLORA_FEC_H
@@ -0,0 +1,575 @@
+/*
+ * OurLoRa fragmentation - messages larger than one frame
+
+ * OurLoRaFragmenter: cuts messages of up to 2 KB into frames and
+ * resends only the missing ones, optionally with FEC parity
+ * (ourlora_fec.h).
+ */
+#ifndef OURLORA_FRAG_H
+#define OURLORA_FRAG_H
+
+#include "ourlora.h"
+#include "ourlora_fec.h"
+
+// ============================================================
+//  FRAGMENTATION
+// ============================================================
+// Messages larger than one LoRa frame (batched history, config blobs,
+// feature vectors), up to OURLORA_FRAG_MAX_MESSAGE bytes:
+//   - the sender cuts a message into fragments of OURLORA_FRAG_SIZE
+//     bytes (the last one shorter), each with a 7-byte header
+//   - the receiver puts every fragment straight into its place in a
+//     preallocated reassembly buffer, in whatever order they arrive
+//   - the last fragment of every round asks for a status: a bitmap of
+//     the fragments received so far. The sender resends only the
+//     missing ones, until the bitmap is full or it runs out of retries
+//   - a reassembly that sees no fragment for OURLORA_FRAG_TIMEOUT_MS
+//     is dropped and its buffer reused
+// 
+// With set_fec(m) the first round also carries m parity fragments
+// (OurLoRaFec), so up to m lost fragments are rebuilt by the receiver
+// and need no second round. Worth it on links that lose frames often.
+// 
+// One message is in flight per sender; the receiver reassembles up to
+// OURLORA_FRAG_BUFFERS messages at once (from different senders).
+// Both sides must be built with the same OURLORA_FRAG_SIZE.
+
+// Fragment: [marker, type, dst, src, message id, index, count, data...]
+// Parity:   [marker, type, dst, src, message id, count + row, count,
+//            message length (2), parity...]
+// Status:   [marker, type, dst, src, message id, count, bitmap...]
+#define OURLORA_FRAG_MARKER      0xA9  // First byte of every fragmentation frame
+#define OURLORA_FRAG_DATA        0x01
+#define OURLORA_FRAG_STATUS      0x02
+#define OURLORA_FRAG_WANT_STATUS 0x80  // Type flag: answer with a status now
+#define OURLORA_FRAG_HEADER_LEN  7
+#define OURLORA_FRAG_STATUS_HDR  6
+
+#ifndef OURLORA_FRAG_SIZE
+#define OURLORA_FRAG_SIZE        200   // Data bytes per fragment
+#endif
+#ifndef OURLORA_FRAG_MAX_MESSAGE
+#define OURLORA_FRAG_MAX_MESSAGE 2048
+#endif
+#ifndef OURLORA_FRAG_BUFFERS
+#define OURLORA_FRAG_BUFFERS     2     // Reassemblies at once
+#endif
+#ifndef OURLORA_FRAG_TIMEOUT_MS
+#define OURLORA_FRAG_TIMEOUT_MS  30000 // Silent reassembly is dropped
+#endif
+#ifndef OURLORA_FRAG_MAX_PARITY
+#define OURLORA_FRAG_MAX_PARITY  4     // FEC fragments per message (buffer space)
+#endif
+#define OURLORA_FRAG_STATUS_MARGIN_MS 100 // Added to the status airtime
+#define OURLORA_FRAG_MAX_RETRIES 6     // Rounds without progress, then give up
+#define OURLORA_FRAG_DONE        4     // Finished messages remembered (re-ACK)
+
+#define OURLORA_FRAG_MAX_COUNT   ((OURLORA_FRAG_MAX_MESSAGE + OURLORA_FRAG_SIZE - 1) / OURLORA_FRAG_SIZE)
+
+static_assert(OURLORA_FRAG_SIZE >= 1 && OURLORA_FRAG_SIZE + OURLORA_FRAG_HEADER_LEN + 2 <= 255,
+              "Fragment (parity: + message length) must fit one LoRa frame");
+static_assert(OURLORA_FRAG_MAX_PARITY <= OURLORA_FEC_MAX_PARITY, "Too many parity fragments");
+static_assert(OURLORA_FRAG_MAX_COUNT <= 64, "At most 64 fragments (status bitmap)");
+
+// One message being reassembled
+typedef struct {
+  bool     used;
+  uint8_t  src;
+  uint8_t  id;
+  uint8_t  count;
+  uint16_t lastLength;                 // Data bytes in the last fragment (0 = unknown)
+  uint64_t have;                       // Bit i: fragment i arrived
+  uint8_t  haveParity;                 // Bit r: parity fragment r arrived
+  uint32_t lastMs;
+  uint8_t  data[OURLORA_FRAG_MAX_COUNT * OURLORA_FRAG_SIZE];  // Last one zero padded
+  uint8_t  parity[OURLORA_FRAG_MAX_PARITY][OURLORA_FRAG_SIZE];
+} OurLoRaFragBuffer;
+
+// Fragmentation statistics, see OurLoRaFragmenter::stats()
+typedef struct {
+  uint32_t messagesSent;               // Fully acknowledged
+  uint32_t messagesFailed;             // Given up
+  uint32_t fragmentsSent;              // First sends
+  uint32_t fragmentsResent;            // Missing from a status
+  uint32_t paritySent;                 // FEC fragments
+  uint32_t messagesReceived;
+  uint32_t fragmentsReceived;
+  uint32_t duplicates;                 // Fragments we already had
+  uint32_t recovered;                  // Fragments rebuilt from parity
+  uint32_t timeouts;                   // Reassemblies dropped incomplete
+  uint32_t noBuffer;                   // Fragments dropped, all buffers busy
+} OurLoRaFragStats;
+
+/*
+ * Fragmentation and reassembly engine for one radio
+ * 
+ * Use interrupt mode with start_listening(), so the radio is back in
+ * RX after every frame it sends. Feed every received frame to
+ * handle_frame() and call poll() from loop(); poll() sends one
+ * fragment per call, so received frames are handled in between.
+ * 
+ * Example (sub tank, ID 2, sending its history to the main tank, ID 1):
+ *   OurLoRaFragmenter<OurLoRaDefaultRadio> frag(OurLoRa, 2);
+ * 
+ *   void loop() {
+ *     OurLoRaRxFrame f;
+ *     while (lora_rx_pop(&f)) {
+ *       const uint8_t *message;
+ *       uint8_t from;
+ *       int n = frag.handle_frame(f.data, f.length, &message, &from);
+ *       if (n > 0) { ... }                   // Whole message from `from`
+ *     }
+ *     if (historyReady && !frag.busy()) frag.send(1, history, historyLength);
+ *     frag.poll();
+ *   }
+ * 
+ * Application frames must not start with OURLORA_FRAG_MARKER.
+ * Needs an explicit-header profile (frames vary in length).
+ */
+template <class Radio>
+class OurLoRaFragmenter {
+public:
+  OurLoRaFragmenter(Radio &radio, uint8_t nodeId)
+    : _radio(radio), _nodeId(nodeId) {
+    memset(_buffers, 0, sizeof(_buffers));
+    memset(_done, 0, sizeof(_done));
+    memset(&_stats, 0, sizeof(_stats));
+    _txActive = false;
+    _txFec = 0;
+    _txId = (uint8_t)random(256);
+    _doneNext = 0;
+    _onDone = NULL;
+  }
+
+  /*
+   * Start sending a message
+   * The data is copied, the buffer can be reused right away.
+   * 
+   * Parameters:
+   *   dst    - Receiver's node ID
+   *   data   - Message
+   *   length - 1..OURLORA_FRAG_MAX_MESSAGE bytes
+   * 
+   * Returns:
+   *   true  - Accepted, poll() sends it
+   *   false - Previous message still going, or bad length
+   */
+  bool send(uint8_t dst, const uint8_t *data, uint16_t length) {
+    if (_txActive || length == 0 || length > OURLORA_FRAG_MAX_MESSAGE) {
+      return false;
+    }
+    memcpy(_tx, data, length);
+    _txLength = length;
+    _txDst = dst;
+    _txId++;
+    _txCount = (length + OURLORA_FRAG_SIZE - 1) / OURLORA_FRAG_SIZE;
+    _txAcked = 0;
+    _txPending = _all(_txCount);
+    _txParityPending = 0;
+    if (_txFec) {
+      memset(_tx + length, 0, _txCount * OURLORA_FRAG_SIZE - length);
+      const uint8_t *blocks[OURLORA_FRAG_MAX_COUNT];
+      uint8_t *parity[OURLORA_FRAG_MAX_PARITY];
+      for (uint8_t i = 0; i < _txCount; i++) blocks[i] = _tx + i * OURLORA_FRAG_SIZE;
+      for (uint8_t r = 0; r < _txFec; r++) parity[r] = _txParity[r];
+      OurLoRaFec::encode(blocks, _txCount, parity, _txFec, OURLORA_FRAG_SIZE);
+      _txParityPending = (1 << _txFec) - 1;
+    }
+    _txFirstRound = true;
+    _txWaiting = false;
+    _txRetries = 0;
+    _txActive = true;
+    return true;
+  }
+
+  /*
+   * Process a received frame if it is a fragmentation frame
+   * 
+   * Parameters:
+   *   data, length - Frame as received
+   *   message      - Gets the whole message when one is complete (valid
+   *                  until the next handle_frame() call)
+   *   from         - Gets the sender's node ID
+   * 
+   * Returns:
+   *   > 0 - Message of this length complete, handle it
+   *   0   - Fragmentation frame consumed
+   *   -1  - Not a fragmentation frame, handle it yourself
+   */
+  int handle_frame(const uint8_t *data, int length, const uint8_t **message, uint8_t *from) {
+    if (length < OURLORA_FRAG_STATUS_HDR || data[0] != OURLORA_FRAG_MARKER) {
+      return -1;
+    }
+    uint8_t type = data[1] & ~OURLORA_FRAG_WANT_STATUS, dst = data[2], src = data[3], id = data[4];
+    if (dst != _nodeId) {
+      return 0;
+    }
+    if (type == OURLORA_FRAG_STATUS) {
+      _on_status(src, id, data[5], data + OURLORA_FRAG_STATUS_HDR, length - OURLORA_FRAG_STATUS_HDR);
+      return 0;
+    }
+    if (type != OURLORA_FRAG_DATA || length <= OURLORA_FRAG_HEADER_LEN) {
+      return 0;
+    }
+    
+    uint8_t index = data[5], count = data[6];
+    const uint8_t *body = data + OURLORA_FRAG_HEADER_LEN;
+    uint16_t n = length - OURLORA_FRAG_HEADER_LEN;
+    uint16_t total = 0;             // Message length, parity fragments only
+    bool wantStatus = (data[1] & OURLORA_FRAG_WANT_STATUS) != 0;
+    if (count == 0 || count > OURLORA_FRAG_MAX_COUNT) {
+      return 0;
+    }
+    if (index >= count) {
+      if (index - count >= OURLORA_FRAG_MAX_PARITY || n != 2 + OURLORA_FRAG_SIZE) {
+        return 0;
+      }
+      total = body[0] | (body[1] << 8);
+      body += 2;
+      n -= 2;
+      if (total <= (count - 1) * OURLORA_FRAG_SIZE || total > count * OURLORA_FRAG_SIZE) {
+        return 0;
+      }
+    } else if (n > OURLORA_FRAG_SIZE || (index + 1 < count && n != OURLORA_FRAG_SIZE)) {
+      return 0;  // Other fragment size, or damaged
+    }
+    _expire();
+    
+    // Already finished: the sender missed our last status
+    for (uint8_t i = 0; i < OURLORA_FRAG_DONE; i++) {
+      if (_done[i].count && _done[i].src == src && _done[i].id == id) {
+        _stats.duplicates++;
+        if (wantStatus) _send_status(src, id, count, _all(count));
+        return 0;
+      }
+    }
+    
+    OurLoRaFragBuffer *buf = _buffer(src, id, count);
+    if (buf == NULL) {
+      _stats.noBuffer++;
+      return 0;
+    }
+    if (total) {
+      uint8_t bit = 1 << (index - count);
+      if (buf->haveParity & bit || buf->have == _all(count)) {
+        _stats.duplicates++;
+      } else {
+        memcpy(buf->parity[index - count], body, n);
+        buf->haveParity |= bit;
+        buf->lastLength = total - (count - 1) * OURLORA_FRAG_SIZE;
+      }
+    } else {
+      uint64_t bit = (uint64_t)1 << index;
+      uint8_t *block = buf->data + (uint16_t)index * OURLORA_FRAG_SIZE;
+      if (buf->have & bit) {
+        _stats.duplicates++;
+      } else {
+        memcpy(block, body, n);
+        memset(block + n, 0, OURLORA_FRAG_SIZE - n);
+        buf->have |= bit;
+        if (index + 1 == count) buf->lastLength = n;
+        _stats.fragmentsReceived++;
+      }
+    }
+    buf->lastMs = millis();
+    if (buf->haveParity && buf->have != _all(count)) {
+      _repair(buf);
+    }
+    
+    bool complete = buf->have == _all(count);
+    if (wantStatus || complete) {
+      _send_status(src, id, count, buf->have);
+    }
+    if (!complete) {
+      return 0;
+    }
+    
+    _done[_doneNext].src = src;
+    _done[_doneNext].id = id;
+    _done[_doneNext].count = count;
+    _doneNext = (_doneNext + 1) % OURLORA_FRAG_DONE;
+    buf->used = false;  // Data stays until the buffer is taken again
+    _stats.messagesReceived++;
+    *message = buf->data;
+    *from = src;
+    return (count - 1) * OURLORA_FRAG_SIZE + buf->lastLength;
+  }
+
+  /*
+   * Run the engine - call from loop()
+   * Sends the next fragment, or resends after a status timeout.
+   */
+  void poll() {
+    _expire();
+    if (!_txActive) {
+      return;
+    }
+    
+    if (_txPending || _txParityPending) {
+      uint8_t index;
+      if (_txPending) {
+        index = _lowest(_txPending);
+        _txPending &= ~((uint64_t)1 << index);
+        if (_txFirstRound) {
+          _stats.fragmentsSent++;
+        } else {
+          _stats.fragmentsResent++;
+        }
+      } else {
+        index = _lowest(_txParityPending);
+        _txParityPending &= ~(1 << index);
+        index += _txCount;           // Parity rows follow the data
+        _stats.paritySent++;
+      }
+      bool last = _txPending == 0 && _txParityPending == 0;  // Ask for a status
+      _send_fragment(index, last);
+      if (last) {
+        _txWaiting = true;
+        _txSentMs = millis();
+      }
+      return;
+    }
+    
+    if (_txWaiting && millis() - _txSentMs >= (_status_timeout_ms() << _txRetries)) {
+      if (++_txRetries > OURLORA_FRAG_MAX_RETRIES) {
+        _finish(false);
+        return;
+      }
+      // Status lost, or the whole round: ask again with one fragment
+      _txFirstRound = false;
+      _txPending = (uint64_t)1 << _highest(_all(_txCount) & ~_txAcked);
+    }
+  }
+
+  /*
+   * Send parity fragments with every message
+   * 
+   * Parameters:
+   *   parity - 0 (off) .. OURLORA_FRAG_MAX_PARITY; the receiver rebuilds
+   *            up to this many lost fragments without a resend
+   */
+  void set_fec(uint8_t parity) {
+    _txFec = parity > OURLORA_FRAG_MAX_PARITY ? OURLORA_FRAG_MAX_PARITY : parity;
+  }
+  
+  /*
+   * Is a message still being sent?
+   */
+  bool busy() const {
+    return _txActive;
+  }
+
+  /*
+   * Called when a message is acknowledged (true) or given up (false)
+   */
+  void on_done(void (*callback)(uint8_t dst, bool delivered)) {
+    _onDone = callback;
+  }
+
+  OurLoRaFragStats stats() const {
+    return _stats;
+  }
+
+private:
+  typedef struct {
+    uint8_t  src;
+    uint8_t  id;
+    uint8_t  count;                    // 0 = unused
+  } _Done;
+
+  Radio &_radio;
+  uint8_t _nodeId;
+  OurLoRaFragStats _stats;
+  void (*_onDone)(uint8_t dst, bool delivered);
+
+  // Receiving
+  OurLoRaFragBuffer _buffers[OURLORA_FRAG_BUFFERS];
+  _Done _done[OURLORA_FRAG_DONE];
+  uint8_t _doneNext;
+
+  // Sending
+  bool _txActive;
+  bool _txFirstRound;
+  bool _txWaiting;                // Status requested, not here yet
+  uint8_t _txFec;                 // Parity fragments per message
+  uint8_t _txParityPending;
+  uint8_t _txDst;
+  uint8_t _txId;
+  uint8_t _txCount;
+  uint8_t _txRetries;
+  uint16_t _txLength;
+  uint64_t _txAcked;              // Fragments the receiver has
+  uint64_t _txPending;            // Fragments still to send this round
+  uint32_t _txSentMs;
+  uint8_t _tx[OURLORA_FRAG_MAX_COUNT * OURLORA_FRAG_SIZE];
+  uint8_t _txParity[OURLORA_FRAG_MAX_PARITY][OURLORA_FRAG_SIZE];
+
+  static uint64_t _all(uint8_t count) {
+    return count >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << count) - 1;
+  }
+
+  static uint8_t _lowest(uint64_t bits) {
+    uint8_t i = 0;
+    while (!(bits & 1)) {
+      bits >>= 1;
+      i++;
+    }
+    return i;
+  }
+
+  static uint8_t _highest(uint64_t bits) {
+    uint8_t i = 0;
+    while (bits >>= 1) {
+      i++;
+    }
+    return i;
+  }
+
+  // Buffer of (src, id), or a free one for it
+  OurLoRaFragBuffer *_buffer(uint8_t src, uint8_t id, uint8_t count) {
+    OurLoRaFragBuffer *free = NULL;
+    for (uint8_t i = 0; i < OURLORA_FRAG_BUFFERS; i++) {
+      OurLoRaFragBuffer *b = &_buffers[i];
+      if (b->used && b->src == src) {
+        if (b->id == id && b->count == count) {
+          return b;
+        }
+        b->used = false;  // Sender moved on to a new message
+        _stats.timeouts++;
+      }
+      if (!b->used && free == NULL) {
+        free = b;
+      }
+    }
+    if (free != NULL) {
+      free->used = true;
+      free->src = src;
+      free->id = id;
+      free->count = count;
+      free->have = 0;
+      free->haveParity = 0;
+      free->lastLength = 0;
+    }
+    return free;
+  }
+
+  void _expire() {
+    uint32_t now = millis();
+    for (uint8_t i = 0; i < OURLORA_FRAG_BUFFERS; i++) {
+      if (_buffers[i].used && now - _buffers[i].lastMs > OURLORA_FRAG_TIMEOUT_MS) {
+        _buffers[i].used = false;
+        _stats.timeouts++;
+      }
+    }
+  }
+
+  // Enough parity for the missing fragments? Rebuild them.
+  void _repair(OurLoRaFragBuffer *buf) {
+    uint8_t *blocks[OURLORA_FRAG_MAX_COUNT + OURLORA_FRAG_MAX_PARITY];
+    bool present[OURLORA_FRAG_MAX_COUNT + OURLORA_FRAG_MAX_PARITY];
+    uint8_t missing = 0;
+    for (uint8_t i = 0; i < buf->count; i++) {
+      blocks[i] = buf->data + (uint16_t)i * OURLORA_FRAG_SIZE;
+      present[i] = (buf->have >> i) & 1;
+      if (!present[i]) missing++;
+    }
+    for (uint8_t r = 0; r < OURLORA_FRAG_MAX_PARITY; r++) {
+      blocks[buf->count + r] = buf->parity[r];
+      present[buf->count + r] = (buf->haveParity >> r) & 1;
+    }
+    if (OurLoRaFec::decode(blocks, present, buf->count, OURLORA_FRAG_MAX_PARITY, OURLORA_FRAG_SIZE)) {
+      buf->have = _all(buf->count);
+      buf->haveParity = 0;          // Used up by the repair
+      _stats.recovered += missing;
+    }
+  }
+  
+  void _on_status(uint8_t src, uint8_t id, uint8_t count, const uint8_t *bitmap, int length) {
+    if (!_txActive || src != _txDst || id != _txId || count != _txCount ||
+        length < (count + 7) / 8) {
+      return;  // Late status of an older message
+    }
+    uint64_t have = 0;
+    for (uint8_t i = 0; i < (count + 7) / 8; i++) {
+      have |= (uint64_t)bitmap[i] << (8 * i);
+    }
+    have &= _all(count);
+    if (have & ~_txAcked) {
+      _txRetries = 0;  // Progress
+    }
+    _txAcked |= have;
+    if (_txAcked == _all(count)) {
+      _finish(true);
+      return;
+    }
+    if (_txWaiting) {
+      _txWaiting = false;
+      _txFirstRound = false;
+      _txPending = _all(count) & ~_txAcked;  // Resend only what is missing
+    }
+  }
+
+  void _finish(bool delivered) {
+    _txActive = false;
+    _txPending = 0;
+    _txWaiting = false;
+    if (delivered) {
+      _stats.messagesSent++;
+    } else {
+      _stats.messagesFailed++;
+    }
+    if (_onDone) {
+      _onDone(_txDst, delivered);
+    }
+  }
+
+  void _send_fragment(uint8_t index, bool wantStatus) {
+    uint8_t frame[OURLORA_FRAG_HEADER_LEN + 2 + OURLORA_FRAG_SIZE];
+    uint8_t pos = OURLORA_FRAG_HEADER_LEN;
+    const uint8_t *body;
+    uint16_t n = OURLORA_FRAG_SIZE;
+    if (index >= _txCount) {
+      frame[pos++] = _txLength;
+      frame[pos++] = _txLength >> 8;
+      body = _txParity[index - _txCount];
+    } else {
+      uint16_t offset = (uint16_t)index * OURLORA_FRAG_SIZE;
+      body = _tx + offset;
+      if (_txLength - offset < OURLORA_FRAG_SIZE) n = _txLength - offset;
+    }
+    frame[0] = OURLORA_FRAG_MARKER;
+    frame[1] = OURLORA_FRAG_DATA | (wantStatus ? OURLORA_FRAG_WANT_STATUS : 0);
+    frame[2] = _txDst;
+    frame[3] = _nodeId;
+    frame[4] = _txId;
+    frame[5] = index;
+    frame[6] = _txCount;
+    memcpy(frame + pos, body, n);
+    _radio.send_a_msg(frame, pos + n);
+  }
+
+  void _send_status(uint8_t dst, uint8_t id, uint8_t count, uint64_t have) {
+    uint8_t frame[OURLORA_FRAG_STATUS_HDR + 8];
+    uint8_t bytes = (count + 7) / 8;
+    frame[0] = OURLORA_FRAG_MARKER;
+    frame[1] = OURLORA_FRAG_STATUS;
+    frame[2] = dst;
+    frame[3] = _nodeId;
+    frame[4] = id;
+    frame[5] = count;
+    for (uint8_t i = 0; i < bytes; i++) {
+      frame[OURLORA_FRAG_STATUS_HDR + i] = have >> (8 * i);
+    }
+    _radio.send_a_msg(frame, OURLORA_FRAG_STATUS_HDR + bytes);
+  }
+
+  // The receiver answers right after the fragment that asked
+  uint32_t _status_timeout_ms() {
+    return _radio.time_on_air_us(OURLORA_FRAG_STATUS_HDR + 8) / 1000 + OURLORA_FRAG_STATUS_MARGIN_MS;
+  }
+
+  OurLoRaFragmenter(const OurLoRaFragmenter &);
+  OurLoRaFragmenter &operator=(const OurLoRaFragmenter &);
+};
+
+#endif // OURLORA_FRAG_H
@@ -0,0 +1,809 @@
+/*
+ * OurLoRa mesh - multi-hop routing to the main tank
+
+ * OurLoRaMesh: on-demand routes and hop-by-hop acknowledged forwarding
+ * for nodes out of range of the main tank.
+ */
+#ifndef OURLORA_MESH_H
+#define OURLORA_MESH_H
+
+#include "ourlora.h"
+
+// ============================================================
+//  MESH ROUTING
+// ============================================================
+// Multi-hop forwarding for nodes out of range of the main tank.
+// Routes are found when they are needed (AODV style):
+//   - a node with data for an unknown destination floods a route
+//     request (RREQ); every node passes it on once, after a short
+//     random delay, adding the cost of the link it came in on, and
+//     remembers the way back to the requester
+//   - the destination answers the first copy, and every cheaper copy
+//     after it, with a route reply (RREP) that travels back hop by
+//     hop; each hop on the way learns the route to the destination
+//   - data moves hop by hop, every hop is acknowledged and retried;
+//     a next hop that stops answering loses its routes and the node
+//     looks for a new one (local repair). If that fails too, the
+//     data is dropped and a route error (RERR) goes back towards the
+//     sender, so the nodes in between forget the broken route
+// 
+// Link cost comes from the neighbour table (SNR of the frames each
+// neighbour sent): 1 per hop, plus a penalty for links with little
+// margin above the demodulation floor and for recent failures, so two
+// strong hops beat one marginal one. Frames carry a hop count capped
+// at OURLORA_MESH_MAX_HOPS; small caches of recently seen (origin, id)
+// pairs drop flooded and retransmitted copies, one for route requests
+// and one for data, so a burst of floods cannot push out the data.
+// 
+// Each hop costs about one data frame plus one ACK of airtime, so the
+// latency of a report grows linearly with the hop count.
+// 
+// Node IDs are 0..254 (0xFF is broadcast).
+
+// Frame: [marker, type, origin, target, from, to, id, hops, ...]
+//   RREQ  + origin seq, cost  (to = broadcast; origin asks for target)
+//   RREP  + target seq, cost  (target answers, goes back to origin)
+//   RERR                      (target unreachable, goes back to origin)
+//   ACK                       (origin, id of the DATA frame received)
+//   DATA  + payload
+#define OURLORA_MESH_MARKER      0xA8  // First byte of every mesh frame
+#define OURLORA_MESH_RREQ        0x01
+#define OURLORA_MESH_RREP        0x02
+#define OURLORA_MESH_RERR        0x03
+#define OURLORA_MESH_ACK         0x04
+#define OURLORA_MESH_DATA        0x05
+#define OURLORA_MESH_HEADER_LEN  8
+#define OURLORA_MESH_ROUTE_LEN   10    // RREQ / RREP
+#define OURLORA_MESH_BROADCAST   0xFF
+
+#ifndef OURLORA_MESH_MAX_HOPS
+#define OURLORA_MESH_MAX_HOPS    6
+#endif
+#ifndef OURLORA_MESH_MAX_NEIGHBORS
+#define OURLORA_MESH_MAX_NEIGHBORS 8
+#endif
+#ifndef OURLORA_MESH_MAX_ROUTES
+#define OURLORA_MESH_MAX_ROUTES  16
+#endif
+#ifndef OURLORA_MESH_QUEUE
+#define OURLORA_MESH_QUEUE       4     // Frames waiting for a route or an ACK
+#endif
+#ifndef OURLORA_MESH_MAX_PAYLOAD
+#define OURLORA_MESH_MAX_PAYLOAD 48
+#endif
+#define OURLORA_MESH_SEEN        16    // Route request cache entries
+#ifndef OURLORA_MESH_DATA_SEEN
+#define OURLORA_MESH_DATA_SEEN   16    // Data duplicate cache entries
+#endif
+#define OURLORA_MESH_JITTER_MS   100   // Largest RREQ rebroadcast delay
+#define OURLORA_MESH_ACK_MARGIN_MS 50  // Added to the ACK airtime
+#define OURLORA_MESH_HOP_RETRIES 3     // Then the next hop counts as gone
+#define OURLORA_MESH_RREQ_RETRIES 2    // Route requests after the first
+#define OURLORA_MESH_WEAK_MARGIN_DB 8  // Less SNR margin than this costs extra
+#define OURLORA_MESH_ROUTE_TIMEOUT_MS 600000 // Unused routes expire
+#define OURLORA_MESH_NEIGHBOR_TIMEOUT_MS 900000
+
+// One neighbour as heard by this node
+typedef struct {
+  bool     used;
+  uint8_t  id;
+  int16_t  rssi;                       // Last frame (dBm)
+  int16_t  snrQ2;                      // Smoothed SNR, quarter dB
+  uint8_t  failures;                   // Hops not acknowledged in a row
+  uint32_t lastHeardMs;
+} OurLoRaMeshNeighbor;
+
+// Route to one destination
+typedef struct {
+  bool     used;
+  bool     valid;
+  uint8_t  target;
+  uint8_t  nextHop;
+  uint8_t  hops;
+  uint8_t  cost;
+  uint8_t  seq;                        // Target's sequence number (freshness)
+  uint32_t usedMs;
+} OurLoRaMeshRoute;
+
+// Frame we originated or forward, until the next hop acknowledged it
+typedef struct {
+  bool     used;
+  bool     waitRoute;                  // Route discovery running
+  uint8_t  origin;
+  uint8_t  target;
+  uint8_t  id;
+  uint8_t  hops;
+  uint8_t  nextHop;
+  uint8_t  tries;                      // Hop resends, or route requests
+  uint32_t sentMs;                     // Last hop send / route request
+  uint8_t  length;
+  uint8_t  data[OURLORA_MESH_MAX_PAYLOAD];
+} OurLoRaMeshPacket;
+
+// Mesh statistics, see OurLoRaMesh::stats()
+typedef struct {
+  uint32_t sent;                       // Frames this node originated
+  uint32_t delivered;                  // Frames for this node
+  uint32_t forwarded;                  // Frames passed on for others
+  uint32_t hopRetries;
+  uint32_t hopFailures;                // Next hop never acknowledged
+  uint32_t routeRequests;              // RREQs this node started
+  uint32_t routeReplies;               // RREPs this node answered with
+  uint32_t routeErrors;                // RERRs sent or passed on
+  uint32_t repairs;                    // Routes looked for again after a failure
+  uint32_t dropped;                    // No route, queue full or hop limit
+  uint32_t duplicates;
+} OurLoRaMeshStats;
+
+/*
+ * Mesh routing engine for one radio
+ * 
+ * Use interrupt mode with start_listening(), so the radio is back in
+ * RX after every frame it sends. Feed every received frame to
+ * handle_frame(), with the frame's RSSI and SNR (the link metrics),
+ * and call poll() from loop(). Every node runs one - relays have
+ * nothing else to do.
+ * 
+ * Example (sub tank, ID 7, main tank ID 1 out of direct range):
+ *   OurLoRaMesh<OurLoRaDefaultRadio> mesh(OurLoRa, 7);
+ * 
+ *   void loop() {
+ *     OurLoRaRxFrame f;
+ *     while (lora_rx_pop(&f)) {
+ *       uint8_t payload[OURLORA_MESH_MAX_PAYLOAD], from;
+ *       int n = mesh.handle_frame(f.data, f.length, f.rssi, f.snr, payload, &from);
+ *       if (n > 0) { ... }                   // Data from node `from`
+ *     }
+ *     if (alarm) mesh.send(1, (uint8_t *)&txData, sizeof(txData));
+ *     mesh.poll();
+ *   }
+ * 
+ * In polling mode pass get_signal_strength() and get_signal_quality()
+ * after check_for_msg(). Application frames must not start with
+ * OURLORA_MESH_MARKER. Needs an explicit-header profile.
+ */
+template <class Radio>
+class OurLoRaMesh {
+public:
+  OurLoRaMesh(Radio &radio, uint8_t nodeId)
+    : _radio(radio), _nodeId(nodeId) {
+    memset(_neighbors, 0, sizeof(_neighbors));
+    memset(_routes, 0, sizeof(_routes));
+    memset(_queue, 0, sizeof(_queue));
+    memset(_seen, 0, sizeof(_seen));
+    memset(_dataSeen, 0, sizeof(_dataSeen));
+    memset(_rebroadcast, 0, sizeof(_rebroadcast));
+    memset(&_stats, 0, sizeof(_stats));
+    _seq = 0;
+    _nextId = (uint8_t)random(256);
+    _seenNext = 0;
+    _dataSeenNext = 0;
+  }
+
+  /*
+   * Send data to a node, over as many hops as it takes
+   * 
+   * Parameters:
+   *   dst    - Destination node ID (no broadcast)
+   *   data   - Payload
+   *   length - 1..OURLORA_MESH_MAX_PAYLOAD bytes
+   * 
+   * Returns:
+   *   true  - Sent, or queued until a route is found
+   *   false - Queue full, bad length or dst is this node
+   */
+  bool send(uint8_t dst, const uint8_t *data, uint8_t length) {
+    if (length == 0 || length > OURLORA_MESH_MAX_PAYLOAD || dst == _nodeId ||
+        dst == OURLORA_MESH_BROADCAST) {
+      return false;
+    }
+    OurLoRaMeshPacket *p = _alloc();
+    if (p == NULL) {
+      return false;
+    }
+    p->origin = _nodeId;
+    p->target = dst;
+    p->id = _nextId++;
+    p->hops = 0;
+    p->length = length;
+    memcpy(p->data, data, length);
+    _stats.sent++;
+    _route_packet(p);
+    return true;
+  }
+
+  /*
+   * Process a received frame if it is a mesh frame
+   * 
+   * Parameters:
+   *   data, length - Frame as received
+   *   rssi, snr    - Its signal strength (dBm) and SNR (dB)
+   *   payload      - Gets the payload (OURLORA_MESH_MAX_PAYLOAD bytes)
+   *   from         - Gets the node ID that sent the data
+   * 
+   * Returns:
+   *   > 0 - Data of this length for this node, handle it
+   *   0   - Mesh frame consumed (routing, forwarded, duplicate)
+   *   -1  - Not a mesh frame, handle it yourself
+   */
+  int handle_frame(const uint8_t *data, int length, int rssi, int snr,
+                   uint8_t *payload, uint8_t *from) {
+    if (length < OURLORA_MESH_HEADER_LEN || data[0] != OURLORA_MESH_MARKER) {
+      return -1;
+    }
+    uint8_t type = data[1], origin = data[2], target = data[3], sender = data[4], to = data[5];
+    uint8_t id = data[6], hops = data[7];
+    if (sender == _nodeId || origin == OURLORA_MESH_BROADCAST) {
+      return 0;
+    }
+    _heard(sender, rssi, snr);  // Overheard frames count too
+    if (to != _nodeId && to != OURLORA_MESH_BROADCAST) {
+      return 0;
+    }
+    
+    switch (type) {
+      case OURLORA_MESH_RREQ:
+        if (length >= OURLORA_MESH_ROUTE_LEN && origin != _nodeId) {
+          _on_rreq(origin, target, sender, id, hops, data[8], data[9]);
+        }
+        return 0;
+      
+      case OURLORA_MESH_RREP:
+        if (length >= OURLORA_MESH_ROUTE_LEN) {
+          _on_rrep(origin, target, sender, id, hops, data[8], data[9]);
+        }
+        return 0;
+      
+      case OURLORA_MESH_RERR:
+        _on_rerr(origin, target, sender, id, hops);
+        return 0;
+      
+      case OURLORA_MESH_ACK:
+        _on_ack(origin, id, sender);
+        return 0;
+      
+      case OURLORA_MESH_DATA:
+        break;
+      
+      default:
+        return 0;
+    }
+    
+    int n = length - OURLORA_MESH_HEADER_LEN;
+    if (n == 0 || n > OURLORA_MESH_MAX_PAYLOAD) {
+      return 0;
+    }
+    if (_data_seen(origin, id)) {
+      _send_frame(OURLORA_MESH_ACK, origin, target, sender, id, hops, NULL, 0);
+      _stats.duplicates++;  // Our ACK got lost, the sender tried again
+      return 0;
+    }
+    
+    if (target == _nodeId) {
+      _send_frame(OURLORA_MESH_ACK, origin, target, sender, id, hops, NULL, 0);
+      _data_remember(origin, id);
+      memcpy(payload, data + OURLORA_MESH_HEADER_LEN, n);
+      *from = origin;
+      _stats.delivered++;
+      return n;
+    }
+    
+    // Only ACK what we can pass on: without the ACK the sender keeps
+    // the frame, tries again or looks for another way
+    OurLoRaMeshPacket *p = hops + 1 < OURLORA_MESH_MAX_HOPS ? _alloc() : NULL;
+    if (p == NULL) {
+      _stats.dropped++;
+      return 0;
+    }
+    _send_frame(OURLORA_MESH_ACK, origin, target, sender, id, hops, NULL, 0);
+    _data_remember(origin, id);
+    p->origin = origin;
+    p->target = target;
+    p->id = id;
+    p->hops = hops + 1;
+    p->length = n;
+    memcpy(p->data, data + OURLORA_MESH_HEADER_LEN, n);
+    _stats.forwarded++;
+    _route_packet(p);
+    return 0;
+  }
+
+  /*
+   * Run the engine - call from loop()
+   * Passes on route requests, resends unacknowledged hops and gives
+   * up on route discoveries that stay unanswered.
+   */
+  void poll() {
+    uint32_t now = millis();
+    for (uint8_t i = 0; i < 2; i++) {
+      _Rebroadcast *r = &_rebroadcast[i];
+      if (r->used && (int32_t)(now - r->dueMs) >= 0) {
+        r->used = false;
+        uint8_t body[2] = { r->originSeq, r->cost };
+        _send_frame(OURLORA_MESH_RREQ, r->origin, r->target, OURLORA_MESH_BROADCAST, r->id,
+                    r->hops, body, 2);
+      }
+    }
+    
+    uint32_t hopMs = _hop_timeout_ms();
+    uint32_t findMs = _discovery_ms();
+    for (uint8_t i = 0; i < OURLORA_MESH_QUEUE; i++) {
+      OurLoRaMeshPacket *p = &_queue[i];
+      if (!p->used) continue;
+      
+      if (p->waitRoute) {
+        if (now - p->sentMs < findMs) continue;
+        if (p->tries < OURLORA_MESH_RREQ_RETRIES) {
+          _send_rreq(p->target);
+          _set_discovery(p->target, p->tries + 1, now);
+        } else {
+          _unreachable(p->target);
+        }
+        continue;
+      }
+      
+      if (now - p->sentMs < (hopMs << p->tries)) continue;
+      if (p->tries < OURLORA_MESH_HOP_RETRIES) {
+        p->tries++;
+        _stats.hopRetries++;
+        _transmit(p);
+        continue;
+      }
+      // Next hop is gone: forget everything through it, look again
+      _stats.hopFailures++;
+      OurLoRaMeshNeighbor *nb = _neighbor(p->nextHop, false);
+      if (nb && nb->failures < 255) nb->failures++;
+      _drop_routes_via(p->nextHop);
+      _stats.repairs++;
+      _route_packet(p);
+    }
+    
+    now = millis();  // Sends above take time
+    for (uint8_t i = 0; i < OURLORA_MESH_MAX_NEIGHBORS; i++) {
+      if (_neighbors[i].used && now - _neighbors[i].lastHeardMs > OURLORA_MESH_NEIGHBOR_TIMEOUT_MS) {
+        _neighbors[i].used = false;
+        _drop_routes_via(_neighbors[i].id);
+      }
+    }
+  }
+
+  /*
+   * Current route to a node
+   * 
+   * Returns:
+   *   true  - Known, next hop and hop count filled in
+   *   false - No valid route (send() will look for one)
+   */
+  bool route_to(uint8_t dst, uint8_t *nextHop, uint8_t *hops) {
+    OurLoRaMeshRoute *r = _route(dst);
+    if (r == NULL) {
+      return false;
+    }
+    *nextHop = r->nextHop;
+    *hops = r->hops;
+    return true;
+  }
+
+  /*
+   * Neighbour table entry for a node, NULL if not heard
+   */
+  const OurLoRaMeshNeighbor *neighbor(uint8_t id) {
+    return _neighbor(id, false);
+  }
+
+  OurLoRaMeshStats stats() const {
+    return _stats;
+  }
+
+private:
+  typedef struct {
+    bool     used;
+    uint8_t  origin;
+    uint8_t  target;
+    uint8_t  id;
+    uint8_t  hops;
+    uint8_t  originSeq;
+    uint8_t  cost;
+    uint32_t dueMs;
+  } _Rebroadcast;
+
+  typedef struct {
+    uint8_t  origin;
+    uint8_t  id;
+    uint8_t  type;                     // 0 = unused
+    uint8_t  cost;                     // Cheapest RREQ copy so far
+  } _Seen;
+
+  Radio &_radio;
+  uint8_t _nodeId;
+  uint8_t _seq;                   // Our sequence number (route freshness)
+  uint8_t _nextId;                // Frame ID for frames we originate
+  uint8_t _seenNext;
+  uint8_t _dataSeenNext;
+  OurLoRaMeshNeighbor _neighbors[OURLORA_MESH_MAX_NEIGHBORS];
+  OurLoRaMeshRoute _routes[OURLORA_MESH_MAX_ROUTES];
+  OurLoRaMeshPacket _queue[OURLORA_MESH_QUEUE];
+  _Seen _seen[OURLORA_MESH_SEEN];     // Route requests
+  _Seen _dataSeen[OURLORA_MESH_DATA_SEEN];
+  _Rebroadcast _rebroadcast[2];   // RREQs waiting for their random delay
+  OurLoRaMeshStats _stats;
+
+  // ==========================================================
+  //  Neighbours and routes
+  // ==========================================================
+
+  void _heard(uint8_t id, int rssi, int snr) {
+    OurLoRaMeshNeighbor *nb = _neighbor(id, false);
+    if (nb == NULL) {
+      nb = _neighbor(id, true);
+      nb->snrQ2 = snr * 4;
+    } else {
+      nb->snrQ2 += (snr * 4 - nb->snrQ2) / 4;
+    }
+    nb->rssi = rssi;
+    nb->lastHeardMs = millis();
+  }
+
+  OurLoRaMeshNeighbor *_neighbor(uint8_t id, bool create) {
+    OurLoRaMeshNeighbor *slot = NULL;
+    for (uint8_t i = 0; i < OURLORA_MESH_MAX_NEIGHBORS; i++) {
+      OurLoRaMeshNeighbor *nb = &_neighbors[i];
+      if (nb->used && nb->id == id) {
+        return nb;
+      }
+      // Free entry, else the one heard least recently
+      if (slot == NULL || (slot->used && (!nb->used || nb->lastHeardMs - slot->lastHeardMs >= 0x80000000UL))) {
+        slot = nb;
+      }
+    }
+    if (!create) {
+      return NULL;
+    }
+    if (slot->used) {
+      _drop_routes_via(slot->id);
+    }
+    memset(slot, 0, sizeof(*slot));
+    slot->used = true;
+    slot->id = id;
+    return slot;
+  }
+
+  // 1 per hop, more for weak or failing links
+  uint8_t _link_cost(uint8_t id) {
+    OurLoRaMeshNeighbor *nb = _neighbor(id, false);
+    if (nb == NULL) {
+      return 1 + OURLORA_MESH_WEAK_MARGIN_DB / 2;
+    }
+    uint8_t sf = _radio.profile().spreadingFactor;
+    int floor = _loraRequiredSnr[sf < 7 ? 0 : (sf > 12 ? 5 : sf - 7)];
+    int margin = nb->snrQ2 / 4 - floor;
+    int cost = 1 + nb->failures;
+    if (margin < OURLORA_MESH_WEAK_MARGIN_DB) {
+      cost += (OURLORA_MESH_WEAK_MARGIN_DB - margin + 1) / 2;
+    }
+    return cost > 15 ? 15 : cost;
+  }
+
+  OurLoRaMeshRoute *_route(uint8_t target) {
+    for (uint8_t i = 0; i < OURLORA_MESH_MAX_ROUTES; i++) {
+      OurLoRaMeshRoute *r = &_routes[i];
+      if (r->used && r->target == target) {
+        if (!r->valid || millis() - r->usedMs > OURLORA_MESH_ROUTE_TIMEOUT_MS) {
+          r->valid = false;
+          return NULL;
+        }
+        return r;
+      }
+    }
+    return NULL;
+  }
+
+  // Learn a route if it is fresher, or as fresh and cheaper.
+  // Returns true when the route was taken.
+  bool _update_route(uint8_t target, uint8_t nextHop, uint8_t hops, uint8_t cost, uint8_t seq) {
+    OurLoRaMeshRoute *slot = NULL;
+    for (uint8_t i = 0; i < OURLORA_MESH_MAX_ROUTES; i++) {
+      OurLoRaMeshRoute *r = &_routes[i];
+      if (r->used && r->target == target) {
+        slot = r;
+        break;
+      }
+      // Free entry, else an invalid one, else the one used least recently
+      if (slot == NULL || (slot->used && (!r->used || (slot->valid && !r->valid) ||
+          (slot->valid == r->valid && r->usedMs - slot->usedMs >= 0x80000000UL)))) {
+        slot = r;
+      }
+    }
+    if (slot->used && slot->target == target && slot->valid &&
+        millis() - slot->usedMs <= OURLORA_MESH_ROUTE_TIMEOUT_MS) {
+      int8_t newer = seq - slot->seq;
+      if (newer < 0 || (newer == 0 && cost >= slot->cost)) {
+        if (newer == 0 && slot->nextHop == nextHop) slot->usedMs = millis();
+        return false;
+      }
+    }
+    slot->used = true;
+    slot->valid = true;
+    slot->target = target;
+    slot->nextHop = nextHop;
+    slot->hops = hops;
+    slot->cost = cost;
+    slot->seq = seq;
+    slot->usedMs = millis();
+    return true;
+  }
+
+  void _drop_routes_via(uint8_t nextHop) {
+    for (uint8_t i = 0; i < OURLORA_MESH_MAX_ROUTES; i++) {
+      if (_routes[i].used && _routes[i].nextHop == nextHop) {
+        _routes[i].valid = false;
+      }
+    }
+  }
+
+  // Seen (origin, id, type) before? Records it if not. For RREQs
+  // *cost holds the new copy's cost and gets the cheapest one seen.
+  bool _seen_before(uint8_t origin, uint8_t id, uint8_t type, uint8_t *cost) {
+    for (uint8_t i = 0; i < OURLORA_MESH_SEEN; i++) {
+      _Seen *s = &_seen[i];
+      if (s->type == type && s->origin == origin && s->id == id) {
+        if (cost) {
+          uint8_t best = s->cost;
+          if (*cost < best) s->cost = *cost;
+          *cost = best;
+        }
+        return true;
+      }
+    }
+    _Seen *s = &_seen[_seenNext];
+    _seenNext = (_seenNext + 1) % OURLORA_MESH_SEEN;
+    s->origin = origin;
+    s->id = id;
+    s->type = type;
+    s->cost = cost ? *cost : 0;
+    return false;
+  }
+
+  // Data frame (origin, id) accepted before?
+  bool _data_seen(uint8_t origin, uint8_t id) {
+    for (uint8_t i = 0; i < OURLORA_MESH_DATA_SEEN; i++) {
+      _Seen *s = &_dataSeen[i];
+      if (s->type == OURLORA_MESH_DATA && s->origin == origin && s->id == id) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void _data_remember(uint8_t origin, uint8_t id) {
+    _Seen *s = &_dataSeen[_dataSeenNext];
+    _dataSeenNext = (_dataSeenNext + 1) % OURLORA_MESH_DATA_SEEN;
+    s->origin = origin;
+    s->id = id;
+    s->type = OURLORA_MESH_DATA;
+    s->cost = 0;
+  }
+
+  // ==========================================================
+  //  Route discovery
+  // ==========================================================
+
+  void _on_rreq(uint8_t origin, uint8_t target, uint8_t sender, uint8_t id, uint8_t hops,
+                uint8_t originSeq, uint8_t cost) {
+    uint8_t total = cost + _link_cost(sender);
+    if (total < cost) total = 255;
+    _update_route(origin, sender, hops + 1, total, originSeq);  // Way back
+    
+    uint8_t best = total;
+    bool seen = _seen_before(origin, id, OURLORA_MESH_RREQ, &best);
+    if (seen && total >= best) {
+      return;  // A copy at least as cheap came first
+    }
+    
+    if (target == _nodeId) {
+      if (!seen) _seq++;
+      uint8_t body[2] = { _seq, 0 };
+      _send_frame(OURLORA_MESH_RREP, origin, target, sender, id, 0, body, 2);
+      _stats.routeReplies++;
+      return;
+    }
+    
+    for (uint8_t i = 0; i < 2; i++) {
+      _Rebroadcast *r = &_rebroadcast[i];
+      if (r->used && r->origin == origin && r->id == id) {
+        r->cost = total;           // Cheaper copy before we passed it on
+        r->hops = hops + 1;
+        r->originSeq = originSeq;
+        return;
+      }
+    }
+    if (seen || hops + 1 >= OURLORA_MESH_MAX_HOPS) {
+      return;  // Passed on already, or far enough
+    }
+    _Rebroadcast *r = _rebroadcast[0].used ? &_rebroadcast[1] : &_rebroadcast[0];
+    if (r->used) {
+      return;  // Busy flooding two other requests
+    }
+    r->used = true;
+    r->origin = origin;
+    r->target = target;
+    r->id = id;
+    r->hops = hops + 1;
+    r->originSeq = originSeq;
+    r->cost = total;
+    r->dueMs = millis() + random(OURLORA_MESH_JITTER_MS);
+  }
+
+  void _on_rrep(uint8_t origin, uint8_t target, uint8_t sender, uint8_t id, uint8_t hops,
+                uint8_t targetSeq, uint8_t cost) {
+    uint8_t total = cost + _link_cost(sender);
+    if (total < cost) total = 255;
+    if (!_update_route(target, sender, hops + 1, total, targetSeq)) {
+      return;  // Nothing new - no need to pass it on
+    }
+    if (origin == _nodeId) {
+      _flush(target);
+      return;
+    }
+    OurLoRaMeshRoute *back = _route(origin);
+    if (back == NULL || hops + 1 >= OURLORA_MESH_MAX_HOPS) {
+      return;
+    }
+    uint8_t body[2] = { targetSeq, total };
+    _send_frame(OURLORA_MESH_RREP, origin, target, back->nextHop, id, hops + 1, body, 2);
+    _flush(target);  // Our own frames for target can go too
+  }
+
+  void _on_rerr(uint8_t origin, uint8_t target, uint8_t sender, uint8_t id, uint8_t hops) {
+    OurLoRaMeshRoute *r = _route(target);
+    if (r != NULL && r->nextHop == sender) {
+      r->valid = false;
+    }
+    if (origin == _nodeId) {
+      return;
+    }
+    OurLoRaMeshRoute *back = _route(origin);
+    if (back != NULL && hops + 1 < OURLORA_MESH_MAX_HOPS) {
+      _send_frame(OURLORA_MESH_RERR, origin, target, back->nextHop, id, hops + 1, NULL, 0);
+      _stats.routeErrors++;
+    }
+  }
+
+  void _send_rreq(uint8_t target) {
+    _seq++;
+    uint8_t id = _nextId++;
+    uint8_t cost = 0;
+    _seen_before(_nodeId, id, OURLORA_MESH_RREQ, &cost);
+    uint8_t body[2] = { _seq, 0 };
+    _send_frame(OURLORA_MESH_RREQ, _nodeId, target, OURLORA_MESH_BROADCAST, id, 0, body, 2);
+    _stats.routeRequests++;
+  }
+
+  // Restart the discovery clock of every frame waiting for target
+  void _set_discovery(uint8_t target, uint8_t tries, uint32_t now) {
+    for (uint8_t i = 0; i < OURLORA_MESH_QUEUE; i++) {
+      OurLoRaMeshPacket *p = &_queue[i];
+      if (p->used && p->waitRoute && p->target == target) {
+        p->tries = tries;
+        p->sentMs = now;
+      }
+    }
+  }
+
+  // No route to target after all retries: drop its frames, tell the
+  // senders of forwarded ones
+  void _unreachable(uint8_t target) {
+    for (uint8_t i = 0; i < OURLORA_MESH_QUEUE; i++) {
+      OurLoRaMeshPacket *p = &_queue[i];
+      if (!p->used || !p->waitRoute || p->target != target) continue;
+      p->used = false;
+      _stats.dropped++;
+      OurLoRaMeshRoute *back = p->origin == _nodeId ? NULL : _route(p->origin);
+      if (back != NULL) {
+        _send_frame(OURLORA_MESH_RERR, p->origin, target, back->nextHop, p->id, 0, NULL, 0);
+        _stats.routeErrors++;
+      }
+    }
+  }
+
+  // ==========================================================
+  //  Data
+  // ==========================================================
+
+  OurLoRaMeshPacket *_alloc() {
+    for (uint8_t i = 0; i < OURLORA_MESH_QUEUE; i++) {
+      if (!_queue[i].used) {
+        memset(&_queue[i], 0, sizeof(_queue[i]));
+        _queue[i].used = true;
+        return &_queue[i];
+      }
+    }
+    return NULL;
+  }
+
+  // Send over the known route, or start (or join) a route discovery
+  void _route_packet(OurLoRaMeshPacket *p) {
+    OurLoRaMeshRoute *r = _route(p->target);
+    if (r != NULL) {
+      r->usedMs = millis();
+      p->waitRoute = false;
+      p->nextHop = r->nextHop;
+      p->tries = 0;
+      _transmit(p);
+      return;
+    }
+    p->waitRoute = true;
+    for (uint8_t i = 0; i < OURLORA_MESH_QUEUE; i++) {
+      OurLoRaMeshPacket *q = &_queue[i];
+      if (q != p && q->used && q->waitRoute && q->target == p->target) {
+        p->tries = q->tries;     // Discovery already running
+        p->sentMs = q->sentMs;
+        return;
+      }
+    }
+    p->tries = 0;
+    p->sentMs = millis();
+    _send_rreq(p->target);
+  }
+
+  // A route to target showed up: send what was waiting for it
+  void _flush(uint8_t target) {
+    for (uint8_t i = 0; i < OURLORA_MESH_QUEUE; i++) {
+      OurLoRaMeshPacket *p = &_queue[i];
+      if (p->used && p->waitRoute && p->target == target) {
+        _route_packet(p);
+      }
+    }
+  }
+
+  void _on_ack(uint8_t origin, uint8_t id, uint8_t sender) {
+    for (uint8_t i = 0; i < OURLORA_MESH_QUEUE; i++) {
+      OurLoRaMeshPacket *p = &_queue[i];
+      if (p->used && !p->waitRoute && p->origin == origin && p->id == id &&
+          p->nextHop == sender) {
+        p->used = false;
+        OurLoRaMeshNeighbor *nb = _neighbor(sender, false);
+        if (nb) nb->failures = 0;
+      }
+    }
+  }
+
+  void _transmit(OurLoRaMeshPacket *p) {
+    p->sentMs = millis();
+    _send_frame(OURLORA_MESH_DATA, p->origin, p->target, p->nextHop, p->id, p->hops,
+                p->data, p->length);
+  }
+
+  void _send_frame(uint8_t type, uint8_t origin, uint8_t target, uint8_t to, uint8_t id,
+                   uint8_t hops, const uint8_t *body, uint8_t length) {
+    uint8_t frame[OURLORA_MESH_HEADER_LEN + OURLORA_MESH_MAX_PAYLOAD];
+    frame[0] = OURLORA_MESH_MARKER;
+    frame[1] = type;
+    frame[2] = origin;
+    frame[3] = target;
+    frame[4] = _nodeId;
+    frame[5] = to;
+    frame[6] = id;
+    frame[7] = hops;
+    if (length) {
+      memcpy(frame + OURLORA_MESH_HEADER_LEN, body, length);
+    }
+    _radio.send_a_msg(frame, OURLORA_MESH_HEADER_LEN + length);
+  }
+
+  // ACK wait per hop: the next hop answers right away
+  uint32_t _hop_timeout_ms() {
+    return _radio.time_on_air_us(OURLORA_MESH_HEADER_LEN) / 1000 + OURLORA_MESH_ACK_MARGIN_MS;
+  }
+
+  // Route request out to the edge of the mesh and the reply back
+  uint32_t _discovery_ms() {
+    uint32_t hopMs = _radio.time_on_air_us(OURLORA_MESH_ROUTE_LEN) / 1000 + OURLORA_MESH_JITTER_MS;
+    return 2 * OURLORA_MESH_MAX_HOPS * hopMs;
+  }
+
+  OurLoRaMesh(const OurLoRaMesh &);
+  OurLoRaMesh &operator=(const OurLoRaMesh &);
+};
+
+#endif // OURLORA_MESH_H
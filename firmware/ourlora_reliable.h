@@ -0,0 +1,442 @@
+/*
+ * OurLoRa reliable transport - ACKs and selective retransmission
+
+ * OurLoRaReliable: sequence numbers, piggybacked ACKs and a window of
+ * frames in flight per peer, on top of send_a_msg().
+ */
+#ifndef OURLORA_RELIABLE_H
+#define OURLORA_RELIABLE_H
+
+#include "ourlora.h"
+
+// ============================================================
+//  RELIABLE TRANSPORT
+// ============================================================
+// Sequence numbers, acknowledgements and retransmission on top of
+// send_a_msg(), per peer:
+//   - every data frame carries the sender's sequence number
+//   - every frame to a peer carries a cumulative ACK (next sequence
+//     number expected from it) plus a bitmap of the 8 frames after
+//     it that also arrived - piggybacked on data, or sent alone
+//     once the link goes quiet for OURLORA_REL_ACK_DELAY_MS
+//   - up to OURLORA_REL_WINDOW frames are in flight at once; a frame
+//     is resent when a later one was acknowledged without it, or on
+//     timeout, never the whole window
+//   - the receiver drops duplicates (retransmissions whose ACK got
+//     lost); frames are delivered once, in arrival order
+// 
+// Each node picks a random session number (epoch) at start-up, so a
+// peer that reboots is recognised and its sequence numbers restart
+// cleanly (it comes from random(): on boards without a hardware RNG,
+// call randomSeed() with something that differs per boot first). An ACK names the session it acknowledges, so one meant for
+// a node's previous session cannot free frames of the new one. Frames
+// still in flight across a reboot may be lost.
+// 
+// Every frame also carries the sender's window base (oldest frame not
+// acknowledged). The receiver starts a new session there, not at the
+// first frame it happens to hear, and skips frames the sender gave up.
+
+// Frame: [marker, flags, dst, src, epoch, seq, ack, ack bits, ack epoch, base, payload...]
+#define OURLORA_REL_MARKER       0xA6  // First byte of every transport frame
+#define OURLORA_REL_HEADER_LEN   10
+#define OURLORA_REL_FLAG_DATA    0x01  // seq + payload valid
+#define OURLORA_REL_FLAG_ACK     0x02  // ack + ack bits valid
+
+#ifndef OURLORA_REL_MAX_PEERS
+#define OURLORA_REL_MAX_PEERS    4
+#endif
+#ifndef OURLORA_REL_WINDOW
+#define OURLORA_REL_WINDOW       4     // Frames in flight per peer (1, 2, 4 or 8)
+#endif
+#ifndef OURLORA_REL_MAX_PAYLOAD
+#define OURLORA_REL_MAX_PAYLOAD  48    // Bytes kept per in-flight frame
+#endif
+#ifndef OURLORA_REL_ACK_DELAY_MS
+#define OURLORA_REL_ACK_DELAY_MS 30    // Quiet time before a standalone ACK
+#endif
+#define OURLORA_REL_RTO_MARGIN_MS 100  // Added to the computed ACK round trip
+#define OURLORA_REL_MAX_RETRIES  5     // Then the frame is given up
+
+static_assert(OURLORA_REL_WINDOW == 1 || OURLORA_REL_WINDOW == 2 ||
+              OURLORA_REL_WINDOW == 4 || OURLORA_REL_WINDOW == 8,
+              "OURLORA_REL_WINDOW must be 1, 2, 4 or 8 (ACK bitmap is 8 bits)");
+
+// One frame waiting for its ACK
+typedef struct {
+  bool     used;
+  uint8_t  seq;
+  uint8_t  length;
+  uint8_t  retries;
+  uint32_t sentMs;
+  uint32_t sentOrder;                  // Send counter, for selective retransmit
+  uint8_t  data[OURLORA_REL_MAX_PAYLOAD];
+} OurLoRaReliableSlot;
+
+// Transport state for one peer
+typedef struct {
+  bool     used;
+  uint8_t  peer;                       // Node ID
+  uint8_t  txNext;                     // Next sequence number to send
+  uint8_t  txBase;                     // Oldest frame not acknowledged
+  bool     rxKnown;                    // Heard a data frame from the peer
+  uint8_t  rxEpoch;                    // Peer's session number
+  uint8_t  rxNext;                     // Next sequence number expected (our ACK)
+  uint8_t  rxBits;                     // Bit i: rxNext + 1 + i arrived too
+  bool     ackDue;                     // Peer has not seen our ACK yet
+  uint32_t lastRxMs;
+  OurLoRaReliableSlot slots[OURLORA_REL_WINDOW];
+} OurLoRaReliablePeer;
+
+// Transport statistics, see OurLoRaReliable::stats()
+typedef struct {
+  uint32_t sent;                       // New data frames
+  uint32_t retransmits;                // Timeout resends
+  uint32_t selectiveRetransmits;       // Resent because a later frame was ACKed
+  uint32_t acked;
+  uint32_t givenUp;                    // OURLORA_REL_MAX_RETRIES exceeded
+  uint32_t acksSent;                   // Standalone ACK frames
+  uint32_t delivered;                  // New frames handed to the application
+  uint32_t duplicates;                 // Received again, dropped
+} OurLoRaReliableStats;
+
+/*
+ * Reliable delivery engine for one radio
+ * 
+ * Use interrupt mode with start_listening(), so the radio is back in
+ * RX after every frame it sends. Feed every received frame to
+ * handle_frame() and call poll() from loop().
+ * 
+ * Example (sub tank, ID 2, reporting to the main tank, ID 1):
+ *   OurLoRaReliable<OurLoRaDefaultRadio> link(OurLoRa, 2);
+ *   
+ *   void loop() {
+ *     OurLoRaRxFrame f;
+ *     while (lora_rx_pop(&f)) {
+ *       uint8_t payload[OURLORA_REL_MAX_PAYLOAD], from;
+ *       int n = link.handle_frame(f.data, f.length, payload, &from);
+ *       if (n > 0) { ... }                   // New data from `from`
+ *     }
+ *     if (alarm) link.send(1, (uint8_t *)&txData, sizeof(txData));
+ *     link.poll();
+ *   }
+ * 
+ * Application frames must not start with OURLORA_REL_MARKER.
+ * Needs an explicit-header profile (frames vary in length).
+ */
+template <class Radio>
+class OurLoRaReliable {
+public:
+  OurLoRaReliable(Radio &radio, uint8_t nodeId)
+    : _radio(radio), _nodeId(nodeId) {
+    memset(_peers, 0, sizeof(_peers));
+    memset(&_stats, 0, sizeof(_stats));
+    _epoch = (uint8_t)random(256);
+    _window = OURLORA_REL_WINDOW;
+    _sendOrder = 0;
+    _onGiveUp = NULL;
+  }
+
+  /*
+   * Queue a frame for reliable delivery and send it right away
+   * 
+   * Parameters:
+   *   dst    - Receiver's node ID (no broadcast)
+   *   data   - Payload
+   *   length - 1..OURLORA_REL_MAX_PAYLOAD bytes
+   * 
+   * Returns:
+   *   true  - Sent (or will be resent until acknowledged)
+   *   false - Window to dst full, peer table full, or bad length
+   */
+  bool send(uint8_t dst, const uint8_t *data, uint8_t length) {
+    if (length == 0 || length > OURLORA_REL_MAX_PAYLOAD) {
+      return false;
+    }
+    OurLoRaReliablePeer *peer = _peer(dst, true);
+    if (peer == NULL || (uint8_t)(peer->txNext - peer->txBase) >= _window) {
+      return false;
+    }
+    
+    OurLoRaReliableSlot *slot = &peer->slots[peer->txNext % OURLORA_REL_WINDOW];
+    slot->used = true;
+    slot->seq = peer->txNext++;
+    slot->length = length;
+    slot->retries = 0;
+    memcpy(slot->data, data, length);
+    _stats.sent++;
+    _transmit(peer, slot);
+    return true;
+  }
+
+  /*
+   * Process a received frame if it is a transport frame
+   * 
+   * Parameters:
+   *   data, length - Frame as received
+   *   payload      - Gets the payload (OURLORA_REL_MAX_PAYLOAD bytes)
+   *   from         - Gets the sender's node ID
+   * 
+   * Returns:
+   *   > 0 - New payload of this length, handle it
+   *   0   - Transport frame consumed (ACK, duplicate, not for us)
+   *   -1  - Not a transport frame, handle it yourself
+   */
+  int handle_frame(const uint8_t *data, int length, uint8_t *payload, uint8_t *from) {
+    if (length < OURLORA_REL_HEADER_LEN || data[0] != OURLORA_REL_MARKER) {
+      return -1;
+    }
+    uint8_t flags = data[1], dst = data[2], src = data[3], epoch = data[4], seq = data[5];
+    uint8_t base = data[9];
+    if (dst != _nodeId) {
+      return 0;  // Someone else's
+    }
+    OurLoRaReliablePeer *peer = _peer(src, true);
+    if (peer == NULL) {
+      return 0;  // Peer table full
+    }
+    
+    if ((flags & OURLORA_REL_FLAG_ACK) && data[8] == _epoch) {
+      _on_ack(peer, data[6], data[7]);  // Not for an earlier session of ours
+    }
+    int payloadLength = length - OURLORA_REL_HEADER_LEN;
+    if (!(flags & OURLORA_REL_FLAG_DATA) || payloadLength == 0 ||
+        payloadLength > OURLORA_REL_MAX_PAYLOAD) {
+      return 0;
+    }
+    
+    if (!peer->rxKnown || peer->rxEpoch != epoch) {
+      // New session: it starts at the sender's window base, earlier
+      // frames of it may still be on their way
+      peer->rxKnown = true;
+      peer->rxEpoch = epoch;
+      peer->rxNext = base;
+      peer->rxBits = 0;
+    }
+    uint8_t skipped = base - peer->rxNext;
+    if (skipped >= 1 && skipped < 128) {
+      _advance(peer, skipped);  // Sender gave up on these, stop waiting
+    }
+    peer->ackDue = true;       // Also when duplicate: our last ACK got lost
+    peer->lastRxMs = millis();
+    
+    if (!_accept(peer, seq)) {
+      _stats.duplicates++;
+      return 0;
+    }
+    memcpy(payload, data + OURLORA_REL_HEADER_LEN, payloadLength);
+    *from = src;
+    _stats.delivered++;
+    return payloadLength;
+  }
+
+  /*
+   * Run the engine - call from loop()
+   * Sends pending ACKs and resends frames that timed out.
+   */
+  void poll() {
+    uint32_t now = millis();
+    uint32_t rto = _rto_ms();
+    for (uint8_t p = 0; p < OURLORA_REL_MAX_PEERS; p++) {
+      OurLoRaReliablePeer *peer = &_peers[p];
+      if (!peer->used) continue;
+      
+      for (uint8_t i = 0; i < OURLORA_REL_WINDOW; i++) {
+        OurLoRaReliableSlot *slot = &peer->slots[i];
+        if (!slot->used || now - slot->sentMs < (rto << slot->retries)) continue;
+        if (slot->retries >= OURLORA_REL_MAX_RETRIES) {
+          _give_up(peer, slot);
+          continue;
+        }
+        slot->retries++;
+        _stats.retransmits++;
+        _transmit(peer, slot);
+      }
+      
+      if (peer->ackDue && now - peer->lastRxMs >= OURLORA_REL_ACK_DELAY_MS) {
+        _send_frame(peer, OURLORA_REL_FLAG_ACK, 0, NULL, 0);
+        _stats.acksSent++;
+      }
+    }
+  }
+
+  /*
+   * Limit frames in flight per peer (1 = stop-and-wait)
+   * 
+   * Parameters:
+   *   frames - 1..OURLORA_REL_WINDOW
+   */
+  void set_window(uint8_t frames) {
+    _window = frames < 1 ? 1 : (frames > OURLORA_REL_WINDOW ? OURLORA_REL_WINDOW : frames);
+  }
+
+  /*
+   * Frames sent to dst and not acknowledged yet
+   */
+  uint8_t in_flight(uint8_t dst) {
+    OurLoRaReliablePeer *peer = _peer(dst, false);
+    return peer ? (uint8_t)(peer->txNext - peer->txBase) : 0;
+  }
+
+  /*
+   * Called with the payload of every frame that was given up
+   */
+  void on_give_up(void (*callback)(uint8_t dst, const uint8_t *data, uint8_t length)) {
+    _onGiveUp = callback;
+  }
+
+  OurLoRaReliableStats stats() const {
+    return _stats;
+  }
+
+private:
+  Radio &_radio;
+  uint8_t _nodeId;
+  uint8_t _epoch;                 // Our session number
+  uint8_t _window;
+  uint32_t _sendOrder;
+  OurLoRaReliablePeer _peers[OURLORA_REL_MAX_PEERS];
+  OurLoRaReliableStats _stats;
+  void (*_onGiveUp)(uint8_t dst, const uint8_t *data, uint8_t length);
+
+  OurLoRaReliablePeer *_peer(uint8_t id, bool create) {
+    OurLoRaReliablePeer *free = NULL;
+    for (uint8_t i = 0; i < OURLORA_REL_MAX_PEERS; i++) {
+      if (_peers[i].used && _peers[i].peer == id) {
+        return &_peers[i];
+      }
+      if (!_peers[i].used && free == NULL) {
+        free = &_peers[i];
+      }
+    }
+    if (!create || free == NULL) {
+      return NULL;
+    }
+    memset(free, 0, sizeof(*free));
+    free->used = true;
+    free->peer = id;
+    return free;
+  }
+
+  // Time to wait for an ACK: a full window of the peer's frames can be
+  // on air before it gets to answer, plus its ACK delay and the ACK
+  uint32_t _rto_ms() {
+    uint32_t frameUs = _radio.time_on_air_us(OURLORA_REL_HEADER_LEN + OURLORA_REL_MAX_PAYLOAD);
+    uint32_t ackUs = _radio.time_on_air_us(OURLORA_REL_HEADER_LEN);
+    return (OURLORA_REL_WINDOW * frameUs + ackUs) / 1000 +
+           OURLORA_REL_ACK_DELAY_MS + OURLORA_REL_RTO_MARGIN_MS;
+  }
+
+  // Record seq from the peer. Returns false for a duplicate.
+  static bool _accept(OurLoRaReliablePeer *peer, uint8_t seq) {
+    uint8_t d = seq - peer->rxNext;
+    if (d >= 128) {
+      return false;  // Before rxNext: already delivered
+    }
+    if (d >= 1 && d <= 8 && (peer->rxBits & (1 << (d - 1)))) {
+      return false;
+    }
+    if (d >= OURLORA_REL_WINDOW) {
+      return false;  // Beyond the sender's window: not from this session
+    }
+    if (d == 0) {
+      _advance(peer, 1);
+    } else {
+      peer->rxBits |= 1 << (d - 1);
+    }
+    return true;
+  }
+
+  // Move rxNext forward by n, then past every frame that already arrived
+  static void _advance(OurLoRaReliablePeer *peer, uint8_t n) {
+    bool have = true;
+    while (n > 0 || have) {
+      peer->rxNext++;
+      have = peer->rxBits & 1;
+      peer->rxBits >>= 1;
+      if (n > 0) n--;
+    }
+  }
+
+  // ACK from the peer: free what it has, resend what it provably lost
+  void _on_ack(OurLoRaReliablePeer *peer, uint8_t ack, uint8_t bits) {
+    uint32_t latest = 0;
+    bool any = false;
+    for (uint8_t i = 0; i < OURLORA_REL_WINDOW; i++) {
+      OurLoRaReliableSlot *slot = &peer->slots[i];
+      if (!slot->used) continue;
+      uint8_t off = slot->seq - ack;
+      bool acked = off >= 128 || (off >= 1 && off <= 8 && ((bits >> (off - 1)) & 1));
+      if (acked) {
+        if (!any || (int32_t)(slot->sentOrder - latest) > 0) {
+          latest = slot->sentOrder;
+        }
+        any = true;
+        slot->used = false;
+        _stats.acked++;
+      }
+    }
+    if (!any) {
+      return;
+    }
+    _slide(peer);
+    
+    // The channel keeps order: a frame sent before an acknowledged one
+    // and still missing was lost, no need to wait for the timeout
+    for (uint8_t i = 0; i < OURLORA_REL_WINDOW; i++) {
+      OurLoRaReliableSlot *slot = &peer->slots[i];
+      if (!slot->used || (int32_t)(slot->sentOrder - latest) > 0) continue;
+      _stats.selectiveRetransmits++;
+      _transmit(peer, slot);
+    }
+  }
+
+  void _give_up(OurLoRaReliablePeer *peer, OurLoRaReliableSlot *slot) {
+    slot->used = false;
+    _stats.givenUp++;
+    _slide(peer);
+    if (_onGiveUp) {
+      _onGiveUp(peer->peer, slot->data, slot->length);
+    }
+  }
+
+  // Window base to the oldest frame still waiting
+  static void _slide(OurLoRaReliablePeer *peer) {
+    while (peer->txBase != peer->txNext && !peer->slots[peer->txBase % OURLORA_REL_WINDOW].used) {
+      peer->txBase++;
+    }
+  }
+
+  void _transmit(OurLoRaReliablePeer *peer, OurLoRaReliableSlot *slot) {
+    slot->sentMs = millis();
+    slot->sentOrder = ++_sendOrder;
+    _send_frame(peer, OURLORA_REL_FLAG_DATA, slot->seq, slot->data, slot->length);
+  }
+
+  void _send_frame(OurLoRaReliablePeer *peer, uint8_t flags, uint8_t seq,
+                   const uint8_t *data, uint8_t length) {
+    uint8_t frame[OURLORA_REL_HEADER_LEN + OURLORA_REL_MAX_PAYLOAD];
+    if (peer->rxKnown) {
+      flags |= OURLORA_REL_FLAG_ACK;   // Piggyback our ACK
+      peer->ackDue = false;
+    }
+    frame[0] = OURLORA_REL_MARKER;
+    frame[1] = flags;
+    frame[2] = peer->peer;
+    frame[3] = _nodeId;
+    frame[4] = _epoch;
+    frame[5] = seq;
+    frame[6] = peer->rxNext;
+    frame[7] = peer->rxBits;
+    frame[8] = peer->rxEpoch;          // Session the ACK belongs to
+    frame[9] = peer->txBase;           // Oldest frame we still resend
+    if (length) {
+      memcpy(frame + OURLORA_REL_HEADER_LEN, data, length);
+    }
+    _radio.send_a_msg(frame, OURLORA_REL_HEADER_LEN + length);
+  }
+
+  OurLoRaReliable(const OurLoRaReliable &);
+  OurLoRaReliable &operator=(const OurLoRaReliable &);
+};
+
+#endif // OURLORA_RELIABLE_H
@@ -0,0 +1,241 @@
+/*
+ * OurLoRa channel survey - interference and occupancy per channel
+
+ * OurLoRaChannelSurvey: scores the channels of a plan from
+ * measure_noise() sweeps, for a gateway deciding where to move.
+ */
+#ifndef OURLORA_SURVEY_H
+#define OURLORA_SURVEY_H
+
+#include "ourlora.h"
+
+// ============================================================
+//  CHANNEL SURVEY
+// ============================================================
+// An interference score per channel of a channel plan: the average
+// RSSI of each measure_noise() sweep, smoothed over sweeps so that a
+// burst caught once does not chase the network away. The quietest
+// channel has the lowest score; moving only pays off when it beats
+// the current channel by OURLORA_SURVEY_HYSTERESIS_DB, and only after
+// OURLORA_SURVEY_MIN_ROUNDS rounds (one sweep says little about a
+// bursty interferer).
+// 
+// Occupancy (busy share) is measured against a long-term floor: per
+// channel the quietest sweep so far, rising slowly while the sweeps
+// stay louder, and the lowest of those over the plan as the receiver's
+// own noise floor. A sweep lasts a few ms; against its own quietest
+// reading an interferer that outlasts it (or never stops) would read
+// as idle.
+#ifndef OURLORA_SURVEY_MAX_CHANNELS
+#define OURLORA_SURVEY_MAX_CHANNELS  16
+#endif
+#ifndef OURLORA_SURVEY_HYSTERESIS_DB
+#define OURLORA_SURVEY_HYSTERESIS_DB 3
+#endif
+#ifndef OURLORA_SURVEY_MIN_ROUNDS
+#define OURLORA_SURVEY_MIN_ROUNDS    16    // Before better_channel() suggests a move
+#endif
+#define OURLORA_SURVEY_SMOOTHING     16    // A new sweep weighs 1/16
+#define OURLORA_SURVEY_FLOOR_RISE    256   // A louder sweep lifts the floor by 1/256 of the gap
+
+// Per channel, see OurLoRaChannelSurvey::channel()
+typedef struct {
+  uint32_t frequencyHz;
+  int16_t  scoreDbm;                   // Smoothed average RSSI, lower = quieter
+  int16_t  noiseDbm;                   // Last sweep: average
+  int16_t  floorDbm;                   // Last sweep: quietest reading
+  int16_t  peakDbm;                    // Last sweep: loudest reading
+  int16_t  quietDbm;                   // Long-term floor (quietest sweeps)
+  uint8_t  busyPct;                    // Last sweep
+  uint8_t  occupancyPct;               // busyPct smoothed over sweeps
+  uint16_t sweeps;
+} OurLoRaChannelStats;
+
+/*
+ * Noise survey over a channel plan
+ * 
+ * survey_next() measures one channel (a few ms, see measure_noise()),
+ * so a busy node can spread a round over its idle moments; survey()
+ * does a whole round at once. The channel array must stay valid.
+ * 
+ * Example (gateway at boot):
+ *   static const uint32_t PLAN[] = { 433175000UL, 433375000UL, 433575000UL, 433775000UL };
+ *   OurLoRaChannelSurvey<OurLoRaDefaultRadio> survey(OurLoRa, PLAN, 4);
+ *   
+ *   for (int i = 0; i < 8; i++) survey.survey();
+ *   set_lora_frequency(survey.channel_hz(survey.quietest()));
+ */
+template <class Radio>
+class OurLoRaChannelSurvey {
+public:
+  OurLoRaChannelSurvey(Radio &radio, const uint32_t *channels, uint8_t count)
+    : _radio(radio), _channels(channels),
+      _count(count < OURLORA_SURVEY_MAX_CHANNELS ? count : OURLORA_SURVEY_MAX_CHANNELS) {
+    memset(_stats, 0, sizeof(_stats));
+    memset(_score, 0, sizeof(_score));
+    memset(_floor, 0, sizeof(_floor));
+    memset(_occupancy, 0, sizeof(_occupancy));
+    _next = 0;
+    _rounds = 0;
+  }
+
+  /*
+   * Measure the next channel of the plan
+   * 
+   * Returns:
+   *   true  - That completed a round over the plan
+   *   false - Round not complete yet, or radio busy (nothing measured)
+   */
+  bool survey_next() {
+    if (_count == 0) {
+      return false;
+    }
+    OurLoRaChannelStats &s = _stats[_next];
+    OurLoRaNoiseReading n;
+    if (!_radio.measure_noise(_channels[_next], &n, OURLORA_SURVEY_SAMPLES, _receiver_floor())) {
+      return false;
+    }
+    int32_t sample = (int32_t)n.meanDbm * 256;
+    _score[_next] = s.sweeps ? _score[_next] + (sample - _score[_next]) / OURLORA_SURVEY_SMOOTHING
+                             : sample;
+    int32_t quiet = (int32_t)n.floorDbm * 256;
+    if (!s.sweeps || quiet < _floor[_next]) {
+      _floor[_next] = quiet;
+    } else {
+      _floor[_next] += (quiet - _floor[_next]) / OURLORA_SURVEY_FLOOR_RISE;
+    }
+    int32_t busy = (int32_t)n.busyPct * 256;
+    _occupancy[_next] = s.sweeps ? _occupancy[_next] +
+                                   (busy - _occupancy[_next]) / OURLORA_SURVEY_SMOOTHING
+                                 : busy;
+    s.noiseDbm = n.meanDbm;
+    s.floorDbm = n.floorDbm;
+    s.peakDbm = n.peakDbm;
+    s.busyPct = n.busyPct;
+    if (s.sweeps < 0xFFFF) s.sweeps++;
+    
+    if (++_next < _count) {
+      return false;
+    }
+    _next = 0;
+    _rounds++;
+    return true;
+  }
+
+  /*
+   * Measure every channel once (blocks count x measure_noise())
+   * 
+   * Returns:
+   *   false - Radio busy, round not finished
+   */
+  bool survey() {
+    do {
+      uint8_t before = _next;
+      if (survey_next()) {
+        return true;
+      }
+      if (_next == before) {
+        return false;
+      }
+    } while (true);
+  }
+
+  /*
+   * Index of the quietest channel, -1 before the first round
+   */
+  int8_t quietest() const {
+    if (_rounds == 0) {
+      return -1;
+    }
+    int8_t best = 0;
+    for (uint8_t i = 1; i < _count; i++) {
+      if (_score[i] < _score[best]) best = i;
+    }
+    return best;
+  }
+
+  /*
+   * Index of a channel worth moving to from current_hz
+   * 
+   * Returns:
+   *   The quietest channel if it beats current_hz by
+   *   OURLORA_SURVEY_HYSTERESIS_DB (any channel does if current_hz is
+   *   not in the plan), -1 otherwise or before
+   *   OURLORA_SURVEY_MIN_ROUNDS rounds
+   */
+  int8_t better_channel(uint32_t current_hz) const {
+    int8_t best = quietest();
+    int8_t cur = index_of(current_hz);
+    if (best < 0 || best == cur || _rounds < OURLORA_SURVEY_MIN_ROUNDS) {
+      return -1;
+    }
+    if (cur >= 0 && _score[best] + OURLORA_SURVEY_HYSTERESIS_DB * 256L > _score[cur]) {
+      return -1;
+    }
+    return best;
+  }
+
+  int8_t index_of(uint32_t frequency_hz) const {
+    for (uint8_t i = 0; i < _count; i++) {
+      if (_channels[i] == frequency_hz) return i;
+    }
+    return -1;
+  }
+
+  uint8_t count() const {
+    return _count;
+  }
+
+  uint32_t channel_hz(uint8_t i) const {
+    return _channels[i];
+  }
+
+  OurLoRaChannelStats channel(uint8_t i) const {
+    OurLoRaChannelStats s = _stats[i];
+    s.frequencyHz = _channels[i];
+    s.scoreDbm = _dbm(_score[i]);
+    s.quietDbm = _dbm(_floor[i]);
+    s.occupancyPct = (_occupancy[i] + 128) / 256;
+    return s;
+  }
+
+  // Completed rounds over the plan
+  uint32_t rounds() const {
+    return _rounds;
+  }
+
+  // How long survey_next() keeps the radio away from its channel
+  static uint32_t sweep_us() {
+    return OURLORA_SURVEY_SETTLE_US + (uint32_t)(OURLORA_SURVEY_SAMPLES - 1) * OURLORA_SURVEY_SAMPLE_US;
+  }
+
+private:
+  Radio &_radio;
+  const uint32_t *_channels;
+  uint8_t _count;
+  uint8_t _next;                  // Channel survey_next() measures
+  uint32_t _rounds;
+  int32_t _score[OURLORA_SURVEY_MAX_CHANNELS];    // 1/256 dB
+  int32_t _floor[OURLORA_SURVEY_MAX_CHANNELS];    // Long-term floor, 1/256 dB
+  int32_t _occupancy[OURLORA_SURVEY_MAX_CHANNELS]; // 1/256 %
+  OurLoRaChannelStats _stats[OURLORA_SURVEY_MAX_CHANNELS];
+
+  // Quietest long-term floor over the plan, the receiver's own noise
+  int16_t _receiver_floor() const {
+    int16_t lowest = OURLORA_SURVEY_NO_FLOOR;
+    for (uint8_t i = 0; i < _count; i++) {
+      if (_stats[i].sweeps && _dbm(_floor[i]) < lowest) lowest = _dbm(_floor[i]);
+    }
+    return lowest;
+  }
+
+  // 1/256 dB to dB, rounded
+  static int16_t _dbm(int32_t q8) {
+    return q8 >= 0 ? (q8 + 128) / 256 : -((-q8 + 128) / 256);
+  }
+
+  OurLoRaChannelSurvey(const OurLoRaChannelSurvey &);
+  OurLoRaChannelSurvey &operator=(const OurLoRaChannelSurvey &);
+};
+
+#endif // OURLORA_SURVEY_H
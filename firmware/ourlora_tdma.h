@@ -0,0 +1,894 @@
+/*
+ * OurLoRa TDMA - beacon-scheduled star network
+
+ * OurLoRaTdmaGateway / OurLoRaTdmaNode: the gateway hands out slots in
+ * its beacon, nodes send only in their own slot and sleep in between.
+ * The gateway can survey its channel plan (ourlora_survey.h) and move.
+ */
+#ifndef OURLORA_TDMA_H
+#define OURLORA_TDMA_H
+
+#include "ourlora.h"
+#include "ourlora_survey.h"
+
+// ============================================================
+//  TDMA STAR NETWORK
+// ============================================================
+// One gateway, many nodes, no contention for data:
+// 
+//   | beacon | join 0 .. join J-1 | slot 0 | slot 1 | ... | slot N-1 |  ...  | beacon |
+//            <------------------- next beacon in (from the beacon) ---------->
+// 
+// The gateway broadcasts a beacon every superframe. It carries the
+// superframe layout, new slot grants and a bitmap of the slots the
+// gateway heard in the previous superframe (the nodes' ACK). Nodes
+// sync on the end of the beacon, send only in their own slot and
+// sleep until the next beacon. A node without a slot sends a join
+// request in a random join slot (with exponential backoff) and gets
+// its slot in one of the next beacons. The number of join slots
+// grows while many nodes are joining (fast when every one of them was
+// busy) and shrinks back when they go idle. Nodes only back off while
+// the join slots stop growing, and try more often again once they
+// shrink, so a crowd of nodes starting together joins in a few
+// superframes.
+// 
+// A slot whose owner stays silent for OURLORA_TDMA_EVICT_FRAMES
+// superframes is freed. The node notices the missing ACKs first, so
+// it drops the slot before anyone else can get it, and joins again.
+// Nodes send a keep-alive when they have nothing to report.
+// 
+// Channel moves: with a channel survey attached (use_survey()) the
+// gateway measures a channel of the plan every OURLORA_TDMA_SURVEY_MS
+// in the idle time at the end of each superframe, when no node may
+// send. When another channel turns out quieter
+// (OURLORA_SURVEY_HYSTERESIS_DB), the next OURLORA_TDMA_MOVE_BEACONS
+// beacons announce the move and the beacon after them goes out on the
+// new channel; nodes follow. A node that missed every announcement
+// loses sync and, given the same plan (set_channel_plan()), searches
+// the plan channel by channel.
+// 
+// Node IDs are 1..254 (0 marks a free slot).
+
+// Beacon: [marker, type, gw, seq, join slots, data slots, join ms (2),
+//          slot ms (2), next beacon ms (4), grant count, grants (node, slot)...,
+//          heard bitmap of the previous superframe,
+//          only while a move is announced: beacons left, new frequency Hz (4)]
+#define OURLORA_TDMA_MARKER      0xA7  // First byte of every TDMA frame
+#define OURLORA_TDMA_BEACON      0x01
+#define OURLORA_TDMA_JOIN        0x02  // [marker, type, gw, node]
+#define OURLORA_TDMA_DATA        0x03  // [marker, type, gw, node, slot, payload...]
+#define OURLORA_TDMA_BEACON_HDR  15
+#define OURLORA_TDMA_JOIN_LEN    4
+#define OURLORA_TDMA_DATA_HDR    5
+#define OURLORA_TDMA_NO_SLOT     0xFF
+#define OURLORA_TDMA_MOVE_LEN    5     // Channel move trailer of the beacon
+
+#ifndef OURLORA_TDMA_MAX_SLOTS
+#define OURLORA_TDMA_MAX_SLOTS   64    // Nodes per gateway (up to 248)
+#endif
+#ifndef OURLORA_TDMA_JOIN_SLOTS
+#define OURLORA_TDMA_JOIN_SLOTS  2     // Contention slots after each beacon (fewest)
+#endif
+#ifndef OURLORA_TDMA_MAX_JOIN_SLOTS
+#define OURLORA_TDMA_MAX_JOIN_SLOTS 128 // ... while many nodes join
+#endif
+#ifndef OURLORA_TDMA_MAX_PAYLOAD
+#define OURLORA_TDMA_MAX_PAYLOAD 32    // Sizes the data slots
+#endif
+#ifndef OURLORA_TDMA_PERIOD_MS
+#define OURLORA_TDMA_PERIOD_MS   10000 // Shortest superframe
+#endif
+#define OURLORA_TDMA_GUARD_MS    10    // Clock error + wake-up, per slot
+#define OURLORA_TDMA_BEACON_GRANTS 48  // Grants per beacon (at most)
+#define OURLORA_TDMA_EVICT_FRAMES 8    // Silent superframes before a slot is freed
+#define OURLORA_TDMA_MAX_MISSED  3     // Missed beacons before a node searches again
+#define OURLORA_TDMA_JOIN_BACKOFF 16   // Largest join backoff (superframes)
+#ifndef OURLORA_TDMA_MOVE_BEACONS
+#define OURLORA_TDMA_MOVE_BEACONS 3    // Beacons announcing a channel move
+#endif
+#ifndef OURLORA_TDMA_SURVEY_MS
+#define OURLORA_TDMA_SURVEY_MS   500   // Between two survey sweeps of the gateway
+#endif
+#define OURLORA_TDMA_SEARCH_FRAMES 3   // Beacons a searching node waits for on one channel
+
+static_assert(OURLORA_TDMA_MAX_SLOTS >= 1 && OURLORA_TDMA_MAX_SLOTS <= 248,
+              "OURLORA_TDMA_MAX_SLOTS must be 1..248 (beacon size)");
+static_assert(OURLORA_TDMA_JOIN_SLOTS >= 1 && OURLORA_TDMA_JOIN_SLOTS <= OURLORA_TDMA_MAX_JOIN_SLOTS &&
+              OURLORA_TDMA_MAX_JOIN_SLOTS <= 255, "Nodes need a join slot");
+
+#define OURLORA_TDMA_BEACON_MAX  (OURLORA_TDMA_BEACON_HDR + 2 * OURLORA_TDMA_BEACON_GRANTS + \
+                                  (OURLORA_TDMA_MAX_SLOTS + 7) / 8 + OURLORA_TDMA_MOVE_LEN)
+
+// Gateway statistics, see OurLoRaTdmaGateway::stats()
+typedef struct {
+  uint8_t  nodes;                      // Slots in use
+  uint8_t  slots;                      // Data slots in the current superframe
+  uint8_t  joinSlots;
+  uint32_t periodMs;                   // Current superframe length
+  uint32_t beacons;
+  uint32_t joinRequests;
+  uint32_t grants;                     // Grants sent (repeats included)
+  uint32_t frames;                     // Data frames received (keep-alives included)
+  uint32_t evictions;
+  uint32_t frequencyHz;                // Current channel
+  uint32_t surveys;                    // Channels measured in idle time
+  uint32_t channelMoves;
+} OurLoRaTdmaGatewayStats;
+
+// Node statistics, see OurLoRaTdmaNode::stats()
+typedef struct {
+  uint8_t  slot;                       // OURLORA_TDMA_NO_SLOT = not joined
+  uint32_t beacons;
+  uint32_t missedBeacons;
+  uint32_t searches;                   // Lost sync, listened continuously
+  uint32_t joinRequests;
+  uint32_t framesSent;                 // In our slot (retries and keep-alives included)
+  uint32_t framesAcked;
+  uint32_t slotLost;                   // Evicted or slot given to another node
+  uint32_t channelMoves;               // Announced moves followed
+  uint32_t channelHops;                // Searching: tried the next plan channel
+} OurLoRaTdmaNodeStats;
+
+/*
+ * TDMA gateway: sends beacons, hands out slots, receives the nodes
+ * 
+ * Keeps the radio in RX between beacons (interrupt mode, the beacon
+ * goes out with start_transmit()). Feed
+ * every received frame to handle_frame() and call poll() from loop().
+ * The superframe is periodMs long, or longer when the slots in use
+ * need more time.
+ * 
+ * Example (main tank, ID 1):
+ *   OurLoRaTdmaGateway<OurLoRaDefaultRadio> tdma(OurLoRa, 1);
+ *   
+ *   void loop() {
+ *     OurLoRaRxFrame f;
+ *     while (lora_rx_pop(&f)) {
+ *       uint8_t report[OURLORA_TDMA_MAX_PAYLOAD], from;
+ *       int n = tdma.handle_frame(f.data, f.length, report, &from);
+ *       if (n > 0) { ... }                   // Report from node `from`
+ *     }
+ *     tdma.poll();
+ *   }
+ */
+template <class Radio>
+class OurLoRaTdmaGateway {
+public:
+  OurLoRaTdmaGateway(Radio &radio, uint8_t gatewayId, uint32_t periodMs = OURLORA_TDMA_PERIOD_MS)
+    : _radio(radio), _gatewayId(gatewayId), _periodMs(periodMs) {
+    memset(_owner, 0, sizeof(_owner));
+    memset(_heardSeq, 0, sizeof(_heardSeq));
+    memset(_confirmed, 0, sizeof(_confirmed));
+    memset(_granted, 0, sizeof(_granted));
+    memset(_heard, 0, sizeof(_heard));
+    memset(&_stats, 0, sizeof(_stats));
+    _seq = 0;
+    _slots = 0;
+    _grantNext = 0;
+    _joinSlots = OURLORA_TDMA_JOIN_SLOTS;
+    _joinsHeard = 0;
+    _started = false;
+    _superframeUs = 0;
+    _nextBeaconUs = 0;
+    _slotsEndUs = 0;
+    _survey = NULL;
+    _surveyUs = 0;
+    _moving = false;
+    _moveAtSeq = 0;
+    _moveHz = 0;
+  }
+
+  /*
+   * Process a received frame if it is a TDMA frame
+   * 
+   * Returns:
+   *   > 0 - Report of this length from node `from`, copied to payload
+   *   0   - TDMA frame consumed (join, keep-alive, not for us)
+   *   -1  - Not a TDMA frame, handle it yourself
+   * 
+   * Pass CRC errors (length -1) too: in the join slots they mean
+   * colliding join requests.
+   */
+  int handle_frame(const uint8_t *data, int length, uint8_t *payload, uint8_t *from) {
+    if (length < 0 && micros() - _superframeUs < _joinSlots * _join_ms() * 1000UL) {
+      if (_joinsHeard < 255) _joinsHeard++;
+      return -1;
+    }
+    if (length < OURLORA_TDMA_JOIN_LEN || data[0] != OURLORA_TDMA_MARKER) {
+      return -1;
+    }
+    uint8_t type = data[1], node = data[3];
+    if (data[2] != _gatewayId || node == 0 || node == OURLORA_TDMA_NO_SLOT) {
+      return 0;
+    }
+    
+    if (type == OURLORA_TDMA_JOIN) {
+      _stats.joinRequests++;
+      if (_joinsHeard < 255) _joinsHeard++;
+      uint8_t slot = _slot_of(node);
+      if (slot == OURLORA_TDMA_NO_SLOT) {
+        slot = _free_slot();
+        if (slot == OURLORA_TDMA_NO_SLOT) {
+          return 0;  // Full - the node keeps trying
+        }
+        _owner[slot] = node;
+        _set_bit(_granted, slot, false);
+      }
+      _set_bit(_confirmed, slot, false);  // (Re)send the grant
+      _heardSeq[slot] = _seq;
+      return 0;
+    }
+    
+    if (type != OURLORA_TDMA_DATA || length < OURLORA_TDMA_DATA_HDR) {
+      return 0;
+    }
+    uint8_t slot = data[4];
+    if (slot >= OURLORA_TDMA_MAX_SLOTS) {
+      return 0;
+    }
+    if (_owner[slot] != node) {
+      uint8_t own = _slot_of(node);
+      if (own != OURLORA_TDMA_NO_SLOT) {
+        _set_bit(_confirmed, own, false);  // Node is confused: grant again
+        return 0;
+      }
+      if (_owner[slot] != 0) {
+        return 0;  // Slot belongs to someone else
+      }
+      _owner[slot] = node;   // We restarted, the node kept its slot
+      _set_bit(_granted, slot, true);
+    }
+    _set_bit(_confirmed, slot, true);
+    _set_bit(_heard, slot, true);
+    _heardSeq[slot] = _seq;
+    _stats.frames++;
+    
+    int n = length - OURLORA_TDMA_DATA_HDR;
+    if (n > OURLORA_TDMA_MAX_PAYLOAD) {
+      n = OURLORA_TDMA_MAX_PAYLOAD;
+    }
+    if (n > 0) {
+      memcpy(payload, data + OURLORA_TDMA_DATA_HDR, n);
+      *from = node;
+    }
+    return n;  // 0 for a keep-alive
+  }
+
+  /*
+   * Run the scheduler - call from loop()
+   * Sends the beacon when the superframe is over, and measures a
+   * channel of the survey once the slots are over.
+   */
+  void poll() {
+    if (_started && (int32_t)(micros() - _nextBeaconUs) < 0) {
+      _survey_idle();
+      return;
+    }
+    _started = true;
+    _send_beacon();
+  }
+
+  /*
+   * Survey a channel plan in idle time and move to quieter channels
+   * One channel every OURLORA_TDMA_SURVEY_MS, between the last slot
+   * and the next beacon (needs a superframe longer than its slots,
+   * see OURLORA_TDMA_PERIOD_MS). NULL stops surveying.
+   * 
+   * Example:
+   *   static const uint32_t PLAN[] = { 433175000UL, 433375000UL, 433575000UL, 433775000UL };
+   *   OurLoRaChannelSurvey<OurLoRaDefaultRadio> survey(OurLoRa, PLAN, 4);
+   *   tdma.use_survey(&survey);
+   */
+  void use_survey(OurLoRaChannelSurvey<Radio> *survey) {
+    _survey = survey;
+  }
+
+  /*
+   * Move the network to another channel
+   * Announced in the next OURLORA_TDMA_MOVE_BEACONS beacons; the
+   * gateway retunes right before the beacon after them.
+   * 
+   * Returns:
+   *   false - Already on that channel, or a move is under way
+   */
+  bool move_to(uint32_t frequency_hz) {
+    if (_moving || frequency_hz == _radio.profile().frequencyHz) {
+      return false;
+    }
+    _moveHz = frequency_hz;
+    _moveAtSeq = _seq + 1 + OURLORA_TDMA_MOVE_BEACONS;
+    _moving = true;
+    return true;
+  }
+
+  /*
+   * Slot of a node, OURLORA_TDMA_NO_SLOT if it has none
+   */
+  uint8_t slot_of(uint8_t node) const {
+    return _slot_of(node);
+  }
+
+  OurLoRaTdmaGatewayStats stats() {
+    OurLoRaTdmaGatewayStats s = _stats;
+    s.nodes = 0;
+    for (uint8_t i = 0; i < OURLORA_TDMA_MAX_SLOTS; i++) {
+      if (_owner[i]) s.nodes++;
+    }
+    s.slots = _slots;
+    s.joinSlots = _joinSlots;
+    s.periodMs = _period_ms();
+    s.frequencyHz = _radio.profile().frequencyHz;
+    return s;
+  }
+
+private:
+  Radio &_radio;
+  uint8_t _gatewayId;
+  uint32_t _periodMs;
+  uint8_t _owner[OURLORA_TDMA_MAX_SLOTS];      // Node ID per slot, 0 = free
+  uint8_t _heardSeq[OURLORA_TDMA_MAX_SLOTS];   // Superframe the owner was last heard in
+  uint8_t _confirmed[(OURLORA_TDMA_MAX_SLOTS + 7) / 8];  // Owner used the slot since its grant
+  uint8_t _granted[(OURLORA_TDMA_MAX_SLOTS + 7) / 8];    // Grant was on air at least once
+  uint8_t _heard[(OURLORA_TDMA_MAX_SLOTS + 7) / 8];      // This superframe
+  uint8_t _seq;                   // Current superframe
+  uint8_t _slots;                 // Data slots in the current superframe
+  uint8_t _grantNext;             // Round robin over unconfirmed grants
+  uint8_t _joinSlots;             // Join slots in the current superframe
+  uint8_t _joinsHeard;            // Join requests (or collisions) this superframe
+  bool _started;
+  uint32_t _superframeUs;         // End of the last beacon
+  uint32_t _nextBeaconUs;
+  uint32_t _slotsEndUs;           // End of the last slot of this superframe
+  OurLoRaChannelSurvey<Radio> *_survey;
+  uint32_t _surveyUs;             // Next survey sweep due
+  bool _moving;                   // Move announced
+  uint8_t _moveAtSeq;             // First beacon on the new channel
+  uint32_t _moveHz;
+  OurLoRaTdmaGatewayStats _stats;
+
+  static bool _bit(const uint8_t *bits, uint8_t i) {
+    return bits[i >> 3] & (1 << (i & 7));
+  }
+
+  static void _set_bit(uint8_t *bits, uint8_t i, bool on) {
+    if (on) bits[i >> 3] |= 1 << (i & 7);
+    else    bits[i >> 3] &= ~(1 << (i & 7));
+  }
+
+  uint8_t _slot_of(uint8_t node) const {
+    for (uint8_t i = 0; i < OURLORA_TDMA_MAX_SLOTS; i++) {
+      if (_owner[i] == node) return i;
+    }
+    return OURLORA_TDMA_NO_SLOT;
+  }
+
+  uint8_t _free_slot() const {
+    for (uint8_t i = 0; i < OURLORA_TDMA_MAX_SLOTS; i++) {
+      if (_owner[i] == 0) return i;
+    }
+    return OURLORA_TDMA_NO_SLOT;
+  }
+
+  uint16_t _join_ms() {
+    return _radio.time_on_air_us(OURLORA_TDMA_JOIN_LEN) / 1000 + 1 + OURLORA_TDMA_GUARD_MS;
+  }
+
+  uint16_t _slot_ms() {
+    return _radio.time_on_air_us(OURLORA_TDMA_DATA_HDR + OURLORA_TDMA_MAX_PAYLOAD) / 1000 + 1 +
+           OURLORA_TDMA_GUARD_MS;
+  }
+
+  // Superframe length: from the end of one beacon to the start of the next
+  uint32_t _period_ms() {
+    uint32_t needed = (uint32_t)_joinSlots * _join_ms() +
+                      (uint32_t)_slots * _slot_ms() + OURLORA_TDMA_GUARD_MS;
+    return needed > _periodMs ? needed : _periodMs;
+  }
+
+  // Survey sweeps between the last slot and the next beacon
+  void _survey_idle() {
+    if (!_survey) {
+      return;
+    }
+    uint32_t now = micros();
+    if ((int32_t)(now - _slotsEndUs) < 0 || (int32_t)(now - _surveyUs) < 0 ||
+        (int32_t)(_nextBeaconUs - now) < (int32_t)(_survey->sweep_us() + OURLORA_TDMA_GUARD_MS * 1000UL)) {
+      return;
+    }
+    _surveyUs = now + OURLORA_TDMA_SURVEY_MS * 1000UL;
+    if (_survey->survey_next()) {
+      int8_t best = _survey->better_channel(_radio.profile().frequencyHz);
+      if (best >= 0) {
+        move_to(_survey->channel_hz(best));
+      }
+    }
+    _stats.surveys++;
+  }
+
+  void _send_beacon() {
+    uint8_t seq = _seq + 1;
+    
+    if (_moving && seq == _moveAtSeq) {
+      _moving = false;
+      if (_radio.set_frequency(_moveHz)) {
+        _stats.channelMoves++;
+      }
+    }
+    
+    // Free the slots of nodes that went quiet (they gave up a superframe
+    // earlier). For a new node the clock starts with its first grant.
+    _slots = 0;
+    for (uint8_t i = 0; i < OURLORA_TDMA_MAX_SLOTS; i++) {
+      if (_owner[i] && _bit(_granted, i) &&
+          (uint8_t)(seq - _heardSeq[i]) > OURLORA_TDMA_EVICT_FRAMES + 1) {
+        _owner[i] = 0;
+        _stats.evictions++;
+      }
+      if (_owner[i]) _slots = i + 1;
+    }
+    
+    // Busy join slots: more of them (collisions hide most requests),
+    // mostly idle ones: fewer
+    if (2 * _joinsHeard >= _joinSlots) {
+      uint16_t more = _joinSlots * (_joinsHeard >= _joinSlots ? 4 : 2);  // All busy: grow faster
+      _joinSlots = more > OURLORA_TDMA_MAX_JOIN_SLOTS ? OURLORA_TDMA_MAX_JOIN_SLOTS : more;
+    } else if (4 * _joinsHeard < _joinSlots && _joinSlots > OURLORA_TDMA_JOIN_SLOTS) {
+      _joinSlots = _joinSlots / 2 < OURLORA_TDMA_JOIN_SLOTS ? OURLORA_TDMA_JOIN_SLOTS : _joinSlots / 2;
+    }
+    _joinsHeard = 0;
+    
+    uint8_t frame[OURLORA_TDMA_BEACON_MAX];
+    uint16_t joinMs = _join_ms(), slotMs = _slot_ms();
+    uint32_t periodMs = _period_ms();
+    frame[0] = OURLORA_TDMA_MARKER;
+    frame[1] = OURLORA_TDMA_BEACON;
+    frame[2] = _gatewayId;
+    frame[3] = seq;
+    frame[4] = _joinSlots;
+    frame[5] = _slots;
+    frame[6] = joinMs;
+    frame[7] = joinMs >> 8;
+    frame[8] = slotMs;
+    frame[9] = slotMs >> 8;
+    frame[10] = periodMs;
+    frame[11] = periodMs >> 8;
+    frame[12] = periodMs >> 16;
+    frame[13] = periodMs >> 24;
+    
+    // Grants not confirmed yet, round robin if there are many
+    uint8_t grants = 0, pos = OURLORA_TDMA_BEACON_HDR, first = _grantNext;
+    for (uint8_t k = 0; k < _slots && grants < OURLORA_TDMA_BEACON_GRANTS; k++) {
+      uint8_t i = (first + k) % _slots;
+      if (_owner[i] == 0 || _bit(_confirmed, i)) continue;
+      frame[pos++] = _owner[i];
+      frame[pos++] = i;
+      if (!_bit(_granted, i)) {
+        _set_bit(_granted, i, true);
+        _heardSeq[i] = seq;
+      }
+      grants++;
+      _grantNext = i + 1;
+    }
+    frame[14] = grants;
+    _stats.grants += grants;
+    
+    uint8_t bitmapLen = (_slots + 7) / 8;
+    memcpy(frame + pos, _heard, bitmapLen);
+    pos += bitmapLen;
+    memset(_heard, 0, sizeof(_heard));
+    
+    if (_moving) {
+      frame[pos++] = _moveAtSeq - seq;  // Beacons left on this channel
+      frame[pos++] = _moveHz;
+      frame[pos++] = _moveHz >> 8;
+      frame[pos++] = _moveHz >> 16;
+      frame[pos++] = _moveHz >> 24;
+    }
+    
+    _seq = seq;
+    // Superframe starts when the beacon ends; the radio returns to RX then
+    if (_radio.start_transmit(frame, pos)) {
+      _stats.beacons++;
+    }
+    _superframeUs = micros() + _radio.time_on_air_us(pos);
+    _nextBeaconUs = _superframeUs + periodMs * 1000UL;
+    _slotsEndUs = _superframeUs + ((uint32_t)_joinSlots * joinMs + (uint32_t)_slots * slotMs +
+                                   OURLORA_TDMA_GUARD_MS) * 1000UL;
+  }
+
+  OurLoRaTdmaGateway(const OurLoRaTdmaGateway &);
+  OurLoRaTdmaGateway &operator=(const OurLoRaTdmaGateway &);
+};
+
+/*
+ * TDMA node: follows the gateway's beacons, sends in its own slot
+ * 
+ * The radio sleeps except while waiting for a beacon and while
+ * sending. Needs interrupt mode: sends do not block, and received
+ * frames carry their RxDone time. send() stores a report for the next slot; it is sent
+ * again every superframe until the beacon acknowledges it, or until
+ * a newer report replaces it.
+ * 
+ * Example (sub tank, ID 7, gateway ID 1):
+ *   OurLoRaTdmaNode<OurLoRaDefaultRadio> tdma(OurLoRa, 7, 1);
+ *   
+ *   void loop() {
+ *     OurLoRaRxFrame f;
+ *     while (lora_rx_pop(&f)) {
+ *       tdma.handle_frame(f.data, f.length, f.timestampUs);
+ *     }
+ *     if (newReading) tdma.send((uint8_t *)&txData, sizeof(txData));
+ *     tdma.poll();
+ *   }
+ */
+template <class Radio>
+class OurLoRaTdmaNode {
+public:
+  OurLoRaTdmaNode(Radio &radio, uint8_t nodeId, uint8_t gatewayId)
+    : _radio(radio), _nodeId(nodeId), _gatewayId(gatewayId) {
+    memset(&_stats, 0, sizeof(_stats));
+    _state = _SEARCH;
+    _slot = OURLORA_TDMA_NO_SLOT;
+    _lastAckSeq = 0;
+    _seq = 0;
+    _missed = 0;
+    _pendingLength = 0;
+    _hasPending = false;
+    _awaitingAck = false;
+    _joinPending = false;
+    _confirmDue = false;
+    _joinWindow = 1;
+    _joinWait = 0;
+    _lastJoinSlots = 0;
+    _beaconAirUs = 0;
+    _listening = false;
+    _periodMs = OURLORA_TDMA_PERIOD_MS;
+    _channels = NULL;
+    _planCount = 0;
+    _planIndex = 0;
+    _searchUs = 0;
+    _movePending = false;
+    _moveAtSeq = 0;
+    _moveHz = 0;
+  }
+
+  /*
+   * Channels the gateway may move to (OurLoRaTdmaGateway::use_survey())
+   * Lets a node that lost the network search for it there. The array
+   * must stay valid.
+   */
+  void set_channel_plan(const uint32_t *channels, uint8_t count) {
+    _channels = channels;
+    _planCount = count;
+    _planIndex = 0;
+    for (uint8_t i = 0; i < count; i++) {
+      if (channels[i] == _radio.profile().frequencyHz) _planIndex = i;
+    }
+  }
+
+  /*
+   * Store a report for the next own slot (replaces an unsent one)
+   * 
+   * Returns:
+   *   false - Longer than OURLORA_TDMA_MAX_PAYLOAD
+   */
+  bool send(const uint8_t *data, uint8_t length) {
+    if (length > OURLORA_TDMA_MAX_PAYLOAD) {
+      return false;
+    }
+    memcpy(_pending, data, length);
+    _pendingLength = length;
+    _hasPending = true;
+    _awaitingAck = false;
+    return true;
+  }
+
+  /*
+   * Process a received frame if it is a TDMA frame
+   * 
+   * Parameters:
+   *   rxDoneUs - micros() at RxDone (OurLoRaRxFrame::timestampUs)
+   * 
+   * Returns:
+   *   true  - TDMA frame, consumed
+   *   false - Application frame, handle it yourself
+   */
+  bool handle_frame(const uint8_t *data, int length, uint32_t rxDoneUs) {
+    if (length < OURLORA_TDMA_JOIN_LEN || data[0] != OURLORA_TDMA_MARKER) {
+      return false;
+    }
+    if (data[1] != OURLORA_TDMA_BEACON || data[2] != _gatewayId ||
+        length < OURLORA_TDMA_BEACON_HDR) {
+      return true;  // Other nodes' traffic, other gateways
+    }
+    uint8_t grants = data[14], slots = data[5];
+    if (length < OURLORA_TDMA_BEACON_HDR + 2 * grants + (slots + 7) / 8) {
+      return true;
+    }
+    
+    _stats.beacons++;
+    _seq = data[3];
+    _joinSlots = data[4];
+    _slots = slots;
+    _joinMs = data[6] | (data[7] << 8);
+    _slotMs = data[8] | (data[9] << 8);
+    _periodMs = (uint32_t)data[10] | ((uint32_t)data[11] << 8) |
+                ((uint32_t)data[12] << 16) | ((uint32_t)data[13] << 24);
+    _t0 = rxDoneUs;
+    _beaconAirUs = _radio.time_on_air_us(length);
+    _missed = 0;
+    
+    // Channel move announced: retune before the beacon that is due then
+    int trailer = OURLORA_TDMA_BEACON_HDR + 2 * grants + (slots + 7) / 8;
+    if (length >= trailer + OURLORA_TDMA_MOVE_LEN && data[trailer] > 0) {
+      _movePending = true;
+      _moveAtSeq = _seq + data[trailer];
+      _moveHz = (uint32_t)data[trailer + 1] | ((uint32_t)data[trailer + 2] << 8) |
+                ((uint32_t)data[trailer + 3] << 16) | ((uint32_t)data[trailer + 4] << 24);
+    }
+    
+    // Was our last frame heard? (bitmap of the previous superframe)
+    const uint8_t *heard = data + OURLORA_TDMA_BEACON_HDR + 2 * grants;
+    if (_slot != OURLORA_TDMA_NO_SLOT && _slot < slots &&
+        (heard[_slot >> 3] & (1 << (_slot & 7)))) {
+      _lastAckSeq = _seq - 1;
+      if (_awaitingAck) {
+        _awaitingAck = false;
+        _hasPending = false;
+        _stats.framesAcked++;
+      }
+    }
+    
+    // The gateway frees the slot one superframe after we give up on it
+    if (_slot != OURLORA_TDMA_NO_SLOT &&
+        ((uint8_t)(_seq - 1 - _lastAckSeq) >= OURLORA_TDMA_EVICT_FRAMES || _slot >= slots)) {
+      _drop_slot();
+    }
+    
+    for (uint8_t i = 0; i < grants; i++) {
+      uint8_t node = data[OURLORA_TDMA_BEACON_HDR + 2 * i];
+      uint8_t slot = data[OURLORA_TDMA_BEACON_HDR + 2 * i + 1];
+      if (node == _nodeId) {
+        if (_slot != slot) {
+          _lastAckSeq = _seq - 1;  // Fresh grant: EVICT_FRAMES to use it
+        }
+        _confirmDue = true;        // Use it now, so the gateway stops granting
+        _slot = slot;
+        _joinPending = false;
+        _joinWindow = 1;
+      } else if (slot == _slot) {
+        _drop_slot();   // Given to someone else
+      }
+    }
+    
+    _plan();
+    return true;
+  }
+
+  /*
+   * Run the node - call from loop() (often: slot timing is in ms)
+   */
+  void poll() {
+    uint32_t now = micros();
+    switch (_state) {
+      case _SEARCH:
+        if (!_listening) {
+          _listen();
+          _searchUs = now;
+        } else if (_planCount > 1 &&
+                   now - _searchUs > OURLORA_TDMA_SEARCH_FRAMES * ((_periodMs + OURLORA_TDMA_GUARD_MS) * 1000UL +
+                                                                 _radio.time_on_air_us(OURLORA_TDMA_BEACON_MAX))) {
+          // No beacon here: the network may have moved while we were away
+          _planIndex = (_planIndex + 1) % _planCount;
+          _radio.set_frequency(_channels[_planIndex]);
+          _searchUs = now;
+          _stats.channelHops++;
+        }
+        break;
+      
+      case _WAIT_SLOT:
+        if ((int32_t)(now - _actionUs) >= 0) {
+          _act();
+          _state = _SENDING;
+        }
+        break;
+      
+      case _SENDING:
+        if (!_radio.is_transmitting()) {
+          _state = _SLEEP;
+          _sleep();
+        }
+        break;
+      
+      case _SLEEP:
+        if ((int32_t)(now - _wakeUs) >= 0) {
+          _follow_move();
+          _listen();
+          _state = _LISTEN;
+        }
+        break;
+      
+      case _LISTEN:
+        if ((int32_t)(now - _listenUntilUs) >= 0) {
+          // Beacon missed - keep the old timing for a while
+          _stats.missedBeacons++;
+          if (++_missed >= OURLORA_TDMA_MAX_MISSED) {
+            _stats.searches++;
+            _state = _SEARCH;
+            _searchUs = now;
+            if (_movePending) {
+              _moveAtSeq = _seq;  // Lost the network around its move: look there first
+              _follow_move();
+            }
+            break;
+          }
+          _t0 += _periodMs * 1000UL + _beaconAirUs;
+          _schedule_wake();
+          _state = _SLEEP;
+          _sleep();
+        }
+        break;
+    }
+  }
+
+  bool synced() const {
+    return _state != _SEARCH;
+  }
+
+  /*
+   * Own data slot, OURLORA_TDMA_NO_SLOT while joining
+   */
+  uint8_t slot() const {
+    return _slot;
+  }
+
+  OurLoRaTdmaNodeStats stats() const {
+    OurLoRaTdmaNodeStats s = _stats;
+    s.slot = _slot;
+    return s;
+  }
+
+private:
+  enum { _SEARCH, _WAIT_SLOT, _SENDING, _SLEEP, _LISTEN };
+  enum { _ACT_NONE, _ACT_DATA, _ACT_JOIN };
+
+  Radio &_radio;
+  uint8_t _nodeId;
+  uint8_t _gatewayId;
+  uint8_t _state;
+  uint8_t _slot;
+  uint8_t _seq;                   // Superframe of the last beacon
+  uint8_t _lastAckSeq;            // Last superframe the gateway heard us in
+  uint8_t _missed;
+  uint8_t _joinSlots, _slots;
+  uint16_t _joinMs, _slotMs;
+  uint32_t _periodMs;
+  uint32_t _t0;                   // End of the last beacon (micros)
+  uint32_t _beaconAirUs;
+  uint32_t _actionUs, _wakeUs, _listenUntilUs;
+  uint8_t _action;
+  bool _listening;
+  uint8_t _pending[OURLORA_TDMA_MAX_PAYLOAD];
+  uint8_t _pendingLength;
+  bool _hasPending;
+  bool _awaitingAck;              // Pending report sent, ACK due in the next beacon
+  bool _joinPending;              // Join sent, grant due
+  bool _confirmDue;               // Grant received, not used yet
+  uint8_t _joinWindow;            // Backoff window (superframes)
+  uint8_t _joinWait;
+  uint8_t _lastJoinSlots;         // Join slots of the previous superframe
+  const uint32_t *_channels;      // Plan to search, set_channel_plan()
+  uint8_t _planCount;
+  uint8_t _planIndex;
+  uint32_t _searchUs;             // Searching on this channel since
+  bool _movePending;              // Channel move announced
+  uint8_t _moveAtSeq;             // First beacon on the new channel
+  uint32_t _moveHz;
+  OurLoRaTdmaNodeStats _stats;
+
+  // Retune if the beacon we are about to listen for is on the new channel
+  void _follow_move() {
+    if (!_movePending || (int8_t)(uint8_t)(_seq + 1 + _missed - _moveAtSeq) < 0) {
+      return;
+    }
+    _movePending = false;
+    if (_radio.set_frequency(_moveHz)) {
+      _stats.channelMoves++;
+      for (uint8_t i = 0; i < _planCount; i++) {
+        if (_channels[i] == _moveHz) _planIndex = i;
+      }
+    }
+  }
+
+  void _drop_slot() {
+    _slot = OURLORA_TDMA_NO_SLOT;
+    _awaitingAck = false;
+    _stats.slotLost++;
+  }
+
+  // Decide what to send in this superframe, then sleep
+  void _plan() {
+    _action = _ACT_NONE;
+    if (_slot != OURLORA_TDMA_NO_SLOT) {
+      bool keepAlive = _confirmDue ||
+                       (uint8_t)(_seq - 1 - _lastAckSeq) >= OURLORA_TDMA_EVICT_FRAMES / 2;
+      if (_hasPending || keepAlive) {
+        _action = _ACT_DATA;
+        _actionUs = _t0 + ((uint32_t)_joinSlots * _joinMs + (uint32_t)_slot * _slotMs +
+                           OURLORA_TDMA_GUARD_MS / 2) * 1000UL;
+      }
+    } else {
+      if (_joinPending) {
+        // No grant: back off further, unless the gateway added join slots
+        _joinPending = false;
+        if (_joinSlots <= _lastJoinSlots && _joinWindow < OURLORA_TDMA_JOIN_BACKOFF) {
+          _joinWindow *= 2;
+        }
+        _joinWait = random(_joinWindow);
+      } else if (_joinSlots < _lastJoinSlots && _joinWindow > 1) {
+        // Join slots going idle: fewer nodes left, try more often
+        _joinWindow /= 2;
+        if (_joinWait >= _joinWindow) _joinWait = random(_joinWindow);
+      }
+      _lastJoinSlots = _joinSlots;
+      if (_joinWait > 0) {
+        _joinWait--;
+      } else {
+        _action = _ACT_JOIN;
+        _actionUs = _t0 + ((uint32_t)random(_joinSlots) * _joinMs +
+                           OURLORA_TDMA_GUARD_MS / 2) * 1000UL;
+      }
+    }
+    _schedule_wake();
+    _state = _action == _ACT_NONE ? _SLEEP : _WAIT_SLOT;
+    _sleep();
+  }
+
+  void _schedule_wake() {
+    _wakeUs = _t0 + (_periodMs - OURLORA_TDMA_GUARD_MS) * 1000UL;
+    uint32_t longest = _radio.time_on_air_us(OURLORA_TDMA_BEACON_MAX);
+    _listenUntilUs = _t0 + (_periodMs + OURLORA_TDMA_GUARD_MS) * 1000UL + longest;
+  }
+
+  void _act() {
+    uint8_t frame[OURLORA_TDMA_DATA_HDR + OURLORA_TDMA_MAX_PAYLOAD];
+    frame[0] = OURLORA_TDMA_MARKER;
+    frame[2] = _gatewayId;
+    frame[3] = _nodeId;
+    if (_action == _ACT_JOIN) {
+      frame[1] = OURLORA_TDMA_JOIN;
+      if (_radio.start_transmit(frame, OURLORA_TDMA_JOIN_LEN)) {
+        _joinPending = true;
+        _stats.joinRequests++;
+      }
+      return;
+    }
+    frame[1] = OURLORA_TDMA_DATA;
+    frame[4] = _slot;
+    _confirmDue = false;
+    uint8_t length = 0;
+    if (_hasPending) {
+      memcpy(frame + OURLORA_TDMA_DATA_HDR, _pending, _pendingLength);
+      length = _pendingLength;
+    }
+    if (_radio.start_transmit(frame, OURLORA_TDMA_DATA_HDR + length)) {
+      _awaitingAck = _hasPending;
+      _stats.framesSent++;
+    }
+  }
+
+  void _listen() {
+    _radio.start_listening();
+    _listening = true;
+  }
+
+  void _sleep() {
+    _radio.go_to_sleep();
+    _listening = false;
+  }
+
+  OurLoRaTdmaNode(const OurLoRaTdmaNode &);
+  OurLoRaTdmaNode &operator=(const OurLoRaTdmaNode &);
+};
+
+#endif // OURLORA_TDMA_H